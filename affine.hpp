@@ -0,0 +1,140 @@
+#ifndef AFFINE_HPP_INCLUDED
+#define AFFINE_HPP_INCLUDED
+
+#include <cmath>
+#include <algorithm>
+
+//Axis aligned box
+struct Box {
+	double minX;
+	double minY;
+	double maxX;
+	double maxY;
+
+	bool contains(double x, double y) const
+	{
+		return x >= minX && x <= maxX && y >= minY && y <= maxY;
+	}
+	bool intersects(const Box &other) const
+	{
+		return minX <= other.maxX && other.minX <= maxX && minY <= other.maxY && other.minY <= maxY;
+	}
+	void expand(const Box &other)
+	{
+		minX = std::min(minX, other.minX);
+		minY = std::min(minY, other.minY);
+		maxX = std::max(maxX, other.maxX);
+		maxY = std::max(maxY, other.maxY);
+	}
+	//Squared distance from a point to the box, 0 inside
+	double distance2(double x, double y) const
+	{
+		double dx = x < minX ? minX - x : (x > maxX ? x - maxX : 0);
+		double dy = y < minY ? minY - y : (y > maxY ? y - maxY : 0);
+		return dx * dx + dy * dy;
+	}
+};
+
+// 2x3 matrix in postscript order [a b c d tx ty]:
+//   x' = a*x + c*y + tx
+//   y' = b*x + d*y + ty
+// translated/rotated/scaled work like the postscript operators, they
+// change the space the following drawing happens in.
+struct Affine {
+	double a = 1;
+	double b = 0;
+	double c = 0;
+	double d = 1;
+	double tx = 0;
+	double ty = 0;
+
+	//this applied after other, like other followed by concat of this in postscript
+	Affine operator*(const Affine &other) const
+	{
+		Affine m;
+		m.a = other.a * a + other.b * c;
+		m.b = other.a * b + other.b * d;
+		m.c = other.c * a + other.d * c;
+		m.d = other.c * b + other.d * d;
+		m.tx = other.tx * a + other.ty * c + tx;
+		m.ty = other.tx * b + other.ty * d + ty;
+		return m;
+	}
+
+	Affine translated(double x, double y) const
+	{
+		Affine m = *this;
+		m.tx += a * x + c * y;
+		m.ty += b * x + d * y;
+		return m;
+	}
+
+	Affine rotated(double degrees) const
+	{
+		const double pi = 3.141592653589793238;
+		double r = degrees * pi / 180;
+		Affine rotation;
+		rotation.a = cos(r);
+		rotation.b = sin(r);
+		rotation.c = -rotation.b;
+		rotation.d = rotation.a;
+		return *this * rotation;
+	}
+
+	Affine scaled(double fx, double fy) const
+	{
+		Affine m = *this;
+		m.a *= fx;
+		m.b *= fx;
+		m.c *= fy;
+		m.d *= fy;
+		return m;
+	}
+
+	Affine inverse() const
+	{
+		double det = a * d - b * c;
+		Affine m;
+		m.a = d / det;
+		m.b = -b / det;
+		m.c = -c / det;
+		m.d = a / det;
+		m.tx = -(m.a * tx + m.c * ty);
+		m.ty = -(m.b * tx + m.d * ty);
+		return m;
+	}
+
+	//True if the matrix only translates, allowing for rounding
+	bool isTranslation(double epsilon = 1e-9) const
+	{
+		return std::fabs(a - 1) < epsilon && std::fabs(b) < epsilon &&
+			std::fabs(c) < epsilon && std::fabs(d - 1) < epsilon;
+	}
+
+	void apply(double x, double y, double &outX, double &outY) const
+	{
+		outX = a * x + c * y + tx;
+		outY = b * x + d * y + ty;
+	}
+
+	//Bounds of a box after transforming its corners
+	Box apply(const Box &box) const
+	{
+		Box result;
+		apply(box.minX, box.minY, result.minX, result.minY);
+		result.maxX = result.minX;
+		result.maxY = result.minY;
+		const double xs[3] = { box.maxX, box.minX, box.maxX };
+		const double ys[3] = { box.minY, box.maxY, box.maxY };
+		for (int i = 0; i < 3; ++i)
+		{
+			double x;
+			double y;
+			apply(xs[i], ys[i], x, y);
+			result.expand(Box{ x, y, x, y });
+		}
+		return result;
+	}
+};
+
+#endif // AFFINE_HPP_INCLUDED
@@ -0,0 +1,68 @@
+#ifndef ATOMIC_FILE_HPP_INCLUDED
+#define ATOMIC_FILE_HPP_INCLUDED
+
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <filesystem>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#define ATOMIC_FILE_FSYNC 1
+#endif
+
+// Outputs are written to a temporary file next to them and renamed into
+// place, so readers never see half a file. The temporary names are unique
+// per write, so two writers of one output do not write into each other's
+// file. Where there is fsync the data is on disk before the rename and the
+// rename once the directory is synced, so a crash does not leave an empty
+// or partly written file under the output's name.
+
+// Name for a temporary file next to path that no other write of this
+// process uses, and with the process id none of another process either
+inline std::string temporaryPath(const std::string &path)
+{
+	static std::atomic<unsigned long> counter(0);
+#ifdef ATOMIC_FILE_FSYNC
+	unsigned long process = (unsigned long)::getpid();
+#else
+	unsigned long process = (unsigned long)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	return path + ".tmp." + std::to_string(process) + "." + std::to_string(counter++);
+}
+
+#ifdef ATOMIC_FILE_FSYNC
+// Creates a new temporary file for path and sets temporary to its name.
+// Returns the fd open for writing, or -1. O_EXCL so a file left by a
+// crashed run with the same process id is not shared.
+inline int createTemporary(const std::string &path, std::string &temporary)
+{
+	int fd = -1;
+	for (int attempt = 0; fd < 0 && attempt < 16; ++attempt)
+	{
+		temporary = temporaryPath(path);
+		fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+		if (fd < 0 && errno != EEXIST)
+		{
+			break;
+		}
+	}
+	return fd;
+}
+
+//Puts a rename into the directory of path on disk
+inline void syncDirectory(const std::string &path)
+{
+	std::filesystem::path directory = std::filesystem::path(path).parent_path();
+	int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+	if (fd >= 0)
+	{
+		::fsync(fd);
+		::close(fd);
+	}
+}
+#endif
+
+#endif // ATOMIC_FILE_HPP_INCLUDED
@@ -0,0 +1,212 @@
+#ifndef BATCH_RENDER_HPP_INCLUDED
+#define BATCH_RENDER_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <set>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include <cstdio>
+#include "shape_value.hpp"
+#include "scene_parser.hpp"
+#include "work_stealing.hpp"
+#include "atomic_file.hpp"
+
+// Rendering of many scene files at once, see render_batch.cpp.
+// Files are rendered largest first on a work stealing pool so a big file
+// is not left running alone at the end, and every output is written to a
+// temporary file and renamed into place, see atomic_file.hpp.
+
+//One scene file to render and, once rendered, how it went
+struct BatchJob {
+	std::string input;
+	std::string output;
+	std::uintmax_t inputSize = 0;
+	std::size_t outputSize = 0;
+	double milliseconds = 0;
+	bool ok = false;
+	std::string error;
+};
+
+const char *const sceneExtension = ".scene";
+
+// Makes a job for every input. Directories contribute the ".scene" files
+// directly in them. Outputs go next to the inputs with a ".ps" extension,
+// or into outputDir if it is not empty. Returns false and sets error if
+// an input is missing, two inputs would write the same output or an
+// output would be written over an input, e.g. for an input ending in ".ps".
+inline bool collectJobs(const std::vector<std::string> &inputs, const std::string &outputDir,
+	std::vector<BatchJob> &jobs, std::string &error)
+{
+	namespace fs = std::filesystem;
+	std::vector<fs::path> files;
+	for (const std::string &input : inputs)
+	{
+		std::error_code ec;
+		if (fs::is_directory(input, ec))
+		{
+			std::vector<fs::path> found;
+			for (const fs::directory_entry &entry : fs::directory_iterator(input, ec))
+			{
+				if (entry.is_regular_file(ec) && entry.path().extension() == sceneExtension)
+				{
+					found.push_back(entry.path());
+				}
+			}
+			std::sort(found.begin(), found.end());
+			files.insert(files.end(), found.begin(), found.end());
+		}
+		else if (fs::is_regular_file(input, ec))
+		{
+			files.push_back(input);
+		}
+		else
+		{
+			error = "can not find " + input;
+			return false;
+		}
+	}
+
+	// Compared as absolute paths without "." and "..", so different
+	// spellings of the same file are caught
+	auto sameFileName = [](const fs::path &path) {
+		std::error_code ec;
+		fs::path normal = fs::weakly_canonical(path, ec);
+		return ec ? fs::absolute(path, ec).lexically_normal().string() : normal.string();
+	};
+	std::set<std::string> inputNames;
+	for (const fs::path &file : files)
+	{
+		inputNames.insert(sameFileName(file));
+	}
+
+	std::set<std::string> outputs;
+	for (const fs::path &file : files)
+	{
+		BatchJob job;
+		job.input = file.string();
+		fs::path output = file;
+		output.replace_extension(".ps");
+		if (!outputDir.empty())
+		{
+			output = fs::path(outputDir) / output.filename();
+		}
+		job.output = output.string();
+		std::string outputName = sameFileName(output);
+		if (inputNames.count(outputName) != 0)
+		{
+			error = "the output of " + job.input + " would be written over the input " + job.output;
+			return false;
+		}
+		if (!outputs.insert(outputName).second)
+		{
+			error = "more than one input would be written to " + job.output;
+			return false;
+		}
+		std::error_code ec;
+		job.inputSize = fs::file_size(file, ec);
+		jobs.push_back(std::move(job));
+	}
+
+	// Largest first, ties in name order so runs are repeatable
+	std::stable_sort(jobs.begin(), jobs.end(), [](const BatchJob &l, const BatchJob &r) {
+		return l.inputSize > r.inputSize;
+	});
+	return true;
+}
+
+// Writes data to path through a temporary file in the same directory, so
+// path either keeps its old contents or has all of the new ones.
+inline bool writeFileAtomically(const std::string &path, const std::string &data, std::string &error)
+{
+	std::string temporary;
+#ifdef ATOMIC_FILE_FSYNC
+	int fd = createTemporary(path, temporary);
+	if (fd < 0)
+	{
+		error = "can not create " + temporary;
+		return false;
+	}
+	bool written = true;
+	for (std::size_t done = 0; written && done < data.size();)
+	{
+		ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		written = n > 0;
+		done += written ? n : 0;
+	}
+	written = written && ::fsync(fd) == 0;
+	written = ::close(fd) == 0 && written;
+	if (!written)
+	{
+		std::remove(temporary.c_str());
+		error = "can not write " + temporary;
+		return false;
+	}
+#else
+	temporary = temporaryPath(path);
+	{
+		std::ofstream ofs(temporary, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+		if (!ofs)
+		{
+			error = "can not create " + temporary;
+			return false;
+		}
+		ofs.write(data.data(), data.size());
+		ofs.close();
+		if (!ofs)
+		{
+			std::remove(temporary.c_str());
+			error = "can not write " + temporary;
+			return false;
+		}
+	}
+#endif
+	std::error_code ec;
+	std::filesystem::rename(temporary, path, ec);
+	if (ec)
+	{
+		std::remove(temporary.c_str());
+		error = "can not rename " + temporary + " to " + path + ": " + ec.message();
+		return false;
+	}
+#ifdef ATOMIC_FILE_FSYNC
+	syncDirectory(path);
+#endif
+	return true;
+}
+
+inline void renderJob(BatchJob &job)
+{
+	auto start = std::chrono::steady_clock::now();
+	SceneParser parser;
+	job.ok = parser.parseFile(job.input);
+	if (job.ok)
+	{
+		std::string out;
+		parser.getScene().appendPostScript(out);
+		job.outputSize = out.size();
+		job.ok = writeFileAtomically(job.output, out, job.error);
+	}
+	else
+	{
+		job.error = parser.getError();
+	}
+	job.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//Renders every job, in the order given, on threads threads
+inline void renderBatch(std::vector<BatchJob> &jobs, unsigned int threads = std::thread::hardware_concurrency())
+{
+	parallelFor(jobs.size(), [&](std::size_t i) {
+		renderJob(jobs[i]);
+	}, threads);
+}
+
+#endif // BATCH_RENDER_HPP_INCLUDED
@@ -0,0 +1,1894 @@
+// bench.cpp : Benchmarks for building and rendering large shape trees.
+// Build with optimizations, e.g. g++ -std=c++17 -O2 bench.cpp -o bench
+//
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdlib>
+#include <cstdio>
+#include "shape.hpp"
+#include "shape_value.hpp"
+#include "mutable_composite.hpp"
+#include "spatial_index.hpp"
+#include "viewport.hpp"
+#include "scene_file.hpp"
+#include "scene_parser.hpp"
+#include "render_daemon.hpp"
+#include "batch_render.hpp"
+#include "sharded_render.hpp"
+#include "render_cache.hpp"
+#include "rope.hpp"
+#include "compressed_output.hpp"
+#include "binary_postscript.hpp"
+#include "flatten.hpp"
+#include "lod.hpp"
+#include "stroke_batch.hpp"
+#include "raster.hpp"
+#include "shape_builder.hpp"
+#include "streaming_composite.hpp"
+#include "paginate.hpp"
+#include "pull_render.hpp"
+#include "persistent_shape.hpp"
+#include "render_control.hpp"
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <new>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <cstdint>
+#include <utility>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/perf_event.h>)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <cerrno>
+#define PERF_COUNTERS_AVAILABLE 1
+#ifdef PERF_FLAG_FD_CLOEXEC
+const unsigned long perfOpenFlags = PERF_FLAG_FD_CLOEXEC;
+#else
+const unsigned long perfOpenFlags = 0;
+#endif
+#endif
+#endif
+
+// Hardware and software event counts around each benchmark, from Linux
+// perf_event_open. Each event is opened on its own, for this process and
+// the threads it starts, user space only, so whatever the kernel or the
+// container allows is counted and the rest left out: in a VM without a
+// virtual PMU only the software events, e.g. page faults, open. Counts are
+// scaled up when the kernel had to multiplex the counters. Without perf,
+// page faults come from getrusage instead, which counts every thread.
+struct PerfCount {
+	const char *name;
+	double value;
+};
+
+class PerfCounters {
+public:
+	PerfCounters()
+	{
+#ifdef PERF_COUNTERS_AVAILABLE
+		const Event events[] = {
+			{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+			{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+			{ "L1d misses", PERF_TYPE_HW_CACHE,
+				PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+			{ "LLC misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+			{ "branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+			{ "page faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+		};
+		for (const Event &event : events) {
+			perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = event.type;
+			attr.config = event.config;
+			attr.disabled = 1;
+			attr.inherit = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			// Close on exec, so children forked to render shards do not keep them
+			long fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, perfOpenFlags);
+			if (fd >= 0) {
+				opened_.push_back(Opened{ event.name, (int)fd });
+			}
+			else if (firstError_.empty()) {
+				firstError_ = std::string(event.name) + ": " + std::strerror(errno);
+			}
+		}
+#endif
+	}
+	PerfCounters(const PerfCounters &) = delete;
+	PerfCounters &operator=(const PerfCounters &) = delete;
+	~PerfCounters()
+	{
+#ifdef PERF_COUNTERS_AVAILABLE
+		for (const Opened &counter : opened_) {
+			close(counter.fd);
+		}
+#endif
+	}
+
+	void start()
+	{
+#ifdef PERF_COUNTERS_AVAILABLE
+		for (const Opened &counter : opened_) {
+			ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+		faultsAtStart_ = rusageFaults();
+	}
+
+	//Counts since start()
+	std::vector<PerfCount> stop()
+	{
+		std::vector<PerfCount> counts;
+		bool pageFaults = false;
+#ifdef PERF_COUNTERS_AVAILABLE
+		for (const Opened &counter : opened_) {
+			ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+		}
+		for (const Opened &counter : opened_) {
+			std::uint64_t values[3];
+			if (read(counter.fd, values, sizeof(values)) != (ssize_t)sizeof(values) || values[2] == 0) {
+				continue;
+			}
+			double scale = values[2] < values[1] ? (double)values[1] / values[2] : 1;
+			counts.push_back(PerfCount{ counter.name, values[0] * scale });
+			pageFaults = pageFaults || std::strcmp(counter.name, "page faults") == 0;
+		}
+#endif
+		if (!pageFaults) {
+			counts.push_back(PerfCount{ "page faults", rusageFaults() - faultsAtStart_ });
+		}
+		return counts;
+	}
+
+	//Events that could be opened
+	std::size_t getOpenCount() const
+	{
+		return opened_.size();
+	}
+
+	//Why the first event that could not be opened was not, empty if all were
+	const std::string &getFirstError() const
+	{
+		return firstError_;
+	}
+
+private:
+	struct Event {
+		const char *name;
+		std::uint32_t type;
+		std::uint64_t config;
+	};
+	struct Opened {
+		const char *name;
+		int fd;
+	};
+
+	static double rusageFaults()
+	{
+#ifdef RUSAGE_SELF
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) == 0) {
+			return (double)usage.ru_minflt + usage.ru_majflt;
+		}
+#endif
+		return 0;
+	}
+
+	std::vector<Opened> opened_;
+	std::string firstError_;
+	double faultsAtStart_ = 0;
+};
+
+//Counters shared by every benchmark, opened on first use
+PerfCounters &benchCounters()
+{
+	static PerfCounters counters;
+	static bool reported = false;
+	if (!reported) {
+		reported = true;
+		if (!counters.getFirstError().empty()) {
+			std::cout << "Some perf counters are not available (" << counters.getFirstError() << "), "
+				<< counters.getOpenCount() << " opened\n";
+		}
+	}
+	return counters;
+}
+
+// Runs f once and prints the time it took, and on a second line the
+// counters per shape and per byte.
+// f returns the number of bytes it emitted (0 if it only builds shapes).
+template <class F>
+void runBenchmark(const std::string &name, std::size_t shapes, F &&f)
+{
+	PerfCounters &counters = benchCounters();
+	counters.start();
+	auto start = std::chrono::steady_clock::now();
+	std::size_t bytes = f();
+	auto end = std::chrono::steady_clock::now();
+	std::vector<PerfCount> counts = counters.stop();
+	double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+	std::cout << name << ": " << ms << " ms";
+	if (shapes > 0)
+	{
+		std::cout << ", " << (ms * 1e6 / shapes) << " ns/shape";
+	}
+	if (bytes > 0)
+	{
+		std::cout << ", " << bytes << " bytes";
+	}
+	std::cout << "\n";
+
+	double cycles = 0;
+	double instructions = 0;
+	for (const PerfCount &count : counts)
+	{
+		cycles = std::strcmp(count.name, "cycles") == 0 ? count.value : cycles;
+		instructions = std::strcmp(count.name, "instructions") == 0 ? count.value : instructions;
+	}
+	if (cycles > 0)
+	{
+		std::cout << "  " << instructions / cycles << " instructions/cycle\n";
+	}
+	const std::pair<const char*, std::size_t> divisors[] = { { "  per shape:", shapes }, { "  per byte:", bytes } };
+	for (const auto &divisor : divisors)
+	{
+		if (divisor.second == 0)
+		{
+			continue;
+		}
+		std::cout << divisor.first;
+		for (const PerfCount &count : counts)
+		{
+			std::cout << " " << count.name << " " << count.value / divisor.second << (&count == &counts.back() ? "" : ",");
+		}
+		std::cout << "\n";
+	}
+}
+
+////////////////////////////////SHAPEVALUE BENCHMARKS
+// 1M leaves in rows of 1000, mixing leaf types so the
+// virtual calls are not all to the same target.
+void benchShapeValue()
+{
+	const int rows = 1000;
+	const int perRow = 1000;
+	const std::size_t leaves = (std::size_t)rows * perRow;
+	std::cout << "\nShapeValue vs Shape, " << leaves << " leaves:\n";
+
+	unique_ptr<Shape> tree;
+	runBenchmark("Shape build", leaves, [&]() {
+		std::vector<unique_ptr<Shape>> rowList;
+		for (int r = 0; r < rows; ++r) {
+			std::vector<unique_ptr<Shape>> row;
+			for (int i = 0; i < perRow; ++i) {
+				switch (i % 3) {
+				case 0: row.push_back(make_unique<Circle>(1 + i % 7)); break;
+				case 1: row.push_back(make_unique<Rectangle>(2, 1 + i % 5)); break;
+				default: row.push_back(make_unique<Spacer>(1, 1)); break;
+				}
+			}
+			rowList.push_back(make_unique<MultiHorizontal>(std::move(row)));
+		}
+		tree = make_unique<MultiVertical>(std::move(rowList));
+		return (std::size_t)0;
+	});
+
+	ShapeValue value;
+	runBenchmark("ShapeValue build", leaves, [&]() {
+		std::vector<ShapeValue> rowList;
+		rowList.reserve(rows);
+		for (int r = 0; r < rows; ++r) {
+			std::vector<ShapeValue> row;
+			row.reserve(perRow);
+			for (int i = 0; i < perRow; ++i) {
+				switch (i % 3) {
+				case 0: row.push_back(ShapeValue::circle(1 + i % 7)); break;
+				case 1: row.push_back(ShapeValue::rectangle(2, 1 + i % 5)); break;
+				default: row.push_back(ShapeValue::spacer(1, 1)); break;
+				}
+			}
+			rowList.push_back(ShapeValue::horizontal(std::move(row)));
+		}
+		value = ShapeValue::vertical(std::move(rowList));
+		return (std::size_t)0;
+	});
+
+	std::string shapeOut;
+	runBenchmark("Shape render", leaves, [&]() {
+		shapeOut = tree->generatePostScript();
+		return shapeOut.size();
+	});
+
+	std::string valueOut;
+	runBenchmark("ShapeValue render", leaves, [&]() {
+		value.appendPostScript(valueOut);
+		return valueOut.size();
+	});
+
+	// Same again into a buffer that is already large enough, so page
+	// faults from growing the string are not counted
+	std::string reusedOut;
+	reusedOut.assign(valueOut.size(), ' ');
+	reusedOut.clear();
+	runBenchmark("ShapeValue render, reused buffer", leaves, [&]() {
+		value.appendPostScript(reusedOut);
+		return reusedOut.size();
+	});
+
+	runBenchmark("Shape to ShapeValue", leaves, [&]() {
+		ShapeValue converted = ShapeValue::fromShape(*tree);
+		return (std::size_t)0;
+	});
+
+	if (shapeOut != valueOut)
+	{
+		std::cout << "ShapeValue output differs from Shape output\n";
+	}
+}
+
+////////////////////////////////MUTABLE COMPOSITE BENCHMARKS
+// Random edits on a row of 100k children, against redoing the
+// extent loop of the MultiHorizontal ctor after every edit.
+void benchMutableComposite()
+{
+	const int children = 100000;
+	const int edits = 100000;
+	const int rebuilds = 100;
+	std::cout << "\nMutable composite, " << children << " children:\n";
+
+	MutableHorizontal row;
+	for (int i = 0; i < children; ++i) {
+		row.append(make_unique<Rectangle>(1 + i % 7, 1 + i % 5));
+	}
+
+	unsigned int seed = 12345;
+	auto next = [&]() {
+		seed = seed * 1664525u + 1013904223u;
+		return seed >> 8;
+	};
+
+	runBenchmark("MutableHorizontal edits", edits, [&]() {
+		for (int i = 0; i < edits; ++i) {
+			unsigned int pos = next() % row.getSize();
+			switch (i % 3) {
+			case 0: row.replace(pos, make_unique<Rectangle>(1 + next() % 9, 1 + next() % 9)); break;
+			case 1: row.insert(pos, make_unique<Circle>(1 + next() % 4)); break;
+			default: row.erase(pos); break;
+			}
+		}
+		return (std::size_t)0;
+	});
+
+	std::vector<unique_ptr<Shape>> rowList;
+	for (int i = 0; i < children; ++i) {
+		rowList.push_back(make_unique<Rectangle>(1 + i % 7, 1 + i % 5));
+	}
+	double total = 0;
+	runBenchmark("Vector edits with extent rebuild", rebuilds, [&]() {
+		for (int i = 0; i < rebuilds; ++i) {
+			unsigned int pos = next() % rowList.size();
+			rowList[pos] = make_unique<Rectangle>(1 + next() % 9, 1 + next() % 9);
+			double width = 0;
+			double height = 0;
+			for (unsigned int j = 0; j < rowList.size(); ++j) {
+				width += rowList[j]->width + 1;
+				if (rowList[j]->height > height) {
+					height = rowList[j]->height;
+				}
+			}
+			total += width + height;
+		}
+		return (std::size_t)0;
+	});
+	if (total == 0)
+	{
+		std::cout << "Rebuild produced no extents\n";
+	}
+}
+
+//1000 rows of 1000 mixed leaves, used by several benchmarks
+unique_ptr<Shape> makeGrid(int rows, int perRow)
+{
+	std::vector<unique_ptr<Shape>> rowList;
+	for (int r = 0; r < rows; ++r) {
+		std::vector<unique_ptr<Shape>> row;
+		for (int i = 0; i < perRow; ++i) {
+			switch ((r + i) % 4) {
+			case 0: row.push_back(make_unique<Circle>(1 + i % 7)); break;
+			case 1: row.push_back(make_unique<Rectangle>(2 + r % 3, 1 + i % 5)); break;
+			case 2: row.push_back(make_unique<Polygon>(3 + i % 5, 2)); break;
+			default: row.push_back(make_unique<Custom>(4)); break;
+			}
+		}
+		rowList.push_back(make_unique<MultiHorizontal>(std::move(row)));
+	}
+	return make_unique<MultiVertical>(std::move(rowList));
+}
+
+////////////////////////////////SPATIAL INDEX BENCHMARKS
+void benchSpatialIndex()
+{
+	const int rows = 1000;
+	const int perRow = 1000;
+	const std::size_t leaves = (std::size_t)rows * perRow;
+	const int queries = 100000;
+	std::cout << "\nSpatial index, " << leaves << " leaves:\n";
+
+	unique_ptr<Shape> grid = makeGrid(rows, perRow);
+	unique_ptr<SpatialIndex> index;
+	runBenchmark("Layout and bulk load", leaves, [&]() {
+		index = make_unique<SpatialIndex>(*grid);
+		return (std::size_t)0;
+	});
+
+	unsigned int seed = 777;
+	auto next = [&]() {
+		seed = seed * 1664525u + 1013904223u;
+		return (seed >> 8) / double(1 << 24);
+	};
+	std::size_t found = 0;
+	runBenchmark("Point queries", queries, [&]() {
+		for (int i = 0; i < queries; ++i) {
+			found += index->at(next() * grid->width, next() * grid->height).size();
+		}
+		return (std::size_t)0;
+	});
+	runBenchmark("100 x 100 rectangle queries", queries, [&]() {
+		for (int i = 0; i < queries; ++i) {
+			double x = next() * grid->width;
+			double y = next() * grid->height;
+			found += index->intersecting(Box{ x, y, x + 100, y + 100 }).size();
+		}
+		return (std::size_t)0;
+	});
+	runBenchmark("10 nearest queries", queries, [&]() {
+		for (int i = 0; i < queries; ++i) {
+			found += index->nearest(next() * grid->width, next() * grid->height, 10).size();
+		}
+		return (std::size_t)0;
+	});
+	std::cout << found << " shapes found\n";
+}
+
+////////////////////////////////VIEWPORT BENCHMARKS
+void benchViewport()
+{
+	const int rows = 500;
+	const int perRow = 500;
+	const std::size_t leaves = (std::size_t)rows * perRow;
+	std::cout << "\nViewport, " << leaves << " leaves:\n";
+
+	unique_ptr<Shape> grid = makeGrid(rows, perRow);
+	runBenchmark("Full render", leaves, [&]() {
+		return grid->generatePostScript().size();
+	});
+
+	// Rows do not return to their start, so the grid is drawn as a
+	// diagonal band. Center the clips on a shape in the middle of it.
+	SpatialIndex index(*grid);
+	const Box &middle = index.getLeaves()[leaves / 2].box;
+	double cx = (middle.minX + middle.maxX) / 2;
+	double cy = (middle.minY + middle.maxY) / 2;
+	for (double size : { 100.0, 1000.0, 10000.0 }) {
+		runBenchmark("Clipped render " + std::to_string((int)size) + " wide", 0, [&]() {
+			return renderClipped(index, Box{ cx - size / 2, cy - size / 2, cx + size / 2, cy + size / 2 }).size();
+		});
+	}
+
+	std::size_t tiles = 0;
+	runBenchmark("Letter size tiles", 0, [&]() {
+		std::vector<std::string> pages = renderTiles(index, 612, 792);
+		tiles = pages.size();
+		std::size_t bytes = 0;
+		for (const std::string &page : pages) {
+			bytes += page.size();
+		}
+		return bytes;
+	});
+	std::cout << tiles << " tiles\n";
+}
+
+////////////////////////////////SCENE FILE BENCHMARKS
+//Resident set size in MB, or -1 where /proc is not available
+double residentMB()
+{
+	std::ifstream statm("/proc/self/statm");
+	double pages = 0;
+	double resident = 0;
+	if (!(statm >> pages >> resident))
+	{
+		return -1;
+	}
+	return resident * 4096 / (1024 * 1024);
+}
+
+// Writes a scene of about SCENE_MB megabytes (default 64) and compares
+// opening it in place with loading it into a ShapeValue tree.
+// Run with SCENE_MB=1024 for a gigabyte sized scene.
+void benchSceneFile()
+{
+	const char *sizeSetting = std::getenv("SCENE_MB");
+	double megabytes = sizeSetting ? std::atof(sizeSetting) : 64;
+	// A leaf takes a 24 byte node and two or four params, about 44 bytes on average
+	const int perRow = 1000;
+	const int rows = std::max(1, (int)(megabytes * 1024 * 1024 / 44 / perRow));
+	const std::size_t leaves = (std::size_t)rows * perRow;
+	const std::string path = "bench_scene.bin";
+	std::cout << "\nScene file, " << leaves << " leaves:\n";
+
+	runBenchmark("Write scene", leaves, [&]() {
+		std::vector<ShapeValue> rowList;
+		for (int r = 0; r < rows; ++r) {
+			std::vector<ShapeValue> row;
+			for (int i = 0; i < perRow; ++i) {
+				switch (i % 3) {
+				case 0: row.push_back(ShapeValue::circle(1 + i % 7)); break;
+				case 1: row.push_back(ShapeValue::rectangle(2, 1 + i % 5)); break;
+				default: row.push_back(ShapeValue::spacer(1, 1)); break;
+				}
+			}
+			rowList.push_back(ShapeValue::horizontal(std::move(row)));
+		}
+		ShapeValue scene = ShapeValue::vertical(std::move(rowList));
+		writeScene(scene, path);
+		return 0;
+	});
+	std::ifstream written(path, std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
+	std::cout << "File size: " << (double)written.tellg() / (1024 * 1024) << " MB\n";
+	written.close();
+
+	double before = residentMB();
+	SceneFile scene;
+	runBenchmark("Open scene", 0, [&]() {
+		if (!scene.open(path)) {
+			std::cout << scene.getError() << "\n";
+		}
+		return 0;
+	});
+	std::cout << "Resident after open: " << residentMB() - before << " MB\n";
+
+	// Render row by row into one buffer, as a writer streaming to a file would
+	std::string buffer;
+	runBenchmark("Render from file", leaves, [&]() {
+		std::size_t bytes = 0;
+		const SceneNode &root = scene.getNode(0);
+		for (std::uint64_t c = root.first; c < root.first + root.count; ++c) {
+			buffer.clear();
+			PostScriptWriter writer(buffer);
+			scene.render(c, writer);
+			bytes += buffer.size();
+		}
+		return bytes;
+	});
+	std::cout << "Resident after render: " << residentMB() - before << " MB\n";
+
+	// The tree freed after writing is still in the heap, so this
+	// mostly shows up as time rather than resident memory
+	before = residentMB();
+	ShapeValue loaded;
+	runBenchmark("Load into ShapeValue", leaves, [&]() {
+		loaded = scene.toShapeValue(0);
+		return 0;
+	});
+	std::cout << "Resident after load: " << residentMB() - before << " MB\n";
+
+	scene.close();
+	std::remove(path.c_str());
+}
+
+////////////////////////////////SCENE PARSER BENCHMARKS
+// Parses about SCENE_TEXT_MB megabytes (default 64) of scene text,
+// from a file and from memory, and prints the throughput.
+void benchSceneParser()
+{
+	const char *sizeSetting = std::getenv("SCENE_TEXT_MB");
+	double megabytes = sizeSetting ? std::atof(sizeSetting) : 64;
+	const std::string path = "bench_scene.txt";
+
+	std::string text;
+	std::size_t leaves = 0;
+	while (text.size() < megabytes * 1024 * 1024) {
+		text += "horizontal\n";
+		for (int i = 0; i < 1000; ++i) {
+			switch (i % 4) {
+			case 0: text += "  circle " + std::to_string(1 + i % 7) + "\n"; break;
+			case 1: text += "  rectangle 2.5 " + std::to_string(1 + i % 5) + "\n"; break;
+			case 2: text += "  scaled 1.5 0.75\n    square 3\n"; break;
+			default: text += "  spacer 1 1\n"; break;
+			}
+		}
+		text += "end\n";
+		leaves += 1000;
+	}
+	std::ofstream ofs(path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+	ofs << text;
+	ofs.close();
+	double textMB = (double)text.size() / (1024 * 1024);
+	std::cout << "\nScene parser, " << textMB << " MB, " << leaves << " leaves:\n";
+
+	SceneParser parser;
+	auto report = [&](const std::string &name, auto &&parse) {
+		parser.reset(); // don't time freeing the last scene
+		auto start = std::chrono::steady_clock::now();
+		bool parsed = parse();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << name << ": " << seconds * 1000 << " ms, " << textMB / seconds << " MB/s";
+		if (!parsed) {
+			std::cout << " (" << parser.getError() << ")";
+		}
+		std::cout << "\n";
+	};
+	report("Parse file", [&]() { return parser.parseFile(path); });
+	report("Parse string", [&]() { return parser.parseString(text); });
+	report("Parse stream", [&]() {
+		std::ifstream ifs(path, std::ifstream::in | std::ifstream::binary);
+		return parser.parseStream(ifs);
+	});
+	std::remove(path.c_str());
+}
+
+////////////////////////////////RENDER DAEMON BENCHMARKS
+#ifdef RENDER_DAEMON_AVAILABLE
+// Latency of single requests and throughput of pipelined batches against
+// a server running in this process on a Unix socket.
+void benchRenderDaemon()
+{
+	const std::string path = "bench_render.sock";
+	RenderServer server;
+	if (!server.listen(path)) {
+		std::cout << server.getError() << "\n";
+		return;
+	}
+	std::thread serverThread([&]() { server.serve(); });
+	std::cout << "\nRender daemon:\n";
+
+	const std::string small = "horizontal\n  circle 3\n  rectangle 2 4\n  square 5\nend\n";
+	RenderClient client;
+	client.connect(path);
+	std::string rendered;
+	std::vector<double> latencies;
+	for (int i = 0; i < 5000; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		client.render(small, rendered);
+		latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+	}
+	std::sort(latencies.begin(), latencies.end());
+	std::cout << "Single request latency: p50 " << latencies[latencies.size() / 2] << " us, p99 "
+		<< latencies[latencies.size() * 99 / 100] << " us\n";
+
+	const int clients = 4;
+	const int batches = 200;
+	const int batchSize = 100;
+	std::uint64_t batchesBefore = server.getBatchCount();
+	// Three shapes per request
+	runBenchmark("Pipelined, " + std::to_string(clients) + " clients", (std::size_t)clients * batches * batchSize * 3, [&]() {
+		std::vector<std::thread> threads;
+		std::vector<std::size_t> bytes(clients);
+		for (int c = 0; c < clients; ++c) {
+			threads.emplace_back([&, c]() {
+				RenderClient batchClient;
+				batchClient.connect(path);
+				std::vector<std::string> batch(batchSize, small);
+				std::string reply;
+				for (int b = 0; b < batches; ++b) {
+					batchClient.send(batch);
+					for (int i = 0; i < batchSize; ++i) {
+						batchClient.receive(reply);
+						bytes[c] += reply.size();
+					}
+				}
+			});
+		}
+		std::size_t total = 0;
+		for (int c = 0; c < clients; ++c) {
+			threads[c].join();
+			total += bytes[c];
+		}
+		return total;
+	});
+	std::cout << (std::size_t)clients * batches * batchSize << " requests in "
+		<< server.getBatchCount() - batchesBefore << " writes\n";
+
+	std::string big = "vertical\n";
+	for (int r = 0; r < 200; ++r) {
+		big += "horizontal\n";
+		for (int i = 0; i < 1000; ++i) {
+			big += i % 2 ? "  circle 2\n" : "  rectangle 3 1\n";
+		}
+		big += "end\n";
+	}
+	big += "end\n";
+	runBenchmark("Large scene streamed", 200000, [&]() {
+		client.render(big, rendered);
+		return rendered.size();
+	});
+
+	client.close();
+	server.stop();
+	serverThread.join();
+}
+#endif
+
+////////////////////////////////BATCH RENDER BENCHMARKS
+// Renders a directory of mostly small scenes plus a few large ones with
+// one thread and with every core.
+void benchBatchRender()
+{
+	const std::string dir = "bench_batch";
+	std::filesystem::create_directories(dir + "/out");
+	const int files = 2000;
+	for (int f = 0; f < files; ++f) {
+		// Every 200th file is 100 times bigger than the rest
+		int rows = f % 200 == 0 ? 200 : 2;
+		std::string text = "vertical\n";
+		for (int r = 0; r < rows; ++r) {
+			text += "horizontal\n";
+			for (int i = 0; i < 50; ++i) {
+				text += i % 2 ? "  circle 2\n" : "  rectangle 3 1\n";
+			}
+			text += "end\n";
+		}
+		text += "end\n";
+		std::ofstream(dir + "/scene" + std::to_string(f) + ".scene", std::ofstream::out | std::ofstream::binary) << text;
+	}
+	std::cout << "\nBatch render, " << files << " files:\n";
+
+	unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned int> threadCounts = { 1 };
+	if (cores > 1) {
+		threadCounts.push_back(cores);
+	}
+	for (unsigned int threads : threadCounts) {
+		std::vector<BatchJob> jobs;
+		std::string error;
+		collectJobs({ dir }, dir + "/out", jobs, error);
+		runBenchmark(std::to_string(threads) + " threads", 0, [&]() {
+			renderBatch(jobs, threads);
+			std::size_t bytes = 0;
+			for (const BatchJob &job : jobs) {
+				bytes += job.outputSize;
+			}
+			return bytes;
+		});
+	}
+	std::filesystem::remove_all(dir);
+}
+
+////////////////////////////////SHARDED RENDER BENCHMARKS
+#ifdef SHARDED_RENDER_AVAILABLE
+// Writes one large document from a single process and sharded across
+// worker processes.
+void benchShardedRender()
+{
+	const int rows = 300;
+	const int perRow = 300;
+	const std::size_t leaves = (std::size_t)rows * perRow;
+	const std::string path = "bench_sharded.ps";
+	std::cout << "\nSharded render, " << leaves << " leaves:\n";
+
+	unique_ptr<Shape> grid = makeGrid(rows, perRow);
+	runBenchmark("Single process", leaves, [&]() {
+		std::string out = grid->generatePostScript();
+		std::string error;
+		writeFileAtomically(path, out, error);
+		return out.size();
+	});
+	unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned int> processCounts = { cores };
+	if (cores != 4) {
+		processCounts.push_back(4);
+	}
+	for (unsigned int processes : processCounts) {
+		runBenchmark(std::to_string(processes) + " processes", leaves, [&]() {
+			std::string error;
+			renderShardedToFile(*grid, path, processes, error);
+			std::ifstream written(path, std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
+			return (std::size_t)written.tellg();
+		});
+	}
+	std::remove(path.c_str());
+}
+#endif
+
+////////////////////////////////RENDER CACHE BENCHMARKS
+// Renders a document without the cache, with an empty cache directory
+// and again, as the next run would, with the directory filled.
+void benchRenderCache()
+{
+	const int rows = 300;
+	const int perRow = 300;
+	const std::size_t leaves = (std::size_t)rows * perRow;
+	const std::string dir = "bench_cache";
+	std::cout << "\nRender cache, " << leaves << " leaves:\n";
+
+	unique_ptr<Shape> grid = makeGrid(rows, perRow);
+	runBenchmark("Uncached", leaves, [&]() {
+		return grid->generatePostScript().size();
+	});
+	runBenchmark("Hashing", leaves, [&]() {
+		volatile std::uint64_t h = contentHash(*grid);
+		(void)h;
+		return 0;
+	});
+
+	std::filesystem::remove_all(dir);
+	for (const char *name : { "Cold cache", "Warm cache" }) {
+		RenderCache cache;
+		cache.open(dir);
+		runBenchmark(name, leaves, [&]() {
+			return cache.render(*grid).size();
+		});
+		std::cout << cache.getHits() << " hits, " << cache.getMisses() << " misses, hit rate "
+			<< cache.getHitRate() << ", " << cache.getBytes() << " bytes cached\n";
+	}
+	std::filesystem::remove_all(dir);
+}
+
+////////////////////////////////ROPE BENCHMARKS
+// Bytes generatePostScript copies: every node's output is appended to its
+// parent's, so each byte is copied once per level above it. This is a lower
+// bound, temporaries made on the way are not counted.
+std::size_t stringCopiedBytes(Shape &shape, bool root = true)
+{
+	std::size_t copied = root ? 0 : shape.generatePostScript().size();
+	for (unsigned int i = 0; i < shape.getSize(); ++i)
+	{
+		copied += stringCopiedBytes(*shape.getShape(i), false);
+	}
+	return copied;
+}
+
+// A document nested four composites deep, rendered to a file as one
+// string and as a rope written with writev, cold and from the cache.
+void benchRope()
+{
+	const int grids = 8;
+	const int rows = 150;
+	const int perRow = 150;
+	const std::size_t leaves = (std::size_t)grids * rows * perRow;
+	const std::string dir = "bench_rope_cache";
+	std::cout << "\nRope, " << leaves << " leaves, 4 levels:\n";
+
+	std::vector<unique_ptr<Shape>> bands;
+	for (int b = 0; b < grids / 2; ++b) {
+		std::vector<unique_ptr<Shape>> pair;
+		pair.push_back(makeGrid(rows, perRow));
+		pair.push_back(makeGrid(rows, perRow));
+		bands.push_back(make_unique<MultiHorizontal>(std::move(pair)));
+	}
+	unique_ptr<Shape> document = make_unique<MultiVertical>(std::move(bands));
+
+	std::size_t outputSize = 0;
+	runBenchmark("String render and write", leaves, [&]() {
+		std::string out = document->generatePostScript();
+		std::ofstream ofs("bench_rope.ps", std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+		ofs.write(out.data(), out.size());
+		outputSize = out.size();
+		return out.size();
+	});
+	double stringCopies = (double)stringCopiedBytes(*document) / outputSize;
+
+	Rope rope;
+	runBenchmark("Rope render and writev", leaves, [&]() {
+		renderRope(*document, rope);
+		rope.writeFile("bench_rope.ps");
+		return (std::size_t)rope.size();
+	});
+	std::cout << "Bytes copied per output byte: string " << stringCopies << ", rope "
+		<< (double)rope.getCopiedBytes() / rope.size() << ", " << rope.getPieces().size() << " pieces\n";
+
+	std::filesystem::remove_all(dir);
+	for (const char *name : { "Rope cold cache", "Rope warm cache" }) {
+		RenderCache cache;
+		cache.open(dir);
+		Rope cached;
+		runBenchmark(name, leaves, [&]() {
+			cache.render(*document, cached);
+			cached.writeFile("bench_rope.ps");
+			return (std::size_t)cached.size();
+		});
+		std::cout << "Bytes copied per output byte " << (double)cached.getCopiedBytes() / cached.size()
+			<< ", " << cached.getPieces().size() << " pieces\n";
+	}
+	std::filesystem::remove_all(dir);
+	std::remove("bench_rope.ps");
+}
+
+#ifdef COMPRESSED_OUTPUT_AVAILABLE
+////////////////////////////////COMPRESSED OUTPUT BENCHMARKS
+// Renders a document to a plain file and through the compressor with one
+// and more threads. The compressor runs while the next block is rendered.
+void benchCompressedOutput()
+{
+	const int rows = 500;
+	const int perRow = 500;
+	const std::size_t leaves = (std::size_t)rows * perRow;
+	std::cout << "\nCompressed output, " << leaves << " leaves:\n";
+
+	ShapeValue grid = ShapeValue::fromShape(*makeGrid(rows, perRow));
+	std::size_t plainSize = 0;
+	runBenchmark("Plain", leaves, [&]() {
+		std::string out;
+		grid.appendPostScript(out);
+		std::ofstream ofs("bench_compressed.ps", std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+		ofs.write(out.data(), out.size());
+		plainSize = out.size();
+		return out.size();
+	});
+
+	unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned int> threadCounts = { 1, cores };
+	threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+	for (unsigned int threads : threadCounts) {
+		std::size_t compressedSize = 0;
+		runBenchmark("Flate + ASCII85, " + std::to_string(threads) + " threads", leaves, [&]() {
+			std::ofstream ofs("bench_compressed.ps", std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+			CompressedWriter writer(ofs, threads);
+			grid.render(writer);
+			writer.finish();
+			compressedSize = writer.getOutputBytes();
+			return compressedSize;
+		});
+		std::cout << "Ratio " << (double)plainSize / compressedSize << "\n";
+	}
+	std::remove("bench_compressed.ps");
+}
+#endif
+
+////////////////////////////////BINARY POSTSCRIPT BENCHMARKS
+// What an interpreter's scanner does with text: split tokens, convert
+// numbers, leave names to be looked up. Returns the number of tokens.
+std::size_t scanText(const std::string &text)
+{
+	std::size_t tokens = 0;
+	double sum = 0;
+	const char *p = text.c_str();
+	while (*p)
+	{
+		while (*p == ' ' || *p == '\n')
+		{
+			++p;
+		}
+		if (!*p)
+		{
+			break;
+		}
+		char *end;
+		double value = std::strtod(p, &end);
+		if (end != p && (*end == ' ' || *end == '\n' || *end == '\0'))
+		{
+			sum += value;
+			p = end;
+		}
+		else
+		{
+			while (*p && *p != ' ' && *p != '\n')
+			{
+				++p;
+			}
+		}
+		++tokens;
+	}
+	volatile double keep = sum;
+	(void)keep;
+	return tokens;
+}
+
+//The same for binary tokens, as written by BinaryPostScriptWriter
+std::size_t scanBinary(const std::string &binary)
+{
+	std::size_t tokens = 0;
+	double sum = 0;
+	const unsigned char *p = (const unsigned char*)binary.data();
+	const unsigned char *end = p + binary.size();
+	while (p < end)
+	{
+		switch (*p++)
+		{
+		case Int8Token: sum += (signed char)*p; p += 1; break;
+		case Int16Token: sum += (std::int16_t)((p[0] << 8) | p[1]); p += 2; break;
+		case Int32Token: sum += (std::int32_t)(((std::uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]); p += 4; break;
+		case FixedToken: sum += std::ldexp((std::int16_t)((p[1] << 8) | p[2]), -(p[0] - 32)); p += 3; break;
+		case RealToken:
+		{
+			std::uint32_t bits = ((std::uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+			float real;
+			std::memcpy(&real, &bits, sizeof(real));
+			sum += real;
+			p += 4;
+			break;
+		}
+		default: p += 1; break; // system name
+		}
+		++tokens;
+	}
+	volatile double keep = sum;
+	(void)keep;
+	return tokens;
+}
+
+// Size of a document as text and as binary tokens, and how long it takes
+// to read each back: with Ghostscript if it is installed, otherwise with
+// the scanners above.
+void benchBinaryPostScript()
+{
+	const int rows = 300;
+	const int perRow = 300;
+	const std::size_t leaves = (std::size_t)rows * perRow;
+	std::cout << "\nBinary postscript, " << leaves << " leaves:\n";
+
+	ShapeValue grid = ShapeValue::fromShape(*makeGrid(rows, perRow));
+	std::string text;
+	std::string binary;
+	runBenchmark("Text render", leaves, [&]() {
+		appendPostScript(grid, TextEncoding, text);
+		return text.size();
+	});
+	runBenchmark("Binary render", leaves, [&]() {
+		appendPostScript(grid, BinaryEncoding, binary);
+		return binary.size();
+	});
+	std::cout << "Binary is " << 100.0 * binary.size() / text.size() << "% of text\n";
+
+	if (std::system("gs -v > /dev/null 2>&1") == 0) {
+		for (const std::string *document : { &text, &binary }) {
+			std::ofstream ofs("bench_binary.ps", std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+			ofs << "%!\n";
+			ofs.write(document->data(), document->size());
+			ofs.close();
+			runBenchmark(document == &text ? "Ghostscript, text" : "Ghostscript, binary", leaves, [&]() {
+				return (std::size_t)std::system("gs -q -dNODISPLAY -dBATCH -dNOPAUSE bench_binary.ps > /dev/null 2>&1");
+			});
+		}
+		std::remove("bench_binary.ps");
+	}
+	else {
+		std::cout << "No Ghostscript, timing the scanners in bench.cpp\n";
+		runBenchmark("Scan text", leaves, [&]() {
+			return scanText(text);
+		});
+		runBenchmark("Scan binary", leaves, [&]() {
+			return scanBinary(binary);
+		});
+	}
+}
+
+////////////////////////////////TRANSFORM FUSION BENCHMARKS
+//Number of times op appears as an operator in postscript text
+std::size_t countOperator(const std::string &text, const std::string &op)
+{
+	std::size_t count = 0;
+	std::string needle = op + "\n";
+	for (std::size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + 1))
+	{
+		if (at == 0 || text[at - 1] == ' ' || text[at - 1] == '\n')
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+// Leaves under deep stacks of alternating scales and rotations, rendered
+// as they are and after fuseTransforms. Without an interpreter at hand the
+// number of CTM changes stands in for the work they cause.
+void benchTransformFusion()
+{
+	const int leaves = 20000;
+	const int depth = 16;
+	std::cout << "\nTransform fusion, " << leaves << " leaves under " << depth << " transforms:\n";
+
+	std::vector<ShapeValue> stacks;
+	for (int i = 0; i < leaves; ++i) {
+		ShapeValue shape = i % 2 ? ShapeValue::circle(1 + i % 5) : ShapeValue::rectangle(2, 1 + i % 3);
+		for (int level = 0; level < depth; ++level) {
+			shape = level % 2 ? ShapeValue::rotated(std::move(shape), 15 + level) : ShapeValue::scaled(std::move(shape), 1.1, 0.9);
+		}
+		stacks.push_back(std::move(shape));
+	}
+	ShapeValue scene = ShapeValue::layered(std::move(stacks));
+	ShapeValue fused = scene;
+	runBenchmark("Fusion pass", leaves, [&]() {
+		fuseTransforms(fused);
+		return (std::size_t)0;
+	});
+
+	for (ShapeValue *shape : { &scene, &fused }) {
+		std::string out;
+		runBenchmark(shape == &scene ? "Render chains" : "Render fused", leaves, [&]() {
+			shape->appendPostScript(out);
+			return out.size();
+		});
+		std::size_t changes = countOperator(out, "scale") + countOperator(out, "rotate") + countOperator(out, "concat");
+		std::cout << changes << " CTM changes, " << countOperator(out, "grestore") << " gsave / grestore pairs\n";
+	}
+}
+
+////////////////////////////////FLATTEN BENCHMARKS
+// The batch transform on its own, against a plain loop over points kept
+// as pairs, then a whole document rendered as is and flattened.
+void benchFlatten()
+{
+	const std::size_t points = 1 << 20;
+	const int repeats = 20;
+	std::cout << "\nFlatten, " << points << " points x " << repeats << ":\n";
+
+	Affine m = Affine().translated(10, 20).rotated(30).scaled(2, 0.5);
+	std::vector<double> xs(points);
+	std::vector<double> ys(points);
+	std::vector<std::pair<double, double>> pairs(points);
+	for (std::size_t i = 0; i < points; ++i) {
+		xs[i] = pairs[i].first = (double)(i % 1000);
+		ys[i] = pairs[i].second = (double)(i / 1000);
+	}
+	runBenchmark("Point by point", points * repeats, [&]() {
+		for (int r = 0; r < repeats; ++r) {
+			for (std::pair<double, double> &p : pairs) {
+				m.apply(p.first, p.second, p.first, p.second);
+			}
+		}
+		return (std::size_t)0;
+	});
+	runBenchmark("Batch transform", points * repeats, [&]() {
+		for (int r = 0; r < repeats; ++r) {
+			transformPoints(m, xs.data(), ys.data(), points);
+		}
+		return (std::size_t)0;
+	});
+
+	const int rows = 300;
+	const int perRow = 300;
+	const std::size_t leaves = (std::size_t)rows * perRow;
+	std::cout << "Flatten, " << leaves << " leaves:\n";
+	ShapeValue grid = ShapeValue::fromShape(*makeGrid(rows, perRow));
+	runBenchmark("Relative render", leaves, [&]() {
+		std::string out;
+		grid.appendPostScript(out);
+		return out.size();
+	});
+	std::size_t flatPoints = 0;
+	runBenchmark("Flattened render", leaves, [&]() {
+		std::string out;
+		FlatteningWriter writer(out);
+		grid.render(writer);
+		flatPoints = writer.getPointCount();
+		return out.size();
+	});
+	std::cout << flatPoints << " absolute points\n";
+}
+
+////////////////////////////////LEVEL OF DETAIL BENCHMARKS
+// A mosaic of tiles scaled down to a few points each: many sided polygons,
+// faces and dots, rendered in full and at 300 dpi level of detail.
+void benchLod()
+{
+	const int tiles = 200;
+	const int perTile = 50;
+	const std::size_t leaves = (std::size_t)tiles * perTile;
+	std::cout << "\nLevel of detail, " << leaves << " leaves:\n";
+
+	std::vector<ShapeValue> mosaic;
+	for (int t = 0; t < tiles; ++t) {
+		std::vector<ShapeValue> tile;
+		for (int i = 0; i < perTile; ++i) {
+			switch (i % 3) {
+			case 0: tile.push_back(ShapeValue::polygon(100 + i, 2)); break;
+			case 1: tile.push_back(ShapeValue::custom(60)); break;
+			default: tile.push_back(ShapeValue::circle(1 + i % 4)); break;
+			}
+		}
+		double scale = 0.01 + 0.002 * (t % 10);
+		mosaic.push_back(ShapeValue::scaled(ShapeValue::horizontal(std::move(tile)), scale, scale));
+	}
+	ShapeValue scene = ShapeValue::vertical(std::move(mosaic));
+
+	std::size_t fullSize = 0;
+	runBenchmark("Full detail", leaves, [&]() {
+		std::string out;
+		scene.appendPostScript(out);
+		fullSize = out.size();
+		return out.size();
+	});
+	LodOptions options;
+	LodStats stats;
+	std::size_t lodSize = 0;
+	runBenchmark("Level of detail", leaves, [&]() {
+		std::string out;
+		appendLod(scene, out, options, stats);
+		lodSize = out.size();
+		return out.size();
+	});
+	std::cout << stats.arcs << " arcs, " << stats.squares << " squares, " << stats.dots << " dots, "
+		<< stats.dropped << " dropped, output " << 100.0 * lodSize / fullSize << "% of full, "
+		<< 100.0 * stats.bytesAvoided / (stats.bytes + stats.bytesAvoided) << "% counted as avoided\n";
+}
+
+////////////////////////////////STROKE BATCHING BENCHMARKS
+// A dense row of leaves with a stroke each and batched into one path, and
+// how long Ghostscript takes to rasterize each if it is installed.
+void benchStrokeBatching()
+{
+	const int perRow = 10000;
+	std::cout << "\nStroke batching, " << perRow << " leaves in a row:\n";
+
+	std::vector<ShapeValue> row;
+	for (int i = 0; i < perRow; ++i) {
+		switch (i % 3) {
+		case 0: row.push_back(ShapeValue::circle(2 + i % 5)); break;
+		case 1: row.push_back(ShapeValue::rectangle(4, 3 + i % 7)); break;
+		default: row.push_back(ShapeValue::polygon(5 + i % 4, 3)); break;
+		}
+	}
+	ShapeValue scene = ShapeValue::horizontal(std::move(row));
+
+	std::string plain;
+	std::string batched;
+	runBenchmark("One stroke per leaf", perRow, [&]() {
+		plain.clear();
+		scene.appendPostScript(plain);
+		return plain.size();
+	});
+	std::size_t strokes = 0;
+	runBenchmark("Batched strokes", perRow, [&]() {
+		batched.clear();
+		PostScriptWriter writer(batched);
+		StrokeBatchingWriter<PostScriptWriter> batching(writer);
+		scene.render(batching);
+		batching.finish();
+		strokes = batching.getStrokeCount();
+		return batched.size();
+	});
+	std::cout << countOperator(plain, "stroke") << " strokes before, " << strokes << " after, output "
+		<< 100.0 * batched.size() / plain.size() << "% of the size\n";
+
+	if (std::system("gs -v > /dev/null 2>&1") == 0) {
+		for (const std::string *document : { &plain, &batched }) {
+			std::ofstream ofs("bench_strokes.ps", std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+			ofs << "%!\n0.1 0.1 scale\n100 3000 translate\n";
+			ofs.write(document->data(), document->size());
+			ofs << "showpage\n";
+			ofs.close();
+			runBenchmark(document == &plain ? "Ghostscript, one stroke per leaf" : "Ghostscript, batched", perRow, [&]() {
+				return (std::size_t)std::system("gs -q -dBATCH -dNOPAUSE -sDEVICE=pgmraw -r300 -sOutputFile=/dev/null bench_strokes.ps > /dev/null 2>&1");
+			});
+		}
+		std::remove("bench_strokes.ps");
+	}
+	else {
+		std::cout << "No Ghostscript, interpreter time not measured\n";
+	}
+}
+
+////////////////////////////////RASTER BENCHMARKS
+// Thumbnails of many small documents, and the span kernel on its own with
+// and without SIMD.
+void benchRaster()
+{
+	const int documents = 1000;
+	const int perDocument = 100;
+	std::cout << "\nRaster, " << documents << " documents of " << perDocument << " leaves:\n";
+
+	std::vector<ShapeValue> pages;
+	for (int d = 0; d < documents; ++d) {
+		std::vector<ShapeValue> rows;
+		for (int r = 0; r < 10; ++r) {
+			std::vector<ShapeValue> row;
+			for (int i = 0; i < perDocument / 10; ++i) {
+				switch ((d + r + i) % 4) {
+				case 0: row.push_back(ShapeValue::circle(5 + i % 7)); break;
+				case 1: row.push_back(ShapeValue::rectangle(8 + r, 6 + i)); break;
+				case 2: row.push_back(ShapeValue::polygon(3 + i % 6, 6)); break;
+				default: row.push_back(ShapeValue::custom(20)); break;
+				}
+			}
+			rows.push_back(ShapeValue::horizontal(std::move(row)));
+		}
+		pages.push_back(ShapeValue::vertical(std::move(rows)));
+	}
+
+	const int size = 128;
+	auto start = std::chrono::steady_clock::now();
+	runBenchmark("128x128 thumbnails", documents, [&]() {
+		std::size_t ink = 0;
+		for (const ShapeValue &page : pages) {
+			Raster raster = thumbnail(page, size, size);
+			ink += raster.getPixel(size / 2, size / 2);
+		}
+		return ink;
+	});
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << (long)(documents / seconds * 60) << " thumbnails a minute\n";
+
+	const int spans = 200000;
+	const int spanLength = 64;
+	std::vector<float> row(spanLength);
+	RasterSegment segment{ 2.0f, 0.5f, 60.0f, 9.0f, 1.0f / (60.0f * 60.0f + 9.0f * 9.0f), 1.5f, 1.0f };
+	runBenchmark("Span kernel, SIMD", (std::size_t)spans * spanLength, [&]() {
+		for (int i = 0; i < spans; ++i) {
+			coverSpan(row.data(), 0, spanLength, 0.5f + i % 10, segment);
+		}
+		return (std::size_t)(row[spanLength / 2] * 1000);
+	});
+	std::fill(row.begin(), row.end(), 0.0f);
+	runBenchmark("Span kernel, scalar", (std::size_t)spans * spanLength, [&]() {
+		for (int i = 0; i < spans; ++i) {
+			coverSpanScalar(row.data(), 0, spanLength, 0.5f + i % 10, segment);
+		}
+		return (std::size_t)(row[spanLength / 2] * 1000);
+	});
+}
+
+////////////////////////////////BUILDER BENCHMARKS
+// Every allocation in this program is counted, so builds can report how
+// many they made
+static std::atomic<std::size_t> allocationCount(0);
+
+// With glibc, bytes on the heap can be tallied as well while heapTracking
+// is on, for benchmarks that compare how much memory they hold at the peak
+static std::atomic<bool> heapTracking(false);
+static std::atomic<long long> heapBytes(0);
+static std::atomic<long long> heapPeak(0);
+
+void *operator new(std::size_t size)
+{
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = std::malloc(size > 0 ? size : 1)) {
+#ifdef __GLIBC__
+		if (heapTracking.load(std::memory_order_relaxed)) {
+			long long bytes = heapBytes.fetch_add(malloc_usable_size(p), std::memory_order_relaxed) + malloc_usable_size(p);
+			long long peak = heapPeak.load(std::memory_order_relaxed);
+			while (bytes > peak && !heapPeak.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+			}
+		}
+#endif
+		return p;
+	}
+	throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept
+{
+#ifdef __GLIBC__
+	if (p && heapTracking.load(std::memory_order_relaxed)) {
+		heapBytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+	}
+#endif
+	std::free(p);
+}
+void operator delete(void *p, std::size_t) noexcept
+{
+	operator delete(p);
+}
+
+//Starts tallying heap bytes, from 0
+void startHeapTracking()
+{
+	heapBytes = 0;
+	heapPeak = 0;
+	heapTracking = true;
+}
+
+//Stops tallying, returns the most bytes held at once since it started
+long long stopHeapTracking()
+{
+	heapTracking = false;
+	return heapPeak.load();
+}
+
+// A million children in one MultiHorizontal: copied into an unreserved
+// vector the way main.cpp builds composites, and built in place.
+void benchBuilder()
+{
+	const int children = 1000000;
+	std::cout << "\nBuilder, " << children << " children:\n";
+
+	std::size_t allocations = 0;
+	unique_ptr<MultiHorizontal> copied;
+	runBenchmark("Copy into a vector", children, [&]() {
+		std::size_t before = allocationCount.load();
+		std::vector<unique_ptr<Shape>> row;
+		for (int i = 0; i < children; ++i) {
+			if (i % 2 == 0) {
+				Circle circ(1 + i % 7);
+				row.push_back(make_unique<Circle>(circ));
+			}
+			else {
+				Rectangle rect(2, 1 + i % 5);
+				row.push_back(make_unique<Rectangle>(rect));
+			}
+		}
+		copied = make_unique<MultiHorizontal>(std::move(row));
+		allocations = allocationCount.load() - before;
+		return (std::size_t)0;
+	});
+	std::cout << (double)allocations / children << " allocations per child\n";
+
+	unique_ptr<MultiHorizontal> built;
+	runBenchmark("Built in place", children, [&]() {
+		std::size_t before = allocationCount.load();
+		CompositeBuilder<MultiHorizontal> builder(children);
+		for (int i = 0; i < children; ++i) {
+			if (i % 2 == 0) {
+				builder.emplace<Circle>(1 + i % 7);
+			}
+			else {
+				builder.emplace<Rectangle>(2, 1 + i % 5);
+			}
+		}
+		built = builder.build();
+		allocations = allocationCount.load() - before;
+		return (std::size_t)0;
+	});
+	std::cout << (double)allocations / children << " allocations per child, "
+		<< (built->width == copied->width ? "same" : "different") << " extents\n";
+}
+
+////////////////////////////////STREAMING COMPOSITE BENCHMARKS
+//Stream buffer that only counts what is written to it
+class CountingBuffer : public std::streambuf {
+public:
+	std::size_t count = 0;
+
+protected:
+	int overflow(int c) override
+	{
+		++count;
+		return c;
+	}
+	std::streamsize xsputn(const char *, std::streamsize n) override
+	{
+		count += n;
+		return n;
+	}
+};
+
+// A report of 300000 rows, each made from its row number like a
+// database cursor would give it: built as a MultiVertical and written, and
+// streamed from a generator.
+void benchStreamingComposite()
+{
+	const std::size_t rows = 300000;
+	std::cout << "\nStreaming composite, " << rows << " rows:\n";
+
+	auto cellWidth = [](std::size_t i) { return 20.0 + i % 13; };
+	auto makeRow = [&](std::size_t i) {
+		return CompositeBuilder<MultiHorizontal>(3)
+			.emplace<Rectangle>(cellWidth(i), 8)
+			.emplace<Circle>(3)
+			.emplace<Rectangle>(40, 8)
+			.build();
+	};
+	auto rowSize = [&](std::size_t i, double &w, double &h) {
+		CompositeExtents extents;
+		addHorizontalExtents(extents, cellWidth(i), 8);
+		addHorizontalExtents(extents, 6, 6);
+		addHorizontalExtents(extents, 40, 8);
+		w = extents.width;
+		h = extents.height;
+	};
+
+	std::size_t before = allocationCount.load();
+	CountingBuffer builtBuffer;
+	runBenchmark("Build all rows, then write", rows, [&]() {
+		CompositeBuilder<MultiVertical> report(rows);
+		for (std::size_t i = 0; i < rows; ++i) {
+			report.add(makeRow(i));
+		}
+		unique_ptr<MultiVertical> document = report.build();
+		std::ostream out(&builtBuffer);
+		std::string text = document->generatePostScript();
+		out.write(text.data(), text.size());
+		return builtBuffer.count;
+	});
+	std::cout << (allocationCount.load() - before) / rows << " allocations per row, " << rows << " rows held at once\n";
+
+	before = allocationCount.load();
+	CountingBuffer streamedBuffer;
+	runBenchmark("Stream rows", rows, [&]() {
+		StreamingVertical document(generateChildren(rows, rowSize, [&](std::size_t i) -> unique_ptr<Shape> { return makeRow(i); }));
+		std::ostream out(&streamedBuffer);
+		document.writePostScript(out);
+		return streamedBuffer.count;
+	});
+	std::cout << (allocationCount.load() - before) / rows << " allocations per row, 1 row held at once, "
+		<< (streamedBuffer.count == builtBuffer.count ? "same" : "different") << " output size\n";
+}
+
+void benchPagination()
+{
+	const std::size_t children = 10000000;
+	std::cout << "\nPagination, " << children << " children:\n";
+	std::vector<double> lengths(children);
+	for (std::size_t i = 0; i < children; ++i) {
+		lengths[i] = 4 + (i * 2654435761u) % 40;
+	}
+	const double pageSizes[] = { 720, 648, 540, 1000, 2000 };
+
+	auto start = std::chrono::steady_clock::now();
+	PageBreaks breaks(lengths);
+	double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Prefix sums: " << buildMs << " ms\n";
+
+	for (double pageLength : pageSizes) {
+		start = std::chrono::steady_clock::now();
+		std::size_t searched = breaks.paginate(pageLength).size();
+		double searchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		// Laying out child by child, as a page break pass without the sums would
+		start = std::chrono::steady_clock::now();
+		std::size_t scanned = 0;
+		for (std::size_t first = 0; first < children; ++scanned) {
+			std::size_t last = first + 1;
+			double used = lengths[first];
+			while (last < children && used + 1 + lengths[last] <= pageLength) {
+				used += 1 + lengths[last++];
+			}
+			first = last;
+		}
+		double scanMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Page length " << pageLength << ": " << searched << " pages, search " << searchMs
+			<< " ms, child by child " << scanMs << " ms" << (searched == scanned ? "" : " (page counts differ)") << "\n";
+	}
+
+	const int stackSize = 200000;
+	CompositeBuilder<MultiVertical> builder(stackSize);
+	for (int i = 0; i < stackSize; ++i) {
+		builder.emplace<Rectangle>(20 + i % 30, 4 + i % 17);
+	}
+	unique_ptr<MultiVertical> stack = builder.build();
+	unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::string> pages;
+	runBenchmark("Render pages of a 200000 child stack, 1 thread", stackSize, [&]() {
+		pages = renderPages(*stack, PageOptions(), 1);
+		std::size_t bytes = 0;
+		for (const std::string &page : pages) {
+			bytes += page.size();
+		}
+		return bytes;
+	});
+	runBenchmark("Render pages, " + std::to_string(threads) + " threads", stackSize, [&]() {
+		pages = renderPages(*stack, PageOptions(), threads);
+		std::size_t bytes = 0;
+		for (const std::string &page : pages) {
+			bytes += page.size();
+		}
+		return bytes;
+	});
+	std::cout << pages.size() << " pages\n";
+}
+
+// Many small documents written to slow readers: a thread per document that
+// renders it with generatePostScript() and writes it, against one thread
+// that pulls a chunk from each document in turn. The readers are taken to
+// be slow enough that every document is in flight at once, so the threads
+// write only once all of them have rendered.
+void benchPullRender()
+{
+	const int documents = 2000;
+	const int rows = 50;
+	const std::size_t chunkSize = 4096;
+	std::cout << "\nPull rendering, " << documents << " documents of " << rows << " rows:\n";
+
+	std::vector<unique_ptr<MultiVertical>> docs;
+	for (int d = 0; d < documents; ++d) {
+		CompositeBuilder<MultiVertical> doc(rows);
+		for (int i = 0; i < rows; ++i) {
+			doc.add(CompositeBuilder<MultiHorizontal>(3)
+				.emplace<Rectangle>(20 + (d + i) % 13, 8)
+				.emplace<Circle>(3)
+				.emplace<Rotated>(make_unique<Custom>(6 + i % 5), 90));
+		}
+		docs.push_back(doc.build());
+	}
+
+	std::mutex outMutex;
+	std::condition_variable allRendered;
+	int rendered = 0;
+	CountingBuffer threadBuffer;
+	startHeapTracking();
+	runBenchmark("Thread per document", (std::size_t)documents * rows, [&]() {
+		std::vector<std::thread> threads;
+		for (int d = 0; d < documents; ++d) {
+			threads.emplace_back([&, d]() {
+				std::string text = docs[d]->generatePostScript();
+				std::unique_lock<std::mutex> lock(outMutex);
+				if (++rendered == documents) {
+					allRendered.notify_all();
+				}
+				allRendered.wait(lock, [&]() { return rendered == documents; });
+				std::ostream out(&threadBuffer);
+				out.write(text.data(), text.size());
+			});
+		}
+		for (std::thread &t : threads) {
+			t.join();
+		}
+		return threadBuffer.count;
+	});
+	long long threadPeak = stopHeapTracking();
+
+	CountingBuffer pullBuffer;
+	startHeapTracking();
+	runBenchmark("One thread pulling chunks in turn", (std::size_t)documents * rows, [&]() {
+		std::vector<PullRenderer> renderers;
+		renderers.reserve(documents);
+		for (int d = 0; d < documents; ++d) {
+			renderers.emplace_back(*docs[d], chunkSize);
+		}
+		std::ostream out(&pullBuffer);
+		std::string chunk;
+		for (bool pulled = true; pulled;) {
+			pulled = false;
+			for (PullRenderer &renderer : renderers) {
+				if (renderer.next(chunk)) {
+					out.write(chunk.data(), chunk.size());
+					pulled = true;
+				}
+			}
+		}
+		return pullBuffer.count;
+	});
+	long long pullPeak = stopHeapTracking();
+
+#ifdef __GLIBC__
+	std::cout << "Peak heap: " << threadPeak / 1024 << " KB with " << documents << " threads and their stacks besides, "
+		<< pullPeak / 1024 << " KB pulling, " << (pullBuffer.count == threadBuffer.count ? "same" : "different") << " output size\n";
+#endif
+
+#ifdef PULL_RENDER_COROUTINES_AVAILABLE
+	CountingBuffer coroutineBuffer;
+	startHeapTracking();
+	runBenchmark("One thread resuming coroutines in turn", (std::size_t)documents * rows, [&]() {
+		std::vector<PostScriptChunks> generators;
+		generators.reserve(documents);
+		for (int d = 0; d < documents; ++d) {
+			generators.push_back(renderChunks(*docs[d], chunkSize));
+		}
+		std::ostream out(&coroutineBuffer);
+		std::string chunk;
+		for (bool pulled = true; pulled;) {
+			pulled = false;
+			for (PostScriptChunks &generator : generators) {
+				if (generator.next(chunk)) {
+					out.write(chunk.data(), chunk.size());
+					pulled = true;
+				}
+			}
+		}
+		return coroutineBuffer.count;
+	});
+	std::cout << "Peak heap: " << stopHeapTracking() / 1024 << " KB with coroutines\n";
+#endif
+}
+
+// An editor changing one leaf at a time in a 100000 leaf scene while a
+// reader draws it: readers drawing persistent snapshots, against a
+// MutableComposite scene behind one lock that the editor and the reader
+// both take, and against deep copies of the scene as snapshots.
+void benchPersistentShape()
+{
+	const int rows = 200;
+	const int columns = 500;
+	const int edits = 20000;
+	std::cout << "\nPersistent shapes, " << rows * columns << " leaves:\n";
+
+	std::vector<PersistentShape> persistentRows;
+	MutableVertical lockedScene;
+	for (int r = 0; r < rows; ++r) {
+		std::vector<PersistentShape> cells;
+		std::vector<unique_ptr<Shape>> lockedCells;
+		for (int c = 0; c < columns; ++c) {
+			cells.push_back(PersistentShape::leaf(ShapeValue::rectangle(4 + (r + c) % 7, 3)));
+			lockedCells.push_back(make_unique<Rectangle>(4 + (r + c) % 7, 3));
+		}
+		persistentRows.push_back(PersistentShape::horizontal(cells));
+		lockedScene.append(make_unique<MutableHorizontal>(std::move(lockedCells)));
+	}
+	PersistentScene scene(PersistentShape::vertical(persistentRows));
+	auto randomCell = [](unsigned int &seed) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	};
+
+	unsigned int seed = 12345;
+	std::size_t before = allocationCount.load();
+	runBenchmark("Persistent edits of one leaf", edits, [&]() {
+		for (int i = 0; i < edits; ++i) {
+			unsigned int cell = randomCell(seed);
+			scene.edit([&](const PersistentShape &root) {
+				return root.update({ cell % rows, (cell / rows) % columns }, [&](const PersistentShape &) {
+					return PersistentShape::leaf(ShapeValue::rectangle(4 + cell % 7, 3));
+				});
+			});
+		}
+		return (std::size_t)0;
+	});
+	std::cout << (double)(allocationCount.load() - before) / edits << " allocations per edit\n";
+
+	ShapeValue valueScene = ShapeValue::fromShape(lockedScene);
+	runBenchmark("Deep copy of the scene as a snapshot", rows * columns, [&]() {
+		ShapeValue copy = valueScene;
+		return (std::size_t)copy.width;
+	});
+	runBenchmark("Persistent snapshot, 1000 times", 1000, [&]() {
+		std::size_t sum = 0;
+		for (int i = 0; i < 1000; ++i) {
+			sum += scene.snapshot().getSize();
+		}
+		return sum;
+	});
+
+	// Draws the scene over and over while edit() runs every 100 us, timing
+	// each drawing and each edit. Gives the median and the slowest drawing,
+	// the slowest edit and how many edits were made.
+	auto drawWhileEditing = [&](auto &&draw, auto &&edit, bool editing, double &median, double &slowest,
+		double &slowestEdit, int &made) {
+		std::atomic<bool> drawing(true);
+		std::atomic<int> editCount(0);
+		slowestEdit = 0;
+		std::thread editor([&]() {
+			unsigned int editorSeed = 777;
+			while (editing && drawing.load()) {
+				auto start = std::chrono::steady_clock::now();
+				edit(randomCell(editorSeed));
+				slowestEdit = std::max(slowestEdit,
+					std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+				++editCount;
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+		});
+		std::vector<double> times;
+		for (int i = 0; i < 30; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			draw();
+			times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		drawing = false;
+		editor.join();
+		std::sort(times.begin(), times.end());
+		median = times[times.size() / 2];
+		slowest = times.back();
+		made = editCount.load();
+	};
+
+	CountingBuffer sink;
+	auto drawSnapshot = [&]() {
+		PersistentShape snapshot = scene.snapshot();
+		std::string text;
+		snapshot.appendPostScript(text);
+		sink.count += text.size();
+	};
+	auto editSnapshot = [&](unsigned int cell) {
+		scene.edit([&](const PersistentShape &root) {
+			return root.update({ cell % rows, (cell / rows) % columns }, [&](const PersistentShape &) {
+				return PersistentShape::leaf(ShapeValue::rectangle(4 + cell % 7, 3));
+			});
+		});
+	};
+	std::mutex sceneMutex;
+	auto drawLocked = [&]() {
+		std::lock_guard<std::mutex> lock(sceneMutex);
+		std::string text = lockedScene.generatePostScript();
+		sink.count += text.size();
+	};
+	auto editLocked = [&](unsigned int cell) {
+		std::lock_guard<std::mutex> lock(sceneMutex);
+		MutableComposite *row = static_cast<MutableComposite*>(lockedScene.getShape(cell % rows));
+		row->replace((cell / rows) % columns, make_unique<Rectangle>(4 + cell % 7, 3));
+	};
+
+	double median;
+	double slowest;
+	double slowestEdit;
+	int made;
+	drawWhileEditing(drawSnapshot, editSnapshot, false, median, slowest, slowestEdit, made);
+	std::cout << "Drawing a snapshot, no edits: median " << median << " ms, slowest " << slowest << " ms\n";
+	drawWhileEditing(drawSnapshot, editSnapshot, true, median, slowest, slowestEdit, made);
+	std::cout << "Drawing a snapshot while editing: median " << median << " ms, slowest " << slowest << " ms, "
+		<< made << " edits meanwhile, slowest edit " << slowestEdit << " ms\n";
+	drawWhileEditing(drawLocked, editLocked, false, median, slowest, slowestEdit, made);
+	std::cout << "Drawing under a lock, no edits: median " << median << " ms, slowest " << slowest << " ms\n";
+	drawWhileEditing(drawLocked, editLocked, true, median, slowest, slowestEdit, made);
+	std::cout << "Drawing under a lock while editing: median " << median << " ms, slowest " << slowest << " ms, "
+		<< made << " edits meanwhile, slowest edit " << slowestEdit << " ms\n";
+}
+
+// What checking for a stop costs when nothing stops the render, and how
+// long after its deadline a render returns, for a scene of many leaves and
+// for one polygon with millions of sides
+void benchRenderControl()
+{
+	const int leaves = 200000;
+	std::cout << "\nRender control, " << leaves << " leaves:\n";
+	CompositeBuilder<MultiVertical> builder(leaves / 4);
+	for (int i = 0; i < leaves / 4; ++i) {
+		builder.add(CompositeBuilder<MultiHorizontal>(4)
+			.emplace<Circle>(3 + i % 5)
+			.emplace<Square>(4 + i % 3)
+			.emplace<Custom>(8)
+			.emplace<Rectangle>(6, 2 + i % 4));
+	}
+	unique_ptr<MultiVertical> scene = builder.build();
+	Polygon manySides(5000000, 1);
+
+	runBenchmark("generatePostScript", leaves, [&]() {
+		return scene->generatePostScript().size();
+	});
+	runBenchmark("Controlled, never stopped", leaves, [&]() {
+		CancellationToken token;
+		RenderProgress progress;
+		RenderControl control(&token, RenderControl::Clock::time_point::max(), &progress);
+		std::string out;
+		renderControlled(*scene, out, control);
+		return out.size();
+	});
+
+	auto overshoot = [](Shape &shape, double deadlineMs) {
+		RenderControl control = RenderControl::withTimeout(
+			std::chrono::duration_cast<RenderControl::Clock::duration>(std::chrono::duration<double, std::milli>(deadlineMs)));
+		auto start = std::chrono::steady_clock::now();
+		std::string out;
+		renderControlled(shape, out, control);
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() - deadlineMs * 1000;
+	};
+	for (double deadlineMs : { 1.0, 10.0, 50.0 }) {
+		std::cout << "Deadline " << deadlineMs << " ms: scene returns " << overshoot(*scene, deadlineMs)
+			<< " us late, polygon " << overshoot(manySides, deadlineMs) << " us late\n";
+	}
+}
+
+int main()
+{
+	benchShapeValue();
+	benchMutableComposite();
+	benchSpatialIndex();
+	benchViewport();
+	benchSceneFile();
+	benchSceneParser();
+#ifdef RENDER_DAEMON_AVAILABLE
+	benchRenderDaemon();
+#endif
+	benchBatchRender();
+#ifdef SHARDED_RENDER_AVAILABLE
+	benchShardedRender();
+#endif
+	benchRenderCache();
+	benchRope();
+#ifdef COMPRESSED_OUTPUT_AVAILABLE
+	benchCompressedOutput();
+#endif
+	benchBinaryPostScript();
+	benchTransformFusion();
+	benchFlatten();
+	benchLod();
+	benchStrokeBatching();
+	benchRaster();
+	benchBuilder();
+	benchStreamingComposite();
+	benchPagination();
+	benchPullRender();
+	benchPersistentShape();
+	benchRenderControl();
+	return 0;
+}
@@ -0,0 +1,336 @@
+#ifndef BINARY_POSTSCRIPT_HPP_INCLUDED
+#define BINARY_POSTSCRIPT_HPP_INCLUDED
+
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <charconv>
+#include <algorithm>
+#include "postscript.hpp"
+#include "shape.hpp"
+#include "shape_value.hpp"
+
+// Postscript in LanguageLevel 2 binary token encoding.
+//
+// Interpreters read binary tokens without scanning digits or looking up
+// names: numbers are written as 8, 16 or 32 bit integers, 16 bit fixed
+// point or 32 bit IEEE reals, and the operators the shapes use as
+// executable system names, i.e. an index into the table in the PLRM.
+// Reals are single precision in the interpreter anyway, so a number is only
+// written as a float if it is not an integer or a short fixed point value.
+// Operators missing from the table, and text that is not just numbers and
+// names, are written as text, which may be mixed with binary tokens.
+
+//How a document's postscript is written
+enum PostScriptEncoding { TextEncoding, BinaryEncoding };
+
+//Binary token types, PLRM 3.14.1
+enum BinaryToken : unsigned char {
+	Int32Token = 132,      // high order byte first
+	Int16Token = 134,
+	Int8Token = 136,
+	FixedToken = 137,      // representation byte, then the number
+	RealToken = 138,       // IEEE single, high order byte first
+	SystemNameToken = 146  // executable, index into the system name table
+};
+
+// Index of an operator in the system name table, PLRM Table F.1, or -1 if
+// it has none. The table counts from abs at 0, with arct at 7 before arcto.
+inline int systemNameIndex(const char *name)
+{
+	static const struct { const char *name; int index; } table[] = {
+		{ "arc", 5 }, { "closepath", 21 }, { "concat", 22 }, { "grestore", 76 }, { "gsave", 77 },
+		{ "lineto", 98 }, { "moveto", 106 }, { "newpath", 110 }, { "rlineto", 132 }, { "rotate", 135 },
+		{ "scale", 138 }, { "setlinewidth", 154 }, { "showpage", 160 }, { "stroke", 166 }, { "translate", 172 }
+	};
+	for (const auto &entry : table)
+	{
+		if (std::strcmp(entry.name, name) == 0)
+		{
+			return entry.index;
+		}
+	}
+	return -1;
+}
+
+inline const char *systemName(int index)
+{
+	static const char *const names[] = { "arc", "closepath", "concat", "grestore", "gsave", "lineto",
+		"moveto", "newpath", "rlineto", "rotate", "scale", "setlinewidth", "showpage", "stroke", "translate" };
+	for (const char *name : names)
+	{
+		if (systemNameIndex(name) == index)
+		{
+			return name;
+		}
+	}
+	return nullptr;
+}
+
+// Writer with the PostScriptWriter interface that appends binary tokens.
+// endLine() writes nothing, tokens delimit themselves.
+class BinaryPostScriptWriter {
+public:
+	BinaryPostScriptWriter(std::string &out) : out_(out) {}
+
+	void number(double value)
+	{
+		if (value == std::nearbyint(value) && std::fabs(value) < 2147483648.0)
+		{
+			integer((long)value);
+			return;
+		}
+		// 16 bit fixed point with up to 15 fraction bits, if that is exact.
+		// Scaling by a power of two is exact, so shift out the zero bits.
+		double scaled = value * 32768;
+		if (std::fabs(scaled) < 32768.0 * 32768 && scaled == std::nearbyint(scaled))
+		{
+			long fixed = (long)scaled;
+			int scale = 15;
+			while ((fixed & 1) == 0)
+			{
+				fixed /= 2;
+				--scale;
+			}
+			if (fixed >= -32768 && fixed <= 32767)
+			{
+				putByte(FixedToken);
+				putByte(32 + scale);
+				putBigEndian((std::uint16_t)(std::int16_t)fixed, 2);
+				return;
+			}
+		}
+		float real = (float)value;
+		std::uint32_t bits;
+		std::memcpy(&bits, &real, sizeof(bits));
+		putByte(RealToken);
+		putBigEndian(bits, 4);
+	}
+
+	void integer(long value)
+	{
+		if (value >= -128 && value <= 127)
+		{
+			putByte(Int8Token);
+			putByte((unsigned char)(signed char)value);
+		}
+		else if (value >= -32768 && value <= 32767)
+		{
+			putByte(Int16Token);
+			putBigEndian((std::uint16_t)(std::int16_t)value, 2);
+		}
+		else
+		{
+			putByte(Int32Token);
+			putBigEndian((std::uint32_t)(std::int32_t)value, 4);
+		}
+	}
+
+	void op(const char *name)
+	{
+		int index = systemNameIndex(name);
+		if (index < 0)
+		{
+			out_ += name;
+			out_ += ' ';
+			return;
+		}
+		putByte(SystemNameToken);
+		putByte(index);
+	}
+
+	void endLine()
+	{
+	}
+
+	// Already generated postscript. Text that is only numbers and names is
+	// encoded token by token, anything else is copied as is.
+	void raw(const char *text, std::size_t size)
+	{
+		if (size == 0)
+		{
+			return;
+		}
+		const char special[] = "()<>[]{}/%";
+		if (std::find_first_of(text, text + size, special, special + sizeof(special) - 1) != text + size)
+		{
+			out_.append(text, size);
+			if (!isWhite(text[size - 1]))
+			{
+				out_ += ' ';
+			}
+			return;
+		}
+		const char *end = text + size;
+		const char *p = text;
+		char name[64];
+		while (p < end)
+		{
+			while (p < end && isWhite(*p))
+			{
+				++p;
+			}
+			const char *start = p;
+			while (p < end && !isWhite(*p))
+			{
+				++p;
+			}
+			if (start == p)
+			{
+				break;
+			}
+			double value;
+			auto parsed = std::from_chars(start, p, value);
+			if (parsed.ec == std::errc() && parsed.ptr == p)
+			{
+				number(value);
+			}
+			else if ((std::size_t)(p - start) < sizeof(name))
+			{
+				std::memcpy(name, start, p - start);
+				name[p - start] = '\0';
+				op(name);
+			}
+			else
+			{
+				out_.append(start, p);
+				out_ += ' ';
+			}
+		}
+	}
+	void raw(const std::string &text)
+	{
+		raw(text.data(), text.size());
+	}
+
+private:
+	static bool isWhite(char c)
+	{
+		return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0';
+	}
+
+	void putByte(unsigned int byte)
+	{
+		out_ += (char)byte;
+	}
+
+	void putBigEndian(std::uint32_t value, int bytes)
+	{
+		for (int shift = 8 * (bytes - 1); shift >= 0; shift -= 8)
+		{
+			putByte((value >> shift) & 0xff);
+		}
+	}
+
+	std::string &out_;
+};
+
+//Appends the postscript of shape to out in the given encoding
+inline void appendPostScript(const ShapeValue &shape, PostScriptEncoding encoding, std::string &out)
+{
+	if (encoding == BinaryEncoding)
+	{
+		BinaryPostScriptWriter writer(out);
+		shape.render(writer);
+	}
+	else
+	{
+		shape.appendPostScript(out);
+	}
+}
+
+inline void appendPostScript(Shape &shape, PostScriptEncoding encoding, std::string &out)
+{
+	if (encoding == BinaryEncoding)
+	{
+		appendPostScript(ShapeValue::fromShape(shape), encoding, out);
+	}
+	else
+	{
+		out += shape.generatePostScript();
+	}
+}
+
+// Turns binary tokens back into text, numbers formatted like the text
+// writer's. Text in between is copied. Returns false on a truncated token or
+// one this file does not write.
+inline bool binaryTokensToText(const std::string &binary, std::string &text)
+{
+	PostScriptWriter writer(text);
+	const unsigned char *p = (const unsigned char*)binary.data();
+	const unsigned char *end = p + binary.size();
+	auto bigEndian = [&](int bytes) {
+		std::uint32_t value = 0;
+		for (int i = 0; i < bytes; ++i)
+		{
+			value = (value << 8) | *p++;
+		}
+		return value;
+	};
+	while (p < end)
+	{
+		unsigned char token = *p++;
+		std::size_t left = end - p;
+		switch (token)
+		{
+		case Int8Token:
+			if (left < 1) return false;
+			writer.integer((signed char)*p++);
+			break;
+		case Int16Token:
+			if (left < 2) return false;
+			writer.integer((std::int16_t)bigEndian(2));
+			break;
+		case Int32Token:
+			if (left < 4) return false;
+			writer.integer((std::int32_t)bigEndian(4));
+			break;
+		case FixedToken:
+		{
+			if (left < 3 || p[0] < 33 || p[0] > 47) return false;
+			int scale = *p++ - 32;
+			writer.number(std::ldexp((std::int16_t)bigEndian(2), -scale));
+			break;
+		}
+		case RealToken:
+		{
+			if (left < 4) return false;
+			std::uint32_t bits = bigEndian(4);
+			float real;
+			std::memcpy(&real, &bits, sizeof(real));
+			writer.number(real);
+			break;
+		}
+		case SystemNameToken:
+		{
+			if (left < 1) return false;
+			const char *name = systemName(*p++);
+			if (name == nullptr) return false;
+			writer.op(name);
+			break;
+		}
+		default:
+			if (token >= 128 && token <= 159)
+			{
+				return false;
+			}
+			// Text token, up to the next binary token
+			const unsigned char *start = p - 1;
+			while (p < end && !(*p >= 128 && *p <= 159))
+			{
+				++p;
+			}
+			if (!text.empty() && !std::isspace((unsigned char)text.back()))
+			{
+				writer.raw(" ", 1);
+			}
+			writer.raw((const char*)start, p - start);
+			break;
+		}
+	}
+	return true;
+}
+
+#endif // BINARY_POSTSCRIPT_HPP_INCLUDED
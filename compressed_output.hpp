@@ -0,0 +1,364 @@
+#ifndef COMPRESSED_OUTPUT_HPP_INCLUDED
+#define COMPRESSED_OUTPUT_HPP_INCLUDED
+
+#include <string>
+#include <deque>
+#include <future>
+#include <thread>
+#include <ostream>
+#include <cstdint>
+#include <algorithm>
+#include "postscript.hpp"
+
+#if defined(__has_include)
+#if __has_include(<zlib.h>)
+#include <zlib.h>
+#define COMPRESSED_OUTPUT_AVAILABLE 1
+#endif
+#endif
+
+// Postscript compressed as it is written, needs zlib (link with -lz).
+//
+// The output is Flate compressed and then ASCII85 encoded, behind a line
+// that has the interpreter decode and run it:
+//
+//   currentfile /ASCII85Decode filter /FlateDecode filter cvx exec
+//
+// FlateDecode is LanguageLevel 3. Anything written to the stream after
+// finish() is plain postscript again, e.g. showpage.
+//
+// Text is cut into blocks that are deflated on their own threads while the
+// next block is written. Each block is primed with the last 32 KB of the one
+// before, which is input and so known up front, and ends on a byte boundary,
+// so the pieces join into one zlib stream. The same idea as pigz.
+
+#ifdef COMPRESSED_OUTPUT_AVAILABLE
+
+// Appends ASCII85 text for a stream of bytes, in lines of lineLength
+// characters. Up to three bytes are held back until the next group is whole.
+class Ascii85Encoder {
+public:
+	static constexpr int lineLength = 75;
+
+	Ascii85Encoder(std::string &out) : out_(out) {}
+
+	void write(const char *data, std::size_t size)
+	{
+		const unsigned char *bytes = (const unsigned char*)data;
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			group_ = (group_ << 8) | bytes[i];
+			if (++count_ == 4)
+			{
+				encodeGroup(4);
+			}
+		}
+	}
+
+	//Encodes what is held back and writes the end marker
+	void finish()
+	{
+		if (count_ > 0)
+		{
+			int bytes = count_;
+			group_ <<= 8 * (4 - count_);
+			encodeGroup(bytes);
+		}
+		out_ += "~>\n";
+		column_ = 0;
+	}
+
+private:
+	// A whole group of zeros is written as z, a short last group as one
+	// character more than it has bytes
+	void encodeGroup(int bytes)
+	{
+		if (bytes == 4 && group_ == 0)
+		{
+			put('z');
+		}
+		else
+		{
+			char digits[5];
+			std::uint32_t value = group_;
+			for (int i = 4; i >= 0; --i)
+			{
+				digits[i] = (char)('!' + value % 85);
+				value /= 85;
+			}
+			for (int i = 0; i <= bytes; ++i)
+			{
+				put(digits[i]);
+			}
+		}
+		group_ = 0;
+		count_ = 0;
+	}
+
+	void put(char c)
+	{
+		out_ += c;
+		if (++column_ == lineLength)
+		{
+			out_ += '\n';
+			column_ = 0;
+		}
+	}
+
+	std::string &out_;
+	std::uint32_t group_ = 0;
+	int count_ = 0;
+	int column_ = 0;
+};
+
+// Writer for the shape templates that compresses its output into a stream.
+// Nothing reaches out until a block is full or finish() is called.
+class CompressedWriter {
+public:
+	//Text deflated at a time
+	static constexpr std::size_t blockSize = 1 << 20;
+	//Primer taken from the block before, the Flate window
+	static constexpr std::size_t windowSize = 1 << 15;
+
+	// Writes the decode line to out. Up to threads blocks are compressed at
+	// once, with zlib level level.
+	CompressedWriter(std::ostream &out, unsigned int threads = std::thread::hardware_concurrency(), int level = 6)
+		: out_(out), threads_(std::max(1u, threads)), level_(level), writer_(block_), encoder_(encoded_)
+	{
+		out_ << "currentfile /ASCII85Decode filter /FlateDecode filter cvx exec\n";
+		// zlib header: deflate with a 32 KB window, no preset dictionary
+		const char header[2] = { 0x78, (char)0x9c };
+		encoder_.write(header, 2);
+		block_.reserve(blockSize + 4096);
+	}
+
+	~CompressedWriter()
+	{
+		finish();
+	}
+
+	void number(double value) { writer_.number(value); }
+	void integer(long value) { writer_.integer(value); }
+	void op(const char *name) { writer_.op(name); }
+	void raw(const char *text, std::size_t size) { writer_.raw(text, size); flushIfFull(); }
+	void raw(const std::string &text) { raw(text.data(), text.size()); }
+	void endLine()
+	{
+		writer_.endLine();
+		flushIfFull();
+	}
+
+	// Compresses what is left and ends the stream. Returns false if zlib or
+	// the stream failed. Later calls do nothing.
+	bool finish()
+	{
+		if (finished_)
+		{
+			return ok_;
+		}
+		finished_ = true;
+		submit(true);
+		while (!pending_.empty())
+		{
+			collect();
+		}
+		const char trailer[4] = { (char)(adler_ >> 24), (char)(adler_ >> 16), (char)(adler_ >> 8), (char)adler_ };
+		encoder_.write(trailer, 4);
+		encoder_.finish();
+		emit();
+		out_.flush();
+		ok_ = ok_ && (bool)out_;
+		return ok_;
+	}
+
+	//Postscript bytes written so far
+	std::uint64_t getInputBytes() const
+	{
+		return inputBytes_ + block_.size();
+	}
+
+	//Bytes sent to the stream, not counting the decode line
+	std::uint64_t getOutputBytes() const
+	{
+		return outputBytes_;
+	}
+
+private:
+	struct Block {
+		std::string deflated;
+		std::uint32_t adler;
+		std::size_t size;
+		bool ok;
+	};
+
+	void flushIfFull()
+	{
+		if (block_.size() >= blockSize)
+		{
+			submit(false);
+		}
+	}
+
+	// Starts compressing the current block. Waits for the oldest block first
+	// if threads_ are already busy.
+	void submit(bool last)
+	{
+		while (pending_.size() >= threads_)
+		{
+			collect();
+		}
+		std::string primer = window_;
+		window_.append(block_, block_.size() - std::min(block_.size(), windowSize), windowSize);
+		if (window_.size() > windowSize)
+		{
+			window_.erase(0, window_.size() - windowSize);
+		}
+		inputBytes_ += block_.size();
+
+		std::string text;
+		text.swap(block_);
+		block_.reserve(blockSize + 4096);
+		int level = level_;
+		pending_.push_back(std::async(std::launch::async, [text = std::move(text), primer = std::move(primer), last, level]() {
+			return deflateBlock(text, primer, last, level);
+		}));
+	}
+
+	//Waits for the oldest block and encodes it
+	void collect()
+	{
+		Block block = pending_.front().get();
+		pending_.pop_front();
+		ok_ = ok_ && block.ok;
+		adler_ = adler32_combine(adler_, block.adler, block.size);
+		encoder_.write(block.deflated.data(), block.deflated.size());
+		emit();
+	}
+
+	void emit()
+	{
+		out_.write(encoded_.data(), encoded_.size());
+		outputBytes_ += encoded_.size();
+		encoded_.clear();
+	}
+
+	// Raw deflate of text, primed with primer. All but the last block end
+	// with a sync flush so the next one starts on a byte boundary.
+	static Block deflateBlock(const std::string &text, const std::string &primer, bool last, int level)
+	{
+		Block block{ std::string(), (std::uint32_t)adler32(1, (const Bytef*)text.data(), text.size()), text.size(), false };
+		z_stream stream{};
+		if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			return block;
+		}
+		if (!primer.empty())
+		{
+			deflateSetDictionary(&stream, (const Bytef*)primer.data(), primer.size());
+		}
+		block.deflated.resize(deflateBound(&stream, text.size()) + 16);
+		stream.next_in = (Bytef*)text.data();
+		stream.avail_in = text.size();
+		stream.next_out = (Bytef*)&block.deflated[0];
+		stream.avail_out = block.deflated.size();
+		int result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+		block.ok = last ? result == Z_STREAM_END : result == Z_OK && stream.avail_in == 0;
+		block.deflated.resize(stream.total_out);
+		deflateEnd(&stream);
+		return block;
+	}
+
+	std::ostream &out_;
+	unsigned int threads_;
+	int level_;
+	std::string block_;
+	PostScriptWriter writer_;
+	std::string window_;
+	std::deque<std::future<Block>> pending_;
+	std::string encoded_;
+	Ascii85Encoder encoder_;
+	std::uint32_t adler_ = 1;
+	std::uint64_t inputBytes_ = 0;
+	std::uint64_t outputBytes_ = 0;
+	bool finished_ = false;
+	bool ok_ = true;
+};
+
+// Decodes what CompressedWriter wrote, from the decode line to the end
+// marker, into out. Returns false if text is not such a stream.
+inline bool decodeCompressed(const std::string &text, std::string &out)
+{
+	std::size_t start = text.find(" cvx exec\n");
+	std::size_t end = text.find("~>", start);
+	if (start == std::string::npos || end == std::string::npos)
+	{
+		return false;
+	}
+	std::string deflated;
+	std::uint32_t group = 0;
+	int count = 0;
+	for (std::size_t i = start + 10; i < end; ++i)
+	{
+		char c = text[i];
+		if (c == 'z' && count == 0)
+		{
+			deflated.append(4, '\0');
+		}
+		else if (c >= '!' && c <= 'u')
+		{
+			group = group * 85 + (c - '!');
+			if (++count == 5)
+			{
+				for (int shift = 24; shift >= 0; shift -= 8)
+				{
+					deflated += (char)(group >> shift);
+				}
+				group = 0;
+				count = 0;
+			}
+		}
+		else if (c != '\n' && c != '\r' && c != ' ' && c != '\t')
+		{
+			return false;
+		}
+	}
+	if (count == 1)
+	{
+		return false;
+	}
+	if (count > 1)
+	{
+		int bytes = count - 1;
+		for (; count < 5; ++count)
+		{
+			group = group * 85 + 84;
+		}
+		for (int i = 0; i < bytes; ++i)
+		{
+			deflated += (char)(group >> (24 - 8 * i));
+		}
+	}
+
+	z_stream stream{};
+	if (inflateInit(&stream) != Z_OK)
+	{
+		return false;
+	}
+	stream.next_in = (Bytef*)deflated.data();
+	stream.avail_in = deflated.size();
+	char buffer[1 << 16];
+	int result = Z_OK;
+	while (result == Z_OK)
+	{
+		stream.next_out = (Bytef*)buffer;
+		stream.avail_out = sizeof(buffer);
+		result = inflate(&stream, Z_NO_FLUSH);
+		out.append(buffer, sizeof(buffer) - stream.avail_out);
+	}
+	inflateEnd(&stream);
+	return result == Z_STREAM_END;
+}
+
+#endif // COMPRESSED_OUTPUT_AVAILABLE
+
+#endif // COMPRESSED_OUTPUT_HPP_INCLUDED
@@ -0,0 +1,583 @@
+#ifndef FLATTEN_HPP_INCLUDED
+#define FLATTEN_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cctype>
+#include <charconv>
+#include <algorithm>
+#include "postscript.hpp"
+#include "affine.hpp"
+#include "shape.hpp"
+#include "shape_value.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FLATTEN_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FLATTEN_SSE2 1
+#endif
+
+// Postscript with absolute coordinates and no changes to the CTM, for
+// plotters and cutters that do not keep a transformation stack.
+//
+// FlatteningWriter takes the output of the shapes through the writer
+// interface and runs the few operators they use: translate, rotate, scale,
+// concat, gsave and grestore change its own CTM, and the path operators
+// collect points. Points added under the same CTM are kept in user space
+// and transformed together, in a batch, when the CTM changes or the path
+// is painted, with SSE2 or AVX where the compiler has them. Arcs are cut
+// into line segments that stay within flatness of the curve on the page.
+//
+// Only long runs of points under one CTM make batches worth the name,
+// which in practice means arcs. Rectangles give runs of four, and polygons
+// translate and rotate between every two points, so theirs are flushed one
+// by one through the scalar tail. Batching those too would need a composed
+// CTM per point, and composing costs more than the multiply.
+//
+// Every painted path is written as moveto / lineto / closepath in page
+// coordinates followed by stroke. Strokes are 1 unit wide whatever the
+// scale, and paths that are never painted, like Spacer's, are dropped.
+// Given a FlatPathSink instead of a string, the writer hands it the points
+// of each painted path and the width the stroke has on the page.
+
+//Applies m to count points in place, x and y kept in separate arrays
+inline void transformPoints(const Affine &m, double *xs, double *ys, std::size_t count)
+{
+	std::size_t i = 0;
+#if defined(FLATTEN_AVX)
+	const __m256d a = _mm256_set1_pd(m.a);
+	const __m256d b = _mm256_set1_pd(m.b);
+	const __m256d c = _mm256_set1_pd(m.c);
+	const __m256d d = _mm256_set1_pd(m.d);
+	const __m256d tx = _mm256_set1_pd(m.tx);
+	const __m256d ty = _mm256_set1_pd(m.ty);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m256d x = _mm256_loadu_pd(xs + i);
+		__m256d y = _mm256_loadu_pd(ys + i);
+		_mm256_storeu_pd(xs + i, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(a, x), _mm256_mul_pd(c, y)), tx));
+		_mm256_storeu_pd(ys + i, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(b, x), _mm256_mul_pd(d, y)), ty));
+	}
+#elif defined(FLATTEN_SSE2)
+	const __m128d a = _mm_set1_pd(m.a);
+	const __m128d b = _mm_set1_pd(m.b);
+	const __m128d c = _mm_set1_pd(m.c);
+	const __m128d d = _mm_set1_pd(m.d);
+	const __m128d tx = _mm_set1_pd(m.tx);
+	const __m128d ty = _mm_set1_pd(m.ty);
+	for (; i + 2 <= count; i += 2)
+	{
+		__m128d x = _mm_loadu_pd(xs + i);
+		__m128d y = _mm_loadu_pd(ys + i);
+		_mm_storeu_pd(xs + i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(a, x), _mm_mul_pd(c, y)), tx));
+		_mm_storeu_pd(ys + i, _mm_add_pd(_mm_add_pd(_mm_mul_pd(b, x), _mm_mul_pd(d, y)), ty));
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		double x = xs[i];
+		double y = ys[i];
+		xs[i] = m.a * x + m.c * y + m.tx;
+		ys[i] = m.b * x + m.d * y + m.ty;
+	}
+}
+
+//Points first up to the next subpath's first of a flattened path
+struct FlatSubpath {
+	std::size_t first;
+	bool closed;
+};
+
+//Takes the paths a FlatteningWriter strokes, in page coordinates
+class FlatPathSink {
+public:
+	virtual ~FlatPathSink() {}
+
+	// The last subpath runs up to count. Subpaths of a single point, from
+	// a moveto nothing was drawn from, draw nothing.
+	virtual void strokePath(const double *xs, const double *ys, std::size_t count,
+		const FlatSubpath *subpaths, std::size_t subpathCount, double lineWidth) = 0;
+};
+
+// Writer with the PostScriptWriter interface that writes the flattened
+// form of what it is given to out, or hands it to a sink.
+class FlatteningWriter {
+public:
+	//Largest distance allowed between an arc and the segments replacing it
+	static constexpr double defaultFlatness = 0.05;
+
+	FlatteningWriter(std::string &out, double flatness = defaultFlatness) : writer_(out), flatness_(flatness) {}
+	FlatteningWriter(FlatPathSink &sink, double flatness = defaultFlatness)
+		: writer_(discarded_), sink_(&sink), flatness_(flatness) {}
+
+	void number(double value)
+	{
+		operands_.push_back(value);
+	}
+	void integer(long value)
+	{
+		operands_.push_back(value);
+	}
+
+	void op(const char *name)
+	{
+		switch (name[0])
+		{
+		case 'a':
+			if (std::strcmp(name, "arc") == 0 && take(5))
+			{
+				arc(args_[0], args_[1], args_[2], args_[3], args_[4]);
+				return;
+			}
+			break;
+		case 'c':
+			if (std::strcmp(name, "closepath") == 0)
+			{
+				closePath();
+				return;
+			}
+			if (std::strcmp(name, "concat") == 0 && take(6))
+			{
+				Affine m;
+				m.a = args_[0];
+				m.b = args_[1];
+				m.c = args_[2];
+				m.d = args_[3];
+				m.tx = args_[4];
+				m.ty = args_[5];
+				changeCtm(m);
+				return;
+			}
+			break;
+		case 'g':
+			if (std::strcmp(name, "gsave") == 0)
+			{
+				flushBatch();
+				saved_.push_back(State{ ctm_, currentX_, currentY_, hasCurrent_, xs_, ys_, subpaths_ });
+				return;
+			}
+			if (std::strcmp(name, "grestore") == 0)
+			{
+				if (!saved_.empty())
+				{
+					State &state = saved_.back();
+					ctm_ = state.ctm;
+					currentX_ = state.currentX;
+					currentY_ = state.currentY;
+					hasCurrent_ = state.hasCurrent;
+					xs_.swap(state.xs);
+					ys_.swap(state.ys);
+					subpaths_.swap(state.subpaths);
+					batchStart_ = xs_.size();
+					saved_.pop_back();
+				}
+				return;
+			}
+			break;
+		case 'l':
+			if (std::strcmp(name, "lineto") == 0 && take(2))
+			{
+				lineTo(args_[0], args_[1]);
+				return;
+			}
+			break;
+		case 'm':
+			if (std::strcmp(name, "moveto") == 0 && take(2))
+			{
+				moveTo(args_[0], args_[1]);
+				return;
+			}
+			break;
+		case 'n':
+			if (std::strcmp(name, "newpath") == 0)
+			{
+				clearPath();
+				return;
+			}
+			break;
+		case 'r':
+			if (std::strcmp(name, "rlineto") == 0 && take(2))
+			{
+				if (hasCurrent_)
+				{
+					lineTo(currentX_ + args_[0], currentY_ + args_[1]);
+				}
+				return;
+			}
+			if (std::strcmp(name, "rmoveto") == 0 && take(2))
+			{
+				if (hasCurrent_)
+				{
+					moveTo(currentX_ + args_[0], currentY_ + args_[1]);
+				}
+				return;
+			}
+			if (std::strcmp(name, "rotate") == 0 && take(1))
+			{
+				changeCtm(Affine().rotated(args_[0]));
+				return;
+			}
+			break;
+		case 's':
+			if (std::strcmp(name, "stroke") == 0)
+			{
+				stroke();
+				return;
+			}
+			if (std::strcmp(name, "scale") == 0 && take(2))
+			{
+				changeCtm(Affine().scaled(args_[0], args_[1]));
+				return;
+			}
+			if (std::strcmp(name, "showpage") == 0)
+			{
+				writer_.op("showpage");
+				writer_.endLine();
+				return;
+			}
+			break;
+		case 't':
+			if (std::strcmp(name, "translate") == 0 && take(2))
+			{
+				changeCtm(Affine().translated(args_[0], args_[1]));
+				return;
+			}
+			break;
+		case '[':
+		case ']':
+			return; // the operands of concat are just left on the stack
+		}
+		// Anything else does not draw
+		++unknown_;
+		operands_.clear();
+	}
+
+	void endLine()
+	{
+	}
+
+	//Already generated postscript, run token by token
+	void raw(const char *text, std::size_t size)
+	{
+		const char *end = text + size;
+		const char *p = text;
+		char name[64];
+		while (p < end)
+		{
+			while (p < end && std::isspace((unsigned char)*p))
+			{
+				++p;
+			}
+			const char *start = p;
+			while (p < end && !std::isspace((unsigned char)*p))
+			{
+				++p;
+			}
+			if (start == p)
+			{
+				break;
+			}
+			double value;
+			auto parsed = std::from_chars(start, p, value);
+			if (parsed.ec == std::errc() && parsed.ptr == p)
+			{
+				number(value);
+			}
+			else if ((std::size_t)(p - start) < sizeof(name))
+			{
+				std::memcpy(name, start, p - start);
+				name[p - start] = '\0';
+				op(name);
+			}
+			else
+			{
+				++unknown_;
+				operands_.clear();
+			}
+		}
+	}
+	void raw(const std::string &text)
+	{
+		raw(text.data(), text.size());
+	}
+
+	//Box around every point written, empty before the first
+	Box getBounds() const
+	{
+		return bounds_;
+	}
+
+	std::size_t getPointCount() const
+	{
+		return points_;
+	}
+
+	std::size_t getPathCount() const
+	{
+		return paths_;
+	}
+
+	//Operators that were not understood, and what they did ignored
+	std::size_t getUnknownCount() const
+	{
+		return unknown_;
+	}
+
+private:
+	typedef FlatSubpath Subpath;
+
+	struct State {
+		Affine ctm;
+		double currentX;
+		double currentY;
+		bool hasCurrent;
+		std::vector<double> xs;
+		std::vector<double> ys;
+		std::vector<Subpath> subpaths;
+	};
+
+	//Moves the last n operands into args_, false if there are not enough
+	bool take(std::size_t n)
+	{
+		if (operands_.size() < n)
+		{
+			operands_.clear();
+			return false;
+		}
+		std::copy(operands_.end() - n, operands_.end(), args_);
+		operands_.resize(operands_.size() - n);
+		return true;
+	}
+
+	// Points from batchStart_ on are still in user space. The current
+	// point is kept in user space too, so a change to the CTM moves it by
+	// the inverse of the change. Flushes the batch, see the top of the file.
+	void changeCtm(const Affine &change)
+	{
+		flushBatch();
+		ctm_ = ctm_ * change;
+		if (hasCurrent_)
+		{
+			change.inverse().apply(currentX_, currentY_, currentX_, currentY_);
+		}
+	}
+
+	void flushBatch()
+	{
+		std::size_t count = xs_.size() - batchStart_;
+		if (count > 0)
+		{
+			transformPoints(ctm_, xs_.data() + batchStart_, ys_.data() + batchStart_, count);
+		}
+		batchStart_ = xs_.size();
+	}
+
+	void addPoint(double x, double y)
+	{
+		xs_.push_back(x);
+		ys_.push_back(y);
+		currentX_ = x;
+		currentY_ = y;
+		hasCurrent_ = true;
+	}
+
+	void moveTo(double x, double y)
+	{
+		// A moveto right after another replaces it
+		if (!subpaths_.empty() && !subpaths_.back().closed && subpaths_.back().first == xs_.size() - 1)
+		{
+			xs_.pop_back();
+			ys_.pop_back();
+			batchStart_ = std::min(batchStart_, xs_.size());
+		}
+		else
+		{
+			subpaths_.push_back(Subpath{ xs_.size(), false });
+		}
+		addPoint(x, y);
+	}
+
+	void lineTo(double x, double y)
+	{
+		if (!hasCurrent_)
+		{
+			return;
+		}
+		if (subpaths_.empty() || subpaths_.back().closed)
+		{
+			// Drawing on after closepath starts from the closed subpath's start
+			subpaths_.push_back(Subpath{ xs_.size(), false });
+			addPoint(currentX_, currentY_);
+		}
+		addPoint(x, y);
+	}
+
+	void closePath()
+	{
+		if (subpaths_.empty() || subpaths_.back().closed)
+		{
+			return;
+		}
+		subpaths_.back().closed = true;
+		flushBatch();
+		std::size_t first = subpaths_.back().first;
+		ctm_.inverse().apply(xs_[first], ys_[first], currentX_, currentY_);
+	}
+
+	// Arc around x, y as postscript draws it, counterclockwise, joined by
+	// a line to the current point if there is one
+	void arc(double x, double y, double r, double startAngle, double endAngle)
+	{
+		const double pi = 3.141592653589793238;
+		while (endAngle < startAngle)
+		{
+			endAngle += 360;
+		}
+		double sweep = (endAngle - startAngle) * pi / 180;
+		double start = startAngle * pi / 180;
+
+		// Largest length a unit vector gets on the page, bounds the radius there
+		double stretch = std::sqrt(std::max(ctm_.a * ctm_.a + ctm_.b * ctm_.b, ctm_.c * ctm_.c + ctm_.d * ctm_.d));
+		double pageRadius = std::fabs(r) * stretch;
+		unsigned int segments = 1;
+		if (pageRadius > flatness_)
+		{
+			double step = 2 * std::acos(1 - flatness_ / pageRadius);
+			segments = (unsigned int)std::min(4096.0, std::ceil(sweep / step));
+		}
+		segments = std::max(segments, 4u);
+
+		double startX = x + r * std::cos(start);
+		double startY = y + r * std::sin(start);
+		if (hasCurrent_)
+		{
+			lineTo(startX, startY);
+		}
+		else
+		{
+			moveTo(startX, startY);
+		}
+		for (unsigned int i = 1; i <= segments; ++i)
+		{
+			double angle = start + sweep * i / segments;
+			addPoint(x + r * std::cos(angle), y + r * std::sin(angle));
+		}
+	}
+
+	void addBounds(double x, double y)
+	{
+		Box point{ x, y, x, y };
+		if (points_++ == 0)
+		{
+			bounds_ = point;
+		}
+		else
+		{
+			bounds_.expand(point);
+		}
+	}
+
+	void clearPath()
+	{
+		xs_.clear();
+		ys_.clear();
+		subpaths_.clear();
+		batchStart_ = 0;
+		hasCurrent_ = false;
+	}
+
+	void stroke()
+	{
+		flushBatch();
+		if (sink_ != nullptr)
+		{
+			if (!xs_.empty())
+			{
+				// How wide a stroke 1 unit wide comes out, on average
+				double width = std::sqrt(std::fabs(ctm_.a * ctm_.d - ctm_.b * ctm_.c));
+				sink_->strokePath(xs_.data(), ys_.data(), xs_.size(), subpaths_.data(), subpaths_.size(), width);
+				++paths_;
+				for (std::size_t i = 0; i < xs_.size(); ++i)
+				{
+					addBounds(xs_[i], ys_[i]);
+				}
+			}
+			clearPath();
+			return;
+		}
+		bool started = false;
+		for (std::size_t s = 0; s < subpaths_.size(); ++s)
+		{
+			std::size_t first = subpaths_[s].first;
+			std::size_t last = s + 1 < subpaths_.size() ? subpaths_[s + 1].first : xs_.size();
+			if (last - first < 2)
+			{
+				continue; // a lone moveto draws nothing
+			}
+			if (!started)
+			{
+				writer_.op("newpath");
+				writer_.endLine();
+				started = true;
+			}
+			for (std::size_t i = first; i < last; ++i)
+			{
+				writer_.number(xs_[i]);
+				writer_.number(ys_[i]);
+				writer_.op(i == first ? "moveto" : "lineto");
+				writer_.endLine();
+				addBounds(xs_[i], ys_[i]);
+			}
+			if (subpaths_[s].closed)
+			{
+				writer_.op("closepath");
+				writer_.endLine();
+			}
+		}
+		if (started)
+		{
+			writer_.op("stroke");
+			writer_.endLine();
+			++paths_;
+		}
+		clearPath();
+	}
+
+	std::string discarded_;
+	PostScriptWriter writer_;
+	FlatPathSink *sink_ = nullptr;
+	double flatness_;
+	std::vector<double> operands_;
+	double args_[6];
+	Affine ctm_;
+	double currentX_ = 0;
+	double currentY_ = 0;
+	bool hasCurrent_ = false;
+	std::vector<double> xs_;
+	std::vector<double> ys_;
+	std::size_t batchStart_ = 0;
+	std::vector<Subpath> subpaths_;
+	std::vector<State> saved_;
+	Box bounds_{ 0, 0, 0, 0 };
+	std::size_t points_ = 0;
+	std::size_t paths_ = 0;
+	std::size_t unknown_ = 0;
+};
+
+//Appends the flattened postscript of shape to out
+inline void appendFlattened(const ShapeValue &shape, std::string &out, double flatness = FlatteningWriter::defaultFlatness)
+{
+	FlatteningWriter writer(out, flatness);
+	shape.render(writer);
+}
+
+inline void appendFlattened(Shape &shape, std::string &out, double flatness = FlatteningWriter::defaultFlatness)
+{
+	appendFlattened(ShapeValue::fromShape(shape), out, flatness);
+}
+
+#endif // FLATTEN_HPP_INCLUDED
@@ -0,0 +1,268 @@
+#ifndef LOD_HPP_INCLUDED
+#define LOD_HPP_INCLUDED
+
+#include <string>
+#include <cmath>
+#include <variant>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "shape.hpp"
+#include "shape_value.hpp"
+#include "affine.hpp"
+#include "viewport.hpp"
+
+// Level of detail: shapes too small on the page to show their detail are
+// written as cheaper stand-ins.
+//
+// The size of a leaf on the device is its width and height taken through
+// the scales and rotations above it, at the device resolution. Layouts
+// only translate, so they do not change it. Then, from small to large:
+//   below dropPixels  nothing is drawn
+//   below dotPixels   a one pixel rectfill
+//   Polygon           an arc, once its sides are within tolerancePixels
+//                     of its circumscribed circle
+//   Custom            its outline square, below detailPixels
+// Stand-ins leave the CTM as the shape would, so nothing after them moves.
+// Text from shapes that can not be looked into is written as is.
+//
+// The stats say what was replaced and what that saved: the bytes a stand-in
+// avoided are the leaf's full postscript less the stand-in's, both counted
+// by ByteCountingWriter without being written.
+
+struct LodOptions {
+	double dpi = 300;
+	double dropPixels = 0.5;
+	double dotPixels = 2;
+	double detailPixels = 24;
+	double tolerancePixels = 0.5;
+};
+
+//What a simplified render replaced, and what that saved
+struct LodStats {
+	std::size_t leaves = 0;
+	std::size_t dropped = 0;
+	std::size_t dots = 0;
+	std::size_t arcs = 0;
+	std::size_t squares = 0;
+	std::size_t bytesAvoided = 0;
+	// Only appendLod knows these, renderLod leaves them alone
+	std::size_t bytes = 0;
+	double milliseconds = 0;
+
+	std::size_t simplified() const
+	{
+		return dropped + dots + arcs + squares;
+	}
+};
+
+// Counts the bytes PostScriptWriter would write, without formatting numbers
+class ByteCountingWriter {
+public:
+	void number(double value)
+	{
+		separate();
+		double scaled = std::fabs(value) * 1e6;
+		if (!(scaled < 4e12))
+		{
+			bytes_ += 16; // rare, a guess is good enough
+			return;
+		}
+		// At least "0." and six decimals, one more digit per power of ten
+		std::size_t count = 8;
+		for (double limit = 1e7 - 0.5; scaled >= limit && count < 21; limit *= 10)
+		{
+			++count;
+		}
+		bytes_ += count + (std::signbit(value) ? 1 : 0);
+	}
+
+	void integer(long value)
+	{
+		separate();
+		unsigned long magnitude = value < 0 ? 0 - (unsigned long)value : (unsigned long)value;
+		std::size_t count = value < 0 ? 2 : 1;
+		while (magnitude >= 10)
+		{
+			magnitude /= 10;
+			++count;
+		}
+		bytes_ += count;
+	}
+
+	void op(const char *name)
+	{
+		separate();
+		bytes_ += std::strlen(name);
+	}
+
+	void endLine()
+	{
+		++bytes_;
+		lineStart_ = true;
+	}
+
+	void raw(const char *text, std::size_t size)
+	{
+		if (size == 0)
+		{
+			return;
+		}
+		bytes_ += size;
+		lineStart_ = text[size - 1] == '\n';
+	}
+	void raw(const std::string &text)
+	{
+		raw(text.data(), text.size());
+	}
+
+	std::size_t bytes() const
+	{
+		return bytes_;
+	}
+
+private:
+	void separate()
+	{
+		if (!lineStart_)
+		{
+			++bytes_;
+		}
+		lineStart_ = false;
+	}
+
+	std::size_t bytes_ = 0;
+	bool lineStart_ = true;
+};
+
+// Writes shape at the level of detail options allow. m is the
+// transformation above shape, only its scale and rotation are used.
+template <class Writer>
+void renderLod(const ShapeValue &shape, Writer &w, const LodOptions &options, LodStats &stats,
+	const Affine &m = Affine())
+{
+	const ShapeValue::Node &node = shape.node;
+	bool leaf = std::holds_alternative<CircleNode>(node) || std::holds_alternative<PolygonNode>(node) ||
+		std::holds_alternative<RectangleNode>(node) || std::holds_alternative<CustomNode>(node);
+	if (leaf)
+	{
+		++stats.leaves;
+		double perUnit = options.dpi / 72;
+		double pixels = std::max(std::fabs(m.a) * shape.width + std::fabs(m.c) * shape.height,
+			std::fabs(m.b) * shape.width + std::fabs(m.d) * shape.height) * perUnit;
+		// Polygons may leave the CTM turned, their stand-ins must too
+		Affine change;
+		const PolygonNode *polygon = std::get_if<PolygonNode>(&node);
+		if (polygon != nullptr)
+		{
+			change = polygonTransformChange(polygon->numSides, polygon->sideLength, shape.height);
+		}
+
+		// Writes the stand-in and counts what it saved
+		auto replace = [&](std::size_t &count, auto emit) {
+			++count;
+			ByteCountingWriter full;
+			ByteCountingWriter standIn;
+			shape.render(full);
+			emit(standIn);
+			if (full.bytes() > standIn.bytes())
+			{
+				stats.bytesAvoided += full.bytes() - standIn.bytes();
+			}
+			emit(w);
+		};
+
+		if (pixels < options.dropPixels)
+		{
+			replace(stats.dropped, [&](auto &out) {
+				emitTransform(out, change);
+			});
+			return;
+		}
+		if (pixels < options.dotPixels)
+		{
+			double stretch = std::sqrt(std::max(m.a * m.a + m.b * m.b, m.c * m.c + m.d * m.d));
+			double pixel = 1 / (perUnit * stretch);
+			replace(stats.dots, [&](auto &out) {
+				out.number(-pixel / 2);
+				out.number(-pixel / 2);
+				out.number(pixel);
+				out.number(pixel);
+				out.op("rectfill");
+				out.endLine();
+				emitTransform(out, change);
+			});
+			return;
+		}
+		if (polygon != nullptr && polygon->numSides > 6)
+		{
+			const double pi = 3.141592653589793238;
+			double radius = polygon->sideLength / (2 * std::sin(pi / polygon->numSides));
+			double apothem = polygon->sideLength / (2 * std::tan(pi / polygon->numSides));
+			double stretch = std::sqrt(std::max(m.a * m.a + m.b * m.b, m.c * m.c + m.d * m.d));
+			if ((radius - apothem) * stretch * perUnit < options.tolerancePixels)
+			{
+				replace(stats.arcs, [&](auto &out) {
+					out.op("newpath");
+					out.endLine();
+					out.integer(0);
+					out.number(-shape.height / 2 + apothem);
+					out.number(radius);
+					out.integer(0);
+					out.integer(360);
+					out.op("arc");
+					out.op("closepath");
+					out.endLine();
+					out.op("stroke");
+					out.endLine();
+					emitTransform(out, change);
+				});
+				return;
+			}
+		}
+		if (std::holds_alternative<CustomNode>(node) && pixels < options.detailPixels)
+		{
+			replace(stats.squares, [&](auto &out) {
+				emitSquare(out, shape.width);
+			});
+			return;
+		}
+		shape.render(w);
+		return;
+	}
+
+	Affine childMatrix = m;
+	if (const ScaledNode *n = std::get_if<ScaledNode>(&node))
+	{
+		childMatrix = m.scaled(n->fx, n->fy);
+	}
+	else if (const RotatedNode *n = std::get_if<RotatedNode>(&node))
+	{
+		childMatrix = m.rotated(n->angle);
+	}
+	else if (const TransformedNode *n = std::get_if<TransformedNode>(&node))
+	{
+		childMatrix = m * n->matrix;
+	}
+	auto renderChild = [&](const ShapeValue &child) {
+		renderLod(child, w, options, stats, childMatrix);
+	};
+	std::visit(ShapeValueRenderer<Writer, decltype(renderChild)>{ w, shape, renderChild }, node);
+}
+
+inline void appendLod(const ShapeValue &shape, std::string &out, const LodOptions &options, LodStats &stats)
+{
+	auto start = std::chrono::steady_clock::now();
+	std::size_t before = out.size();
+	PostScriptWriter writer(out);
+	renderLod(shape, writer, options, stats);
+	stats.bytes += out.size() - before;
+	stats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline void appendLod(Shape &shape, std::string &out, const LodOptions &options, LodStats &stats)
+{
+	appendLod(ShapeValue::fromShape(shape), out, options, stats);
+}
+
+#endif // LOD_HPP_INCLUDED
@@ -4,8 +4,35 @@
 
 #include <iostream>
 #include <fstream>      // std::ofstream
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
 #include <vector>
 #include "shape.hpp"
+#include "shape_value.hpp"
+#include "mutable_composite.hpp"
+#include "spatial_index.hpp"
+#include "viewport.hpp"
+#include "scene_file.hpp"
+#include "scene_parser.hpp"
+#include "render_daemon.hpp"
+#include "batch_render.hpp"
+#include "sharded_render.hpp"
+#include "render_cache.hpp"
+#include "rope.hpp"
+#include "compressed_output.hpp"
+#include "binary_postscript.hpp"
+#include "flatten.hpp"
+#include "lod.hpp"
+#include "stroke_batch.hpp"
+#include "raster.hpp"
+#include "shape_builder.hpp"
+#include "streaming_composite.hpp"
+#include "paginate.hpp"
+#include "pull_render.hpp"
+#include "persistent_shape.hpp"
+#include "render_control.hpp"
+#include <type_traits>
 
 int main() {
 	////////////////////////////////CIRCLE TESTS
@@ -383,6 +410,2237 @@ int main() {
 	
 	ofs.close();
 
+	////////////////////////////////SHAPEVALUE TESTS
+	std::cout << "\nShapeValue Tests:\n";
+	bool allValuePassed = true;
+
+	// **** Converted shapes give the same postscript and size ****
+	ShapeValue customValue = ShapeValue::fromShape(vertCustomShape);
+	if (customValue.generatePostScript() != customVertical ||
+		customValue.height != vertCustomShape.height || customValue.width != vertCustomShape.width)
+	{
+		std::cout << "ShapeValue from MultiVertical does not match" << std::endl;
+		allValuePassed = false;
+	}
+	ShapeValue horValue = ShapeValue::fromShape(horTest2Shape);
+	if (horValue.generatePostScript() != horString || horValue.toShape()->generatePostScript() != horString)
+	{
+		std::cout << "ShapeValue from MultiHorizontal does not match" << std::endl;
+		allValuePassed = false;
+	}
+	if (ShapeValue::fromShape(lay2).generatePostScript() != layString ||
+		ShapeValue::fromShape(rot).toShape()->generatePostScript() != rotString)
+	{
+		std::cout << "ShapeValue from MultiLayered or Rotated does not match" << std::endl;
+		allValuePassed = false;
+	}
+
+	// **** Shapes built as values match the same polymorphic shapes ****
+	std::vector<ShapeValue> rowValues;
+	rowValues.push_back(ShapeValue::circle(40));
+	rowValues.push_back(ShapeValue::square(30));
+	rowValues.push_back(ShapeValue::triangle(15));
+	rowValues.push_back(ShapeValue::scaled(ShapeValue::circle(40), 0.7, 0.7));
+	rowValues.push_back(ShapeValue::rotated(ShapeValue::custom(50), 90));
+	rowValues.push_back(ShapeValue::spacer(50, 50));
+	ShapeValue rowValue = ShapeValue::vertical(std::move(rowValues));
+
+	std::vector<unique_ptr<Shape>> rowShapes;
+	Circle rowCirc(40);
+	Custom rowCus(50);
+	rowShapes.push_back(make_unique<Circle>(40));
+	rowShapes.push_back(make_unique<Square>(30));
+	rowShapes.push_back(make_unique<Triangle>(15));
+	rowShapes.push_back(make_unique<Scaled>(rowCirc, 0.7, 0.7));
+	rowShapes.push_back(make_unique<Rotated>(rowCus, 90));
+	rowShapes.push_back(make_unique<Spacer>(50, 50));
+	MultiVertical rowShape(std::move(rowShapes));
+
+	if (rowValue.generatePostScript() != rowShape.generatePostScript() ||
+		rowValue.height != rowShape.height || rowValue.width != rowShape.width)
+	{
+		std::cout << "ShapeValue built directly does not match shapes" << std::endl;
+		allValuePassed = false;
+	}
+	if (allValuePassed) {
+		std::cout << "All ShapeValue tests passed.\n";
+	}
+
+	////////////////////////////////MUTABLE COMPOSITE TESTS
+	std::cout << "\nMutable Composite Tests:\n";
+	bool allMutablePassed = true;
+
+	// **** Same output as MultiVertical ****
+	std::vector<unique_ptr<Shape>> mutVec;
+	std::vector<unique_ptr<Shape>> fixedVec;
+	for (int i = 1; i <= 5; ++i) {
+		mutVec.push_back(make_unique<Circle>(10 * i));
+		fixedVec.push_back(make_unique<Circle>(10 * i));
+	}
+	MutableVertical mutVert(std::move(mutVec));
+	MultiVertical fixedVert(std::move(fixedVec));
+	if (mutVert.generatePostScript() != fixedVert.generatePostScript() ||
+		mutVert.height != fixedVert.height || mutVert.width != fixedVert.width)
+	{
+		std::cout << "MutableVertical does not match MultiVertical" << std::endl;
+		allMutablePassed = false;
+	}
+
+	// **** Insert, erase and replace keep the extents ****
+	mutVert.insert(2, make_unique<Rectangle>(300, 5));
+	mutVert.erase(0);
+	mutVert.replace(3, make_unique<Square>(30));
+	mutVert.append(make_unique<Spacer>(1, 1));
+	// Children are now Circle(20), Rectangle(300, 5), Circle(30), Square(30), Circle(50), Spacer(1, 1)
+	double mutHeight = 40 + 5 + 60 + mutVert.getShape(3)->height + 100 + 1 + 6;
+	if (mutVert.getSize() != 6 || mutVert.width != 300 || std::fabs(mutVert.height - mutHeight) > 1e-9 ||
+		mutVert.offset(2) != 40 + 1 + 5 + 1 || mutVert.getShape(1)->width != 300)
+	{
+		std::cout << "MutableVertical has incorrect children or extents after edits" << std::endl;
+		allMutablePassed = false;
+	}
+
+	// **** Nested mutable composites update their ancestors ****
+	MutableVertical outer;
+	outer.append(make_unique<MutableHorizontal>());
+	outer.append(make_unique<Circle>(5));
+	MutableHorizontal *inner = dynamic_cast<MutableHorizontal*>(outer.getShape(0));
+	inner->append(make_unique<Rectangle>(10, 50));
+	inner->append(make_unique<Rectangle>(20, 30));
+	double outerHeight = outer.height;
+	double outerWidth = outer.width;
+	inner->getShape(0)->height = 70;
+	inner->childResized(0);
+	if (outerHeight != 50 + 1 + 10 + 1 || outerWidth != 32 ||
+		outer.height != 70 + 1 + 10 + 1 || outer.offset(1) != 71)
+	{
+		std::cout << "Nested mutable composite did not update its parent" << std::endl;
+		allMutablePassed = false;
+	}
+
+	// **** Positions past the last child change nothing ****
+	std::string beforeBadEdits = mutVert.generatePostScript();
+	unique_ptr<Shape> notReplaced = make_unique<Circle>(7);
+	Shape *notReplacedShape = notReplaced.get();
+	mutVert.childResized(6);
+	if (mutVert.erase(6) != nullptr || mutVert.getShape(6) != nullptr || mutVert.getShape(-1) != nullptr ||
+		mutVert.replace(100, std::move(notReplaced)).get() != notReplacedShape ||
+		mutVert.getSize() != 6 || mutVert.generatePostScript() != beforeBadEdits)
+	{
+		std::cout << "MutableVertical accepted a position past its last child" << std::endl;
+		allMutablePassed = false;
+	}
+
+	// **** Null shapes are not taken in ****
+	std::vector<unique_ptr<Shape>> withNulls;
+	withNulls.push_back(nullptr);
+	withNulls.push_back(make_unique<Circle>(3));
+	withNulls.push_back(nullptr);
+	MutableHorizontal nullRow(std::move(withNulls));
+	nullRow.insert(0, nullptr);
+	nullRow.append(nullptr);
+	std::vector<unique_ptr<Shape>> withoutNulls;
+	withoutNulls.push_back(make_unique<Circle>(3));
+	MultiHorizontal withoutNullsRow(std::move(withoutNulls));
+	if (nullRow.replace(0, nullptr) != nullptr || nullRow.getSize() != 1 ||
+		nullRow.generatePostScript() != withoutNullsRow.generatePostScript() ||
+		mutVert.replace(0, nullptr) != nullptr || mutVert.generatePostScript() != beforeBadEdits)
+	{
+		std::cout << "Mutable composite took in a null shape" << std::endl;
+		allMutablePassed = false;
+	}
+
+	if (allMutablePassed) {
+		std::cout << "All mutable composite tests passed.\n";
+	}
+
+	////////////////////////////////SPATIAL INDEX TESTS
+	std::cout << "\nSpatial Index Tests:\n";
+	bool allIndexPassed = true;
+
+	// Row of three rectangles, 10 wide and 1 apart, centered at x = 5, 16, 27
+	std::vector<unique_ptr<Shape>> indexRow;
+	indexRow.push_back(make_unique<Rectangle>(10, 10));
+	indexRow.push_back(make_unique<Rectangle>(10, 20));
+	indexRow.push_back(make_unique<Rectangle>(10, 10));
+	Shape *middle = indexRow[1].get();
+	Shape *last = indexRow[2].get();
+	MultiHorizontal indexShape(std::move(indexRow));
+	SpatialIndex index(indexShape);
+
+	std::vector<Shape*> hit = index.at(16, 20);
+	if (index.getLeaves().size() != 3 || hit.size() != 1 || hit[0] != middle || !index.at(10.5, 20).empty())
+	{
+		std::cout << "Point query returned the wrong shapes" << std::endl;
+		allIndexPassed = false;
+	}
+	if (index.intersecting(Box{ 15, 0, 40, 40 }).size() != 2 || index.intersecting(Box{ 100, 100, 200, 200 }).size() != 0)
+	{
+		std::cout << "Rectangle query returned the wrong shapes" << std::endl;
+		allIndexPassed = false;
+	}
+	std::vector<Shape*> closest = index.nearest(40, 20, 2);
+	if (closest.size() != 2 || closest[0] != last || closest[1] != middle)
+	{
+		std::cout << "Nearest query returned the wrong shapes" << std::endl;
+		allIndexPassed = false;
+	}
+
+	// Rotated by 90, a 10 x 20 rectangle lies along the x axis
+	Rectangle tall(10, 20);
+	Rotated turned(tall, 90);
+	SpatialIndex turnedIndex(turned);
+	if (turnedIndex.at(9, 0).size() != 1 || turnedIndex.at(0, 9).size() != 0)
+	{
+		std::cout << "Rotated shape has the wrong box" << std::endl;
+		allIndexPassed = false;
+	}
+
+	if (allIndexPassed) {
+		std::cout << "All spatial index tests passed.\n";
+	}
+
+	////////////////////////////////VIEWPORT TESTS
+	std::cout << "\nViewport Tests:\n";
+	bool allViewportPassed = true;
+
+	// Two rows of two 10 x 10 rectangles. The first row leaves the current
+	// point 22 to the right, so the second row starts at x = 27 + 22.
+	std::vector<unique_ptr<Shape>> viewRows;
+	Shape *secondRowFirst = nullptr;
+	for (int r = 0; r < 2; ++r) {
+		std::vector<unique_ptr<Shape>> viewRow;
+		viewRow.push_back(make_unique<Rectangle>(10, 10));
+		viewRow.push_back(make_unique<Rectangle>(10, 10));
+		secondRowFirst = viewRow[0].get();
+		viewRows.push_back(make_unique<MultiHorizontal>(std::move(viewRow)));
+	}
+	MultiVertical viewShape(std::move(viewRows));
+	SpatialIndex viewIndex(viewShape);
+	Rectangle viewRect(10, 10);
+
+	std::vector<Shape*> viewHit = viewIndex.at(49, 26);
+	std::string viewClipped = renderClipped(viewIndex, Box{ 48, 25, 50, 27 });
+	std::string viewExpected = "49.000000 26.000000 translate\n" + viewRect.generatePostScript();
+	if (viewHit.size() != 1 || viewHit[0] != secondRowFirst ||
+		viewClipped.compare(0, viewExpected.size(), viewExpected) != 0)
+	{
+		std::cout << "Clipped render did not draw the second row where the full output does" << std::endl;
+		allViewportPassed = false;
+	}
+	if (renderClipped(viewIndex, Box{ -100, -100, -50, -50 }).find("newpath") != std::string::npos)
+	{
+		std::cout << "Clipped render outside the shape drew something" << std::endl;
+		allViewportPassed = false;
+	}
+
+	// The shape covers 43 x 21, so 12 x 12 tiles make 4 x 2 pages.
+	// Rectangles on a tile edge are drawn on both tiles.
+	std::vector<std::string> viewTiles = renderTiles(viewIndex, 12, 12, 2);
+	std::size_t tileShapes = 0;
+	for (const std::string &tile : viewTiles) {
+		for (std::size_t at = tile.find("newpath"); at != std::string::npos; at = tile.find("newpath", at + 1)) {
+			++tileShapes;
+		}
+	}
+	std::vector<std::string> oneTile = renderTiles(viewIndex, 100, 100, 2);
+	if (viewTiles.size() != 8 || tileShapes < 4 || oneTile.size() != 1 ||
+		oneTile[0].find("newpath") == std::string::npos)
+	{
+		std::cout << "Tiles do not cover the shape once" << std::endl;
+		allViewportPassed = false;
+	}
+
+	if (allViewportPassed) {
+		std::cout << "All viewport tests passed.\n";
+	}
+
+	////////////////////////////////SCENE FILE TESTS
+	std::cout << "\nScene File Tests:\n";
+	bool allSceneFilePassed = true;
+
+	// **** Written scenes render the same from the mapped file ****
+	std::vector<ShapeValue> sceneParts;
+	sceneParts.push_back(rowValue);
+	sceneParts.push_back(ShapeValue::fromShape(vertCustomShape));
+	sceneParts.push_back(ShapeValue::fromShape(lay2));
+	sceneParts.push_back(ShapeValue::fromShape(s)); // Scaled becomes text
+	ShapeValue sceneValue = ShapeValue::horizontal(std::move(sceneParts));
+	std::string sceneString = sceneValue.generatePostScript();
+
+	SceneFile scene;
+	if (!writeScene(sceneValue, "test_scene.bin") || !scene.open("test_scene.bin"))
+	{
+		std::cout << "Scene file could not be written or opened: " << scene.getError() << std::endl;
+		allSceneFilePassed = false;
+	}
+	else if (scene.generatePostScript() != sceneString || scene.getWidth(0) != sceneValue.width ||
+		scene.toShapeValue(0).generatePostScript() != sceneString)
+	{
+		std::cout << "Scene file does not render the same as the shape" << std::endl;
+		allSceneFilePassed = false;
+	}
+	scene.close();
+
+	// **** Files that are not scenes are refused ****
+	std::ofstream badScene("test_scene.bin", std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+	badScene << "%!\nThis is postscript, not a scene file. It is long enough to hold a header though.\n";
+	badScene.close();
+	if (scene.open("test_scene.bin") || scene.getError().empty())
+	{
+		std::cout << "Scene file accepted a file that is not a scene" << std::endl;
+		allSceneFilePassed = false;
+	}
+
+	// **** Polygons with too few or too many sides are refused ****
+	for (int sides : { 2, 1000000000 })
+	{
+		std::vector<ShapeValue> badPolygon;
+		badPolygon.push_back(ShapeValue(PolygonNode{ sides, 10 }, 10, 10));
+		if (writeScene(ShapeValue::horizontal(std::move(badPolygon)), "test_scene.bin") && scene.open("test_scene.bin") &&
+			(scene.generatePostScript().find("lineto") != std::string::npos || scene.getError().empty()))
+		{
+			std::cout << "Scene file rendered a polygon with " << sides << " sides" << std::endl;
+			allSceneFilePassed = false;
+		}
+		scene.close();
+	}
+
+	// **** Scenes nested deeper than maxSceneDepth are refused ****
+	ShapeValue deepScene = ShapeValue::circle(1);
+	for (unsigned int i = 0; i < maxSceneDepth + 10; ++i)
+	{
+		deepScene = ShapeValue::rotated(std::move(deepScene), 90);
+	}
+	if (!writeScene(deepScene, "test_scene.bin") || !scene.open("test_scene.bin"))
+	{
+		std::cout << "Deep scene file could not be written or opened: " << scene.getError() << std::endl;
+		allSceneFilePassed = false;
+	}
+	else if (scene.generatePostScript().find("arc") != std::string::npos || scene.getError().empty() ||
+		scene.toShapeValue(0).generatePostScript().find("arc") != std::string::npos)
+	{
+		std::cout << "Scene file rendered a scene nested past maxSceneDepth" << std::endl;
+		allSceneFilePassed = false;
+	}
+	scene.close();
+
+	// Writes a scene file by hand, for tables writeScene would never write
+	auto writeRawScene = [](const std::vector<SceneNode> &nodes, const std::vector<double> &params) {
+		SceneHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, "SHPS", 4);
+		header.version = sceneFileVersion;
+		header.byteOrder = sceneByteOrder;
+		header.nodeCount = nodes.size();
+		header.paramCount = params.size();
+		header.nodeOffset = sizeof(SceneHeader);
+		header.paramOffset = header.nodeOffset + nodes.size() * sizeof(SceneNode);
+		header.textOffset = header.paramOffset + params.size() * sizeof(double);
+		std::ofstream raw("test_scene.bin", std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+		raw.write((const char*)&header, sizeof(header));
+		raw.write((const char*)nodes.data(), nodes.size() * sizeof(SceneNode));
+		raw.write((const char*)params.data(), params.size() * sizeof(double));
+	};
+
+	// **** Rotated angles that are not ints are refused ****
+	for (double angle : { std::nan(""), 1e300, -3e9 })
+	{
+		writeRawScene({ SceneNode{ SceneRotated, {}, 1, 1, 0 }, SceneNode{ SceneCircle, {}, 0, 0, 3 } }, { 2, 2, angle, 2, 2 });
+		if (!scene.open("test_scene.bin") || scene.generatePostScript().find("rotate") != std::string::npos ||
+			scene.getError().empty() || scene.toShapeValue(0).generatePostScript() != "")
+		{
+			std::cout << "Scene file accepted the rotation angle " << angle << std::endl;
+			allSceneFilePassed = false;
+		}
+		scene.close();
+	}
+	writeRawScene({ SceneNode{ SceneRotated, {}, 1, 1, 0 }, SceneNode{ SceneCircle, {}, 0, 0, 3 } }, { 2, 2, 90, 2, 2 });
+	if (!scene.open("test_scene.bin") ||
+		scene.generatePostScript() != ShapeValue::rotated(ShapeValue::circle(1), 90).generatePostScript())
+	{
+		std::cout << "Hand written scene file does not render: " << scene.getError() << std::endl;
+		allSceneFilePassed = false;
+	}
+	scene.close();
+
+	// **** Node tables that are not a tree in breadth first order are refused ****
+	// Node i has children i + 1 and i + 2, so a render would take 2^1000 steps
+	std::vector<SceneNode> sharedChildren;
+	std::vector<double> sharedParams;
+	for (std::uint64_t i = 0; i < 1000; ++i)
+	{
+		sharedChildren.push_back(SceneNode{ SceneLayered, {}, 2, i + 1, 2 * i });
+		sharedParams.insert(sharedParams.end(), { 1, 1 });
+	}
+	for (std::uint64_t i = 1000; i < 1002; ++i)
+	{
+		sharedChildren.push_back(SceneNode{ SceneCircle, {}, 0, 0, 2 * i });
+		sharedParams.insert(sharedParams.end(), { 1, 1 });
+	}
+	std::vector<std::vector<SceneNode>> notTrees = {
+		sharedChildren,
+		// A parent with no children, then a node nobody points at
+		{ SceneNode{ SceneLayered, {}, 0, 1, 0 }, SceneNode{ SceneCircle, {}, 0, 0, 2 } },
+		// The second child range starts inside the first
+		{ SceneNode{ SceneLayered, {}, 2, 1, 0 }, SceneNode{ SceneLayered, {}, 1, 2, 2 }, SceneNode{ SceneCircle, {}, 0, 0, 4 } },
+	};
+	for (std::size_t t = 0; t < notTrees.size(); ++t)
+	{
+		writeRawScene(notTrees[t], t == 0 ? sharedParams : std::vector<double>(6, 1));
+		if (scene.open("test_scene.bin") || scene.getError().empty())
+		{
+			std::cout << "Scene file accepted node table " << t << ", which is not a tree" << std::endl;
+			allSceneFilePassed = false;
+		}
+		scene.close();
+	}
+	std::remove("test_scene.bin");
+
+	if (allSceneFilePassed) {
+		std::cout << "All scene file tests passed.\n";
+	}
+
+	////////////////////////////////SCENE PARSER TESTS
+	std::cout << "\nScene Parser Tests:\n";
+	bool allSceneParserPassed = true;
+
+	// **** Parsed text builds the same scene as the factories ****
+	std::string sceneText =
+		"# test scene\n"
+		"vertical\n"
+		"  horizontal\n"
+		"    circle 5\n"
+		"    rectangle 2 3   # trailing comment\n"
+		"    spacer 1 1\n"
+		"  end\n"
+		"  scaled 2 0.5\n"
+		"    rotated 90\n"
+		"      polygon 6 +4.5\n"
+		"\n"
+		"  multilayered\n"
+		"    square 3\n"
+		"    triangle 2e1\n"
+		"  end\n"
+		"  layered\r\n"
+		"    custom 20\r\n"
+		"  end\n"
+		"end";
+	std::vector<ShapeValue> parsedRow;
+	parsedRow.push_back(ShapeValue::circle(5));
+	parsedRow.push_back(ShapeValue::rectangle(2, 3));
+	parsedRow.push_back(ShapeValue::spacer(1, 1));
+	std::vector<ShapeValue> parsedMulti;
+	parsedMulti.push_back(ShapeValue::square(3));
+	parsedMulti.push_back(ShapeValue::triangle(20));
+	std::vector<ShapeValue> parsedLayer;
+	parsedLayer.push_back(ShapeValue::custom(20));
+	std::vector<ShapeValue> parsedColumn;
+	parsedColumn.push_back(ShapeValue::horizontal(std::move(parsedRow)));
+	parsedColumn.push_back(ShapeValue::scaled(ShapeValue::rotated(ShapeValue::polygon(6, 4.5), 90), 2, 0.5));
+	parsedColumn.push_back(ShapeValue::multiLayered(std::move(parsedMulti)));
+	parsedColumn.push_back(ShapeValue::layered(std::move(parsedLayer)));
+	std::string expectedScene = ShapeValue::vertical(std::move(parsedColumn)).generatePostScript();
+
+	SceneParser parser;
+	if (!parser.parseString(sceneText) || parser.getScene().generatePostScript() != expectedScene)
+	{
+		std::cout << "Parsed scene does not match: " << parser.getError() << std::endl;
+		allSceneParserPassed = false;
+	}
+
+	// **** Lines split between chunks are put back together ****
+	parser.reset();
+	for (char c : sceneText)
+	{
+		parser.feed(&c, 1);
+	}
+	if (!parser.finish() || parser.getScene().generatePostScript() != expectedScene)
+	{
+		std::cout << "Scene fed a byte at a time does not match: " << parser.getError() << std::endl;
+		allSceneParserPassed = false;
+	}
+
+	// **** Files parse the same as strings ****
+	std::ofstream sceneTextFile("test_scene.txt", std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+	sceneTextFile << sceneText;
+	sceneTextFile.close();
+	if (!parser.parseFile("test_scene.txt") || parser.getScene().generatePostScript() != expectedScene)
+	{
+		std::cout << "Parsed scene file does not match: " << parser.getError() << std::endl;
+		allSceneParserPassed = false;
+	}
+	std::remove("test_scene.txt");
+
+	// **** Errors name the line they are on ****
+	std::vector<std::pair<std::string, std::string>> badScenes = {
+		{ "circle 1\ncircle x\n", "line 2: 'x' is not a number" },
+		{ "horizontal\n circle 1\n", "line 1: horizontal is missing end" },
+		{ "circle 1\nend\n", "line 2: end without a group to close" },
+		{ "\n\nhexagon 3\n", "line 3: unknown shape 'hexagon'" },
+		{ "rectangle 1\n", "line 1: expected a number" },
+		{ "rotated 45.5\n circle 1\n", "line 1: '45.5' is not a whole number" },
+		{ "circle 1 2\n", "line 1: unexpected '2'" },
+		{ "vertical\n scaled 1 2\nend\n", "line 3: end without a group to close" },
+		{ "# nothing\n", "no shapes in scene" },
+		{ "polygon 2000000000 1\n", "line 1: a polygon can have at most 65535 sides" },
+	};
+	std::string deepText;
+	for (unsigned int i = 0; i < maxSceneDepth; ++i)
+	{
+		deepText += "rotated 90\n";
+	}
+	badScenes.push_back({ deepText + "circle 1\n", "line " + std::to_string(maxSceneDepth) + ": nested deeper than " +
+		std::to_string(maxSceneDepth) + " levels" });
+	for (const auto &bad : badScenes)
+	{
+		if (parser.parseString(bad.first) || parser.getError() != bad.second)
+		{
+			std::cout << "Expected error \"" << bad.second << "\" but got \"" << parser.getError() << "\"" << std::endl;
+			allSceneParserPassed = false;
+		}
+	}
+	// Just inside the limit, with a second top level node, still parses and renders
+	if (!parser.parseString(deepText.substr(std::strlen("rotated 90\n")) + "circle 1\ncircle 2\n") ||
+		parser.getScene().generatePostScript().find("arc") == std::string::npos)
+	{
+		std::cout << "Scene just inside the depth limit was refused: " << parser.getError() << std::endl;
+		allSceneParserPassed = false;
+	}
+
+	if (allSceneParserPassed) {
+		std::cout << "All scene parser tests passed.\n";
+	}
+
+#ifdef RENDER_DAEMON_AVAILABLE
+	////////////////////////////////RENDER DAEMON TESTS
+	std::cout << "\nRender Daemon Tests:\n";
+	bool allRenderDaemonPassed = true;
+
+	RenderServer server(2, 500);
+	if (!server.listen("test_render.sock"))
+	{
+		std::cout << "Render server could not listen: " << server.getError() << std::endl;
+		allRenderDaemonPassed = false;
+	}
+	else
+	{
+		std::thread serverThread([&]() { server.serve(); });
+
+		// **** A rendered scene matches rendering it in process ****
+		RenderClient client;
+		std::string rendered;
+		if (!client.connect("test_render.sock") || !client.render(sceneText, rendered) || rendered != expectedScene)
+		{
+			std::cout << "Daemon output does not match: " << client.getError() << std::endl;
+			allRenderDaemonPassed = false;
+		}
+
+		// **** Errors come back without closing the connection ****
+		if (client.render("circle 1\nhexagon 2\n", rendered) || client.getError() != "line 2: unknown shape 'hexagon'")
+		{
+			std::cout << "Daemon did not report the scene error: " << client.getError() << std::endl;
+			allRenderDaemonPassed = false;
+		}
+
+		// **** Scenes nested too deep are refused, and the daemon carries on ****
+		std::string tooDeep;
+		for (int i = 0; i < 100000; ++i)
+		{
+			tooDeep += "rotated 90\n";
+		}
+		tooDeep += "circle 1\n";
+		if (client.render(tooDeep, rendered) || client.getError().find("nested deeper than") == std::string::npos ||
+			!client.render("circle 2\n", rendered) || rendered != ShapeValue::circle(2).generatePostScript())
+		{
+			std::cout << "Daemon did not refuse a scene nested too deep: " << client.getError() << std::endl;
+			allRenderDaemonPassed = false;
+		}
+
+		// **** Pipelined requests are answered in order, in fewer writes ****
+		std::uint64_t batchesBefore = server.getBatchCount();
+		std::vector<std::string> batch;
+		for (int i = 1; i <= 50; ++i)
+		{
+			batch.push_back("circle " + std::to_string(i) + "\n");
+		}
+		bool batchMatches = client.send(batch);
+		for (int i = 1; i <= 50 && batchMatches; ++i)
+		{
+			batchMatches = client.receive(rendered) && rendered == ShapeValue::circle(i).generatePostScript();
+		}
+		if (!batchMatches || server.getBatchCount() - batchesBefore >= 50)
+		{
+			std::cout << "Pipelined requests were not answered in order or not batched" << std::endl;
+			allRenderDaemonPassed = false;
+		}
+
+		// **** Outputs bigger than a chunk are streamed intact ****
+		std::string bigScene = "horizontal\n";
+		std::vector<ShapeValue> bigRow;
+		for (int i = 0; i < 5000; ++i)
+		{
+			bigScene += "rectangle " + std::to_string(i % 9 + 1) + " 2\n";
+			bigRow.push_back(ShapeValue::rectangle(i % 9 + 1, 2));
+		}
+		bigScene += "end\n";
+		std::string bigExpected = ShapeValue::horizontal(std::move(bigRow)).generatePostScript();
+		if (!client.render(bigScene, rendered) || rendered != bigExpected || bigExpected.size() < 4 * ChunkWriter::chunkSize)
+		{
+			std::cout << "Large daemon output does not match" << std::endl;
+			allRenderDaemonPassed = false;
+		}
+
+		// **** A client that does not read its replies is dropped, others are served ****
+		RenderClient slowClient;
+		std::uint64_t droppedBefore = server.getDroppedCount();
+		bool slowSent = slowClient.connect("test_render.sock") &&
+			slowClient.send(std::vector<std::string>(4, bigScene));
+		bool othersServed = client.render("circle 3\n", rendered) && rendered == ShapeValue::circle(3).generatePostScript();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+		int slowReplies = 0;
+		while (slowReplies < 4 && slowClient.receive(rendered))
+		{
+			++slowReplies;
+		}
+		if (!slowSent || !othersServed || slowReplies == 4 || server.getDroppedCount() == droppedBefore)
+		{
+			std::cout << "Daemon was held up by a client that does not read" << std::endl;
+			allRenderDaemonPassed = false;
+		}
+		slowClient.close();
+
+		client.close();
+		server.stop();
+		serverThread.join();
+	}
+
+	if (allRenderDaemonPassed) {
+		std::cout << "All render daemon tests passed.\n";
+	}
+#endif
+
+	////////////////////////////////BATCH RENDER TESTS
+	std::cout << "\nBatch Render Tests:\n";
+	bool allBatchRenderPassed = true;
+
+	// **** Every task runs exactly once, whatever the thread count ****
+	for (unsigned int threads : { 1u, 3u, 8u })
+	{
+		std::vector<std::atomic<int>> runs(1000);
+		parallelFor(runs.size(), [&](std::size_t i) {
+			// Uneven work so threads run out at different times and steal
+			volatile double sink = 0;
+			for (std::size_t k = 0; k < (i % 17) * 100; ++k)
+			{
+				sink = sink + k;
+			}
+			++runs[i];
+		}, threads);
+		if (std::any_of(runs.begin(), runs.end(), [](const std::atomic<int> &r) { return r != 1; }))
+		{
+			std::cout << "parallelFor with " << threads << " threads did not run every task once" << std::endl;
+			allBatchRenderPassed = false;
+		}
+	}
+
+	// **** A directory of scenes renders largest first into the output directory ****
+	std::filesystem::create_directories("test_batch/out");
+	std::vector<std::string> batchScenes = { "circle 1\n", sceneText, "square 2\nsquare 3\n", "circle oops\n" };
+	for (std::size_t i = 0; i < batchScenes.size(); ++i)
+	{
+		std::ofstream batchFile("test_batch/scene" + std::to_string(i) + ".scene", std::ofstream::out | std::ofstream::binary);
+		batchFile << batchScenes[i];
+	}
+	std::ofstream("test_batch/ignored.txt") << "not a scene";
+
+	std::vector<BatchJob> batchJobs;
+	std::string batchError;
+	if (!collectJobs({ "test_batch" }, "test_batch/out", batchJobs, batchError) || batchJobs.size() != 4 ||
+		batchJobs[0].input != (std::filesystem::path("test_batch") / "scene1.scene").string())
+	{
+		std::cout << "Batch jobs were not collected largest first: " << batchError << std::endl;
+		allBatchRenderPassed = false;
+	}
+	renderBatch(batchJobs, 2);
+	for (const BatchJob &job : batchJobs)
+	{
+		bool shouldFail = job.input.find("scene3") != std::string::npos;
+		SceneParser expectedParser;
+		std::ifstream rendered(job.output, std::ifstream::in | std::ifstream::binary);
+		std::string contents((std::istreambuf_iterator<char>(rendered)), std::istreambuf_iterator<char>());
+		if (shouldFail ? (job.ok || job.error != "line 1: 'oops' is not a number")
+			: (!job.ok || !expectedParser.parseFile(job.input) || contents != expectedParser.getScene().generatePostScript()))
+		{
+			std::cout << "Batch render of " << job.input << " is wrong: " << job.error << std::endl;
+			allBatchRenderPassed = false;
+		}
+	}
+	for (const auto &entry : std::filesystem::directory_iterator("test_batch/out"))
+	{
+		if (entry.path().filename().string().find(".tmp") != std::string::npos)
+		{
+			std::cout << "Batch render left " << entry.path().string() << " behind" << std::endl;
+			allBatchRenderPassed = false;
+		}
+	}
+
+	// **** Outputs that would overwrite each other are refused ****
+	batchJobs.clear();
+	if (collectJobs({ "test_batch/scene0.scene", "test_batch/./scene0.scene" }, "test_batch/out", batchJobs, batchError))
+	{
+		std::cout << "Batch accepted two inputs with the same output" << std::endl;
+		allBatchRenderPassed = false;
+	}
+
+	// **** Outputs that would overwrite an input are refused ****
+	std::ofstream("test_batch/written.ps") << "circle 1\n";
+	batchJobs.clear();
+	if (collectJobs({ "test_batch/written.ps" }, "", batchJobs, batchError) ||
+		collectJobs({ "test_batch/out/../written.ps" }, "test_batch", batchJobs, batchError) ||
+		collectJobs({ "test_batch/scene0.scene", "test_batch/out/scene1.ps" }, "test_batch/out", batchJobs, batchError) ||
+		!collectJobs({ "test_batch/written.ps" }, "test_batch/out", batchJobs, batchError))
+	{
+		std::cout << "Batch accepted an output that is also an input" << std::endl;
+		allBatchRenderPassed = false;
+	}
+	std::filesystem::remove_all("test_batch");
+
+	if (allBatchRenderPassed) {
+		std::cout << "All batch render tests passed.\n";
+	}
+
+#ifdef SHARDED_RENDER_AVAILABLE
+	////////////////////////////////SHARDED RENDER TESTS
+	std::cout << "\nSharded Render Tests:\n";
+	bool allShardedRenderPassed = true;
+
+	std::vector<unique_ptr<Shape>> shardRows;
+	for (int r = 0; r < 40; ++r)
+	{
+		std::vector<unique_ptr<Shape>> shardRow;
+		for (int i = 0; i < r % 7 + 1; ++i)
+		{
+			shardRow.push_back(make_unique<Rectangle>(i + 1, r % 5 + 1));
+			shardRow.push_back(make_unique<Circle>(i + 2));
+		}
+		shardRows.push_back(make_unique<MultiHorizontal>(std::move(shardRow)));
+	}
+	shardRows.push_back(make_unique<Custom>(30));
+	MultiVertical shardColumn(std::move(shardRows));
+	std::string shardExpected = shardColumn.generatePostScript();
+
+	// **** Fragments cover the output in order ****
+	std::vector<unsigned int> bounds = shardBounds(shardColumn, 4);
+	std::string fragments;
+	for (unsigned int i = 0; i < fragmentCount(shardColumn); ++i)
+	{
+		appendFragment(shardColumn, i, fragments);
+	}
+	if (fragments != shardExpected || bounds.front() != 0 || bounds.back() != shardColumn.getSize() || bounds.size() != 5)
+	{
+		std::cout << "Fragments do not add up to the output" << std::endl;
+		allShardedRenderPassed = false;
+	}
+
+	// **** Output is byte identical, whatever the shape and process count ****
+	auto shardedMatches = [&](Shape &shape, unsigned int processes, std::size_t regionSize) {
+		std::string error;
+		if (!renderShardedToFile(shape, "test_sharded.ps", processes, error, regionSize))
+		{
+			std::cout << error << std::endl;
+			return false;
+		}
+		std::ifstream rendered("test_sharded.ps", std::ifstream::in | std::ifstream::binary);
+		std::string contents((std::istreambuf_iterator<char>(rendered)), std::istreambuf_iterator<char>());
+		std::remove("test_sharded.ps");
+		return contents == shape.generatePostScript();
+	};
+	for (unsigned int processes : { 1u, 3u, 8u, 100u })
+	{
+		if (!shardedMatches(shardColumn, processes, (std::size_t)1 << 30))
+		{
+			std::cout << "Sharded output with " << processes << " processes does not match" << std::endl;
+			allShardedRenderPassed = false;
+		}
+	}
+	// Regions too small for the shards, the parent renders them instead
+	if (!shardedMatches(shardColumn, 4, 4096) || !shardedMatches(vertCustomShape, 2, 1 << 20) ||
+		!shardedMatches(c, 4, 1 << 20) || !shardedMatches(lay2, 2, 1 << 20))
+	{
+		std::cout << "Sharded output with fallback or other shapes does not match" << std::endl;
+		allShardedRenderPassed = false;
+	}
+	// Written through a temporary file of its own, which does not stay behind
+	std::filesystem::create_directories("test_sharded");
+	std::string shardedError;
+	if (!renderShardedToFile(shardColumn, "test_sharded/out.ps", 3, shardedError, (std::size_t)1 << 30) ||
+		!renderShardedToFile(shardColumn, "test_sharded/out.ps", 3, shardedError, (std::size_t)1 << 30) ||
+		std::distance(std::filesystem::directory_iterator("test_sharded"), std::filesystem::directory_iterator()) != 1)
+	{
+		std::cout << "Sharded render left files behind: " << shardedError << std::endl;
+		allShardedRenderPassed = false;
+	}
+	std::filesystem::remove_all("test_sharded");
+
+	if (allShardedRenderPassed) {
+		std::cout << "All sharded render tests passed.\n";
+	}
+#endif
+
+	////////////////////////////////RENDER CACHE TESTS
+	std::cout << "\nRender Cache Tests:\n";
+	bool allRenderCachePassed = true;
+
+	// **** Hashes follow content, not identity, and do not change between runs ****
+	auto makeCacheColumn = [](int changedRow) {
+		std::vector<unique_ptr<Shape>> rows;
+		for (int r = 0; r < 30; ++r)
+		{
+			std::vector<unique_ptr<Shape>> row;
+			for (int i = 0; i < 20; ++i)
+			{
+				row.push_back(make_unique<Rectangle>(i % 4 + 1, r == changedRow ? 100 : r + 2));
+				row.push_back(make_unique<Triangle>(i % 3 + 1));
+			}
+			rows.push_back(make_unique<MultiHorizontal>(std::move(row)));
+		}
+		rows.push_back(make_unique<Rotated>(make_unique<Custom>(40), 90));
+		return make_unique<MultiVertical>(std::move(rows));
+	};
+	unique_ptr<Shape> cacheColumn = makeCacheColumn(-1);
+	unique_ptr<Shape> sameColumn = makeCacheColumn(-1);
+	unique_ptr<Shape> changedColumn = makeCacheColumn(12);
+	Circle hashCircle(1);
+	Rectangle hashRectangle(2, 3);
+	if (contentHash(*cacheColumn) != contentHash(*sameColumn) || contentHash(*cacheColumn) == contentHash(*changedColumn) ||
+		contentHash(hashCircle) != 0xedb20f2db1757363ull || contentHash(hashRectangle) != 0xdc193271c1799457ull ||
+		contentHash(c) == contentHash(hashCircle))
+	{
+		std::cout << "Content hashes are wrong" << std::endl;
+		allRenderCachePassed = false;
+	}
+
+	// **** Cold, warm and partly changed renders all match ****
+	std::filesystem::remove_all("test_cache");
+	RenderCache cache;
+	if (!cache.open("test_cache", 4 << 20, 256) || cache.render(*cacheColumn) != cacheColumn->generatePostScript() ||
+		cache.getHits() != 0 || cache.getStores() == 0)
+	{
+		std::cout << "Cold cached render is wrong: " << cache.getError() << std::endl;
+		allRenderCachePassed = false;
+	}
+	cache.resetCounters();
+	if (cache.render(*sameColumn) != cacheColumn->generatePostScript() || cache.getHits() != 1 || cache.getMisses() != 0)
+	{
+		std::cout << "Warm cached render did not come from the cache" << std::endl;
+		allRenderCachePassed = false;
+	}
+	cache.resetCounters();
+	if (cache.render(*changedColumn) != changedColumn->generatePostScript() || cache.getMisses() != 2 || cache.getHits() != 30)
+	{
+		std::cout << "Changed render did not reuse the unchanged rows: " << cache.getHits() << " hits, "
+			<< cache.getMisses() << " misses" << std::endl;
+		allRenderCachePassed = false;
+	}
+
+	// **** Blobs survive reopening, and the size cap evicts the oldest ****
+	RenderCache reopened;
+	reopened.open("test_cache", 4 << 20, 256);
+	if (reopened.render(*cacheColumn) != cacheColumn->generatePostScript() || reopened.getHits() != 1)
+	{
+		std::cout << "Reopened cache did not find the blobs" << std::endl;
+		allRenderCachePassed = false;
+	}
+
+	// **** A blob under the right name but for other content is not used ****
+	// Stands in for a collision of the 64 bit hashes: the whole changed
+	// column's blob is put where the unchanged column's is looked up
+	auto blobPath = [](const std::string &directory, Shape &shape) {
+		char name[20];
+		std::snprintf(name, sizeof(name), "%016llx.ps", (unsigned long long)hashCombine(renderCacheVersion, contentHash(shape)));
+		return (std::filesystem::path(directory) / name).string();
+	};
+	std::filesystem::remove_all("test_cache_other");
+	RenderCache other;
+	other.open("test_cache_other", 4 << 20, 256);
+	other.render(*changedColumn);
+	std::error_code collisionError;
+	std::filesystem::copy_file(blobPath("test_cache_other", *changedColumn), blobPath("test_cache", *cacheColumn),
+		std::filesystem::copy_options::overwrite_existing, collisionError);
+	RenderCache collided;
+	collided.open("test_cache", 4 << 20, 256);
+	if (collisionError || collided.render(*cacheColumn) != cacheColumn->generatePostScript() ||
+		collided.getMisses() != 1 || collided.getHits() != 31)
+	{
+		std::cout << "Cache used a blob written for other content: " << collided.getHits() << " hits, "
+			<< collided.getMisses() << " misses" << std::endl;
+		allRenderCachePassed = false;
+	}
+	std::filesystem::remove_all("test_cache_other");
+	RenderCache small;
+	small.open("test_cache", 4096, 256);
+	if (small.getBytes() > 4096 || small.getEvictions() == 0 || small.render(*changedColumn) != changedColumn->generatePostScript())
+	{
+		std::cout << "Cache size cap was not kept" << std::endl;
+		allRenderCachePassed = false;
+	}
+	std::filesystem::remove_all("test_cache");
+
+	if (allRenderCachePassed) {
+		std::cout << "All render cache tests passed.\n";
+	}
+
+	////////////////////////////////ROPE TESTS
+	std::cout << "\nRope Tests:\n";
+	bool allRopePassed = true;
+
+	// **** Ropes hold the same bytes as generatePostScript ****
+	for (Shape *shape : std::vector<Shape*>{ cacheColumn.get(), &vertCustomShape, &lay2, &c })
+	{
+		Rope rope;
+		renderRope(*shape, rope);
+		if (rope.str() != shape->generatePostScript() || rope.size() != rope.str().size())
+		{
+			std::cout << "Rope does not match generatePostScript" << std::endl;
+			allRopePassed = false;
+		}
+	}
+
+	// **** Short glue is merged, long text is kept, not copied ****
+	Rope glued;
+	glued += "1 2 translate\n";
+	glued += std::string("3 4 translate\n");
+	glued += std::string(1000, 'x');
+	glued += "\n";
+	if (glued.getPieces().size() != 3 || glued.getCopiedBytes() != 29 || glued.size() != 1029)
+	{
+		std::cout << "Rope glue was not merged: " << glued.getPieces().size() << " pieces, "
+			<< glued.getCopiedBytes() << " bytes copied" << std::endl;
+		allRopePassed = false;
+	}
+
+	// **** Composites copy no child output, and files match ****
+	Rope columnRope;
+	renderRope(*cacheColumn, columnRope);
+	std::string columnText = cacheColumn->generatePostScript();
+	if (columnRope.getCopiedBytes() >= columnText.size())
+	{
+		std::cout << "Rope copied more than its size" << std::endl;
+		allRopePassed = false;
+	}
+	std::string ropeFile;
+	if (columnRope.writeFile("test_rope.ps"))
+	{
+		std::ifstream ifs("test_rope.ps", std::ifstream::in | std::ifstream::binary);
+		ropeFile.assign((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	}
+	std::remove("test_rope.ps");
+	if (ropeFile != columnText)
+	{
+		std::cout << "Rope file does not match" << std::endl;
+		allRopePassed = false;
+	}
+
+	// **** Cached renders into a rope store and share the blobs ****
+	std::filesystem::remove_all("test_rope_cache");
+	for (int run = 0; run < 2; ++run)
+	{
+		RenderCache ropeCache;
+		ropeCache.open("test_rope_cache", 4 << 20, 256);
+		Rope cachedRope;
+		ropeCache.render(*cacheColumn, cachedRope);
+		bool expected = run == 0 ? ropeCache.getMisses() > 0 && ropeCache.getStores() > 0 : ropeCache.getHits() == 1;
+		if (cachedRope.str() != columnText || !expected)
+		{
+			std::cout << (run == 0 ? "Cold" : "Warm") << " cached rope does not match" << std::endl;
+			allRopePassed = false;
+		}
+		if (run == 1 && cachedRope.getCopiedBytes() != 0)
+		{
+			std::cout << "Warm cached rope copied the blob" << std::endl;
+			allRopePassed = false;
+		}
+	}
+	RenderCache stringCache;
+	stringCache.open("test_rope_cache", 4 << 20, 256);
+	if (stringCache.render(*changedColumn) != changedColumn->generatePostScript() || stringCache.getHits() != 30)
+	{
+		std::cout << "Rope cache broke string rendering" << std::endl;
+		allRopePassed = false;
+	}
+	std::filesystem::remove_all("test_rope_cache");
+
+	if (allRopePassed) {
+		std::cout << "All rope tests passed.\n";
+	}
+
+#ifdef COMPRESSED_OUTPUT_AVAILABLE
+	////////////////////////////////COMPRESSED OUTPUT TESTS
+	std::cout << "\nCompressed Output Tests:\n";
+	bool allCompressedPassed = true;
+
+	// **** ASCII85 groups, zeros and short last groups ****
+	std::string ascii85;
+	Ascii85Encoder encoder(ascii85);
+	encoder.write("Man \0\0\0\0sur", 11);
+	encoder.finish();
+	if (ascii85 != "9jqo^zF*2L~>\n")
+	{
+		std::cout << "ASCII85 encoding is wrong: " << ascii85 << std::endl;
+		allCompressedPassed = false;
+	}
+
+	// **** Streams decode to what was written, short and over many blocks ****
+	auto compressedMatches = [](const std::string &text, unsigned int threads) {
+		std::ostringstream stream;
+		CompressedWriter writer(stream, threads);
+		writer.raw(text);
+		bool ok = writer.finish();
+		std::string decoded;
+		return ok && decodeCompressed(stream.str(), decoded) && decoded == text &&
+			writer.getInputBytes() == text.size();
+	};
+	for (std::size_t size = 0; size < 9; ++size)
+	{
+		if (!compressedMatches(columnText.substr(0, size), 1))
+		{
+			std::cout << "Compressed " << size << " bytes do not decode" << std::endl;
+			allCompressedPassed = false;
+		}
+	}
+	std::string manyBlocks;
+	while (manyBlocks.size() < 3 * CompressedWriter::blockSize)
+	{
+		manyBlocks += columnText;
+		manyBlocks += changedColumn->generatePostScript();
+	}
+	for (unsigned int threads : { 1u, 4u })
+	{
+		if (!compressedMatches(manyBlocks, threads))
+		{
+			std::cout << "Compressed blocks with " << threads << " threads do not decode" << std::endl;
+			allCompressedPassed = false;
+		}
+	}
+
+	// **** Shape values write straight into the compressor ****
+	ShapeValue compressedValue = ShapeValue::vertical({ ShapeValue::circle(3), ShapeValue::rectangle(4, 5) });
+	std::ostringstream compressedStream;
+	CompressedWriter valueWriter(compressedStream, 2);
+	compressedValue.render(valueWriter);
+	valueWriter.finish();
+	std::string decodedValue;
+	if (!decodeCompressed(compressedStream.str(), decodedValue) || decodedValue != compressedValue.generatePostScript() ||
+		valueWriter.getOutputBytes() == 0)
+	{
+		std::cout << "Compressed shape value does not decode" << std::endl;
+		allCompressedPassed = false;
+	}
+
+	if (allCompressedPassed) {
+		std::cout << "All compressed output tests passed.\n";
+	}
+#endif
+
+	////////////////////////////////BINARY POSTSCRIPT TESTS
+	std::cout << "\nBinary PostScript Tests:\n";
+	bool allBinaryPassed = true;
+
+	// **** Token bytes for each kind of number and operator ****
+	std::string tokens;
+	BinaryPostScriptWriter tokenWriter(tokens);
+	tokenWriter.integer(5);
+	tokenWriter.integer(-1000);
+	tokenWriter.integer(100000);
+	tokenWriter.number(0.5);
+	tokenWriter.number(0.1);
+	tokenWriter.op("translate");
+	tokenWriter.op("[");
+	const unsigned char expectedTokens[] = { 136, 5, 134, 0xfc, 0x18, 132, 0, 1, 0x86, 0xa0, 137, 33, 0, 1,
+		138, 0x3d, 0xcc, 0xcc, 0xcd, 146, 172, '[', ' ' };
+	if (tokens != std::string((const char*)expectedTokens, sizeof(expectedTokens)))
+	{
+		std::cout << "Binary tokens are wrong" << std::endl;
+		allBinaryPassed = false;
+	}
+
+	// **** System name indices are positions in PLRM Table F.1 ****
+	// The table as printed in the PLRM, from index 0 up to translate
+	const char *plrmSystemNames =
+		"abs add aload anchorsearch and arc arcn arct arcto array astore awidthshow begin bind bitshift ceiling "
+		"charpath clear cleartomark clip clippath closepath concat concatmatrix copy count counttomark "
+		"currentcmykcolor currentdash currentdict currentfile currentfont currentgray currentgstate currenthsbcolor "
+		"currentlinecap currentlinejoin currentlinewidth currentmatrix currentpoint currentrgbcolor currentshared "
+		"curveto cvi cvlit cvn cvr cvrs cvs cvx def defineusername dict div dtransform dup end eoclip eofill "
+		"eoviewclip eq exch exec exit file fill findfont flattenpath floor flush flushfile for forall ge get "
+		"getinterval grestore gsave gstate gt identmatrix idiv idtransform if ifelse image imagemask index "
+		"ineofill infill initviewclip inueofill inufill invertmatrix itransform known le length lineto load loop "
+		"lt makefont matrix maxlength mod moveto mul ne neg newpath not null or pathbbox pathforall pop print "
+		"printobject put putinterval rcurveto read readhexstring readline readstring rectclip rectfill "
+		"rectstroke rectviewclip repeat restore rlineto rmoveto roll rotate round save scale scalefont search "
+		"selectfont setbbox setcachedevice setcachedevice2 setcharwidth setcmykcolor setdash setfont setgray "
+		"setgstate sethsbcolor setlinecap setlinejoin setlinewidth setmatrix setrgbcolor setshared shareddict "
+		"show showpage stop stopped store string stringwidth stroke strokepath sub systemdict token transform "
+		"translate";
+	std::istringstream plrmStream(plrmSystemNames);
+	std::string plrmName;
+	int plrmIndex = 0;
+	int plrmMatched = 0;
+	for (; plrmStream >> plrmName; ++plrmIndex)
+	{
+		int index = systemNameIndex(plrmName.c_str());
+		if (index != -1 && index != plrmIndex)
+		{
+			std::cout << "System name " << plrmName << " has index " << index << ", not " << plrmIndex << std::endl;
+			allBinaryPassed = false;
+		}
+		plrmMatched += index == plrmIndex;
+	}
+	if (plrmIndex != 173 || plrmMatched != 15)
+	{
+		std::cout << "System name table does not cover the operators the shapes use" << std::endl;
+		allBinaryPassed = false;
+	}
+
+	// **** An interpreter draws the same from binary and text, if gs is installed ****
+	if (std::system("gs --version > /dev/null 2>&1") == 0)
+	{
+		Rectangle gsRect(10, 20);
+		Transformed gsTurned(gsRect, Affine().rotated(30));
+		Rotated gsRotated(gsRect, 90);
+		Scaled gsScaled(gsRect, 2, 3);
+		std::string gsBox[2];
+		for (int binary = 0; binary < 2; ++binary)
+		{
+			std::string page = "300 400 translate\n";
+			appendPostScript(vertCustomShape, binary ? BinaryEncoding : TextEncoding, page);
+			appendPostScript(gsScaled, binary ? BinaryEncoding : TextEncoding, page);
+			appendPostScript(gsTurned, binary ? BinaryEncoding : TextEncoding, page);
+			appendPostScript(gsRotated, binary ? BinaryEncoding : TextEncoding, page);
+			page += "showpage\n";
+			std::ofstream gsIn("test_binary.ps", std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+			gsIn << page;
+			gsIn.close();
+			std::system("gs -q -dSAFER -dBATCH -dNOPAUSE -sDEVICE=bbox test_binary.ps > test_binary.txt 2>&1");
+			std::ifstream gsOut("test_binary.txt");
+			std::stringstream box;
+			box << gsOut.rdbuf();
+			gsBox[binary] = box.str();
+		}
+		if (gsBox[0].find("%%BoundingBox") == std::string::npos || gsBox[0] != gsBox[1])
+		{
+			std::cout << "gs does not draw the same from binary and text postscript:\n" << gsBox[0] << gsBox[1] << std::endl;
+			allBinaryPassed = false;
+		}
+		std::remove("test_binary.ps");
+		std::remove("test_binary.txt");
+	}
+
+	// **** Every shape decodes to its text, up to single precision ****
+	auto splitTokens = [](const std::string &text) {
+		std::vector<std::string> split;
+		std::istringstream stream(text);
+		std::string token;
+		while (stream >> token)
+		{
+			split.push_back(token);
+		}
+		return split;
+	};
+	auto sameTokens = [](const std::string &l, const std::string &r) {
+		if (l == r)
+		{
+			return true;
+		}
+		char *lEnd;
+		char *rEnd;
+		double lValue = std::strtod(l.c_str(), &lEnd);
+		double rValue = std::strtod(r.c_str(), &rEnd);
+		return *lEnd == '\0' && *rEnd == '\0' && std::fabs(lValue - rValue) <= 1e-6 + 1e-6 * std::fabs(lValue);
+	};
+	Circle scaledCircle(5);
+	Scaled binaryScaled(scaledCircle, 2, 3);
+	Spacer binarySpacer(10, 20);
+	for (Shape *shape : std::vector<Shape*>{ &c, &binarySpacer, &binaryScaled, &lay2, &vertCustomShape, cacheColumn.get() })
+	{
+		std::string binary;
+		std::string text;
+		appendPostScript(*shape, BinaryEncoding, binary);
+		std::string decoded;
+		appendPostScript(*shape, TextEncoding, text);
+		std::vector<std::string> expectedSplit = splitTokens(text);
+		std::vector<std::string> decodedSplit;
+		bool decodedOk = binaryTokensToText(binary, decoded);
+		decodedSplit = splitTokens(decoded);
+		bool same = decodedOk && expectedSplit.size() == decodedSplit.size() && binary.size() < text.size();
+		for (std::size_t i = 0; same && i < expectedSplit.size(); ++i)
+		{
+			same = sameTokens(expectedSplit[i], decodedSplit[i]);
+		}
+		if (!same || text != shape->generatePostScript())
+		{
+			std::cout << "Binary postscript does not decode to the text" << std::endl;
+			allBinaryPassed = false;
+		}
+	}
+
+	if (allBinaryPassed) {
+		std::cout << "All binary postscript tests passed.\n";
+	}
+
+	////////////////////////////////TRANSFORM FUSION TESTS
+	std::cout << "\nTransform Fusion Tests:\n";
+	bool allTransformPassed = true;
+
+	// **** Transformed boxes are exact for any angle ****
+	Rectangle transformRect(10, 20);
+	Transformed turned45(transformRect, Affine().rotated(45));
+	Transformed turned90(transformRect, Affine().rotated(90));
+	Transformed stretched(transformRect, Affine().scaled(3, 0.5));
+	if (std::fabs(turned45.width - 30 / std::sqrt(2.0)) > 1e-9 || std::fabs(turned45.height - 30 / std::sqrt(2.0)) > 1e-9 ||
+		std::fabs(turned90.width - 20) > 1e-9 || std::fabs(turned90.height - 10) > 1e-9 ||
+		stretched.width != 30 || stretched.height != 10)
+	{
+		std::cout << "Transformed has the wrong box" << std::endl;
+		allTransformPassed = false;
+	}
+
+	// **** One concat inside gsave / grestore, the same from a ShapeValue ****
+	Transformed identity(transformRect, Affine());
+	if (identity.generatePostScript() != "gsave\n[ 1.000000 0.000000 0.000000 1.000000 0.000000 0.000000 ] concat\n" +
+		transformRect.generatePostScript() + "grestore\n" ||
+		ShapeValue::fromShape(turned45).generatePostScript() != turned45.generatePostScript() ||
+		ShapeValue::fromShape(turned45).toShape()->generatePostScript() != turned45.generatePostScript())
+	{
+		std::cout << "Transformed postscript is wrong" << std::endl;
+		allTransformPassed = false;
+	}
+
+	// **** Chains fuse into one matrix, single wrappers are left alone ****
+	auto makeChain = []() {
+		return ShapeValue::scaled(ShapeValue::rotated(ShapeValue::scaled(ShapeValue::circle(5), 1, 3), 30), 2, 1);
+	};
+	std::vector<ShapeValue> chains;
+	chains.push_back(makeChain());
+	chains.push_back(ShapeValue::rotated(ShapeValue::rectangle(4, 6), 90));
+	chains.push_back(ShapeValue::horizontal({ makeChain(), ShapeValue::custom(8) }));
+	ShapeValue fusedScene = ShapeValue::vertical(std::move(chains));
+	double fusedWidth = fusedScene.width;
+	fuseTransforms(fusedScene);
+	const std::vector<ShapeValue> &fusedRows = std::get<VerticalNode>(fusedScene.node).children;
+	const TransformedNode *fused = std::get_if<TransformedNode>(&fusedRows[0].node);
+	Affine expectedMatrix = Affine().scaled(2, 1).rotated(30).scaled(1, 3);
+	std::string fusedText = fusedRows[0].generatePostScript();
+	if (fused == nullptr || !std::holds_alternative<CircleNode>(fused->child[0].node) ||
+		std::fabs(fused->matrix.a - expectedMatrix.a) > 1e-12 || std::fabs(fused->matrix.b - expectedMatrix.b) > 1e-12 ||
+		std::fabs(fused->matrix.c - expectedMatrix.c) > 1e-12 || std::fabs(fused->matrix.d - expectedMatrix.d) > 1e-12 ||
+		fusedRows[0].width != makeChain().width || fusedScene.width != fusedWidth ||
+		fusedText.find(" scale\n") != std::string::npos || fusedText.find(" rotate\n") != std::string::npos ||
+		!std::holds_alternative<RotatedNode>(fusedRows[1].node) ||
+		!std::holds_alternative<TransformedNode>(std::get<HorizontalNode>(fusedRows[2].node).children[0].node))
+	{
+		std::cout << "Transform chains were not fused" << std::endl;
+		allTransformPassed = false;
+	}
+
+	// **** Fused scenes survive scene files ****
+	SceneFile fusedFile;
+	if (!writeScene(fusedScene, "test_fused.bin") || !fusedFile.open("test_fused.bin") ||
+		fusedFile.generatePostScript() != fusedScene.generatePostScript())
+	{
+		std::cout << "Fused scene file does not render the same" << std::endl;
+		allTransformPassed = false;
+	}
+	fusedFile.close();
+	std::remove("test_fused.bin");
+
+	if (allTransformPassed) {
+		std::cout << "All transform fusion tests passed.\n";
+	}
+
+	////////////////////////////////FLATTEN TESTS
+	std::cout << "\nFlatten Tests:\n";
+	bool allFlattenPassed = true;
+
+	// **** The vector kernel matches the matrix on odd sized batches ****
+	Affine kernelMatrix = Affine().translated(3, -2).rotated(33).scaled(1.5, 0.25);
+	std::vector<double> kernelXs;
+	std::vector<double> kernelYs;
+	for (int i = 0; i < 11; ++i)
+	{
+		kernelXs.push_back(i * 1.25 - 4);
+		kernelYs.push_back(7 - i * 0.5);
+	}
+	std::vector<double> inputXs = kernelXs;
+	std::vector<double> inputYs = kernelYs;
+	transformPoints(kernelMatrix, kernelXs.data(), kernelYs.data(), kernelXs.size());
+	for (std::size_t i = 0; i < kernelXs.size(); ++i)
+	{
+		double x;
+		double y;
+		kernelMatrix.apply(inputXs[i], inputYs[i], x, y);
+		if (std::fabs(x - kernelXs[i]) > 1e-12 || std::fabs(y - kernelYs[i]) > 1e-12)
+		{
+			std::cout << "Vector transform does not match the matrix" << std::endl;
+			allFlattenPassed = false;
+			break;
+		}
+	}
+
+	// **** A rectangle comes out as absolute corners ****
+	std::string flatRect;
+	appendFlattened(transformRect, flatRect);
+	if (flatRect != "newpath\n-5.000000 -10.000000 moveto\n5.000000 -10.000000 lineto\n5.000000 10.000000 lineto\n"
+		"-5.000000 10.000000 lineto\nclosepath\nstroke\n")
+	{
+		std::cout << "Flattened rectangle is wrong:\n" << flatRect << std::endl;
+		allFlattenPassed = false;
+	}
+
+	// **** Layouts land where the spatial index puts them, with no CTM changes ****
+	std::vector<unique_ptr<Shape>> flatRow;
+	flatRow.push_back(make_unique<Rectangle>(10, 20));
+	flatRow.push_back(make_unique<Circle>(7));
+	flatRow.push_back(make_unique<Rotated>(make_unique<Rectangle>(4, 30), 90));
+	flatRow.push_back(make_unique<Transformed>(make_unique<Rectangle>(12, 6), Affine().rotated(30)));
+	flatRow.push_back(make_unique<Spacer>(5, 5));
+	std::vector<unique_ptr<Shape>> flatRows;
+	flatRows.push_back(make_unique<MultiHorizontal>(std::move(flatRow)));
+	flatRows.push_back(make_unique<Circle>(12));
+	flatRows.push_back(make_unique<Rectangle>(40, 3));
+	MultiVertical flatScene(std::move(flatRows));
+	std::string flatText;
+	FlatteningWriter flattener(flatText);
+	ShapeValue::fromShape(flatScene).render(flattener);
+	Box flatBounds = flattener.getBounds();
+	Box indexBounds = SpatialIndex(flatScene).getBounds();
+	if (std::fabs(flatBounds.minX - indexBounds.minX) > 0.06 || std::fabs(flatBounds.maxX - indexBounds.maxX) > 0.06 ||
+		std::fabs(flatBounds.minY - indexBounds.minY) > 0.06 || std::fabs(flatBounds.maxY - indexBounds.maxY) > 0.06 ||
+		flattener.getPathCount() != 6 || flattener.getUnknownCount() != 0)
+	{
+		std::cout << "Flattened layout is not where the shapes are: " << flattener.getPathCount() << " paths" << std::endl;
+		allFlattenPassed = false;
+	}
+	for (const char *op : { "translate", "rotate", "scale", "concat", "arc" })
+	{
+		if (flatText.find(std::string(" ") + op + "\n") != std::string::npos)
+		{
+			std::cout << "Flattened output changes the CTM with " << op << std::endl;
+			allFlattenPassed = false;
+		}
+	}
+
+	// **** Baked text, polygons and fused transforms flatten too ****
+	std::string flatCustom;
+	FlatteningWriter customFlattener(flatCustom);
+	customFlattener.raw(vertCustomShape.generatePostScript());
+	fusedScene.render(customFlattener);
+	if (customFlattener.getUnknownCount() != 0 || customFlattener.getPathCount() == 0 ||
+		flatCustom.find("translate") != std::string::npos)
+	{
+		std::cout << "Flattening baked text failed" << std::endl;
+		allFlattenPassed = false;
+	}
+
+	if (allFlattenPassed) {
+		std::cout << "All flatten tests passed.\n";
+	}
+
+	////////////////////////////////LOD TESTS
+	std::cout << "\nLevel Of Detail Tests:\n";
+	bool allLodPassed = true;
+
+	// **** Nothing changes at a resolution where everything shows ****
+	LodOptions fineLod;
+	fineLod.dpi = 72 * 100;
+	for (Shape *shape : std::vector<Shape*>{ &lay2, &vertCustomShape, &flatScene })
+	{
+		LodStats fineStats;
+		std::string fine;
+		appendLod(*shape, fine, fineLod, fineStats);
+		if (fine != shape->generatePostScript() || fineStats.simplified() != 0 || fineStats.leaves == 0 ||
+			fineStats.bytesAvoided != 0 || fineStats.bytes != fine.size())
+		{
+			std::cout << "Level of detail changed a shape that shows in full" << std::endl;
+			allLodPassed = false;
+		}
+	}
+
+	// **** Small faces become squares, many sided polygons arcs, specks dots or nothing ****
+	LodOptions lod;
+	LodStats lodStats;
+	std::string lodText;
+	std::vector<ShapeValue> lodParts;
+	lodParts.push_back(ShapeValue::scaled(ShapeValue::custom(40), 0.05, 0.05));
+	lodParts.push_back(ShapeValue::polygon(200, 1));
+	lodParts.push_back(ShapeValue::scaled(ShapeValue::circle(1), 0.1, 0.1));
+	lodParts.push_back(ShapeValue::scaled(ShapeValue::circle(1), 0.01, 0.01));
+	appendLod(ShapeValue::layered(lodParts), lodText, lod, lodStats);
+	std::string squareText;
+	PostScriptWriter squareWriter(squareText);
+	emitSquare(squareWriter, 40);
+	if (lodStats.leaves != 4 || lodStats.squares != 1 || lodStats.arcs != 1 || lodStats.dots != 1 || lodStats.dropped != 1 ||
+		lodText.find(squareText) == std::string::npos || lodText.find(" lineto\n") == std::string::npos ||
+		lodText.find(" arc closepath\n") == std::string::npos || lodText.find(" rectfill\n") == std::string::npos ||
+		lodText.size() >= ShapeValue::layered(lodParts).generatePostScript().size() / 10)
+	{
+		std::cout << "Level of detail did not simplify: " << lodStats.squares << " squares, " << lodStats.arcs << " arcs, "
+			<< lodStats.dots << " dots, " << lodStats.dropped << " dropped" << std::endl;
+		allLodPassed = false;
+	}
+	// What it saved adds up to the full output
+	std::size_t lodFullSize = ShapeValue::layered(lodParts).generatePostScript().size();
+	if (lodStats.bytes != lodText.size() || lodStats.bytes + lodStats.bytesAvoided != lodFullSize ||
+		lodStats.milliseconds < 0)
+	{
+		std::cout << "Level of detail counted " << lodStats.bytes << " bytes and " << lodStats.bytesAvoided
+			<< " avoided, the full output has " << lodFullSize << std::endl;
+		allLodPassed = false;
+	}
+
+	// **** Stand-ins leave the CTM as the shapes did, so what follows stays put ****
+	std::vector<ShapeValue> specks;
+	for (int i = 0; i < 5; ++i)
+	{
+		specks.push_back(ShapeValue::scaled(ShapeValue::polygon(7, 1), 0.02, 0.02));
+	}
+	specks.push_back(ShapeValue::rectangle(30, 20));
+	ShapeValue speckRow = ShapeValue::layered(specks);
+	std::string fullFlat;
+	std::string lodFlat;
+	FlatteningWriter fullFlattener(fullFlat);
+	speckRow.render(fullFlattener);
+	LodStats speckStats;
+	FlatteningWriter lodFlattener(lodFlat);
+	renderLod(speckRow, lodFlattener, lod, speckStats);
+	std::string lastRect = fullFlat.substr(fullFlat.rfind("newpath"));
+	if (speckStats.dropped != 5 || lodFlat.substr(lodFlat.rfind("newpath")) != lastRect ||
+		lastRect.find("-15.000000 -10.000000 moveto") != std::string::npos)
+	{
+		std::cout << "Level of detail moved the shapes after a stand-in" << std::endl;
+		allLodPassed = false;
+	}
+
+	if (allLodPassed) {
+		std::cout << "All level of detail tests passed.\n";
+	}
+
+	////////////////////////////////STROKE BATCHING TESTS
+	std::cout << "\nStroke Batching Tests:\n";
+	bool allBatchingPassed = true;
+
+	// The points a flattened page draws, with the zero length joins an arc
+	// makes from a moveto to its own start left out
+	auto drawnPoints = [](const std::string &postscript) {
+		std::string flat;
+		FlatteningWriter flattener(flat);
+		flattener.raw(postscript);
+		std::vector<std::pair<double, double>> points;
+		std::istringstream lines(flat);
+		std::string line;
+		while (std::getline(lines, line))
+		{
+			double x;
+			double y;
+			char op[16];
+			if (std::sscanf(line.c_str(), "%lf %lf %15s", &x, &y, op) != 3)
+			{
+				continue;
+			}
+			if (std::strcmp(op, "lineto") == 0 && !points.empty() &&
+				std::fabs(points.back().first - x) < 1e-4 && std::fabs(points.back().second - y) < 1e-4)
+			{
+				continue;
+			}
+			points.emplace_back(x, y);
+		}
+		return points;
+	};
+	auto samePoints = [](const std::vector<std::pair<double, double>> &a, const std::vector<std::pair<double, double>> &b) {
+		if (a.size() != b.size() || a.empty())
+		{
+			return false;
+		}
+		for (std::size_t i = 0; i < a.size(); ++i)
+		{
+			if (std::fabs(a[i].first - b[i].first) > 1e-4 || std::fabs(a[i].second - b[i].second) > 1e-4)
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+	auto strokeLines = [](const std::string &postscript) {
+		std::istringstream lines(postscript);
+		std::string line;
+		std::size_t count = 0;
+		while (std::getline(lines, line))
+		{
+			count += line == "stroke";
+		}
+		return count;
+	};
+	auto batchedText = [](const ShapeValue &shape, std::size_t &strokes, std::size_t &joined) {
+		std::string out;
+		PostScriptWriter writer(out);
+		StrokeBatchingWriter<PostScriptWriter> batching(writer);
+		shape.render(batching);
+		batching.finish();
+		strokes = batching.getStrokeCount();
+		joined = batching.getJoinedCount();
+		return out;
+	};
+
+	// **** A row of leaves is one path and one stroke, drawing the same points ****
+	std::vector<ShapeValue> batchRow;
+	batchRow.push_back(ShapeValue::circle(5));
+	batchRow.push_back(ShapeValue::rectangle(10, 20));
+	batchRow.push_back(ShapeValue::circle(3));
+	batchRow.push_back(ShapeValue::polygon(5, 8));
+	batchRow.push_back(ShapeValue::custom(30));
+	batchRow.push_back(ShapeValue::circle(2));
+	ShapeValue batchScene = ShapeValue::horizontal(batchRow);
+	std::size_t batchStrokes;
+	std::size_t batchJoined;
+	std::string batched = batchedText(batchScene, batchStrokes, batchJoined);
+	std::string unbatched = batchScene.generatePostScript();
+	if (batchStrokes != 1 || batchJoined != 16 || strokeLines(batched) != 1 ||
+		!samePoints(drawnPoints(batched), drawnPoints(unbatched)))
+	{
+		std::cout << "Batched row is not one stroke of the same path: " << batchStrokes << " strokes, "
+			<< batchJoined << " joined" << std::endl;
+		allBatchingPassed = false;
+	}
+
+	// **** Scales end a run, spacers are never stroked, and Shapes batch too ****
+	std::vector<ShapeValue> breaks;
+	breaks.push_back(ShapeValue::circle(4));
+	breaks.push_back(ShapeValue::circle(4));
+	breaks.push_back(ShapeValue::scaled(ShapeValue::circle(4), 2, 0.5));
+	breaks.push_back(ShapeValue::spacer(10, 10));
+	breaks.push_back(ShapeValue::circle(4));
+	breaks.push_back(ShapeValue::rectangle(6, 6));
+	ShapeValue breakScene = ShapeValue::vertical(breaks);
+	std::string breakBatched = batchedText(breakScene, batchStrokes, batchJoined);
+	std::string breakUnbatched = breakScene.generatePostScript();
+	std::size_t scaleAt = breakBatched.find(" scale\n");
+	if (batchStrokes != 3 || batchJoined != 2 || scaleAt == std::string::npos ||
+		breakBatched.rfind("stroke\n", scaleAt) == std::string::npos ||
+		!samePoints(drawnPoints(breakBatched), drawnPoints(breakUnbatched)))
+	{
+		std::cout << "Batching joined paths across a scale or a spacer: " << batchStrokes << " strokes" << std::endl;
+		allBatchingPassed = false;
+	}
+	std::string shapeBatched;
+	appendBatched(vertCustomShape, shapeBatched);
+	if (strokeLines(shapeBatched) != 1 || !samePoints(drawnPoints(shapeBatched), drawnPoints(vertCustomShape.generatePostScript())))
+	{
+		std::cout << "Batched Shape does not draw the same" << std::endl;
+		allBatchingPassed = false;
+	}
+
+	if (allBatchingPassed) {
+		std::cout << "All stroke batching tests passed.\n";
+	}
+
+	////////////////////////////////RASTER TESTS
+	std::cout << "\nRaster Tests:\n";
+	bool allRasterPassed = true;
+
+	// **** The vector span kernel inks like the scalar one, tail included ****
+	RasterSegment diagonal{ 3.0f, 1.0f, 25.0f, 4.0f, 1.0f / (25.0f * 25.0f + 4.0f * 4.0f), 1.5f, 1.0f };
+	std::vector<float> vectorRow(37, 0.0f);
+	std::vector<float> scalarRow(37, 0.0f);
+	coverSpan(vectorRow.data(), 1, 36, 3.5f, diagonal);
+	coverSpanScalar(scalarRow.data(), 1, 36, 3.5f, diagonal);
+	for (std::size_t x = 0; x < vectorRow.size(); ++x)
+	{
+		if (std::fabs(vectorRow[x] - scalarRow[x]) > 1e-5f)
+		{
+			std::cout << "Vector span differs from scalar at " << x << std::endl;
+			allRasterPassed = false;
+			break;
+		}
+	}
+
+	// **** A rectangle is ink on its edges and paper inside and out ****
+	Raster rectRaster(60, 40);
+	rasterize(ShapeValue::rectangle(40, 20), rectRaster, Affine().translated(30, 20).scaled(1, -1));
+	int leftEdge = 255;
+	int topEdge = 255;
+	for (int i = 8; i <= 12; ++i)
+	{
+		leftEdge = std::min(leftEdge, (int)rectRaster.getPixel(i, 20));
+		topEdge = std::min(topEdge, (int)rectRaster.getPixel(30, i));
+	}
+	if (rectRaster.getPixel(30, 20) != 255 || rectRaster.getPixel(3, 20) != 255 || rectRaster.getPixel(30, 3) != 255 ||
+		leftEdge > 128 || topEdge > 128)
+	{
+		std::cout << "Rasterized rectangle is wrong: edges " << leftEdge << " " << topEdge << std::endl;
+		allRasterPassed = false;
+	}
+
+	// **** PGM and PPM are a header and a byte, or three, per pixel ****
+	std::ostringstream pgm;
+	std::ostringstream ppm;
+	rectRaster.writePgm(pgm);
+	rectRaster.writePpm(ppm);
+	if (pgm.str().compare(0, 13, "P5\n60 40\n255\n") != 0 || pgm.str().size() != 13 + 60 * 40 ||
+		ppm.str().compare(0, 13, "P6\n60 40\n255\n") != 0 || ppm.str().size() != 13 + 3 * 60 * 40 ||
+		(unsigned char)pgm.str()[13 + 20 * 60 + 30] != 255)
+	{
+		std::cout << "PGM or PPM output is wrong" << std::endl;
+		allRasterPassed = false;
+	}
+
+	// **** Batched strokes draw the same pixels, a different shape does not ****
+	Box batchBounds;
+	drawnBounds(batchScene, batchBounds);
+	Affine batchPixels = fitToRaster(batchBounds, 400, 120);
+	Raster plainRaster(400, 120);
+	Raster batchedRaster(400, 120);
+	rasterizePostScript(unbatched, plainRaster, batchPixels);
+	rasterizePostScript(batched, batchedRaster, batchPixels);
+	Raster thumb = thumbnail(batchScene, 400, 120);
+	RasterDiff batchDiff;
+	RasterDiff thumbDiff;
+	if (!compareRasters(plainRaster, batchedRaster, batchDiff, 1) || batchDiff.differing != 0 ||
+		!compareRasters(plainRaster, thumb, thumbDiff, 1) || thumbDiff.differing != 0)
+	{
+		std::cout << "Batched strokes rasterize differently, " << batchDiff.differing << " pixels" << std::endl;
+		allRasterPassed = false;
+	}
+	Raster circleRaster = thumbnail(ShapeValue::circle(10), 40, 40);
+	Raster polygonRaster = thumbnail(ShapeValue::polygon(5, 12), 40, 40);
+	RasterDiff shapeDiff;
+	if (!compareRasters(circleRaster, polygonRaster, shapeDiff) || shapeDiff.differing < 20 || shapeDiff.largest < 128 ||
+		compareRasters(circleRaster, rectRaster, shapeDiff))
+	{
+		std::cout << "Different shapes rasterize the same" << std::endl;
+		allRasterPassed = false;
+	}
+
+	if (allRasterPassed) {
+		std::cout << "All raster tests passed.\n";
+	}
+
+	////////////////////////////////BUILDER TESTS
+	std::cout << "\nBuilder Tests:\n";
+	bool allBuilderPassed = true;
+
+	// Composites only take vectors that are moved in, and wrappers no temporaries
+	static_assert(!std::is_constructible<MultiVertical, std::vector<unique_ptr<Shape>>&>::value,
+		"MultiVertical must not take a vector it does not own");
+	static_assert(!std::is_constructible<MultiHorizontal, std::vector<unique_ptr<Shape>>&>::value,
+		"MultiHorizontal must not take a vector it does not own");
+	static_assert(!std::is_constructible<Rotated, Circle, int>::value, "Rotated must not refer to a temporary");
+	static_assert(!std::is_constructible<Transformed, Circle, Affine>::value, "Transformed must not refer to a temporary");
+
+	// **** Built in place, a composite matches one built from a vector ****
+	std::vector<unique_ptr<Shape>> builtRow;
+	builtRow.push_back(make_unique<Circle>(5));
+	builtRow.push_back(make_unique<Rectangle>(10, 20));
+	builtRow.push_back(make_unique<Rotated>(make_unique<Custom>(40), 90));
+	builtRow.push_back(make_unique<Polygon>(7, 3));
+	MultiHorizontal ownedRow(std::move(builtRow));
+	CompositeBuilder<MultiHorizontal> rowBuilder(4);
+	rowBuilder.emplace<Circle>(5).emplace<Rectangle>(10, 20).emplace<Rotated>(make_unique<Custom>(40), 90).emplace<Polygon>(7, 3);
+	if (rowBuilder.getSize() != 4 || rowBuilder.getExtents().width != ownedRow.width)
+	{
+		std::cout << "Builder extents are wrong while children are added" << std::endl;
+		allBuilderPassed = false;
+	}
+	unique_ptr<MultiHorizontal> builtShape = rowBuilder.build();
+	if (builtShape->generatePostScript() != ownedRow.generatePostScript() || builtShape->width != ownedRow.width ||
+		builtShape->height != ownedRow.height || builtShape->getSize() != 4 || rowBuilder.getSize() != 0)
+	{
+		std::cout << "Built MultiHorizontal does not match" << std::endl;
+		allBuilderPassed = false;
+	}
+
+	// **** Nested builders, for every kind of composite ****
+	unique_ptr<MultiVertical> builtColumn = CompositeBuilder<MultiVertical>(3)
+		.add(CompositeBuilder<MultiLayered>().emplace<Circle>(8).emplace<Square>(6))
+		.add(CompositeBuilder<Horizontal>().emplace<Triangle>(9).emplace<Spacer>(4, 4))
+		.add(CompositeBuilder<Vertical>().emplace<Rectangle>(3, 4).add(CompositeBuilder<Layered>().emplace<Custom>(12)))
+		.build();
+	std::vector<unique_ptr<Shape>> layeredPart;
+	layeredPart.push_back(make_unique<Circle>(8));
+	layeredPart.push_back(make_unique<Square>(6));
+	std::vector<unique_ptr<Shape>> horizontalPart;
+	horizontalPart.push_back(make_unique<Triangle>(9));
+	horizontalPart.push_back(make_unique<Spacer>(4, 4));
+	std::vector<unique_ptr<Shape>> innerLayered;
+	innerLayered.push_back(make_unique<Custom>(12));
+	std::vector<unique_ptr<Shape>> verticalPart;
+	verticalPart.push_back(make_unique<Rectangle>(3, 4));
+	verticalPart.push_back(make_unique<Layered>(std::move(innerLayered)));
+	std::vector<unique_ptr<Shape>> columnParts;
+	columnParts.push_back(make_unique<MultiLayered>(std::move(layeredPart)));
+	columnParts.push_back(make_unique<Horizontal>(std::move(horizontalPart)));
+	columnParts.push_back(make_unique<Vertical>(std::move(verticalPart)));
+	MultiVertical vectorColumn(std::move(columnParts));
+	if (builtColumn->generatePostScript() != vectorColumn.generatePostScript() ||
+		builtColumn->width != vectorColumn.width || builtColumn->height != vectorColumn.height)
+	{
+		std::cout << "Nested builders do not match" << std::endl;
+		allBuilderPassed = false;
+	}
+
+	if (allBuilderPassed) {
+		std::cout << "All builder tests passed.\n";
+	}
+
+	////////////////////////////////STREAMING COMPOSITE TESTS
+	std::cout << "\nStreaming Composite Tests:\n";
+	bool allStreamingPassed = true;
+
+	// Rectangle that counts how many of its kind are alive
+	struct CountedRectangle : public Rectangle {
+		CountedRectangle(double w, double h, int &live, int &peak) : Rectangle(w, h), live_(live)
+		{
+			peak = std::max(peak, ++live_);
+		}
+		~CountedRectangle()
+		{
+			--live_;
+		}
+		int &live_;
+	};
+	int liveRows = 0;
+	int peakRows = 0;
+	const int streamedCount = 50;
+	auto rowWidth = [](std::size_t i) { return 5.0 + (i * 7) % 11; };
+	auto rowHeight = [](std::size_t i) { return 2.0 + (i * 3) % 13; };
+
+	// **** A streamed row matches the MultiHorizontal of the same children, one alive at a time ****
+	StreamingHorizontal streamedRow(generateChildren(streamedCount,
+		[&](std::size_t i, double &w, double &h) { w = rowWidth(i); h = rowHeight(i); },
+		[&](std::size_t i) -> unique_ptr<Shape> { return make_unique<CountedRectangle>(rowWidth(i), rowHeight(i), liveRows, peakRows); }));
+	int peakAfterSizes = peakRows;
+	CompositeBuilder<MultiHorizontal> fixedRowBuilder(streamedCount);
+	for (int i = 0; i < streamedCount; ++i)
+	{
+		fixedRowBuilder.emplace<Rectangle>(rowWidth(i), rowHeight(i));
+	}
+	unique_ptr<MultiHorizontal> fixedRow = fixedRowBuilder.build();
+	std::ostringstream streamedText;
+	bool streamedOk = streamedRow.writePostScript(streamedText);
+	if (peakAfterSizes != 0 || streamedRow.generatePostScript() != fixedRow->generatePostScript() || !streamedOk ||
+		streamedText.str() != fixedRow->generatePostScript() || streamedRow.width != fixedRow->width ||
+		streamedRow.height != fixedRow->height || streamedRow.getChildCount() != (std::size_t)streamedCount ||
+		streamedRow.getSize() != 0 || peakRows != 1 || liveRows != 0)
+	{
+		std::cout << "Streamed row does not match, " << peakRows << " rows alive at once" << std::endl;
+		allStreamingPassed = false;
+	}
+
+	// **** Columns of composites stream too ****
+	auto makeBand = [](std::size_t i) {
+		return CompositeBuilder<MultiHorizontal>(2).emplace<Circle>(3 + i % 4).emplace<Custom>(10 + i % 3).build();
+	};
+	StreamingVertical streamedColumn(generateChildren(12,
+		[&](std::size_t i, double &w, double &h) {
+			CompositeExtents extents;
+			addHorizontalExtents(extents, 2 * (3.0 + i % 4), 2 * (3.0 + i % 4));
+			addHorizontalExtents(extents, 10.0 + i % 3, 10.0 + i % 3);
+			w = extents.width;
+			h = extents.height;
+		},
+		[&](std::size_t i) -> unique_ptr<Shape> { return makeBand(i); }));
+	CompositeBuilder<MultiVertical> fixedColumnBuilder(12);
+	for (std::size_t i = 0; i < 12; ++i)
+	{
+		fixedColumnBuilder.add(makeBand(i));
+	}
+	unique_ptr<MultiVertical> fixedColumn = fixedColumnBuilder.build();
+	if (streamedColumn.generatePostScript() != fixedColumn->generatePostScript() ||
+		streamedColumn.width != fixedColumn->width || streamedColumn.height != fixedColumn->height)
+	{
+		std::cout << "Streamed column does not match" << std::endl;
+		allStreamingPassed = false;
+	}
+
+	if (allStreamingPassed) {
+		std::cout << "All streaming composite tests passed.\n";
+	}
+
+	////////////////////////////////PAGINATION TESTS
+	std::cout << "\nPagination Tests:\n";
+	bool allPaginationPassed = true;
+
+	// **** Pages cover every child in order, and each fits unless it holds one child ****
+	std::vector<double> pageLengths;
+	for (int i = 0; i < 400; ++i)
+	{
+		pageLengths.push_back((i * 37) % 60 + (i % 50 == 0 ? 900 : 0));
+	}
+	PageBreaks lengthBreaks(pageLengths);
+	std::vector<PageSlice> lengthPages = lengthBreaks.paginate(720);
+	std::size_t nextChild = 0;
+	for (const PageSlice &slice : lengthPages)
+	{
+		double used = lengthBreaks.getStart(slice.last) - lengthBreaks.getStart(slice.first) - 1;
+		if (slice.first != nextChild || slice.last <= slice.first || (used > 720 && slice.last - slice.first != 1))
+		{
+			std::cout << "Page of children " << slice.first << " to " << slice.last << " is wrong" << std::endl;
+			allPaginationPassed = false;
+		}
+		nextChild = slice.last;
+	}
+	if (nextChild != pageLengths.size())
+	{
+		std::cout << "Pages end at child " << nextChild << " of " << pageLengths.size() << std::endl;
+		allPaginationPassed = false;
+	}
+
+	// **** The binary search breaks where laying out a page child by child does ****
+	std::vector<PageSlice> greedyPages;
+	for (std::size_t first = 0; first < pageLengths.size();)
+	{
+		std::size_t last = first + 1;
+		double used = pageLengths[first];
+		while (last < pageLengths.size() && used + 1 + pageLengths[last] <= 720)
+		{
+			used += 1 + pageLengths[last++];
+		}
+		greedyPages.push_back(PageSlice{ first, last });
+		first = last;
+	}
+	bool sameBreaks = greedyPages.size() == lengthPages.size();
+	for (std::size_t i = 0; sameBreaks && i < greedyPages.size(); ++i)
+	{
+		sameBreaks = greedyPages[i].first == lengthPages[i].first && greedyPages[i].last == lengthPages[i].last;
+	}
+	if (!sameBreaks)
+	{
+		std::cout << "Page breaks differ from laying out child by child" << std::endl;
+		allPaginationPassed = false;
+	}
+
+	// **** The pages of a stack hold its own output, and threads do not change them ****
+	auto pagesBody = [](const std::vector<std::string> &pages) {
+		std::string body;
+		for (const std::string &page : pages)
+		{
+			std::size_t start = page.find('\n') + 1;
+			std::size_t end = page.rfind("showpage");
+			body += page.substr(start, end - start);
+		}
+		return body;
+	};
+	CompositeBuilder<MultiVertical> tallBuilder(300);
+	for (int i = 0; i < 300; ++i)
+	{
+		if (i % 3 == 0)
+		{
+			tallBuilder.emplace<Circle>(5 + i % 7);
+		}
+		else
+		{
+			tallBuilder.emplace<Rectangle>(20 + i % 30, 10 + i % 17);
+		}
+	}
+	unique_ptr<MultiVertical> tallStack = tallBuilder.build();
+	PageOptions letter;
+	std::vector<std::string> tallPages = renderPages(*tallStack, letter, 4);
+	std::vector<std::string> tallPagesOneThread = renderPages(*tallStack, letter, 1);
+	if (tallPages.size() != pageBreaks(*tallStack).paginate(letter.pageHeight - 2 * letter.margin).size() ||
+		tallPages.size() < 2 || tallPages != tallPagesOneThread || pagesBody(tallPages) != tallStack->generatePostScript())
+	{
+		std::cout << "Pages of a tall stack do not hold its output" << std::endl;
+		allPaginationPassed = false;
+	}
+
+	// **** Wide rows break across the page ****
+	std::vector<unique_ptr<Shape>> wideShapes;
+	for (int i = 0; i < 60; ++i)
+	{
+		wideShapes.push_back(make_unique<Square>(10 + i % 25));
+	}
+	Horizontal wideRow(std::move(wideShapes));
+	std::vector<std::string> widePages = renderPages(wideRow, letter, 2);
+	if (widePages.size() != pageBreaks(wideRow).paginate(letter.pageWidth - 2 * letter.margin).size() ||
+		widePages.size() < 2 || pagesBody(widePages) != wideRow.generatePostScript())
+	{
+		std::cout << "Pages of a wide row do not hold its output" << std::endl;
+		allPaginationPassed = false;
+	}
+
+	// **** Shapes that are not stacks or rows are not paginated ****
+	Circle unpaged(10);
+	if (!renderPages(unpaged).empty())
+	{
+		std::cout << "A circle was paginated" << std::endl;
+		allPaginationPassed = false;
+	}
+
+	if (allPaginationPassed) {
+		std::cout << "All pagination tests passed.\n";
+	}
+
+	////////////////////////////////PULL RENDER TESTS
+	std::cout << "\nPull Render Tests:\n";
+	bool allPullPassed = true;
+
+	// A tree with every kind of shape the pull renderer walks into or writes whole
+	auto makePullDocument = [](int seed) {
+		Rectangle scaledSource(10 + seed, 4);
+		std::vector<unique_ptr<Shape>> mutableShapes;
+		mutableShapes.push_back(make_unique<Circle>(3 + seed));
+		mutableShapes.push_back(make_unique<Triangle>(6));
+		std::vector<unique_ptr<Shape>> layeredShapes;
+		layeredShapes.push_back(make_unique<Square>(8));
+		layeredShapes.push_back(make_unique<Custom>(5 + seed));
+		std::vector<unique_ptr<Shape>> rowShapes;
+		rowShapes.push_back(make_unique<Spacer>(3, 3));
+		rowShapes.push_back(make_unique<Layered>(std::move(layeredShapes)));
+		rowShapes.push_back(make_unique<MutableHorizontal>(std::move(mutableShapes)));
+		CompositeBuilder<MultiVertical> document(6);
+		for (int i = 0; i < 4; ++i)
+		{
+			document.add(CompositeBuilder<MultiHorizontal>(2).emplace<Circle>(2 + i).emplace<Rectangle>(5, 3 + i));
+		}
+		document.emplace<Rotated>(make_unique<Transformed>(make_unique<Scaled>(scaledSource, 2, 0.5), Affine().rotated(30)), 90);
+		document.emplace<Horizontal>(std::move(rowShapes));
+		return document.build();
+	};
+
+	// **** The chunks make up generatePostScript(), none longer than asked ****
+	unique_ptr<MultiVertical> pullDocument = makePullDocument(0);
+	std::string pullExpected = pullDocument->generatePostScript();
+	for (std::size_t chunkSize : { (std::size_t)1, (std::size_t)7, (std::size_t)64, (std::size_t)100000 })
+	{
+		PullRenderer renderer(*pullDocument, chunkSize);
+		std::string pulled;
+		std::string chunk;
+		bool sizesOk = true;
+		std::size_t chunks = 0;
+		while (renderer.next(chunk))
+		{
+			sizesOk = sizesOk && chunk.size() <= chunkSize && (chunk.size() == chunkSize || renderer.isDone());
+			pulled += chunk;
+			++chunks;
+		}
+		if (pulled != pullExpected || !sizesOk || !renderer.isDone() || renderer.getBytesWritten() != pullExpected.size() ||
+			renderer.next(chunk) || !chunk.empty() || chunks != (pullExpected.size() + chunkSize - 1) / chunkSize)
+		{
+			std::cout << "Pulled chunks of " << chunkSize << " bytes do not make up the output" << std::endl;
+			allPullPassed = false;
+		}
+	}
+
+	// **** Documents pulled in turns on one thread come out whole ****
+	std::vector<unique_ptr<MultiVertical>> pullDocuments;
+	std::vector<PullRenderer> pullRenderers;
+	std::vector<std::string> pullOutputs(3);
+	for (int i = 0; i < 3; ++i)
+	{
+		pullDocuments.push_back(makePullDocument(i));
+	}
+	for (int i = 0; i < 3; ++i)
+	{
+		pullRenderers.emplace_back(*pullDocuments[i], 16 + 16 * i);
+	}
+	for (bool pulledAny = true; pulledAny;)
+	{
+		pulledAny = false;
+		for (int i = 0; i < 3; ++i)
+		{
+			std::string chunk;
+			if (pullRenderers[i].next(chunk))
+			{
+				pullOutputs[i] += chunk;
+				pulledAny = true;
+			}
+		}
+	}
+	for (int i = 0; i < 3; ++i)
+	{
+		if (pullOutputs[i] != pullDocuments[i]->generatePostScript())
+		{
+			std::cout << "Document " << i << " pulled in turns is wrong" << std::endl;
+			allPullPassed = false;
+		}
+	}
+
+	// **** Leaves and shapes that are not walked into come out whole ****
+	Circle pullCircle(4);
+	PullRenderer circleRenderer(pullCircle, 5);
+	std::string circlePulled;
+	for (std::string chunk; circleRenderer.next(chunk);)
+	{
+		circlePulled += chunk;
+	}
+	if (circlePulled != pullCircle.generatePostScript() || circleRenderer.getDepth() != 0)
+	{
+		std::cout << "Pulled circle is wrong" << std::endl;
+		allPullPassed = false;
+	}
+
+#ifdef PULL_RENDER_COROUTINES_AVAILABLE
+	// **** The coroutine gives the same chunks ****
+	std::string coroutineOutput;
+	std::size_t coroutineChunks = 0;
+	for (const std::string &chunk : renderChunks(*pullDocument, 64))
+	{
+		coroutineOutput += chunk;
+		++coroutineChunks;
+	}
+	PostScriptChunks stepped = renderChunks(*pullDocument, 64);
+	std::string steppedOutput;
+	for (std::string chunk; stepped.next(chunk);)
+	{
+		steppedOutput += chunk;
+	}
+	if (coroutineOutput != pullExpected || steppedOutput != pullExpected || coroutineChunks != (pullExpected.size() + 63) / 64)
+	{
+		std::cout << "Coroutine chunks do not make up the output" << std::endl;
+		allPullPassed = false;
+	}
+#endif
+
+	if (allPullPassed) {
+		std::cout << "All pull render tests passed.\n";
+	}
+
+	////////////////////////////////PERSISTENT SHAPE TESTS
+	std::cout << "\nPersistent Shape Tests:\n";
+	bool allPersistentPassed = true;
+
+	// A column of rows, like a document, and the same built as fixed composites
+	auto persistentRowSizes = [](int row) {
+		std::vector<double> sizes;
+		for (int i = 0; i < 4 + row % 3; ++i)
+		{
+			sizes.push_back(5 + (row * 7 + i * 3) % 11);
+		}
+		return sizes;
+	};
+	auto fixedColumnOf = [](const std::vector<std::vector<double>> &rows) {
+		CompositeBuilder<MultiVertical> column(rows.size());
+		for (const std::vector<double> &sizes : rows)
+		{
+			CompositeBuilder<MultiHorizontal> row(sizes.size());
+			for (double size : sizes)
+			{
+				row.emplace<Rectangle>(size, size / 2 + 1);
+			}
+			column.add(row);
+		}
+		return column.build();
+	};
+	std::vector<std::vector<double>> persistentRows;
+	for (int row = 0; row < 30; ++row)
+	{
+		persistentRows.push_back(persistentRowSizes(row));
+	}
+	unique_ptr<MultiVertical> persistentFixed = fixedColumnOf(persistentRows);
+
+	// **** A copied tree writes what the tree it came from does ****
+	PersistentShape persistentColumn = PersistentShape::fromShape(*persistentFixed);
+	std::string persistentOriginal = persistentColumn.generatePostScript();
+	if (persistentOriginal != persistentFixed->generatePostScript() || persistentColumn.getSize() != 30 ||
+		persistentColumn.getWidth() != persistentFixed->width || persistentColumn.getHeight() != persistentFixed->height)
+	{
+		std::cout << "Persistent copy of a column does not match it" << std::endl;
+		allPersistentPassed = false;
+	}
+
+	// **** Edits give new trees and leave the old ones as they were ****
+	PersistentShape edited = persistentColumn
+		.update({ 3, 1 }, [](const PersistentShape &) { return PersistentShape::leaf(ShapeValue::rectangle(40, 21)); })
+		.erase(7)
+		.insert(0, PersistentShape::horizontal({ PersistentShape::leaf(ShapeValue::rectangle(9, 5.5)) }))
+		.update({ 20 }, [](const PersistentShape &row) { return row.append(PersistentShape::leaf(ShapeValue::rectangle(12, 7))); });
+	std::vector<std::vector<double>> editedRows = persistentRows;
+	editedRows[3][1] = 40;
+	editedRows.erase(editedRows.begin() + 7);
+	editedRows.insert(editedRows.begin(), std::vector<double>{ 9 });
+	editedRows[20].push_back(12);
+	if (edited.generatePostScript() != fixedColumnOf(editedRows)->generatePostScript() ||
+		persistentColumn.generatePostScript() != persistentOriginal)
+	{
+		std::cout << "Persistent edits do not match the same edits made by hand" << std::endl;
+		allPersistentPassed = false;
+	}
+
+	// **** Children an edit does not reach are shared, not copied ****
+	PersistentShape oneChanged = persistentColumn.update({ 12, 0 }, [](const PersistentShape &) {
+		return PersistentShape::leaf(ShapeValue::circle(3));
+	});
+	bool shared = oneChanged.getNode() != persistentColumn.getNode() &&
+		oneChanged.getShape(12).getNode() != persistentColumn.getShape(12).getNode();
+	for (unsigned int i = 0; i < 30; ++i)
+	{
+		shared = shared && (i == 12 || oneChanged.getShape(i).getNode() == persistentColumn.getShape(i).getNode());
+	}
+	for (unsigned int i = 1; i < persistentColumn.getShape(12).getSize(); ++i)
+	{
+		shared = shared && oneChanged.getShape(12).getShape(i).getNode() == persistentColumn.getShape(12).getShape(i).getNode();
+	}
+	if (!shared)
+	{
+		std::cout << "Persistent edit copied children it did not change" << std::endl;
+		allPersistentPassed = false;
+	}
+
+	// **** Positions and paths that lead nowhere change nothing ****
+	bool editCalled = false;
+	auto markEdit = [&](const PersistentShape &shape) { editCalled = true; return shape; };
+	if (persistentColumn.erase(30).getNode() != persistentColumn.getNode() ||
+		persistentColumn.replace(30, PersistentShape()).getNode() != persistentColumn.getNode() ||
+		persistentColumn.update({ 30 }, markEdit).getNode() != persistentColumn.getNode() ||
+		persistentColumn.update({ 3, 1, 0 }, markEdit).getNode() != persistentColumn.getNode() || editCalled ||
+		persistentColumn.getShape(30).getSize() != 0 || persistentColumn.getShape(3).getShape(1).getShape(0).getSize() != 0 ||
+		!persistentColumn.hasPath({ 3, 1 }) || persistentColumn.hasPath({ 3, 100 }) ||
+		persistentColumn.insert(100, PersistentShape()).getSize() != 31)
+	{
+		std::cout << "Persistent shape accepted a position past its last child" << std::endl;
+		allPersistentPassed = false;
+	}
+
+	// **** Readers draw whole versions while another thread edits ****
+	PersistentScene editedScene(PersistentShape::vertical({}));
+	PersistentShape firstVersion = editedScene.snapshot();
+	std::string rectangleText = PersistentShape::vertical({ PersistentShape::leaf(ShapeValue::rectangle(10, 4)) }).generatePostScript();
+	std::atomic<bool> editing(true);
+	std::atomic<int> tornReads(0);
+	std::atomic<int> reads(0);
+	std::vector<std::thread> readers;
+	for (int r = 0; r < 2; ++r)
+	{
+		readers.emplace_back([&]() {
+			while (editing.load())
+			{
+				PersistentShape seen = editedScene.snapshot();
+				if (seen.generatePostScript().size() != seen.getSize() * rectangleText.size())
+				{
+					++tornReads;
+				}
+				++reads;
+			}
+		});
+	}
+	for (int i = 0; i < 300; ++i)
+	{
+		editedScene.edit([](const PersistentShape &root) { return root.append(PersistentShape::leaf(ShapeValue::rectangle(10, 4))); });
+		if (i % 50 == 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+	editing = false;
+	for (std::thread &reader : readers)
+	{
+		reader.join();
+	}
+	if (tornReads != 0 || editedScene.getVersion() != 300 || editedScene.snapshot().getSize() != 300 ||
+		!firstVersion.generatePostScript().empty())
+	{
+		std::cout << "Snapshots read during edits are wrong, " << tornReads << " of " << reads << std::endl;
+		allPersistentPassed = false;
+	}
+
+	// **** Replaced versions are freed once no snapshot holds them ****
+	std::weak_ptr<const PersistentNode> oldRoot = editedScene.snapshot().getNode();
+	PersistentShape held = editedScene.snapshot();
+	editedScene.edit([](const PersistentShape &root) { return root.erase(0); });
+	bool keptWhileHeld = !oldRoot.expired();
+	held = PersistentShape();
+	PersistentShape stale = editedScene.snapshot();
+	if (!keptWhileHeld || !oldRoot.expired() || !editedScene.tryPublish(stale, stale.erase(0)) ||
+		editedScene.tryPublish(stale, stale.erase(1)) || editedScene.snapshot().getSize() != 298)
+	{
+		std::cout << "Persistent versions are not freed or published as they should be" << std::endl;
+		allPersistentPassed = false;
+	}
+
+	if (allPersistentPassed) {
+		std::cout << "All persistent shape tests passed.\n";
+	}
+
+	////////////////////////////////RENDER CONTROL TESTS
+	std::cout << "\nRender Control Tests:\n";
+	bool allControlPassed = true;
+
+	// **** A render that is not stopped writes what generatePostScript() does ****
+	unique_ptr<MultiVertical> controlDocument = makePullDocument(2);
+	std::string controlExpected = controlDocument->generatePostScript();
+	std::string controlOut = "%!PS\n";
+	RenderProgress controlProgress;
+	CancellationToken unusedToken;
+	RenderControl unstopped(&unusedToken, RenderControl::Clock::time_point::max(), &controlProgress, 16);
+	RenderStatus unstoppedStatus = renderControlled(*controlDocument, controlOut, unstopped);
+	// The document, its 4 rows of 2, the Rotated, Transformed and Scaled, the
+	// row of a Spacer, a Layered of 2 and a mutable row of 2
+	const std::size_t controlNodes = 1 + 4 * 3 + 3 + 1 + 1 + 3 + 3;
+	if (unstoppedStatus != RenderFinished || controlOut != "%!PS\n" + controlExpected ||
+		controlProgress.nodes != controlNodes || controlProgress.bytes != controlExpected.size() ||
+		unstopped.getChecks() < controlExpected.size() / 16 / 8)
+	{
+		std::cout << "Controlled render that ran to the end is wrong, " << controlProgress.nodes << " nodes" << std::endl;
+		allControlPassed = false;
+	}
+
+	// **** A cancelled render stops and gives back its output ****
+	CancellationToken cancelled;
+	cancelled.cancel();
+	std::string cancelledOut = "kept";
+	RenderControl cancelledControl(&cancelled);
+	if (renderControlled(*controlDocument, cancelledOut, cancelledControl) != RenderCancelled ||
+		cancelledOut != "kept" || cancelledControl.getNodes() != 0)
+	{
+		std::cout << "Cancelled render did not stop" << std::endl;
+		allControlPassed = false;
+	}
+
+	// **** A polygon with many sides stops inside its loop at the deadline ****
+	Polygon manySides(2000000, 1);
+	std::string deadlineOut;
+	RenderProgress deadlineProgress;
+	RenderControl deadlineControl = RenderControl::withTimeout(std::chrono::milliseconds(2), nullptr, &deadlineProgress);
+	auto deadlineStart = std::chrono::steady_clock::now();
+	RenderStatus deadlineStatus = renderControlled(manySides, deadlineOut, deadlineControl);
+	double deadlineMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - deadlineStart).count();
+	if (deadlineStatus != RenderTimedOut || !deadlineOut.empty() || deadlineOut.capacity() > 32 ||
+		deadlineProgress.bytes == 0 || deadlineProgress.bytes >= manySides.generatePostScript().size() / 2 || deadlineMs > 500)
+	{
+		std::cout << "Polygon render ran past its deadline, " << deadlineMs << " ms" << std::endl;
+		allControlPassed = false;
+	}
+
+	// **** Another thread can cancel a render and watch its progress ****
+	CompositeBuilder<MultiVertical> longBuilder(200000);
+	for (int i = 0; i < 200000; ++i)
+	{
+		longBuilder.emplace<Custom>(5 + i % 9);
+	}
+	unique_ptr<MultiVertical> longDocument = longBuilder.build();
+	CancellationToken stopLong;
+	RenderProgress longProgress;
+	std::string longOut;
+	std::thread canceller([&]() {
+		while (longProgress.nodes.load() < 1000)
+		{
+			std::this_thread::yield();
+		}
+		stopLong.cancel();
+	});
+	RenderControl longControl(&stopLong, RenderControl::Clock::time_point::max(), &longProgress);
+	RenderStatus longStatus = renderControlled(*longDocument, longOut, longControl);
+	canceller.join();
+	if (longStatus != RenderCancelled || !longOut.empty() || longProgress.nodes < 1000 || longProgress.nodes >= 200000)
+	{
+		std::cout << "Render cancelled by another thread did not stop, " << longProgress.nodes << " nodes" << std::endl;
+		allControlPassed = false;
+	}
+
+	if (allControlPassed) {
+		std::cout << "All render control tests passed.\n";
+	}
+
 
 	return 0;
 }
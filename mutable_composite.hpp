@@ -0,0 +1,468 @@
+#ifndef MUTABLE_COMPOSITE_HPP_INCLUDED
+#define MUTABLE_COMPOSITE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include "shape.hpp"
+
+// Composites whose children can be inserted, erased, replaced and resized.
+// The children are kept in a balanced tree (an implicit treap) where every
+// node also holds the sum and max of the widths and heights below it, so
+// extents and child offsets are updated in O(log n) per edit instead of
+// the O(n) loop the Multi constructors run.
+//
+// When a mutable composite is a child of another mutable composite, a change
+// of its extents is passed on to the parent, so every mutable ancestor stays
+// up to date. Extents do not propagate through the fixed composites.
+//
+// Output is the same as the matching fixed composite (Layered, MultiLayered,
+// MultiHorizontal, MultiVertical). Summed extents may differ in the last bit
+// because the sums are added in tree order rather than left to right.
+class MutableComposite : public Shape {
+public:
+	enum Layout { LayeredLayout, MultiLayeredLayout, HorizontalLayout, VerticalLayout };
+
+	MutableComposite(Layout layout) : layout_(layout)
+	{
+		width = 0;
+		height = 0;
+	}
+	//Null shapes are left out
+	MutableComposite(Layout layout, std::vector<unique_ptr<Shape>> shapes) : MutableComposite(layout)
+	{
+		for (unique_ptr<Shape> &shape : shapes)
+		{
+			if (!shape)
+			{
+				continue;
+			}
+			Node *node = makeNode(std::move(shape));
+			root_ = merge(root_, node);
+		}
+		root_ = detach(root_);
+		updateExtents();
+	}
+	MutableComposite(const MutableComposite &) = delete;
+	MutableComposite &operator=(const MutableComposite &) = delete;
+	~MutableComposite()
+	{
+		destroy(root_);
+	}
+
+	std::string generatePostScript() override
+	{
+		std::string mString = "";
+		PostScriptWriter writer(mString);
+		renderNode(root_, writer);
+		return mString;
+	}
+
+	unsigned int getSize() override
+	{
+		return count(root_);
+	}
+	Layout getLayout() const
+	{
+		return layout_;
+	}
+	//nullptr if there is no child number shapeNum
+	Shape* getShape(int shapeNum) override
+	{
+		Node *node = select(shapeNum);
+		return node ? node->shape.get() : nullptr;
+	}
+
+	// Insert a shape so that it becomes child number pos, or the last child
+	// if pos is past the end. A null shape is not inserted.
+	void insert(unsigned int pos, unique_ptr<Shape> shape)
+	{
+		if (!shape)
+		{
+			return;
+		}
+		Node *node = makeNode(std::move(shape));
+		Node *left;
+		Node *right;
+		split(root_, pos, left, right);
+		root_ = detach(merge(merge(left, node), right));
+		updateExtents();
+	}
+
+	void append(unique_ptr<Shape> shape)
+	{
+		insert(getSize(), std::move(shape));
+	}
+
+	//Remove child number pos and hand it back, nullptr if there is none
+	unique_ptr<Shape> erase(unsigned int pos)
+	{
+		if (pos >= getSize())
+		{
+			return nullptr;
+		}
+		Node *left;
+		Node *middle;
+		Node *right;
+		split(root_, pos, left, right);
+		split(right, 1, middle, right);
+		root_ = detach(merge(left, right));
+
+		unique_ptr<Shape> shape = release(middle);
+		updateExtents();
+		return shape;
+	}
+
+	// Put a new shape in place of child number pos and hand back the old one.
+	// If there is no child number pos, or shape is null, nothing changes and
+	// shape is handed back.
+	unique_ptr<Shape> replace(unsigned int pos, unique_ptr<Shape> shape)
+	{
+		Node *node = select(pos);
+		if (node == nullptr || !shape)
+		{
+			return shape;
+		}
+		unique_ptr<Shape> old = std::move(node->shape);
+		forgetParent(old.get());
+		node->shape = std::move(shape);
+		adopt(node);
+		nodeResized(node);
+		return old;
+	}
+
+	//Call after changing the width or height of child number pos in place
+	void childResized(unsigned int pos)
+	{
+		if (Node *node = select(pos))
+		{
+			nodeResized(node);
+		}
+	}
+
+	// Distance along the stacking direction from the start of this shape to
+	// the start of child number pos, i.e. the sum of (size + 1) of the
+	// children before it. Always 0 for the layered layouts.
+	double offset(unsigned int pos)
+	{
+		if (layout_ == LayeredLayout || layout_ == MultiLayeredLayout)
+		{
+			return 0;
+		}
+		double total = 0;
+		Node *node = root_;
+		while (node != nullptr)
+		{
+			unsigned int leftCount = count(node->left);
+			if (pos <= leftCount)
+			{
+				node = node->left;
+				continue;
+			}
+			// Everything left of this node and the node itself come before pos
+			if (node->left != nullptr)
+			{
+				total += stackSum(node->left) + leftCount;
+			}
+			total += stackSize(node) + 1;
+			pos -= leftCount + 1;
+			node = node->right;
+		}
+		return total;
+	}
+
+private:
+	struct Node {
+		unique_ptr<Shape> shape;
+		Node *left = nullptr;
+		Node *right = nullptr;
+		Node *parent = nullptr;
+		unsigned int priority = 0;
+		unsigned int count = 1;
+		double w = 0;
+		double h = 0;
+		double sumW = 0;
+		double sumH = 0;
+		double maxW = 0;
+		double maxH = 0;
+	};
+
+	static unsigned int count(Node *node)
+	{
+		return node ? node->count : 0;
+	}
+
+	double stackSize(Node *node) const
+	{
+		return layout_ == HorizontalLayout ? node->w : node->h;
+	}
+	double stackSum(Node *node) const
+	{
+		return layout_ == HorizontalLayout ? node->sumW : node->sumH;
+	}
+
+	// Recompute the totals of a node from its own size and its children
+	static void pull(Node *node)
+	{
+		node->count = 1;
+		node->sumW = node->w;
+		node->sumH = node->h;
+		node->maxW = node->w;
+		node->maxH = node->h;
+		for (Node *child : { node->left, node->right })
+		{
+			if (child != nullptr)
+			{
+				child->parent = node;
+				node->count += child->count;
+				node->sumW += child->sumW;
+				node->sumH += child->sumH;
+				node->maxW = std::max(node->maxW, child->maxW);
+				node->maxH = std::max(node->maxH, child->maxH);
+			}
+		}
+	}
+
+	//Splits the first k shapes of t into a and the rest into b
+	static void split(Node *t, unsigned int k, Node *&a, Node *&b)
+	{
+		if (t == nullptr)
+		{
+			a = nullptr;
+			b = nullptr;
+			return;
+		}
+		if (count(t->left) < k)
+		{
+			split(t->right, k - count(t->left) - 1, t->right, b);
+			a = t;
+		}
+		else
+		{
+			split(t->left, k, a, t->left);
+			b = t;
+		}
+		pull(t);
+		detach(a);
+		detach(b);
+	}
+
+	static Node *merge(Node *a, Node *b)
+	{
+		if (a == nullptr)
+		{
+			return b;
+		}
+		if (b == nullptr)
+		{
+			return a;
+		}
+		if (a->priority > b->priority)
+		{
+			a->right = merge(a->right, b);
+			pull(a);
+			return a;
+		}
+		b->left = merge(a, b->left);
+		pull(b);
+		return b;
+	}
+
+	static Node *detach(Node *node)
+	{
+		if (node != nullptr)
+		{
+			node->parent = nullptr;
+		}
+		return node;
+	}
+
+	Node *select(unsigned int pos) const
+	{
+		Node *node = root_;
+		while (node != nullptr)
+		{
+			unsigned int leftCount = count(node->left);
+			if (pos < leftCount)
+			{
+				node = node->left;
+			}
+			else if (pos == leftCount)
+			{
+				return node;
+			}
+			else
+			{
+				pos -= leftCount + 1;
+				node = node->right;
+			}
+		}
+		return nullptr;
+	}
+
+	//shape must not be null
+	Node *makeNode(unique_ptr<Shape> shape)
+	{
+		Node *node = new Node;
+		// xorshift, the priorities only need to look random
+		seed_ ^= seed_ << 13;
+		seed_ ^= seed_ >> 17;
+		seed_ ^= seed_ << 5;
+		node->priority = seed_;
+		node->shape = std::move(shape);
+		adopt(node);
+		node->w = node->shape->width;
+		node->h = node->shape->height;
+		pull(node);
+		return node;
+	}
+
+	unique_ptr<Shape> release(Node *node)
+	{
+		unique_ptr<Shape> shape = std::move(node->shape);
+		forgetParent(shape.get());
+		delete node;
+		return shape;
+	}
+
+	void adopt(Node *node)
+	{
+		MutableComposite *child = dynamic_cast<MutableComposite*>(node->shape.get());
+		if (child != nullptr)
+		{
+			child->parent_ = this;
+			child->parentNode_ = node;
+		}
+	}
+
+	static void forgetParent(Shape *shape)
+	{
+		MutableComposite *child = dynamic_cast<MutableComposite*>(shape);
+		if (child != nullptr)
+		{
+			child->parent_ = nullptr;
+			child->parentNode_ = nullptr;
+		}
+	}
+
+	static void destroy(Node *node)
+	{
+		if (node != nullptr)
+		{
+			destroy(node->left);
+			destroy(node->right);
+			delete node;
+		}
+	}
+
+	void nodeResized(Node *node)
+	{
+		node->w = node->shape->width;
+		node->h = node->shape->height;
+		for (Node *n = node; n != nullptr; n = n->parent)
+		{
+			pull(n);
+		}
+		updateExtents();
+	}
+
+	// Same rules as the fixed composites, which start their maxima at 0
+	void updateExtents()
+	{
+		double maxW = root_ ? std::max(0.0, root_->maxW) : 0;
+		double maxH = root_ ? std::max(0.0, root_->maxH) : 0;
+		double newWidth = maxW;
+		double newHeight = maxH;
+		if (layout_ == HorizontalLayout)
+		{
+			newWidth = root_ ? root_->sumW + root_->count : 0;
+		}
+		else if (layout_ == VerticalLayout)
+		{
+			newHeight = root_ ? root_->sumH + root_->count : 0;
+		}
+
+		bool changed = newWidth != width || newHeight != height;
+		width = newWidth;
+		height = newHeight;
+		if (changed && parent_ != nullptr)
+		{
+			parent_->nodeResized(parentNode_);
+		}
+	}
+
+	template <class Writer>
+	void renderNode(Node *node, Writer &w)
+	{
+		if (node == nullptr)
+		{
+			return;
+		}
+		renderNode(node->left, w);
+
+		Shape &shape = *node->shape;
+		switch (layout_)
+		{
+		case LayeredLayout:
+			w.raw(shape.generatePostScript());
+			break;
+		case MultiLayeredLayout:
+			emitTranslate(w, 0.0, 0.0);
+			w.raw(shape.generatePostScript());
+			emitTranslate(w, 0.0, 0.0);
+			w.endLine();
+			break;
+		case HorizontalLayout:
+			emitTranslate(w, shape.width / 2, height);
+			w.raw(shape.generatePostScript());
+			emitTranslate(w, (shape.width / 2) + 1, -height);
+			w.endLine();
+			break;
+		case VerticalLayout:
+			emitTranslate(w, width, shape.height / 2);
+			w.raw(shape.generatePostScript());
+			emitTranslate(w, -width, (shape.height / 2) + 1);
+			w.endLine();
+			break;
+		}
+
+		renderNode(node->right, w);
+	}
+
+	Layout layout_;
+	Node *root_ = nullptr;
+	unsigned int seed_ = 2463534242u;
+	MutableComposite *parent_ = nullptr;
+	Node *parentNode_ = nullptr;
+};
+
+//Mutable version of Layered
+class MutableLayered : public MutableComposite {
+public:
+	MutableLayered() : MutableComposite(LayeredLayout) {}
+	MutableLayered(std::vector<unique_ptr<Shape>> shapes) : MutableComposite(LayeredLayout, std::move(shapes)) {}
+};
+
+//Mutable version of MultiLayered
+class MutableMultiLayered : public MutableComposite {
+public:
+	MutableMultiLayered() : MutableComposite(MultiLayeredLayout) {}
+	MutableMultiLayered(std::vector<unique_ptr<Shape>> shapes) : MutableComposite(MultiLayeredLayout, std::move(shapes)) {}
+};
+
+//Mutable version of MultiHorizontal
+class MutableHorizontal : public MutableComposite {
+public:
+	MutableHorizontal() : MutableComposite(HorizontalLayout) {}
+	MutableHorizontal(std::vector<unique_ptr<Shape>> shapes) : MutableComposite(HorizontalLayout, std::move(shapes)) {}
+};
+
+//Mutable version of MultiVertical
+class MutableVertical : public MutableComposite {
+public:
+	MutableVertical() : MutableComposite(VerticalLayout) {}
+	MutableVertical(std::vector<unique_ptr<Shape>> shapes) : MutableComposite(VerticalLayout, std::move(shapes)) {}
+};
+
+#endif // MUTABLE_COMPOSITE_HPP_INCLUDED
@@ -0,0 +1,187 @@
+#ifndef PAGINATE_HPP_INCLUDED
+#define PAGINATE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include "shape.hpp"
+#include "sharded_render.hpp"
+
+// Splitting a stack or row of shapes over several pages.
+//
+// MultiVertical puts child i at the running total of height + 1 of the
+// children before it, MultiHorizontal does the same with width + 1. Those
+// running totals are kept as prefix sums, so where a child starts is one
+// lookup and the last child that still fits on a page starting at child i
+// is a search that gallops ahead and then halves. Finding the breaks of p
+// pages of k children each takes p searches of log k steps, after the one
+// pass over the n children that sums them.
+//
+// Each page holds whole children, one after another as the composite lays
+// them out, moved so the first starts at the page margin. A child longer
+// than a page gets a page to itself and runs over its edge. Across the
+// pages nothing is split: the children stay centered on one another as in
+// the composite, which starts at the margin on that side too.
+
+//Children first up to last, not including last, on one page
+struct PageSlice {
+	std::size_t first;
+	std::size_t last;
+};
+
+// Page breaks for children laid out one after another with a gap of 1,
+// given the length of each along the direction they are laid out in
+class PageBreaks {
+public:
+	PageBreaks(const std::vector<double> &lengths)
+	{
+		starts_.reserve(lengths.size() + 1);
+		double start = 0;
+		for (double length : lengths)
+		{
+			starts_.push_back(start);
+			start += length + 1;
+		}
+		starts_.push_back(start);
+	}
+
+	std::size_t getCount() const
+	{
+		return starts_.size() - 1;
+	}
+
+	//Where child i starts, or for i == getCount() one past where the last ends
+	double getStart(std::size_t i) const
+	{
+		return starts_[i];
+	}
+
+	// One past the last child that ends within pageLength of the start of
+	// child first. At least first + 1, so an oversized child gets a page.
+	std::size_t pageEnd(std::size_t first, double pageLength) const
+	{
+		// Child i ends at starts_[i + 1] - 1, so children up to i fit while
+		// starts_[i + 1] <= starts_[first] + pageLength + 1
+		double limit = starts_[first] + pageLength + 1;
+		std::size_t count = getCount();
+
+		// Doubles the step until it passes the end of the page, so the
+		// search takes the log of the children on the page, not of all
+		std::size_t low = first + 1;
+		std::size_t step = 1;
+		while (low + step <= count && starts_[low + step] <= limit)
+		{
+			low += step;
+			step *= 2;
+		}
+		std::size_t high = std::min(low + step, count + 1);
+		std::size_t end = std::upper_bound(starts_.begin() + low, starts_.begin() + high, limit) - starts_.begin() - 1;
+		return std::max(end, first + 1);
+	}
+
+	//Slices of children that fit on pages pageLength long, in order
+	std::vector<PageSlice> paginate(double pageLength) const
+	{
+		std::vector<PageSlice> pages;
+		for (std::size_t first = 0; first < getCount();)
+		{
+			std::size_t last = pageEnd(first, pageLength);
+			pages.push_back(PageSlice{ first, last });
+			first = last;
+		}
+		return pages;
+	}
+
+private:
+	std::vector<double> starts_;
+};
+
+//Size of the pages and the margin kept free on every side, in points
+struct PageOptions {
+	double pageWidth = 612;
+	double pageHeight = 792;
+	double margin = 36;
+};
+
+// True if shape can be split over pages, i.e. it is a MultiVertical,
+// Vertical, MultiHorizontal or Horizontal. vertical tells which way.
+inline bool isPaginable(Shape &shape, bool &vertical)
+{
+	vertical = dynamic_cast<MultiVertical*>(&shape) != nullptr || dynamic_cast<Vertical*>(&shape) != nullptr;
+	return vertical || dynamic_cast<MultiHorizontal*>(&shape) != nullptr || dynamic_cast<Horizontal*>(&shape) != nullptr;
+}
+
+//Page breaks of the children of a composite that isPaginable
+inline PageBreaks pageBreaks(Shape &shape)
+{
+	bool vertical = false;
+	isPaginable(shape, vertical);
+	std::vector<double> lengths(shape.getSize());
+	for (unsigned int i = 0; i < lengths.size(); ++i)
+	{
+		Shape &child = *shape.getShape(i);
+		lengths[i] = vertical ? child.height : child.width;
+	}
+	return PageBreaks(lengths);
+}
+
+// Appends one page: the children of slice in the composite's own output,
+// from the page margin, and showpage
+inline void appendPage(Shape &shape, const PageSlice &slice, const PageOptions &options, std::string &page)
+{
+	// The layouts center children on the width of a stack, or the height of
+	// a row, so the composite spans half of it to one and a half across
+	bool vertical = false;
+	isPaginable(shape, vertical);
+	PostScriptWriter writer(page);
+	emitTranslate(writer, options.margin - (vertical ? shape.width / 2 : 0),
+		options.margin - (vertical ? 0 : shape.height / 2));
+	for (std::size_t i = slice.first; i < slice.last; ++i)
+	{
+		appendFragment(shape, (unsigned int)i, page);
+	}
+	writer.op("showpage");
+	writer.endLine();
+}
+
+// Splits a MultiVertical, Vertical, MultiHorizontal or Horizontal over pages
+// and renders them, each on its own, on up to threads threads. Returns no
+// pages for any other shape.
+inline std::vector<std::string> renderPages(Shape &shape, const PageOptions &options = PageOptions(),
+	unsigned int threads = std::thread::hardware_concurrency())
+{
+	std::vector<std::string> pages;
+	bool vertical = false;
+	if (!isPaginable(shape, vertical) || shape.getSize() == 0)
+	{
+		return pages;
+	}
+	double pageLength = (vertical ? options.pageHeight : options.pageWidth) - 2 * options.margin;
+	std::vector<PageSlice> slices = pageBreaks(shape).paginate(pageLength);
+	pages.resize(slices.size());
+
+	std::atomic<std::size_t> nextPage(0);
+	auto work = [&]() {
+		for (std::size_t page = nextPage++; page < pages.size(); page = nextPage++)
+		{
+			appendPage(shape, slices[page], options, pages[page]);
+		}
+	};
+
+	threads = std::max(1u, std::min<unsigned int>(threads, pages.size()));
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < threads; ++i)
+	{
+		workers.emplace_back(work);
+	}
+	work();
+	for (std::thread &t : workers)
+	{
+		t.join();
+	}
+	return pages;
+}
+
+#endif // PAGINATE_HPP_INCLUDED
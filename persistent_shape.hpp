@@ -0,0 +1,536 @@
+#ifndef PERSISTENT_SHAPE_HPP_INCLUDED
+#define PERSISTENT_SHAPE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <utility>
+#include <algorithm>
+#include "shape.hpp"
+#include "shape_value.hpp"
+#include "mutable_composite.hpp"
+
+// Shape trees that are never changed, only replaced, so readers on other
+// threads can keep drawing a tree while it is being edited.
+//
+// A PersistentShape is a leaf, any ShapeValue, or a composite whose children
+// are kept in an implicit treap like MutableComposite's, with the sums and
+// maxima of the extents in every node. Nothing in a tree changes once it
+// is made. An edit copies the treap nodes on the way down to the child it
+// changes, and the composites above that, and shares everything else with
+// the tree it started from: an edit of one child among n takes O(log n)
+// new nodes per level of nesting. Nodes are reference counted, so a tree
+// is freed when the last snapshot that reaches it is dropped.
+//
+// PersistentScene holds the current tree. The editor publishes a new root
+// and readers take the one that is current with an atomic load, then draw
+// it without holding anything the editor waits for.
+//
+// Output is the same as the matching fixed composite, with the same caveat
+// as MutableComposite: summed extents may differ in the last bit.
+
+class PersistentShape;
+struct PersistentNode;
+struct PersistentChild;
+using PersistentNodeRef = std::shared_ptr<const PersistentNode>;
+using PersistentChildRef = std::shared_ptr<const PersistentChild>;
+
+//Treap node holding one child of a persistent composite
+struct PersistentChild {
+	PersistentNodeRef shape;
+	PersistentChildRef left;
+	PersistentChildRef right;
+	unsigned int priority;
+	unsigned int count;
+	double sumW;
+	double sumH;
+	double maxW;
+	double maxH;
+};
+
+struct PersistentNode {
+	enum Layout { LeafLayout, LayeredLayout, MultiLayeredLayout, HorizontalLayout, VerticalLayout };
+
+	Layout layout;
+	ShapeValue leaf;
+	PersistentChildRef children;
+	double width;
+	double height;
+};
+
+class PersistentShape {
+public:
+	using Layout = PersistentNode::Layout;
+
+	//An empty Layered
+	PersistentShape() : PersistentShape(makeComposite(PersistentNode::LayeredLayout, nullptr)) {}
+
+	static PersistentShape leaf(ShapeValue shape)
+	{
+		double w = shape.width;
+		double h = shape.height;
+		return PersistentShape(std::make_shared<const PersistentNode>(
+			PersistentNode{ PersistentNode::LeafLayout, std::move(shape), nullptr, w, h }));
+	}
+	static PersistentShape layered(const std::vector<PersistentShape> &shapes)
+	{
+		return composite(PersistentNode::LayeredLayout, shapes);
+	}
+	static PersistentShape multiLayered(const std::vector<PersistentShape> &shapes)
+	{
+		return composite(PersistentNode::MultiLayeredLayout, shapes);
+	}
+	static PersistentShape horizontal(const std::vector<PersistentShape> &shapes)
+	{
+		return composite(PersistentNode::HorizontalLayout, shapes);
+	}
+	static PersistentShape vertical(const std::vector<PersistentShape> &shapes)
+	{
+		return composite(PersistentNode::VerticalLayout, shapes);
+	}
+	static PersistentShape composite(Layout layout, const std::vector<PersistentShape> &shapes)
+	{
+		PersistentChildRef children;
+		for (const PersistentShape &shape : shapes)
+		{
+			children = merge(children, makeChild(shape.node_, nullptr, nullptr, nextPriority()));
+		}
+		return PersistentShape(makeComposite(layout, std::move(children)));
+	}
+
+	// Copy of shape. Layered, MultiLayered, Horizontal, Vertical, their Multi
+	// versions and MutableComposite become persistent composites, anything
+	// else a leaf.
+	static PersistentShape fromShape(Shape &shape);
+
+	//Children, 0 for a leaf
+	unsigned int getSize() const
+	{
+		return count(node_->children);
+	}
+	//Child number pos, an empty Layered if there is none
+	PersistentShape getShape(unsigned int pos) const
+	{
+		const PersistentChild *child = select(node_->children, pos);
+		return child ? PersistentShape(child->shape) : PersistentShape();
+	}
+	//True if path, a child number for each level down, leads to a shape
+	bool hasPath(const std::vector<unsigned int> &path) const
+	{
+		const PersistentNode *node = node_.get();
+		for (unsigned int pos : path)
+		{
+			const PersistentChild *child = select(node->children, pos);
+			if (child == nullptr)
+			{
+				return false;
+			}
+			node = child->shape.get();
+		}
+		return true;
+	}
+	Layout getLayout() const
+	{
+		return node_->layout;
+	}
+	bool isLeaf() const
+	{
+		return node_->layout == PersistentNode::LeafLayout;
+	}
+	//The ShapeValue of a leaf
+	const ShapeValue &getLeaf() const
+	{
+		return node_->leaf;
+	}
+	double getWidth() const
+	{
+		return node_->width;
+	}
+	double getHeight() const
+	{
+		return node_->height;
+	}
+	//The node itself, the same for trees that share it
+	const PersistentNodeRef &getNode() const
+	{
+		return node_;
+	}
+	static PersistentShape fromNode(PersistentNodeRef node)
+	{
+		return PersistentShape(std::move(node));
+	}
+
+	//Copy with shape put in as child number pos, or as the last child if pos is past the end
+	PersistentShape insert(unsigned int pos, const PersistentShape &shape) const
+	{
+		PersistentChildRef left;
+		PersistentChildRef right;
+		split(node_->children, pos, left, right);
+		PersistentChildRef child = makeChild(shape.node_, nullptr, nullptr, nextPriority());
+		return withChildren(merge(merge(left, child), right));
+	}
+	PersistentShape append(const PersistentShape &shape) const
+	{
+		return insert(getSize(), shape);
+	}
+
+	//Copy without child number pos, the same shape if there is none
+	PersistentShape erase(unsigned int pos) const
+	{
+		if (pos >= getSize())
+		{
+			return *this;
+		}
+		PersistentChildRef left;
+		PersistentChildRef middle;
+		PersistentChildRef right;
+		split(node_->children, pos, left, right);
+		split(right, 1, middle, right);
+		return withChildren(merge(left, right));
+	}
+
+	//Copy with shape in place of child number pos, the same shape if there is none
+	PersistentShape replace(unsigned int pos, const PersistentShape &shape) const
+	{
+		if (pos >= getSize())
+		{
+			return *this;
+		}
+		return withChildren(replaceChild(node_->children, pos, shape.node_));
+	}
+
+	// Copy with the shape at path, a child number for each level down,
+	// replaced by edit(const PersistentShape &) returning a PersistentShape.
+	// An empty path edits this shape, a path that leads nowhere returns the
+	// same shape without calling edit.
+	template <class Edit>
+	PersistentShape update(const std::vector<unsigned int> &path, Edit &&edit) const
+	{
+		return hasPath(path) ? update(path, 0, edit) : *this;
+	}
+
+	//Writes the postscript through any writer with the PostScriptWriter interface
+	template <class Writer>
+	void render(Writer &w) const
+	{
+		renderNode(*node_, w);
+	}
+
+	void appendPostScript(std::string &out) const
+	{
+		PostScriptWriter writer(out);
+		render(writer);
+	}
+
+	std::string generatePostScript() const
+	{
+		std::string out = "";
+		appendPostScript(out);
+		return out;
+	}
+
+private:
+	explicit PersistentShape(PersistentNodeRef node) : node_(std::move(node)) {}
+
+	template <class Edit>
+	PersistentShape update(const std::vector<unsigned int> &path, std::size_t level, Edit &edit) const
+	{
+		if (level == path.size())
+		{
+			return edit(*this);
+		}
+		return replace(path[level], getShape(path[level]).update(path, level + 1, edit));
+	}
+
+	// Walks the nodes without copying references to them, a snapshot keeps
+	// them all alive while it is drawn
+	template <class Writer>
+	static void renderNode(const PersistentNode &node, Writer &w)
+	{
+		if (node.layout == PersistentNode::LeafLayout)
+		{
+			node.leaf.render(w);
+			return;
+		}
+		renderChildren(node, node.children.get(), w);
+	}
+
+	template <class Writer>
+	static void renderChildren(const PersistentNode &parent, const PersistentChild *child, Writer &w)
+	{
+		if (child == nullptr)
+		{
+			return;
+		}
+		renderChildren(parent, child->left.get(), w);
+
+		const PersistentNode &shape = *child->shape;
+		switch (parent.layout)
+		{
+		case PersistentNode::LeafLayout:
+		case PersistentNode::LayeredLayout:
+			renderNode(shape, w);
+			break;
+		case PersistentNode::MultiLayeredLayout:
+			emitTranslate(w, 0.0, 0.0);
+			renderNode(shape, w);
+			emitTranslate(w, 0.0, 0.0);
+			w.endLine();
+			break;
+		case PersistentNode::HorizontalLayout:
+			emitTranslate(w, shape.width / 2, parent.height);
+			renderNode(shape, w);
+			emitTranslate(w, (shape.width / 2) + 1, -parent.height);
+			w.endLine();
+			break;
+		case PersistentNode::VerticalLayout:
+			emitTranslate(w, parent.width, shape.height / 2);
+			renderNode(shape, w);
+			emitTranslate(w, -parent.width, (shape.height / 2) + 1);
+			w.endLine();
+			break;
+		}
+
+		renderChildren(parent, child->right.get(), w);
+	}
+
+	PersistentShape withChildren(PersistentChildRef children) const
+	{
+		return PersistentShape(makeComposite(node_->layout, std::move(children)));
+	}
+
+	// Same rules as the fixed composites, which start their maxima at 0
+	static PersistentNodeRef makeComposite(Layout layout, PersistentChildRef children)
+	{
+		double maxW = children ? std::max(0.0, children->maxW) : 0;
+		double maxH = children ? std::max(0.0, children->maxH) : 0;
+		double w = maxW;
+		double h = maxH;
+		if (layout == PersistentNode::HorizontalLayout)
+		{
+			w = children ? children->sumW + children->count : 0;
+		}
+		else if (layout == PersistentNode::VerticalLayout)
+		{
+			h = children ? children->sumH + children->count : 0;
+		}
+		return std::make_shared<const PersistentNode>(PersistentNode{ layout, ShapeValue(), std::move(children), w, h });
+	}
+
+	static unsigned int count(const PersistentChildRef &child)
+	{
+		return child ? child->count : 0;
+	}
+
+	static PersistentChildRef makeChild(PersistentNodeRef shape, PersistentChildRef left, PersistentChildRef right,
+		unsigned int priority)
+	{
+		PersistentChild child{ std::move(shape), std::move(left), std::move(right), priority, 1, 0, 0, 0, 0 };
+		child.sumW = child.maxW = child.shape->width;
+		child.sumH = child.maxH = child.shape->height;
+		for (const PersistentChild *side : { child.left.get(), child.right.get() })
+		{
+			if (side != nullptr)
+			{
+				child.count += side->count;
+				child.sumW += side->sumW;
+				child.sumH += side->sumH;
+				child.maxW = std::max(child.maxW, side->maxW);
+				child.maxH = std::max(child.maxH, side->maxH);
+			}
+		}
+		return std::make_shared<const PersistentChild>(std::move(child));
+	}
+
+	// xorshift, the priorities only need to look random. Each editing thread
+	// has its own.
+	static unsigned int nextPriority()
+	{
+		static thread_local unsigned int seed = 2463534242u;
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	}
+
+	//Copies of a and b joined, a first
+	static PersistentChildRef merge(const PersistentChildRef &a, const PersistentChildRef &b)
+	{
+		if (a == nullptr)
+		{
+			return b;
+		}
+		if (b == nullptr)
+		{
+			return a;
+		}
+		if (a->priority > b->priority)
+		{
+			return makeChild(a->shape, a->left, merge(a->right, b), a->priority);
+		}
+		return makeChild(b->shape, merge(a, b->left), b->right, b->priority);
+	}
+
+	//The first pos children of child in left, the rest in right
+	static void split(const PersistentChildRef &child, unsigned int pos, PersistentChildRef &left, PersistentChildRef &right)
+	{
+		if (child == nullptr)
+		{
+			left = nullptr;
+			right = nullptr;
+			return;
+		}
+		PersistentChildRef keep = child;
+		unsigned int leftCount = count(keep->left);
+		if (pos <= leftCount)
+		{
+			PersistentChildRef rest;
+			split(keep->left, pos, left, rest);
+			right = makeChild(keep->shape, std::move(rest), keep->right, keep->priority);
+		}
+		else
+		{
+			PersistentChildRef rest;
+			split(keep->right, pos - leftCount - 1, rest, right);
+			left = makeChild(keep->shape, keep->left, std::move(rest), keep->priority);
+		}
+	}
+
+	static const PersistentChild *select(const PersistentChildRef &root, unsigned int pos)
+	{
+		const PersistentChild *child = root.get();
+		while (child != nullptr)
+		{
+			unsigned int leftCount = count(child->left);
+			if (pos < leftCount)
+			{
+				child = child->left.get();
+			}
+			else if (pos == leftCount)
+			{
+				return child;
+			}
+			else
+			{
+				pos -= leftCount + 1;
+				child = child->right.get();
+			}
+		}
+		return nullptr;
+	}
+
+	static PersistentChildRef replaceChild(const PersistentChildRef &child, unsigned int pos, const PersistentNodeRef &shape)
+	{
+		unsigned int leftCount = count(child->left);
+		if (pos < leftCount)
+		{
+			return makeChild(child->shape, replaceChild(child->left, pos, shape), child->right, child->priority);
+		}
+		if (pos == leftCount)
+		{
+			return makeChild(shape, child->left, child->right, child->priority);
+		}
+		return makeChild(child->shape, child->left, replaceChild(child->right, pos - leftCount - 1, shape), child->priority);
+	}
+
+	PersistentNodeRef node_;
+};
+
+inline PersistentShape PersistentShape::fromShape(Shape &shape)
+{
+	Layout layout = PersistentNode::LeafLayout;
+	if (dynamic_cast<Layered*>(&shape))
+	{
+		layout = PersistentNode::LayeredLayout;
+	}
+	else if (dynamic_cast<MultiLayered*>(&shape))
+	{
+		layout = PersistentNode::MultiLayeredLayout;
+	}
+	else if (dynamic_cast<MultiHorizontal*>(&shape) || dynamic_cast<Horizontal*>(&shape))
+	{
+		layout = PersistentNode::HorizontalLayout;
+	}
+	else if (dynamic_cast<MultiVertical*>(&shape) || dynamic_cast<Vertical*>(&shape))
+	{
+		layout = PersistentNode::VerticalLayout;
+	}
+	else if (MutableComposite *mutableShape = dynamic_cast<MutableComposite*>(&shape))
+	{
+		switch (mutableShape->getLayout())
+		{
+		case MutableComposite::LayeredLayout: layout = PersistentNode::LayeredLayout; break;
+		case MutableComposite::MultiLayeredLayout: layout = PersistentNode::MultiLayeredLayout; break;
+		case MutableComposite::HorizontalLayout: layout = PersistentNode::HorizontalLayout; break;
+		case MutableComposite::VerticalLayout: layout = PersistentNode::VerticalLayout; break;
+		}
+	}
+
+	if (layout == PersistentNode::LeafLayout)
+	{
+		return leaf(ShapeValue::fromShape(shape));
+	}
+	std::vector<PersistentShape> children;
+	children.reserve(shape.getSize());
+	for (unsigned int i = 0; i < shape.getSize(); ++i)
+	{
+		children.push_back(fromShape(*shape.getShape(i)));
+	}
+	return composite(layout, children);
+}
+
+// The current version of a tree that one thread edits while others draw it.
+// Readers take a snapshot and keep it for as long as they draw; edits made
+// meanwhile do not touch it, and what only it still reaches is freed when
+// the last reader drops it.
+class PersistentScene {
+public:
+	PersistentScene(PersistentShape root = PersistentShape()) : root_(root.getNode()) {}
+
+	//The current tree, safe to call from any thread
+	PersistentShape snapshot() const
+	{
+		return PersistentShape::fromNode(std::atomic_load(&root_));
+	}
+
+	//Makes root the current tree
+	void publish(const PersistentShape &root)
+	{
+		std::atomic_store(&root_, root.getNode());
+		version_.fetch_add(1, std::memory_order_release);
+	}
+
+	// Publishes edit(const PersistentShape &) applied to the current tree.
+	// For one editing thread; with more, use tryPublish.
+	template <class Edit>
+	void edit(Edit &&edit)
+	{
+		publish(edit(snapshot()));
+	}
+
+	// Publishes root only if the current tree is still expected, so edits
+	// from several threads are not lost. Returns false if it was not.
+	bool tryPublish(const PersistentShape &expected, const PersistentShape &root)
+	{
+		PersistentNodeRef current = expected.getNode();
+		if (!std::atomic_compare_exchange_strong(&root_, &current, root.getNode()))
+		{
+			return false;
+		}
+		version_.fetch_add(1, std::memory_order_release);
+		return true;
+	}
+
+	//Trees published so far
+	std::size_t getVersion() const
+	{
+		return version_.load(std::memory_order_acquire);
+	}
+
+private:
+	PersistentNodeRef root_;
+	std::atomic<std::size_t> version_{ 0 };
+};
+
+#endif // PERSISTENT_SHAPE_HPP_INCLUDED
@@ -0,0 +1,370 @@
+#ifndef POSTSCRIPT_HPP_INCLUDED
+#define POSTSCRIPT_HPP_INCLUDED
+
+#include <string>
+#include <cmath>
+#include <charconv>
+#include "affine.hpp"
+
+// Appends postscript tokens to a string.
+// Tokens on the same line are separated by a space, endLine() finishes a line.
+// Numbers are formatted exactly like std::to_string so output matches
+// the string concatenation the shapes used before.
+class PostScriptWriter {
+public:
+	PostScriptWriter(std::string &out) : out_(out) {}
+
+	void number(double value)
+	{
+		separate();
+		// %f of the largest double is a little over 300 characters
+		char buffer[400];
+		char *end = formatFixed6(buffer, value);
+		if (end == nullptr)
+		{
+			end = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, 6).ptr;
+		}
+		out_.append(buffer, end);
+	}
+
+	void integer(long value)
+	{
+		separate();
+		char buffer[24];
+		auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+		out_.append(buffer, result.ptr);
+	}
+
+	void op(const char *name)
+	{
+		separate();
+		out_ += name;
+	}
+
+	void endLine()
+	{
+		out_ += '\n';
+		lineStart_ = true;
+	}
+
+	//Already generated postscript, copied as is
+	void raw(const char *text, std::size_t size)
+	{
+		if (size == 0)
+		{
+			return;
+		}
+		out_.append(text, size);
+		lineStart_ = text[size - 1] == '\n';
+	}
+	void raw(const std::string &text)
+	{
+		raw(text.data(), text.size());
+	}
+
+private:
+	// Fast path for the common case of moderate values. value * 1e6 is rounded
+	// to the nearest integer, which is what printf does as long as the product
+	// is not within a few ulps of a half. Returns nullptr when that can't be
+	// guaranteed so the caller falls back to to_chars.
+	static char *formatFixed6(char *buffer, double value)
+	{
+		double scaled = std::fabs(value) * 1e6;
+		if (!(scaled < 4e12))
+		{
+			return nullptr; // too large, inf or nan
+		}
+		double rounded = std::nearbyint(scaled);
+		if (std::fabs(scaled - rounded) > 0.499)
+		{
+			return nullptr;
+		}
+		unsigned long long digits = (unsigned long long)rounded;
+
+		// Write the digits backwards, with the point before the last six
+		char reversed[24];
+		int count = 0;
+		do
+		{
+			reversed[count++] = (char)('0' + digits % 10);
+			digits /= 10;
+		} while (digits > 0 || count < 7);
+
+		char *out = buffer;
+		if (std::signbit(value))
+		{
+			*out++ = '-';
+		}
+		while (count > 0)
+		{
+			if (count == 6)
+			{
+				*out++ = '.';
+			}
+			*out++ = reversed[--count];
+		}
+		return out;
+	}
+
+	void separate()
+	{
+		if (!lineStart_)
+		{
+			out_ += ' ';
+		}
+		lineStart_ = false;
+	}
+
+	std::string &out_;
+	bool lineStart_ = true;
+};
+
+//Width and height of a regular polygon with the given number of sides and side length
+inline void polygonExtents(int numSides, double sideLength, double &width, double &height)
+{
+	const double pi = 3.141592653589793238;
+
+	if (numSides % 2 == 1)
+	{
+		height = sideLength*(1 + cos(pi / numSides)) / (2 * sin(pi / numSides));
+		width = (sideLength*sin(pi*(numSides - 1) / (2 * numSides)) / (sin(pi / numSides)));
+	}
+	else if (numSides % 4 != 0) // numSides%2==0
+	{
+		height = sideLength * (cos(pi / numSides)) / (sin(pi / numSides));
+		width = sideLength / (sin(pi / numSides));
+	}
+	else // numSides%2 == 0 && numSides%4 == 0
+	{
+		height = sideLength*(cos(pi / numSides)) / (sin(pi / numSides));
+		width = height;
+	}
+}
+
+// The emit functions below hold the postscript of every leaf shape.
+// They are shared by the Shape classes and ShapeValue so both produce the same bytes.
+
+// True once a writer that can be stopped, e.g. by a deadline, has been. The
+// loops of the emit functions check it so they can give up early. Writers
+// that can be stopped overload it, plain writers never are.
+template <class Writer>
+bool writerStopped(const Writer &)
+{
+	return false;
+}
+
+template <class Writer>
+void emitTranslate(Writer &w, double x, double y)
+{
+	w.number(x);
+	w.number(y);
+	w.op("translate");
+	w.endLine();
+}
+
+//Concatenates m with the current transformation
+template <class Writer>
+void emitConcat(Writer &w, const Affine &m)
+{
+	w.op("[");
+	w.number(m.a);
+	w.number(m.b);
+	w.number(m.c);
+	w.number(m.d);
+	w.number(m.tx);
+	w.number(m.ty);
+	w.op("]");
+	w.op("concat");
+	w.endLine();
+}
+
+template <class Writer>
+void emitCircle(Writer &w, double width, double height)
+{
+	w.op("newpath");
+	w.endLine();
+	emitTranslate(w, height / -2, width / -2);
+	w.number(height / 2);
+	w.number(width / 2);
+	w.number(width / 2);
+	w.integer(0);
+	w.integer(360);
+	w.op("arc");
+	w.op("closepath");
+	w.endLine();
+	w.op("stroke");
+	w.endLine();
+	emitTranslate(w, height / 2, width / 2);
+}
+
+template <class Writer>
+void emitPolygon(Writer &w, int numSides, double sideLength, double height)
+{
+	// Same double arithmetic as before so the truncated angle does not change
+	double sides = numSides;
+	int totalAngle = (sides - 2) * 180;
+	int anglePerSide = 180 - totalAngle / sides;
+
+	emitTranslate(w, sideLength / -2, height / -2);
+	w.op("newpath");
+	w.endLine();
+	w.integer(0);
+	w.integer(0);
+	w.op("moveto");
+	w.endLine();
+
+	for (int i = 0; i < numSides; i++)
+	{
+		if (writerStopped(w))
+		{
+			return;
+		}
+		w.number(sideLength);
+		w.integer(0);
+		w.op("lineto");
+		w.endLine();
+		w.number(sideLength);
+		w.integer(0);
+		w.op("translate");
+		w.endLine();
+		w.integer(anglePerSide);
+		w.op("rotate");
+		w.endLine();
+	}
+	w.op("closepath");
+	w.endLine();
+	w.op("stroke");
+	w.endLine();
+	emitTranslate(w, sideLength / 2, height / 2);
+}
+
+template <class Writer>
+void emitRectangle(Writer &w, double width, double height)
+{
+	double halfHeight = height / 2.0;
+	double halfWidth = width / 2.0;
+
+	w.op("newpath");
+	w.endLine();
+	w.integer(0);
+	w.integer(0);
+	w.op("moveto");
+	w.endLine();
+
+	w.number(-1 * halfWidth); //move to draw at origin
+	w.number(-1 * halfHeight);
+	w.op("moveto");
+	w.endLine();
+	emitTranslate(w, -1 * halfWidth, -1 * halfHeight);
+
+	w.number(width);                // Bottom
+	w.integer(0);
+	w.op("rlineto");
+	w.endLine();
+
+	w.integer(0);                   // Right
+	w.number(height);
+	w.op("rlineto");
+	w.endLine();
+
+	w.number(width*-1);             // Top
+	w.integer(0);
+	w.op("rlineto");
+	w.endLine();
+
+	w.op("closepath");              // Left
+	w.endLine();
+	w.op("stroke");
+	w.endLine();
+
+	w.number(halfWidth);            //move back from origin
+	w.number(halfHeight);
+	w.op("moveto");
+	w.endLine();
+	emitTranslate(w, halfWidth, halfHeight);
+}
+
+template <class Writer>
+void emitSpacer(Writer &w, double width, double height, double x, double y)
+{
+	w.op("newpath");
+	w.endLine();
+	w.number(x);
+	w.number(y);
+	w.op("moveto");
+	w.endLine();
+
+	w.number(width);
+	w.number(x);
+	w.op("rlineto");
+	w.endLine();
+
+	w.number(y);
+	w.number(height);
+	w.op("rlineto");
+	w.endLine();
+
+	w.number(-width);
+	w.number(x);
+	w.op("rlineto");
+	w.op("closepath");
+	w.endLine();
+}
+
+template <class Writer>
+void emitSquare(Writer &w, double sideLength)
+{
+	double squareWidth;
+	double squareHeight;
+	polygonExtents(4, sideLength, squareWidth, squareHeight);
+	emitPolygon(w, 4, sideLength, squareHeight);
+}
+
+template <class Writer>
+void emitCustom(Writer &w, double width, double height)
+{
+	// Head
+	emitSquare(w, width);
+	emitTranslate(w, width / 4, height / 4);
+
+	// Eyes
+	emitSquare(w, width / 5);
+	emitTranslate(w, -width / 4, -height / 4);
+	emitTranslate(w, -width / 4, height / 4);
+	emitSquare(w, width / 5);
+	emitTranslate(w, width / 4, -height / 4);
+
+	// Mouth
+	w.integer(0);
+	w.number(-height / 4);
+	w.op("translate");
+	w.endLine();
+	emitRectangle(w, width / 2, height / 4);
+	w.integer(0);
+	w.number(height / 4);
+	w.op("translate");
+	w.endLine();
+
+	// Teeth
+	double halfTeeth = (width / 8);
+	double quarterTeeth = halfTeeth/2;
+
+	// Top row of teeth, then bottom row
+	for (int row = 0; row < 2; ++row) {
+		double rowOffset = row == 0 ? quarterTeeth : -quarterTeeth;
+		int scale = 0;
+		for (int ii = 1; ii <= 4; ++ii) {
+			if (writerStopped(w)) {
+				return;
+			}
+			emitTranslate(w, (-width / 4), (-height / 4));
+			emitTranslate(w, (quarterTeeth*ii) + (quarterTeeth*scale), rowOffset);
+			emitSquare(w, width / 8);
+			emitTranslate(w, (-quarterTeeth*ii) - (quarterTeeth*scale), -rowOffset);
+			emitTranslate(w, (width / 4), (height / 4));
+			scale++;
+		}
+	}
+}
+
+#endif // POSTSCRIPT_HPP_INCLUDED
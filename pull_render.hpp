@@ -0,0 +1,332 @@
+#ifndef PULL_RENDER_HPP_INCLUDED
+#define PULL_RENDER_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "shape.hpp"
+#include "postscript.hpp"
+#include "mutable_composite.hpp"
+#include "sharded_render.hpp"
+
+#if defined(__has_include)
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+#define PULL_RENDER_COROUTINES_AVAILABLE 1
+#endif
+#endif
+
+// Postscript handed out a chunk at a time, when the reader asks for it.
+//
+// generatePostScript() builds the whole output of a tree before returning,
+// so a document holds its thread and its full text until it is done. A
+// PullRenderer walks the tree with a stack of its own instead and stops
+// as soon as it has a chunk, so one thread can take turns between many
+// documents and leave alone those whose readers are slow. What it holds is
+// the path from the root to the current shape and less than a chunk plus
+// one leaf of text.
+//
+// Composites, Rotated, Transformed and MutableComposite are walked into,
+// with the same bytes between their children as their generatePostScript().
+// Everything else, leaves, Scaled and StreamingComposite included, is
+// written whole when it is reached.
+//
+// Built as C++20, renderChunks() gives the same chunks from a coroutine.
+
+// Children the pull renderer walks into, 0 for shapes it writes whole
+inline unsigned int pullChildCount(Shape &shape)
+{
+	if (dynamic_cast<Rotated*>(&shape) || dynamic_cast<Transformed*>(&shape) ||
+		dynamic_cast<MutableComposite*>(&shape))
+	{
+		return shape.getSize();
+	}
+	return fragmentCount(shape) == shape.getSize() ? shape.getSize() : 0;
+}
+
+// Sets before and after to what shape writes around child i, for a shape
+// with pullChildCount() above 0
+inline void pullChildWrapping(Shape &shape, unsigned int i, std::string &before, std::string &after)
+{
+	before.clear();
+	after.clear();
+	if (Rotated *rotated = dynamic_cast<Rotated*>(&shape))
+	{
+		before += std::to_string(rotated->getAngle());
+		before += " rotate\n";
+	}
+	else if (Transformed *transformed = dynamic_cast<Transformed*>(&shape))
+	{
+		PostScriptWriter start(before);
+		start.op("gsave");
+		start.endLine();
+		emitConcat(start, transformed->getMatrix());
+		PostScriptWriter end(after);
+		end.op("grestore");
+		end.endLine();
+	}
+	else if (MutableComposite *mutableShape = dynamic_cast<MutableComposite*>(&shape))
+	{
+		Shape &child = *shape.getShape(i);
+		PostScriptWriter start(before);
+		PostScriptWriter end(after);
+		switch (mutableShape->getLayout())
+		{
+		case MutableComposite::LayeredLayout:
+			break;
+		case MutableComposite::MultiLayeredLayout:
+			emitTranslate(start, 0.0, 0.0);
+			emitTranslate(end, 0.0, 0.0);
+			end.endLine();
+			break;
+		case MutableComposite::HorizontalLayout:
+			emitTranslate(start, child.width / 2, shape.height);
+			emitTranslate(end, (child.width / 2) + 1, -shape.height);
+			end.endLine();
+			break;
+		case MutableComposite::VerticalLayout:
+			emitTranslate(start, shape.width, child.height / 2);
+			emitTranslate(end, -shape.width, (child.height / 2) + 1);
+			end.endLine();
+			break;
+		}
+	}
+	else
+	{
+		// The fragment with the child left out is what comes before and after it
+		std::size_t childAt = 0;
+		appendFragment(shape, i, before, [&](Shape &, std::string &out) {
+			childAt = out.size();
+		});
+		after.assign(before, childAt, std::string::npos);
+		before.resize(childAt);
+	}
+}
+
+class PullRenderer {
+public:
+	// Renders shape, which has to outlive the renderer, in chunks of at
+	// most chunkSize bytes
+	PullRenderer(Shape &shape, std::size_t chunkSize = 4096)
+		: chunkSize_(std::max<std::size_t>(chunkSize, 1))
+	{
+		enter(shape);
+	}
+
+	// Replaces chunk with the next chunkSize bytes of output, or fewer at
+	// the end. Returns false, with chunk empty, once everything was given.
+	bool next(std::string &chunk)
+	{
+		while (pending_.size() - given_ < chunkSize_ && step())
+		{
+		}
+		std::size_t size = std::min(chunkSize_, pending_.size() - given_);
+		chunk.assign(pending_, given_, size);
+		given_ += size;
+		written_ += size;
+		if (given_ == pending_.size())
+		{
+			pending_.clear();
+			given_ = 0;
+		}
+		else if (given_ >= chunkSize_)
+		{
+			pending_.erase(0, given_);
+			given_ = 0;
+		}
+		return size > 0;
+	}
+
+	//True once the last chunk was given
+	bool isDone() const
+	{
+		return stack_.empty() && pending_.size() == given_;
+	}
+
+	//Bytes given so far
+	std::size_t getBytesWritten() const
+	{
+		return written_;
+	}
+
+	//Shapes from the root down to the one being written
+	std::size_t getDepth() const
+	{
+		return stack_.size();
+	}
+
+private:
+	struct Frame {
+		Shape *shape;
+		unsigned int count;
+		unsigned int next;
+		// The child before next is written, and after has to follow it
+		bool inChild;
+		std::string after;
+	};
+
+	//Starts writing shape, as a frame to walk or whole
+	void enter(Shape &shape)
+	{
+		unsigned int count = pullChildCount(shape);
+		if (count == 0)
+		{
+			pending_ += shape.generatePostScript();
+			return;
+		}
+		stack_.push_back(Frame{ &shape, count, 0, false, std::string() });
+	}
+
+	//Moves one piece of the walk to pending_, false when there is none left
+	bool step()
+	{
+		if (stack_.empty())
+		{
+			return false;
+		}
+		Frame &frame = stack_.back();
+		if (frame.inChild)
+		{
+			pending_ += frame.after;
+			frame.inChild = false;
+			return true;
+		}
+		if (frame.next == frame.count)
+		{
+			stack_.pop_back();
+			return true;
+		}
+		unsigned int i = frame.next++;
+		frame.inChild = true;
+		pullChildWrapping(*frame.shape, i, before_, frame.after);
+		pending_ += before_;
+		enter(*frame.shape->getShape(i));
+		return true;
+	}
+
+	std::size_t chunkSize_;
+	std::vector<Frame> stack_;
+	std::string pending_;
+	std::size_t given_ = 0;
+	std::size_t written_ = 0;
+	std::string before_;
+};
+
+#ifdef PULL_RENDER_COROUTINES_AVAILABLE
+
+// Chunks of postscript from a coroutine that runs until the next chunk
+// each time it is resumed. Moves only.
+class PostScriptChunks {
+public:
+	struct promise_type {
+		std::string chunk;
+
+		PostScriptChunks get_return_object()
+		{
+			return PostScriptChunks(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		std::suspend_always yield_value(const std::string &value)
+		{
+			chunk = value;
+			return {};
+		}
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	class iterator {
+	public:
+		explicit iterator(std::coroutine_handle<promise_type> handle = nullptr) : handle_(handle) {}
+
+		const std::string &operator*() const
+		{
+			return handle_.promise().chunk;
+		}
+		iterator &operator++()
+		{
+			handle_.resume();
+			return *this;
+		}
+		bool operator!=(const iterator &other) const
+		{
+			return atEnd() != other.atEnd();
+		}
+
+	private:
+		bool atEnd() const
+		{
+			return !handle_ || handle_.done();
+		}
+
+		std::coroutine_handle<promise_type> handle_;
+	};
+
+	PostScriptChunks(PostScriptChunks &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+	PostScriptChunks &operator=(PostScriptChunks &&other) noexcept
+	{
+		std::swap(handle_, other.handle_);
+		return *this;
+	}
+	~PostScriptChunks()
+	{
+		if (handle_)
+		{
+			handle_.destroy();
+		}
+	}
+
+	// Runs to the next chunk and sets chunk to it. Returns false, leaving
+	// chunk alone, once there are no more.
+	bool next(std::string &chunk)
+	{
+		if (!handle_ || handle_.done())
+		{
+			return false;
+		}
+		handle_.resume();
+		if (handle_.done())
+		{
+			return false;
+		}
+		chunk.swap(handle_.promise().chunk);
+		return true;
+	}
+
+	//For range for, which takes over from next()
+	iterator begin()
+	{
+		if (handle_ && !handle_.done())
+		{
+			handle_.resume();
+		}
+		return iterator(handle_);
+	}
+	iterator end()
+	{
+		return iterator();
+	}
+
+private:
+	explicit PostScriptChunks(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+	std::coroutine_handle<promise_type> handle_;
+};
+
+// The chunks a PullRenderer gives for shape, which has to outlive them
+inline PostScriptChunks renderChunks(Shape &shape, std::size_t chunkSize = 4096)
+{
+	PullRenderer renderer(shape, chunkSize);
+	std::string chunk;
+	while (renderer.next(chunk))
+	{
+		co_yield chunk;
+	}
+}
+
+#endif // PULL_RENDER_COROUTINES_AVAILABLE
+
+#endif // PULL_RENDER_HPP_INCLUDED
@@ -0,0 +1,395 @@
+#ifndef RASTER_HPP_INCLUDED
+#define RASTER_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <ostream>
+#include <fstream>
+#include <algorithm>
+#include "postscript.hpp"
+#include "affine.hpp"
+#include "shape.hpp"
+#include "shape_value.hpp"
+#include "flatten.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define RASTER_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RASTER_SSE2 1
+#endif
+
+// Grayscale previews of what the shapes draw, without a postscript
+// interpreter.
+//
+// A FlatteningWriter runs the operators and cuts arcs into segments, and
+// the Rasterizer strokes the segments it is handed into a Raster. Each
+// segment is a capsule as wide as the stroke: the ink a pixel gets is how
+// far its center lies inside the capsule, plus half a pixel, so edges come
+// out anti-aliased. Strokes thinner than a pixel are drawn a pixel wide and
+// lighter. Pixels keep the most ink any segment gave them, so joints and
+// overlaps are not darkened twice. Caps and joins are round, where
+// postscript's default are butt caps and miter joins.
+//
+// For each row a segment crosses, the span of pixels it can reach is
+// covered with SSE2 or AVX, 4 or 8 pixels at a time, where the compiler
+// has them.
+
+//Ink in 0..1 for each pixel, rows from the top of the page down
+class Raster {
+public:
+	Raster(int width, int height)
+		: width_(std::max(0, width)), height_(std::max(0, height)), ink_((std::size_t)width_ * height_, 0.0f) {}
+
+	int getWidth() const
+	{
+		return width_;
+	}
+
+	int getHeight() const
+	{
+		return height_;
+	}
+
+	float *row(int y)
+	{
+		return ink_.data() + (std::size_t)y * width_;
+	}
+	const float *row(int y) const
+	{
+		return ink_.data() + (std::size_t)y * width_;
+	}
+
+	//Gray level of a pixel, 255 for blank paper
+	unsigned char getPixel(int x, int y) const
+	{
+		return (unsigned char)(255 - (int)std::lround(255 * row(y)[x]));
+	}
+
+	void clear()
+	{
+		std::fill(ink_.begin(), ink_.end(), 0.0f);
+	}
+
+	//Binary PGM, P5
+	bool writePgm(std::ostream &out) const
+	{
+		out << "P5\n" << width_ << ' ' << height_ << "\n255\n";
+		std::string line(width_, '\0');
+		for (int y = 0; y < height_; ++y)
+		{
+			for (int x = 0; x < width_; ++x)
+			{
+				line[x] = (char)getPixel(x, y);
+			}
+			out.write(line.data(), line.size());
+		}
+		return (bool)out;
+	}
+
+	//Binary PPM, P6, with equal red, green and blue
+	bool writePpm(std::ostream &out) const
+	{
+		out << "P6\n" << width_ << ' ' << height_ << "\n255\n";
+		std::string line(3 * (std::size_t)width_, '\0');
+		for (int y = 0; y < height_; ++y)
+		{
+			for (int x = 0; x < width_; ++x)
+			{
+				line[3 * x] = line[3 * x + 1] = line[3 * x + 2] = (char)getPixel(x, y);
+			}
+			out.write(line.data(), line.size());
+		}
+		return (bool)out;
+	}
+
+	//Writes a PPM if path ends in .ppm, a PGM otherwise
+	bool writeFile(const std::string &path) const
+	{
+		std::ofstream out(path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+		bool ppm = path.size() >= 4 && path.compare(path.size() - 4, 4, ".ppm") == 0;
+		return out && (ppm ? writePpm(out) : writePgm(out));
+	}
+
+private:
+	int width_;
+	int height_;
+	std::vector<float> ink_;
+};
+
+// A segment from a by e, for coverSpan. Pixels within reach of it get ink,
+// fading out over the last pixel, up to alpha.
+struct RasterSegment {
+	float ax;
+	float ay;
+	float ex;
+	float ey;
+	float inverseLength2;
+	float reach;
+	float alpha;
+};
+
+//Ink segment s gives the pixel centered on px, py
+inline float segmentInk(const RasterSegment &s, float px, float py)
+{
+	float dx = px - s.ax;
+	float dy = py - s.ay;
+	float t = std::min(std::max((dx * s.ex + dy * s.ey) * s.inverseLength2, 0.0f), 1.0f);
+	float qx = dx - t * s.ex;
+	float qy = dy - t * s.ey;
+	float ink = std::min(std::max(s.reach - std::sqrt(qx * qx + qy * qy), 0.0f), 1.0f);
+	return ink * s.alpha;
+}
+
+//Inks pixels x0 up to x1 of a row whose centers are at height py, one at a time
+inline void coverSpanScalar(float *row, int x0, int x1, float py, const RasterSegment &s)
+{
+	for (int x = x0; x < x1; ++x)
+	{
+		row[x] = std::max(row[x], segmentInk(s, x + 0.5f, py));
+	}
+}
+
+//Inks pixels x0 up to x1 of a row whose centers are at height py
+inline void coverSpan(float *row, int x0, int x1, float py, const RasterSegment &s)
+{
+	int x = x0;
+#if defined(RASTER_AVX)
+	const __m256 ax = _mm256_set1_ps(s.ax);
+	const __m256 ex = _mm256_set1_ps(s.ex);
+	const __m256 ey = _mm256_set1_ps(s.ey);
+	const __m256 inverseLength2 = _mm256_set1_ps(s.inverseLength2);
+	const __m256 reach = _mm256_set1_ps(s.reach);
+	const __m256 alpha = _mm256_set1_ps(s.alpha);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 dy = _mm256_set1_ps(py - s.ay);
+	const __m256 dyey = _mm256_mul_ps(dy, ey);
+	__m256 px = _mm256_add_ps(_mm256_set1_ps(x0 + 0.5f), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+	const __m256 step = _mm256_set1_ps(8.0f);
+	for (; x + 8 <= x1; x += 8)
+	{
+		__m256 dx = _mm256_sub_ps(px, ax);
+		__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(dx, ex), dyey), inverseLength2);
+		t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+		__m256 qx = _mm256_sub_ps(dx, _mm256_mul_ps(t, ex));
+		__m256 qy = _mm256_sub_ps(dy, _mm256_mul_ps(t, ey));
+		__m256 distance = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(qx, qx), _mm256_mul_ps(qy, qy)));
+		__m256 ink = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(reach, distance), zero), one);
+		ink = _mm256_mul_ps(ink, alpha);
+		_mm256_storeu_ps(row + x, _mm256_max_ps(_mm256_loadu_ps(row + x), ink));
+		px = _mm256_add_ps(px, step);
+	}
+#elif defined(RASTER_SSE2)
+	const __m128 ax = _mm_set1_ps(s.ax);
+	const __m128 ex = _mm_set1_ps(s.ex);
+	const __m128 ey = _mm_set1_ps(s.ey);
+	const __m128 inverseLength2 = _mm_set1_ps(s.inverseLength2);
+	const __m128 reach = _mm_set1_ps(s.reach);
+	const __m128 alpha = _mm_set1_ps(s.alpha);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 dy = _mm_set1_ps(py - s.ay);
+	const __m128 dyey = _mm_mul_ps(dy, ey);
+	__m128 px = _mm_add_ps(_mm_set1_ps(x0 + 0.5f), _mm_setr_ps(0, 1, 2, 3));
+	const __m128 step = _mm_set1_ps(4.0f);
+	for (; x + 4 <= x1; x += 4)
+	{
+		__m128 dx = _mm_sub_ps(px, ax);
+		__m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(dx, ex), dyey), inverseLength2);
+		t = _mm_min_ps(_mm_max_ps(t, zero), one);
+		__m128 qx = _mm_sub_ps(dx, _mm_mul_ps(t, ex));
+		__m128 qy = _mm_sub_ps(dy, _mm_mul_ps(t, ey));
+		__m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)));
+		__m128 ink = _mm_min_ps(_mm_max_ps(_mm_sub_ps(reach, distance), zero), one);
+		ink = _mm_mul_ps(ink, alpha);
+		_mm_storeu_ps(row + x, _mm_max_ps(_mm_loadu_ps(row + x), ink));
+		px = _mm_add_ps(px, step);
+	}
+#endif
+	coverSpanScalar(row, x, x1, py, s);
+}
+
+// Strokes the paths a FlatteningWriter hands it into a raster. The
+// flattener's page coordinates are taken to be pixels.
+class Rasterizer : public FlatPathSink {
+public:
+	Rasterizer(Raster &raster) : raster_(raster) {}
+
+	void strokePath(const double *xs, const double *ys, std::size_t count,
+		const FlatSubpath *subpaths, std::size_t subpathCount, double lineWidth) override
+	{
+		double width = std::max(lineWidth, 1.0);
+		float alpha = (float)std::min(lineWidth, 1.0);
+		for (std::size_t s = 0; s < subpathCount; ++s)
+		{
+			std::size_t first = subpaths[s].first;
+			std::size_t last = s + 1 < subpathCount ? subpaths[s + 1].first : count;
+			if (last - first < 2)
+			{
+				continue;
+			}
+			for (std::size_t i = first; i + 1 < last; ++i)
+			{
+				drawSegment(xs[i], ys[i], xs[i + 1], ys[i + 1], width, alpha);
+			}
+			if (subpaths[s].closed)
+			{
+				drawSegment(xs[last - 1], ys[last - 1], xs[first], ys[first], width, alpha);
+			}
+		}
+	}
+
+	//Segments drawn so far
+	std::size_t getSegmentCount() const
+	{
+		return segments_;
+	}
+
+private:
+	void drawSegment(double ax, double ay, double bx, double by, double width, float alpha)
+	{
+		double reach = width / 2 + 0.5;
+		int top = std::max(0, (int)std::floor(std::min(ay, by) - reach));
+		int bottom = std::min(raster_.getHeight(), (int)std::ceil(std::max(ay, by) + reach) + 1);
+		if (top >= bottom || std::max(ax, bx) + reach < 0 || std::min(ax, bx) - reach > raster_.getWidth())
+		{
+			return;
+		}
+		++segments_;
+		double ex = bx - ax;
+		double ey = by - ay;
+		double length2 = ex * ex + ey * ey;
+		RasterSegment segment{ (float)ax, (float)ay, (float)ex, (float)ey,
+			length2 > 0 ? (float)(1 / length2) : 0.0f, (float)reach, alpha };
+		for (int y = top; y < bottom; ++y)
+		{
+			// The part of the segment within reach of this row, widened by reach
+			double py = y + 0.5;
+			double t0 = 0;
+			double t1 = 1;
+			if (std::fabs(ey) > 1e-12)
+			{
+				t0 = (py - reach - ay) / ey;
+				t1 = (py + reach - ay) / ey;
+				if (t0 > t1)
+				{
+					std::swap(t0, t1);
+				}
+				t0 = std::max(t0, 0.0);
+				t1 = std::min(t1, 1.0);
+				if (t0 > t1)
+				{
+					continue;
+				}
+			}
+			double x0 = ax + t0 * ex;
+			double x1 = ax + t1 * ex;
+			int left = std::max(0, (int)std::floor(std::min(x0, x1) - reach));
+			int right = std::min(raster_.getWidth(), (int)std::ceil(std::max(x0, x1) + reach) + 1);
+			if (left < right)
+			{
+				coverSpan(raster_.row(y), left, right, (float)py, segment);
+			}
+		}
+	}
+
+	Raster &raster_;
+	std::size_t segments_ = 0;
+};
+
+// Matrix from page coordinates to the pixels of a width by height raster
+// that fits bounds, margin pixels in from the edges. Page y points up,
+// raster rows down.
+inline Affine fitToRaster(const Box &bounds, int width, int height, double margin = 2)
+{
+	double fitWidth = std::max(1.0, width - 2 * margin);
+	double fitHeight = std::max(1.0, height - 2 * margin);
+	double scale = std::min(fitWidth / std::max(bounds.maxX - bounds.minX, 1e-9),
+		fitHeight / std::max(bounds.maxY - bounds.minY, 1e-9));
+	return Affine().translated(width / 2.0, height / 2.0).scaled(scale, -scale)
+		.translated(-(bounds.minX + bounds.maxX) / 2, -(bounds.minY + bounds.maxY) / 2);
+}
+
+// Box around the points shape draws, with arcs cut within flatness. Returns
+// false if it draws nothing.
+inline bool drawnBounds(const ShapeValue &shape, Box &bounds, double flatness = 0.5)
+{
+	struct Discard : FlatPathSink {
+		void strokePath(const double*, const double*, std::size_t, const FlatSubpath*, std::size_t, double) override {}
+	} discard;
+	FlatteningWriter writer(discard, flatness);
+	shape.render(writer);
+	bounds = writer.getBounds();
+	return writer.getPointCount() > 0;
+}
+
+//Arcs are cut into segments within this many pixels of the curve
+const double rasterFlatness = 0.2;
+
+//Draws shape into raster, with page coordinates taken to pixels by toPixels
+inline void rasterize(const ShapeValue &shape, Raster &raster, const Affine &toPixels)
+{
+	Rasterizer rasterizer(raster);
+	FlatteningWriter writer(rasterizer, rasterFlatness);
+	emitConcat(writer, toPixels);
+	shape.render(writer);
+}
+
+inline void rasterize(Shape &shape, Raster &raster, const Affine &toPixels)
+{
+	rasterize(ShapeValue::fromShape(shape), raster, toPixels);
+}
+
+// Draws postscript text, e.g. the output of one of the other writers, into
+// raster. Only the operators FlatteningWriter knows draw.
+inline void rasterizePostScript(const std::string &postscript, Raster &raster, const Affine &toPixels)
+{
+	Rasterizer rasterizer(raster);
+	FlatteningWriter writer(rasterizer, rasterFlatness);
+	emitConcat(writer, toPixels);
+	writer.raw(postscript);
+}
+
+//A width by height preview of what shape draws, fitted to the raster
+inline Raster thumbnail(const ShapeValue &shape, int width, int height)
+{
+	Raster raster(width, height);
+	Box bounds;
+	if (drawnBounds(shape, bounds))
+	{
+		rasterize(shape, raster, fitToRaster(bounds, width, height));
+	}
+	return raster;
+}
+
+//How two rasters differ
+struct RasterDiff {
+	std::size_t differing = 0;  // pixels whose gray levels differ by more than tolerance
+	int largest = 0;            // largest difference in gray levels
+};
+
+// Compares a and b pixel by pixel. Returns false if they are not the same
+// size, true otherwise, with diff filled in.
+inline bool compareRasters(const Raster &a, const Raster &b, RasterDiff &diff, int tolerance = 0)
+{
+	diff = RasterDiff();
+	if (a.getWidth() != b.getWidth() || a.getHeight() != b.getHeight())
+	{
+		return false;
+	}
+	for (int y = 0; y < a.getHeight(); ++y)
+	{
+		for (int x = 0; x < a.getWidth(); ++x)
+		{
+			int difference = std::abs((int)a.getPixel(x, y) - (int)b.getPixel(x, y));
+			diff.largest = std::max(diff.largest, difference);
+			diff.differing += difference > tolerance;
+		}
+	}
+	return true;
+}
+
+#endif // RASTER_HPP_INCLUDED
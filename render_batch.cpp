@@ -0,0 +1,99 @@
+// render_batch.cpp : Renders many scene files at once, one .ps file per scene.
+// Usage: render_batch [-j threads] [-o output_dir] [-l list_file] inputs...
+// Inputs are scene files or directories of .scene files, a list file has
+// one input per line. Prints how long each file took.
+// Build e.g. g++ -std=c++17 -O2 -pthread render_batch.cpp -o render_batch
+//
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+#include "batch_render.hpp"
+
+int usage(const char *program)
+{
+	std::cerr << "Usage: " << program << " [-j threads] [-o output_dir] [-l list_file] inputs...\n";
+	return 2;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int threads = std::thread::hardware_concurrency();
+	std::string outputDir;
+	std::vector<std::string> inputs;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if ((arg == "-j" || arg == "-o" || arg == "-l") && i + 1 >= argc)
+		{
+			return usage(argv[0]);
+		}
+		if (arg == "-j")
+		{
+			threads = std::atoi(argv[++i]);
+		}
+		else if (arg == "-o")
+		{
+			outputDir = argv[++i];
+		}
+		else if (arg == "-l")
+		{
+			std::ifstream list(argv[++i]);
+			if (!list)
+			{
+				std::cerr << "can not open " << argv[i] << "\n";
+				return 1;
+			}
+			std::string line;
+			while (std::getline(list, line))
+			{
+				if (!line.empty())
+				{
+					inputs.push_back(line);
+				}
+			}
+		}
+		else
+		{
+			inputs.push_back(arg);
+		}
+	}
+	if (inputs.empty())
+	{
+		return usage(argv[0]);
+	}
+
+	std::vector<BatchJob> jobs;
+	std::string error;
+	if (!collectJobs(inputs, outputDir, jobs, error))
+	{
+		std::cerr << error << "\n";
+		return 1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	renderBatch(jobs, threads);
+	double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	double busy = 0;
+	int failed = 0;
+	std::cout << std::fixed << std::setprecision(2);
+	for (const BatchJob &job : jobs)
+	{
+		busy += job.milliseconds;
+		if (job.ok)
+		{
+			std::cout << std::setw(10) << job.milliseconds << " ms " << std::setw(12) << job.inputSize << " -> "
+				<< std::setw(12) << job.outputSize << " bytes  " << job.input << "\n";
+		}
+		else
+		{
+			++failed;
+			std::cout << std::setw(10) << job.milliseconds << " ms FAILED " << job.input << ": " << job.error << "\n";
+		}
+	}
+	std::cout << jobs.size() << " files, " << failed << " failed, " << wall << " ms wall, "
+		<< busy << " ms rendering, " << (wall > 0 ? busy / wall : 0) << "x parallel\n";
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,532 @@
+#ifndef RENDER_CACHE_HPP_INCLUDED
+#define RENDER_CACHE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <system_error>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <charconv>
+#include "shape.hpp"
+#include "mutable_composite.hpp"
+#include "sharded_render.hpp"
+#include "rope.hpp"
+
+// Content hashes of shapes and a render cache on disk keyed by them.
+//
+// The hash of a shape covers its class, the parameters its output depends
+// on and the hashes of its children, in order, so equal hashes mean equal
+// output. It does not depend on addresses, so it is the same from run to
+// run. Shapes the hash does not know are hashed by their output. A seed
+// other than 0 gives a second hash of the same content that collides
+// independently of the first.
+
+//Mixes value into h, the splitmix64 finalizer applied to the combination
+inline std::uint64_t hashCombine(std::uint64_t h, std::uint64_t value)
+{
+	std::uint64_t z = h ^ (value + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+inline std::uint64_t hashCombine(std::uint64_t h, double value)
+{
+	std::uint64_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return hashCombine(h, bits);
+}
+
+inline std::uint64_t hashText(const std::string &text)
+{
+	std::uint64_t h = 0xcbf29ce484222325ull; // FNV-1a
+	for (char c : text)
+	{
+		h = (h ^ (unsigned char)c) * 0x100000001b3ull;
+	}
+	return hashCombine(h, (std::uint64_t)text.size());
+}
+
+// Class tags, part of every hash so equal parameters of different classes differ
+enum ShapeHashTag : std::uint64_t {
+	CircleHash = 1, PolygonHash, RectangleHash, SpacerHash, CustomHash, RotatedHash,
+	LayeredHash, MultiLayeredHash, MultiHorizontalHash, MultiVerticalHash, VerticalHash, HorizontalHash,
+	MutableHash, TextHash, TransformedHash
+};
+
+// Hash of shape given the hashes of its children. childHash(Shape &) is
+// called for each child in order.
+template <class ChildHash>
+std::uint64_t contentHash(Shape &shape, ChildHash &&childHash, std::uint64_t seed = 0)
+{
+	auto tag = [seed](ShapeHashTag t) {
+		return seed == 0 ? (std::uint64_t)t : hashCombine(seed, (std::uint64_t)t);
+	};
+	auto children = [&](std::uint64_t h) {
+		for (unsigned int i = 0; i < shape.getSize(); ++i)
+		{
+			h = hashCombine(h, childHash(*shape.getShape(i)));
+		}
+		return hashCombine(h, (std::uint64_t)shape.getSize());
+	};
+	if (dynamic_cast<Circle*>(&shape))
+	{
+		return hashCombine(hashCombine(tag(CircleHash), shape.width), shape.height);
+	}
+	if (Polygon *polygon = dynamic_cast<Polygon*>(&shape))
+	{
+		std::uint64_t h = hashCombine(tag(PolygonHash), (std::uint64_t)polygon->numSides());
+		return hashCombine(hashCombine(h, polygon->sideLength()), shape.height);
+	}
+	if (dynamic_cast<Rectangle*>(&shape))
+	{
+		return hashCombine(hashCombine(tag(RectangleHash), shape.width), shape.height);
+	}
+	if (dynamic_cast<Spacer*>(&shape))
+	{
+		std::uint64_t h = hashCombine(hashCombine(tag(SpacerHash), shape.width), shape.height);
+		return hashCombine(hashCombine(h, shape.x), shape.y);
+	}
+	if (dynamic_cast<Custom*>(&shape))
+	{
+		return hashCombine(hashCombine(tag(CustomHash), shape.width), shape.height);
+	}
+	if (Rotated *rotated = dynamic_cast<Rotated*>(&shape))
+	{
+		return children(hashCombine(tag(RotatedHash), (std::uint64_t)(std::int64_t)rotated->getAngle()));
+	}
+	if (Transformed *transformed = dynamic_cast<Transformed*>(&shape))
+	{
+		const Affine &m = transformed->getMatrix();
+		std::uint64_t h = tag(TransformedHash);
+		for (double value : { m.a, m.b, m.c, m.d, m.tx, m.ty, shape.width, shape.height })
+		{
+			h = hashCombine(h, value);
+		}
+		return children(h);
+	}
+	if (dynamic_cast<MultiLayered*>(&shape))
+	{
+		return children(tag(MultiLayeredHash));
+	}
+	if (dynamic_cast<MultiHorizontal*>(&shape))
+	{
+		return children(tag(MultiHorizontalHash));
+	}
+	if (dynamic_cast<MultiVertical*>(&shape))
+	{
+		return children(tag(MultiVerticalHash));
+	}
+	if (dynamic_cast<Layered*>(&shape))
+	{
+		return children(tag(LayeredHash));
+	}
+	if (dynamic_cast<Vertical*>(&shape))
+	{
+		return children(tag(VerticalHash));
+	}
+	if (dynamic_cast<Horizontal*>(&shape))
+	{
+		return children(tag(HorizontalHash));
+	}
+	if (MutableComposite *mutableShape = dynamic_cast<MutableComposite*>(&shape))
+	{
+		return children(hashCombine(tag(MutableHash), (std::uint64_t)mutableShape->getLayout()));
+	}
+	// Scaled keeps only its child's output, and other classes are unknown
+	return hashCombine(tag(TextHash), hashText(shape.generatePostScript()));
+}
+
+inline std::uint64_t contentHash(Shape &shape, std::uint64_t seed = 0)
+{
+	return contentHash(shape, [seed](Shape &child) {
+		return contentHash(child, seed);
+	}, seed);
+}
+
+// Version of the blob files and of the postscript in them. Part of every
+// blob's name and header, so blobs written before it changed are not used.
+const std::uint64_t renderCacheVersion = 1;
+
+// Renders shapes, taking the output of subtrees that were rendered before
+// from files in a cache directory.
+//
+// Every subtree whose output is at least minBlobSize bytes is stored as
+// "<hash>.ps" after it is rendered. The file starts with a BlobHeader
+// holding the version and a second hash of the subtree with another seed,
+// which is checked when the blob is read, so two subtrees whose 64 bit
+// hashes collide are not mistaken for each other. When a shape is rendered its hash is
+// looked up first, then those of its children, and so on, so an unchanged
+// document is read back in one piece and a changed one is put together
+// from the subtrees that did not change. Blobs are mapped rather than read,
+// and rendering into a Rope keeps them mapped instead of copying them.
+//
+// A file's modification time is its last use. Once the directory holds
+// more than maxBytes the least recently used files are removed.
+class RenderCache {
+public:
+	bool open(const std::string &directory, std::uint64_t maxBytes = (std::uint64_t)1 << 30,
+		std::size_t minBlobSize = 4096)
+	{
+		namespace fs = std::filesystem;
+		directory_ = directory;
+		maxBytes_ = maxBytes;
+		minBlobSize_ = minBlobSize;
+		entries_.clear();
+		bytes_ = 0;
+		error_.clear();
+
+		std::error_code ec;
+		fs::create_directories(directory_, ec);
+		if (!fs::is_directory(directory_, ec))
+		{
+			error_ = "can not create " + directory_;
+			return false;
+		}
+		for (const fs::directory_entry &entry : fs::directory_iterator(directory_, ec))
+		{
+			std::uint64_t hash;
+			if (entry.is_regular_file(ec) && parseName(entry.path().filename().string(), hash))
+			{
+				Entry e{ entry.file_size(ec), entry.last_write_time(ec) };
+				entries_[hash] = e;
+				bytes_ += e.size;
+			}
+		}
+		evict();
+		return true;
+	}
+
+	std::string render(Shape &shape)
+	{
+		std::string out;
+		render(shape, out);
+		return out;
+	}
+
+	//Appends the postscript of shape to out
+	void render(Shape &shape, std::string &out)
+	{
+		hashes_.clear();
+		checks_.clear();
+		renderCached(shape, out);
+		hashes_.clear();
+		checks_.clear();
+	}
+	void render(Shape &shape, Rope &out)
+	{
+		hashes_.clear();
+		checks_.clear();
+		renderCached(shape, out);
+		hashes_.clear();
+		checks_.clear();
+	}
+
+	const std::string &getError() const
+	{
+		return error_;
+	}
+
+	std::uint64_t getLookups() const { return hits_ + misses_; }
+	std::uint64_t getHits() const { return hits_; }
+	std::uint64_t getMisses() const { return misses_; }
+	std::uint64_t getStores() const { return stores_; }
+	std::uint64_t getEvictions() const { return evictions_; }
+	//Bytes of blobs in the directory
+	std::uint64_t getBytes() const { return bytes_; }
+
+	double getHitRate() const
+	{
+		return getLookups() > 0 ? (double)hits_ / getLookups() : 0;
+	}
+
+	void resetCounters()
+	{
+		hits_ = 0;
+		misses_ = 0;
+		stores_ = 0;
+		evictions_ = 0;
+	}
+
+private:
+	struct Entry {
+		std::uint64_t size;
+		std::filesystem::file_time_type used;
+	};
+
+	struct BlobHeader {
+		std::uint64_t version;
+		std::uint64_t check;
+	};
+
+	//Seed of the hash kept in each blob's header to check it against
+	static constexpr std::uint64_t checkSeed = 0x6a09e667f3bcc909ull;
+
+	static bool parseName(const std::string &name, std::uint64_t &hash)
+	{
+		if (name.size() != 19 || name.compare(16, 3, ".ps") != 0)
+		{
+			return false;
+		}
+		auto result = std::from_chars(name.data(), name.data() + 16, hash, 16);
+		return result.ec == std::errc() && result.ptr == name.data() + 16;
+	}
+
+	std::string pathOf(std::uint64_t hash) const
+	{
+		char name[20];
+		std::snprintf(name, sizeof(name), "%016llx.ps", (unsigned long long)hash);
+		return (std::filesystem::path(directory_) / name).string();
+	}
+
+	// Hash of a subtree, with seed 0 or checkSeed. Composites are
+	// remembered for the rest of the render so each hash is only worked
+	// out once.
+	std::uint64_t hashOf(Shape &shape, std::uint64_t seed = 0)
+	{
+		auto child = [this, seed](Shape &c) { return hashOf(c, seed); };
+		if (shape.getSize() == 0)
+		{
+			return contentHash(shape, child, seed);
+		}
+		std::unordered_map<Shape*, std::uint64_t> &known = seed == 0 ? hashes_ : checks_;
+		auto found = known.find(&shape);
+		if (found != known.end())
+		{
+			return found->second;
+		}
+		std::uint64_t h = contentHash(shape, child, seed);
+		known[&shape] = h;
+		return h;
+	}
+
+	template <class Out>
+	void renderCached(Shape &shape, Out &out)
+	{
+		// Leaves are quicker to render than to look up
+		if (shape.getSize() == 0)
+		{
+			out += shape.generatePostScript();
+			return;
+		}
+		std::uint64_t hash = hashCombine(renderCacheVersion, hashOf(shape));
+		if (load(shape, hash, out))
+		{
+			++hits_;
+			return;
+		}
+		++misses_;
+
+		auto start = begin(out);
+		auto child = [this](Shape &c, Out &childOut) { renderCached(c, childOut); };
+		if (Rotated *rotated = dynamic_cast<Rotated*>(&shape))
+		{
+			out += std::to_string(rotated->getAngle());
+			out += " rotate\n";
+			renderCached(*rotated->getShape(0), out);
+		}
+		else if (fragmentCount(shape) == shape.getSize())
+		{
+			for (unsigned int i = 0; i < shape.getSize(); ++i)
+			{
+				appendFragment(shape, i, out, child);
+			}
+		}
+		else
+		{
+			out += shape.generatePostScript();
+		}
+		store(shape, hash, out, start);
+	}
+
+	static std::size_t begin(std::string &out)
+	{
+		return out.size();
+	}
+	static Rope::Mark begin(Rope &out)
+	{
+		return out.mark();
+	}
+
+	// Maps the blob of hash, without its header, forgetting it if the file
+	// is gone or changed or was written for other content
+	bool loadChunk(Shape &shape, std::uint64_t hash, RopeChunk &chunk)
+	{
+		auto found = entries_.find(hash);
+		if (found == entries_.end())
+		{
+			return false;
+		}
+		std::string path = pathOf(hash);
+		bool loaded = false;
+#ifdef ROPE_WRITEV
+		loaded = mapFileChunk(path, chunk) && chunk.size == found->second.size;
+#else
+		std::ifstream ifs(path, std::ifstream::in | std::ifstream::binary);
+		std::string text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+		loaded = ifs.eof() && text.size() == found->second.size;
+		chunk = makeChunk(std::move(text));
+#endif
+		BlobHeader header;
+		if (loaded && chunk.size >= sizeof(header))
+		{
+			std::memcpy(&header, chunk.data, sizeof(header));
+			loaded = header.version == renderCacheVersion && header.check == hashOf(shape, checkSeed);
+		}
+		else
+		{
+			loaded = false;
+		}
+		if (!loaded)
+		{
+			bytes_ -= found->second.size;
+			entries_.erase(found);
+			return false;
+		}
+		std::error_code ec;
+		found->second.used = std::filesystem::file_time_type::clock::now();
+		std::filesystem::last_write_time(path, found->second.used, ec);
+		chunk.data += sizeof(header);
+		chunk.size -= sizeof(header);
+		return true;
+	}
+
+	bool load(Shape &shape, std::uint64_t hash, std::string &out)
+	{
+		RopeChunk chunk;
+		if (!loadChunk(shape, hash, chunk))
+		{
+			return false;
+		}
+		out.append(chunk.data, chunk.size);
+		return true;
+	}
+	bool load(Shape &shape, std::uint64_t hash, Rope &out)
+	{
+		RopeChunk chunk;
+		if (!loadChunk(shape, hash, chunk))
+		{
+			return false;
+		}
+		out.append(std::move(chunk));
+		return true;
+	}
+
+	//Stores what was added to out since start, the output of shape, if it is big enough
+	void store(Shape &shape, std::uint64_t hash, const std::string &out, std::size_t start)
+	{
+		std::size_t size = out.size() - start;
+		if (size >= minBlobSize_)
+		{
+			BlobHeader header{ renderCacheVersion, hashOf(shape, checkSeed) };
+			storeBlob(hash, sizeof(header) + size, [&](const std::string &path) {
+				std::ofstream ofs(path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+				ofs.write((const char*)&header, sizeof(header));
+				ofs.write(out.data() + start, size);
+				ofs.close();
+				return (bool)ofs;
+			});
+		}
+	}
+	void store(Shape &shape, std::uint64_t hash, const Rope &out, Rope::Mark start)
+	{
+		std::uint64_t size = out.size() - start.bytes;
+		if (size >= minBlobSize_)
+		{
+			// The header and the new pieces, shared rather than copied
+			BlobHeader header{ renderCacheVersion, hashOf(shape, checkSeed) };
+			Rope blob;
+			blob.append((const char*)&header, sizeof(header));
+			for (std::size_t piece = start.piece; piece < out.getPieces().size(); ++piece)
+			{
+				blob.append(out.getPieces()[piece]);
+			}
+			storeBlob(hash, sizeof(header) + size, [&](const std::string &path) {
+				return blob.writeFile(path);
+			});
+		}
+	}
+
+	// Writes a blob through a temporary file. write(path) writes the
+	// bytes to path and returns false if it failed.
+	template <class Write>
+	void storeBlob(std::uint64_t hash, std::uint64_t size, Write &&write)
+	{
+		if (size > maxBytes_)
+		{
+			return;
+		}
+		std::string path = pathOf(hash);
+		std::string temporary = path + ".tmp";
+		if (!write(temporary))
+		{
+			std::remove(temporary.c_str());
+			return;
+		}
+		std::error_code ec;
+		std::filesystem::rename(temporary, path, ec);
+		if (ec)
+		{
+			std::remove(temporary.c_str());
+			return;
+		}
+		auto found = entries_.find(hash);
+		if (found != entries_.end())
+		{
+			bytes_ -= found->second.size;
+		}
+		entries_[hash] = Entry{ size, std::filesystem::file_time_type::clock::now() };
+		bytes_ += size;
+		++stores_;
+		evict();
+	}
+
+	//Removes least recently used blobs until the directory is back under maxBytes
+	void evict()
+	{
+		if (bytes_ <= maxBytes_)
+		{
+			return;
+		}
+		std::vector<std::pair<std::filesystem::file_time_type, std::uint64_t>> order;
+		for (const auto &e : entries_)
+		{
+			order.push_back({ e.second.used, e.first });
+		}
+		std::sort(order.begin(), order.end());
+		// Go a little below the cap so the next stores don't evict again right away
+		std::uint64_t target = maxBytes_ - maxBytes_ / 10;
+		for (const auto &o : order)
+		{
+			if (bytes_ <= target)
+			{
+				break;
+			}
+			std::remove(pathOf(o.second).c_str());
+			bytes_ -= entries_[o.second].size;
+			entries_.erase(o.second);
+			++evictions_;
+		}
+	}
+
+	std::string directory_;
+	std::uint64_t maxBytes_ = 0;
+	std::size_t minBlobSize_ = 0;
+	std::unordered_map<std::uint64_t, Entry> entries_;
+	std::uint64_t bytes_ = 0;
+	std::unordered_map<Shape*, std::uint64_t> hashes_;
+	std::unordered_map<Shape*, std::uint64_t> checks_;
+	std::string error_;
+
+	std::uint64_t hits_ = 0;
+	std::uint64_t misses_ = 0;
+	std::uint64_t stores_ = 0;
+	std::uint64_t evictions_ = 0;
+};
+
+#endif // RENDER_CACHE_HPP_INCLUDED
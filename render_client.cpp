@@ -0,0 +1,68 @@
+// render_client.cpp : Sends scene files to a running render_daemon and
+// writes the postscript to stdout. Reads the scene from stdin if no files are given.
+// Usage: render_client socket_path [scene files...]
+// Build e.g. g++ -std=c++17 -O2 -pthread render_client.cpp -o render_client
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "render_daemon.hpp"
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: " << argv[0] << " socket_path [scene files...]\n";
+		return 2;
+	}
+	std::vector<std::string> scenes;
+	for (int i = 2; i < argc; ++i)
+	{
+		std::ifstream ifs(argv[i], std::ifstream::in | std::ifstream::binary);
+		if (!ifs)
+		{
+			std::cerr << "can not open " << argv[i] << "\n";
+			return 1;
+		}
+		std::ostringstream text;
+		text << ifs.rdbuf();
+		scenes.push_back(text.str());
+	}
+	if (argc == 2)
+	{
+		std::ostringstream text;
+		text << std::cin.rdbuf();
+		scenes.push_back(text.str());
+	}
+
+	RenderClient client;
+	if (!client.connect(argv[1]))
+	{
+		std::cerr << client.getError() << "\n";
+		return 1;
+	}
+	// Send everything up front so the daemon can answer the scenes as one
+	// batch. Sending from its own thread keeps big replies from filling the
+	// socket while requests are still going out.
+	std::thread sender([&]() {
+		client.send(scenes);
+	});
+	int result = 0;
+	std::string postscript;
+	for (std::size_t i = 0; i < scenes.size(); ++i)
+	{
+		if (client.receive(postscript))
+		{
+			std::cout << postscript;
+		}
+		else
+		{
+			std::cerr << (argc > 2 ? argv[i + 2] : "stdin") << ": " << client.getError() << "\n";
+			result = 1;
+		}
+	}
+	sender.join();
+	return result;
+}
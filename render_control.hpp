@@ -0,0 +1,293 @@
+#ifndef RENDER_CONTROL_HPP_INCLUDED
+#define RENDER_CONTROL_HPP_INCLUDED
+
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <cstddef>
+#include "shape.hpp"
+#include "shape_value.hpp"
+#include "postscript.hpp"
+#include "pull_render.hpp"
+
+// Rendering that can be stopped part way, by a cancellation token another
+// thread sets or by a deadline, and that can be watched while it runs.
+//
+// The tree is walked as the pull renderer walks it, with the same bytes
+// between children, and leaves are written through their emit functions.
+// Every child boundary and every token written counts as work. After each
+// checkEvery units of work the token and the clock are looked at, and the
+// nodes and bytes done so far are published. Once stopped, the writer drops
+// everything and the loops in emitPolygon and emitCustom return at their
+// next turn. So a render stops within about checkEvery tokens of work, plus
+// at most one shape that is not walked into, e.g. a Scaled, which is copied
+// in one piece.
+//
+// A stopped render takes back what it wrote and gives back the memory.
+
+//Set from any thread to stop the renders that were given it
+class CancellationToken {
+public:
+	void cancel()
+	{
+		cancelled_.store(true, std::memory_order_relaxed);
+	}
+	bool isCancelled() const
+	{
+		return cancelled_.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<bool> cancelled_{ false };
+};
+
+//Work done so far, can be read from any thread while a render runs
+struct RenderProgress {
+	std::atomic<std::size_t> nodes{ 0 };
+	std::atomic<std::size_t> bytes{ 0 };
+};
+
+enum RenderStatus { RenderFinished, RenderCancelled, RenderTimedOut };
+
+// When a render should stop and where it reports to. Any of the token and
+// the progress may be nullptr.
+class RenderControl {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	RenderControl(const CancellationToken *token = nullptr, Clock::time_point deadline = Clock::time_point::max(),
+		RenderProgress *progress = nullptr, std::size_t checkEvery = 256)
+		: token_(token), deadline_(deadline), progress_(progress), checkEvery_(checkEvery > 0 ? checkEvery : 1) {}
+
+	//Stops at timeout from now
+	static RenderControl withTimeout(Clock::duration timeout, const CancellationToken *token = nullptr,
+		RenderProgress *progress = nullptr)
+	{
+		return RenderControl(token, Clock::now() + timeout, progress);
+	}
+
+	// Counts work units of work, and checks the token and the deadline if
+	// checkEvery units have been done since the last check. True once stopped.
+	bool poll(std::size_t work)
+	{
+		if (status_ != RenderFinished)
+		{
+			return true;
+		}
+		sinceCheck_ += work;
+		if (sinceCheck_ >= checkEvery_)
+		{
+			check();
+		}
+		return status_ != RenderFinished;
+	}
+
+	// Checks the token and the deadline now, and publishes the progress
+	void check()
+	{
+		sinceCheck_ = 0;
+		++checks_;
+		if (status_ == RenderFinished)
+		{
+			if (token_ != nullptr && token_->isCancelled())
+			{
+				status_ = RenderCancelled;
+			}
+			else if (deadline_ != Clock::time_point::max() && Clock::now() >= deadline_)
+			{
+				status_ = RenderTimedOut;
+			}
+		}
+		publish();
+	}
+
+	bool isStopped() const
+	{
+		return status_ != RenderFinished;
+	}
+
+	// RenderFinished while the render runs and after it ran to the end,
+	// otherwise why it stopped
+	RenderStatus getStatus() const
+	{
+		return status_;
+	}
+
+	//A shape was written whole
+	void nodeDone()
+	{
+		++nodes_;
+	}
+
+	//The render's output, which it appends to from start
+	void setOutput(const std::string *out, std::size_t start)
+	{
+		out_ = out;
+		start_ = start;
+	}
+
+	std::size_t getNodes() const
+	{
+		return nodes_;
+	}
+	//Bytes written when the progress was last published
+	std::size_t getBytes() const
+	{
+		return bytes_;
+	}
+	//Times the token and the deadline were looked at
+	std::size_t getChecks() const
+	{
+		return checks_;
+	}
+
+	void publish()
+	{
+		bytes_ = out_ != nullptr && out_->size() > start_ ? out_->size() - start_ : 0;
+		if (progress_ != nullptr)
+		{
+			progress_->nodes.store(nodes_, std::memory_order_relaxed);
+			progress_->bytes.store(bytes_, std::memory_order_relaxed);
+		}
+	}
+
+private:
+	const CancellationToken *token_;
+	Clock::time_point deadline_;
+	RenderProgress *progress_;
+	std::size_t checkEvery_;
+	std::size_t sinceCheck_ = 0;
+	std::size_t checks_ = 0;
+	std::size_t nodes_ = 0;
+	const std::string *out_ = nullptr;
+	std::size_t start_ = 0;
+	std::size_t bytes_ = 0;
+	RenderStatus status_ = RenderFinished;
+};
+
+// Writer that counts each token as a unit of work for a RenderControl and
+// drops everything once it has stopped
+template <class Writer>
+class ControlledWriter {
+public:
+	ControlledWriter(Writer &w, RenderControl &control) : w_(w), control_(control) {}
+
+	void number(double value)
+	{
+		if (!control_.poll(1))
+		{
+			w_.number(value);
+		}
+	}
+	void integer(long value)
+	{
+		if (!control_.poll(1))
+		{
+			w_.integer(value);
+		}
+	}
+	void op(const char *name)
+	{
+		if (!control_.poll(1))
+		{
+			w_.op(name);
+		}
+	}
+	void endLine()
+	{
+		if (!control_.poll(1))
+		{
+			w_.endLine();
+		}
+	}
+	//A token's worth of work for about every 8 bytes
+	void raw(const char *text, std::size_t size)
+	{
+		if (!control_.poll(1 + size / 8))
+		{
+			w_.raw(text, size);
+		}
+	}
+	void raw(const std::string &text)
+	{
+		raw(text.data(), text.size());
+	}
+
+	bool isStopped() const
+	{
+		return control_.isStopped();
+	}
+
+private:
+	Writer &w_;
+	RenderControl &control_;
+};
+
+template <class Writer>
+bool writerStopped(const ControlledWriter<Writer> &w)
+{
+	return w.isStopped();
+}
+
+// Writes shape through w under control. Returns false if it was stopped,
+// leaving the output of the shape unfinished.
+template <class Writer>
+bool renderControlledNode(Shape &shape, ControlledWriter<Writer> &w, RenderControl &control)
+{
+	unsigned int count = pullChildCount(shape);
+	if (count == 0)
+	{
+		ShapeValue::fromShape(shape).render(w);
+	}
+	std::string before;
+	std::string after;
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		// A boundary costs a few tokens' worth, so long runs of children
+		// that write little are still checked
+		if (control.poll(8))
+		{
+			return false;
+		}
+		pullChildWrapping(shape, i, before, after);
+		w.raw(before);
+		if (!renderControlledNode(*shape.getShape(i), w, control))
+		{
+			return false;
+		}
+		w.raw(after);
+	}
+	if (w.isStopped())
+	{
+		return false;
+	}
+	control.nodeDone();
+	return true;
+}
+
+// Appends the postscript of shape to out unless control stops it first.
+// Then out is cut back to what it held before and the memory the render
+// took is given back. The progress is published once more at the end,
+// before that, so it tells how far a stopped render got.
+inline RenderStatus renderControlled(Shape &shape, std::string &out, RenderControl &control)
+{
+	std::size_t start = out.size();
+	PostScriptWriter writer(out);
+	ControlledWriter<PostScriptWriter> controlled(writer, control);
+	control.setOutput(&out, start);
+	control.check();
+	if (!control.isStopped())
+	{
+		renderControlledNode(shape, controlled, control);
+	}
+	control.publish();
+	control.setOutput(nullptr, 0);
+	if (control.isStopped())
+	{
+		out.resize(start);
+		out.shrink_to_fit();
+	}
+	return control.getStatus();
+}
+
+#endif // RENDER_CONTROL_HPP_INCLUDED
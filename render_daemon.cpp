@@ -0,0 +1,44 @@
+// render_daemon.cpp : Serves renders over a Unix domain socket until interrupted.
+// Usage: render_daemon socket_path [workers]
+// Build e.g. g++ -std=c++17 -O2 -pthread render_daemon.cpp -o render_daemon
+//
+
+#include <iostream>
+#include <csignal>
+#include <cstdlib>
+#include "render_daemon.hpp"
+
+RenderServer *runningServer = nullptr;
+
+void stopServer(int)
+{
+	if (runningServer != nullptr)
+	{
+		runningServer->stop();
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: " << argv[0] << " socket_path [workers]\n";
+		return 2;
+	}
+	unsigned int workers = argc > 2 ? std::atoi(argv[2]) : std::thread::hardware_concurrency();
+
+	RenderServer server(workers);
+	if (!server.listen(argv[1]))
+	{
+		std::cerr << server.getError() << "\n";
+		return 1;
+	}
+	runningServer = &server;
+	std::signal(SIGINT, stopServer);
+	std::signal(SIGTERM, stopServer);
+	std::signal(SIGPIPE, SIG_IGN);
+
+	server.serve();
+	std::cerr << server.getRequestCount() << " requests in " << server.getBatchCount() << " batches\n";
+	return 0;
+}
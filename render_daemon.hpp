@@ -0,0 +1,677 @@
+#ifndef RENDER_DAEMON_HPP_INCLUDED
+#define RENDER_DAEMON_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "shape_value.hpp"
+#include "scene_parser.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#define RENDER_DAEMON_AVAILABLE 1
+
+// Rendering over a Unix domain socket, so many renders share one warm
+// process instead of paying for a process start each.
+//
+// Protocol, all integers 32 bit in the machine's byte order:
+//   request: length, then that many bytes of scene text (see scene_parser.hpp)
+//   reply:   status (0 rendered, 1 error), then chunks of length and bytes,
+//            ended by a chunk of length 0. The chunks hold the postscript,
+//            or the error message.
+// Requests may be pipelined, replies come back in the same order.
+//
+// The server polls idle connections from one thread and hands readable
+// ones to a fixed number of workers. A worker reads every request that has
+// arrived on its connection and answers them with as few writes as
+// possible, so many small requests are sent back together. Large outputs
+// are streamed in chunks as they are rendered. Each worker keeps its
+// parser and output buffer between requests.
+//
+// A worker reads at most maxReadPerTurn bytes of a connection before it
+// answers and hands the connection back, so a client that keeps sending
+// can not hold a worker, and a connection never buffers more than one
+// request that has not fully arrived. Connections are non-blocking on the
+// server side: a client that reads nothing of its replies for the send
+// timeout is dropped instead of blocking the worker that writes to it.
+
+const std::uint32_t renderOk = 0;
+const std::uint32_t renderError = 1;
+
+// Writes all of data, returns false if the connection is gone. If fd is
+// non-blocking, also returns false once nothing could be written for
+// timeout milliseconds, -1 waits for ever.
+inline bool sendAll(int fd, const char *data, std::size_t size, int timeout = -1)
+{
+#ifdef MSG_NOSIGNAL
+	const int flags = MSG_NOSIGNAL;
+#else
+	const int flags = 0;
+#endif
+	while (size > 0)
+	{
+		ssize_t sent = ::send(fd, data, size, flags);
+		if (sent < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				pollfd writable{ fd, POLLOUT, 0 };
+				int ready = ::poll(&writable, 1, timeout);
+				if (ready > 0 || (ready < 0 && errno == EINTR))
+				{
+					continue;
+				}
+			}
+			return false;
+		}
+		data += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+inline void appendUint32(std::string &out, std::uint32_t value)
+{
+	out.append((const char*)&value, sizeof(value));
+}
+
+inline std::uint32_t readUint32(const char *data)
+{
+	std::uint32_t value;
+	std::memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+inline bool unixAddress(const std::string &path, sockaddr_un &address)
+{
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+	{
+		return false;
+	}
+	std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+	return true;
+}
+
+// Writer for the shape templates that sends its output as reply chunks
+// once chunkSize bytes have built up, so big scenes are not held in memory.
+class ChunkWriter {
+public:
+	static constexpr std::size_t chunkSize = 1 << 16;
+
+	// out collects the reply, flushing sends it on fd, waiting up to
+	// timeout milliseconds for the reader as sendAll() does
+	ChunkWriter(std::string &out, int fd, int timeout = -1) : out_(out), fd_(fd), timeout_(timeout), writer_(out) {}
+
+	//Starts a chunk, the writer fills it until it is full or finished
+	void begin()
+	{
+		chunkStart_ = out_.size();
+		appendUint32(out_, 0);
+	}
+
+	//Closes the open chunk and writes the end marker
+	void finish()
+	{
+		closeChunk();
+		appendUint32(out_, 0);
+	}
+
+	bool ok() const
+	{
+		return ok_;
+	}
+
+	void number(double value) { writer_.number(value); }
+	void integer(long value) { writer_.integer(value); }
+	void op(const char *name) { writer_.op(name); }
+	void raw(const char *text, std::size_t size) { writer_.raw(text, size); flushIfFull(); }
+	void raw(const std::string &text) { raw(text.data(), text.size()); }
+	void endLine()
+	{
+		writer_.endLine();
+		flushIfFull();
+	}
+
+private:
+	void closeChunk()
+	{
+		std::uint32_t size = out_.size() - chunkStart_ - sizeof(std::uint32_t);
+		std::memcpy(&out_[chunkStart_], &size, sizeof(size));
+	}
+
+	void flushIfFull()
+	{
+		if (out_.size() - chunkStart_ < chunkSize)
+		{
+			return;
+		}
+		closeChunk();
+		ok_ = ok_ && sendAll(fd_, out_.data(), out_.size(), timeout_);
+		out_.clear();
+		begin();
+	}
+
+	std::string &out_;
+	int fd_;
+	int timeout_;
+	PostScriptWriter writer_;
+	std::size_t chunkStart_ = 0;
+	bool ok_ = true;
+};
+
+class RenderServer {
+public:
+	//Largest scene text accepted in one request
+	static constexpr std::uint32_t maxRequestSize = 1u << 28;
+	//Most bytes read from one connection before its requests are answered
+	static constexpr std::size_t maxReadPerTurn = 1 << 20;
+
+	// sendTimeout is how long, in milliseconds, a client may go without
+	// reading any of its replies before its connection is closed
+	RenderServer(unsigned int workers = std::thread::hardware_concurrency(), int sendTimeout = 10000)
+		: workerCount_(std::max(1u, workers)), sendTimeout_(sendTimeout) {}
+	RenderServer(const RenderServer &) = delete;
+	RenderServer &operator=(const RenderServer &) = delete;
+	~RenderServer()
+	{
+		closeAll();
+	}
+
+	//Creates the socket. Returns false and sets getError() on failure.
+	bool listen(const std::string &path)
+	{
+		sockaddr_un address;
+		if (!unixAddress(path, address))
+		{
+			return fail("socket path is too long: " + path);
+		}
+		int fds[2];
+		if (pipe(fds) != 0)
+		{
+			return fail("can not create wake up pipe");
+		}
+		wakeRead_ = fds[0];
+		wakeWrite_ = fds[1];
+		fcntl(wakeRead_, F_SETFL, O_NONBLOCK);
+		fcntl(wakeWrite_, F_SETFL, O_NONBLOCK);
+
+		listenFd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listenFd_ < 0)
+		{
+			return fail("can not create socket");
+		}
+		::unlink(path.c_str());
+		if (::bind(listenFd_, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(listenFd_, 128) != 0)
+		{
+			return fail("can not listen on " + path + ": " + std::strerror(errno));
+		}
+		path_ = path;
+		return true;
+	}
+
+	// Answers requests until stop() is called. Blocks the calling thread.
+	void serve()
+	{
+		std::vector<std::thread> workers;
+		for (unsigned int i = 0; i < workerCount_; ++i)
+		{
+			workers.emplace_back([this]() { work(); });
+		}
+
+		std::vector<std::unique_ptr<Connection>> idle;
+		std::vector<pollfd> fds;
+		while (!stopping_)
+		{
+			fds.clear();
+			fds.push_back(pollfd{ listenFd_, POLLIN, 0 });
+			fds.push_back(pollfd{ wakeRead_, POLLIN, 0 });
+			for (const auto &c : idle)
+			{
+				fds.push_back(pollfd{ c->fd, POLLIN, 0 });
+			}
+			if (::poll(fds.data(), fds.size(), -1) < 0)
+			{
+				continue; // EINTR
+			}
+
+			// Connections are only watched here while no worker has them
+			for (std::size_t i = idle.size(); i-- > 0;)
+			{
+				if (fds[i + 2].revents != 0)
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					ready_.push_back(std::move(idle[i]));
+					idle.erase(idle.begin() + i);
+					readyChanged_.notify_one();
+				}
+			}
+			if (fds[1].revents != 0)
+			{
+				char drain[64];
+				while (::read(wakeRead_, drain, sizeof(drain)) > 0)
+				{
+				}
+				std::lock_guard<std::mutex> lock(mutex_);
+				for (auto &c : returned_)
+				{
+					idle.push_back(std::move(c));
+				}
+				returned_.clear();
+			}
+			if (fds[0].revents != 0)
+			{
+				int fd = ::accept(listenFd_, nullptr, nullptr);
+				if (fd >= 0)
+				{
+					fcntl(fd, F_SETFL, O_NONBLOCK);
+					std::unique_ptr<Connection> c(new Connection());
+					c->fd = fd;
+					idle.push_back(std::move(c));
+				}
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			readyChanged_.notify_all();
+		}
+		for (std::thread &t : workers)
+		{
+			t.join();
+		}
+		for (auto &c : idle)
+		{
+			::close(c->fd);
+		}
+		for (auto &c : returned_)
+		{
+			::close(c->fd);
+		}
+		for (auto &c : ready_)
+		{
+			::close(c->fd);
+		}
+		returned_.clear();
+		ready_.clear();
+		closeAll();
+	}
+
+	// Makes serve() return. Only writes to a pipe, so it can be called
+	// from another thread or a signal handler.
+	void stop()
+	{
+		stopping_ = true;
+		char c = 0;
+		ssize_t ignored = ::write(wakeWrite_, &c, 1);
+		(void)ignored;
+	}
+
+	const std::string &getError() const
+	{
+		return error_;
+	}
+
+	//Requests answered so far
+	std::uint64_t getRequestCount() const
+	{
+		return requests_;
+	}
+
+	//Writes used for the replies, less than getRequestCount() when requests were batched
+	std::uint64_t getBatchCount() const
+	{
+		return batches_;
+	}
+
+	// Connections closed because a reply could not be sent, as the client
+	// had gone or read nothing of it for the send timeout
+	std::uint64_t getDroppedCount() const
+	{
+		return dropped_;
+	}
+
+private:
+	struct Connection {
+		int fd;
+		std::string input; // bytes of requests that have not fully arrived
+	};
+
+	bool fail(const std::string &message)
+	{
+		error_ = message;
+		closeAll();
+		return false;
+	}
+
+	void closeAll()
+	{
+		for (int *fd : { &listenFd_, &wakeRead_, &wakeWrite_ })
+		{
+			if (*fd >= 0)
+			{
+				::close(*fd);
+				*fd = -1;
+			}
+		}
+		if (!path_.empty())
+		{
+			::unlink(path_.c_str());
+			path_.clear();
+		}
+	}
+
+	void work()
+	{
+		// Kept between requests so their memory is reused
+		SceneParser parser;
+		std::string out;
+		char buffer[1 << 16];
+
+		while (true)
+		{
+			std::unique_ptr<Connection> c;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				readyChanged_.wait(lock, [this]() { return stopping_ || !ready_.empty(); });
+				if (stopping_)
+				{
+					return;
+				}
+				c = std::move(ready_.front());
+				ready_.pop_front();
+			}
+
+			// Read what has arrived, up to maxReadPerTurn bytes, and no more
+			// than one whole request of maxRequestSize. Once that much is
+			// buffered it holds a complete request, which is answered below.
+			const std::size_t maxInput = sizeof(std::uint32_t) + maxRequestSize;
+			std::size_t readThisTurn = 0;
+			bool open = true;
+			while (readThisTurn < maxReadPerTurn && c->input.size() < maxInput)
+			{
+				std::size_t want = std::min({ sizeof(buffer), maxReadPerTurn - readThisTurn, maxInput - c->input.size() });
+				ssize_t received = ::recv(c->fd, buffer, want, MSG_DONTWAIT);
+				if (received > 0)
+				{
+					c->input.append(buffer, received);
+					readThisTurn += received;
+					continue;
+				}
+				if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+				{
+					open = false;
+				}
+				if (received < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				break;
+			}
+
+			// Answer every complete request, then send the replies together
+			out.clear();
+			std::size_t used = 0;
+			while (open && c->input.size() - used >= sizeof(std::uint32_t))
+			{
+				std::uint32_t size = readUint32(c->input.data() + used);
+				if (size > maxRequestSize)
+				{
+					open = false;
+					break;
+				}
+				if (c->input.size() - used - sizeof(std::uint32_t) < size)
+				{
+					break;
+				}
+				const char *text = c->input.data() + used + sizeof(std::uint32_t);
+				open = answer(parser, text, size, out, c->fd);
+				dropped_ += !open;
+				used += sizeof(std::uint32_t) + size;
+				++requests_;
+			}
+			c->input.erase(0, used);
+			if (open && !out.empty())
+			{
+				open = sendAll(c->fd, out.data(), out.size(), sendTimeout_);
+				dropped_ += !open;
+				++batches_;
+			}
+			if (out.capacity() > (4u << 20))
+			{
+				std::string().swap(out); // don't keep a huge reply around
+			}
+
+			if (!open)
+			{
+				::close(c->fd);
+				continue;
+			}
+			std::lock_guard<std::mutex> lock(mutex_);
+			returned_.push_back(std::move(c));
+			char wake = 0;
+			ssize_t ignored = ::write(wakeWrite_, &wake, 1);
+			(void)ignored;
+		}
+	}
+
+	//Appends the reply to one request to out, returns false if the connection is gone
+	bool answer(SceneParser &parser, const char *text, std::size_t size, std::string &out, int fd)
+	{
+		parser.reset();
+		parser.feed(text, size);
+		bool parsed = parser.finish();
+		appendUint32(out, parsed ? renderOk : renderError);
+		ChunkWriter writer(out, fd, sendTimeout_);
+		writer.begin();
+		if (parsed)
+		{
+			parser.getScene().render(writer);
+		}
+		else
+		{
+			writer.raw(parser.getError());
+		}
+		writer.finish();
+		return writer.ok();
+	}
+
+	unsigned int workerCount_;
+	int sendTimeout_;
+	int listenFd_ = -1;
+	int wakeRead_ = -1;
+	int wakeWrite_ = -1;
+	std::string path_;
+	std::string error_;
+	std::atomic<bool> stopping_{ false };
+	std::atomic<std::uint64_t> requests_{ 0 };
+	std::atomic<std::uint64_t> batches_{ 0 };
+	std::atomic<std::uint64_t> dropped_{ 0 };
+
+	std::mutex mutex_;
+	std::condition_variable readyChanged_;
+	std::deque<std::unique_ptr<Connection>> ready_;      // readable, waiting for a worker
+	std::vector<std::unique_ptr<Connection>> returned_;  // answered, to be watched again
+};
+
+// Client side of the protocol. send() may be called several times before
+// receive() to pipeline requests, also from a separate thread.
+class RenderClient {
+public:
+	RenderClient() = default;
+	RenderClient(const RenderClient &) = delete;
+	RenderClient &operator=(const RenderClient &) = delete;
+	~RenderClient()
+	{
+		close();
+	}
+
+	bool connect(const std::string &path)
+	{
+		close();
+		sockaddr_un address;
+		if (!unixAddress(path, address))
+		{
+			return fail("socket path is too long: " + path);
+		}
+		fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd_ < 0 || ::connect(fd_, (sockaddr*)&address, sizeof(address)) != 0)
+		{
+			close();
+			return fail("can not connect to " + path + ": " + std::strerror(errno));
+		}
+		return true;
+	}
+
+	void close()
+	{
+		if (fd_ >= 0)
+		{
+			::close(fd_);
+			fd_ = -1;
+		}
+		input_.clear();
+		used_ = 0;
+	}
+
+	// Leaves getError() alone so one thread can send while another
+	// receives, receive() reports the lost connection
+	bool send(const std::string &scene)
+	{
+		std::string request;
+		request.reserve(sizeof(std::uint32_t) + scene.size());
+		appendUint32(request, scene.size());
+		request += scene;
+		return fd_ >= 0 && sendAll(fd_, request.data(), request.size());
+	}
+
+	//Sends several requests with one write
+	bool send(const std::vector<std::string> &scenes)
+	{
+		std::string request;
+		for (const std::string &scene : scenes)
+		{
+			appendUint32(request, scene.size());
+			request += scene;
+		}
+		return fd_ >= 0 && sendAll(fd_, request.data(), request.size());
+	}
+
+	// Reads the next reply into postscript. Returns false if the server
+	// reported an error (the message is in getError()) or the connection failed.
+	bool receive(std::string &postscript)
+	{
+		postscript.clear();
+		std::uint32_t status;
+		if (!read(&status, sizeof(status)))
+		{
+			return fail("connection lost");
+		}
+		std::string &target = status == renderOk ? postscript : error_;
+		if (status != renderOk)
+		{
+			error_.clear();
+		}
+		while (true)
+		{
+			std::uint32_t size;
+			if (!read(&size, sizeof(size)))
+			{
+				return fail("connection lost");
+			}
+			if (size == 0)
+			{
+				break;
+			}
+			std::size_t start = target.size();
+			target.resize(start + size);
+			if (!read(&target[start], size))
+			{
+				return fail("connection lost");
+			}
+		}
+		return status == renderOk;
+	}
+
+	bool render(const std::string &scene, std::string &postscript)
+	{
+		if (!send(scene))
+		{
+			return fail("connection lost");
+		}
+		return receive(postscript);
+	}
+
+	const std::string &getError() const
+	{
+		return error_;
+	}
+
+private:
+	bool fail(const std::string &message)
+	{
+		error_ = message;
+		return false;
+	}
+
+	//Reads exactly size bytes through the receive buffer
+	bool read(void *data, std::size_t size)
+	{
+		char *target = (char*)data;
+		while (size > 0)
+		{
+			if (used_ == input_.size())
+			{
+				input_.resize(1 << 16);
+				ssize_t received = ::recv(fd_, &input_[0], input_.size(), 0);
+				if (received < 0 && errno == EINTR)
+				{
+					input_.clear();
+					used_ = 0;
+					continue;
+				}
+				if (received <= 0)
+				{
+					input_.clear();
+					used_ = 0;
+					return false;
+				}
+				input_.resize(received);
+				used_ = 0;
+			}
+			std::size_t take = std::min(size, input_.size() - used_);
+			std::memcpy(target, input_.data() + used_, take);
+			used_ += take;
+			target += take;
+			size -= take;
+		}
+		return true;
+	}
+
+	int fd_ = -1;
+	std::string input_;
+	std::size_t used_ = 0;
+	std::string error_;
+};
+
+#endif // unix
+
+#endif // RENDER_DAEMON_HPP_INCLUDED
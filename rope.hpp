@@ -0,0 +1,315 @@
+#ifndef ROPE_HPP_INCLUDED
+#define ROPE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "shape.hpp"
+#include "sharded_render.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <errno.h>
+#define ROPE_WRITEV 1
+#endif
+
+// Output kept as a list of shared, immutable chunks instead of one string.
+//
+// Child output is added to a rope by reference, so putting a document
+// together from its parts, or from cached blobs, does not copy the parts.
+// Short glue like translates is copied into small blocks owned by the rope.
+// writeTo() hands the chunks to writev, so the bytes go from where they
+// were made to the file without being gathered first.
+
+//Bytes that stay valid for as long as owner is alive
+struct RopeChunk {
+	std::shared_ptr<const void> owner;
+	const char *data;
+	std::size_t size;
+};
+
+//Chunk holding a string, which is moved, not copied
+inline RopeChunk makeChunk(std::string &&text)
+{
+	auto owned = std::make_shared<const std::string>(std::move(text));
+	return RopeChunk{ owned, owned->data(), owned->size() };
+}
+
+#ifdef ROPE_WRITEV
+// Chunk of a whole file, mapped read-only. Returns false if the file can
+// not be mapped, an empty file gives an empty chunk.
+inline bool mapFileChunk(const std::string &path, RopeChunk &chunk)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+	std::size_t size = st.st_size;
+	if (size == 0)
+	{
+		::close(fd);
+		chunk = RopeChunk{ nullptr, "", 0 };
+		return true;
+	}
+	void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED)
+	{
+		return false;
+	}
+	std::shared_ptr<const void> owner(mapped, [size](const void *p) {
+		munmap(const_cast<void*>(p), size);
+	});
+	chunk = RopeChunk{ owner, (const char*)mapped, size };
+	return true;
+}
+#endif
+
+class Rope {
+public:
+	//Size of the blocks glue is copied into
+	static constexpr std::size_t glueBlockSize = 4096;
+	//Strings shorter than this are copied as glue rather than kept as chunks
+	static constexpr std::size_t minChunkSize = 256;
+
+	//Where a rope stood, for looking at what was added since
+	struct Mark {
+		std::size_t piece;
+		std::uint64_t bytes;
+	};
+
+	void append(RopeChunk chunk)
+	{
+		if (chunk.size == 0)
+		{
+			return;
+		}
+		size_ += chunk.size;
+		pieces_.push_back(std::move(chunk));
+		glueOpen_ = false;
+	}
+
+	void append(std::string &&text)
+	{
+		if (text.size() < minChunkSize)
+		{
+			append(text.data(), text.size());
+			return;
+		}
+		append(makeChunk(std::move(text)));
+	}
+
+	//Copies text into the glue block
+	void append(const char *text, std::size_t size)
+	{
+		if (size == 0)
+		{
+			return;
+		}
+		if (size > glueBlockSize / 4)
+		{
+			append(std::string(text, size));
+			copied_ += size;
+			return;
+		}
+		if (!glue_ || glueUsed_ + size > glueBlockSize)
+		{
+			glue_ = std::shared_ptr<char>(new char[glueBlockSize], std::default_delete<char[]>());
+			glueUsed_ = 0;
+			glueOpen_ = false;
+		}
+		char *target = glue_.get() + glueUsed_;
+		std::memcpy(target, text, size);
+		glueUsed_ += size;
+		copied_ += size;
+		size_ += size;
+		// Grow the last piece if it is the glue just before this
+		if (glueOpen_ && pieces_.back().data + pieces_.back().size == target)
+		{
+			pieces_.back().size += size;
+		}
+		else
+		{
+			pieces_.push_back(RopeChunk{ glue_, target, size });
+			glueOpen_ = true;
+		}
+	}
+
+	//Shares the chunks of other
+	void append(const Rope &other)
+	{
+		for (const RopeChunk &chunk : other.pieces_)
+		{
+			pieces_.push_back(chunk);
+		}
+		size_ += other.size_;
+		glueOpen_ = false;
+	}
+
+	Rope &operator+=(std::string &&text)
+	{
+		append(std::move(text));
+		return *this;
+	}
+	Rope &operator+=(const std::string &text)
+	{
+		append(text.data(), text.size());
+		return *this;
+	}
+	Rope &operator+=(const char *text)
+	{
+		append(text, std::strlen(text));
+		return *this;
+	}
+
+	// Current position. Glue added after it starts a new piece, so the
+	// pieces from mark.piece on hold exactly what was added since.
+	Mark mark()
+	{
+		glueOpen_ = false;
+		return Mark{ pieces_.size(), size_ };
+	}
+
+	std::uint64_t size() const
+	{
+		return size_;
+	}
+
+	const std::vector<RopeChunk> &getPieces() const
+	{
+		return pieces_;
+	}
+
+	//Bytes copied into the rope as glue, the rest was shared
+	std::uint64_t getCopiedBytes() const
+	{
+		return copied_;
+	}
+
+	std::string str() const
+	{
+		std::string out;
+		out.reserve(size_);
+		for (const RopeChunk &chunk : pieces_)
+		{
+			out.append(chunk.data, chunk.size);
+		}
+		return out;
+	}
+
+#ifdef ROPE_WRITEV
+	// Writes the pieces from firstPiece on to fd with writev, as many at a
+	// time as the system allows. Returns false on a write error.
+	bool writeTo(int fd, std::size_t firstPiece = 0) const
+	{
+		std::vector<iovec> batch;
+		std::size_t piece = firstPiece;
+		while (piece < pieces_.size())
+		{
+			batch.clear();
+			for (; piece < pieces_.size() && batch.size() < IOV_MAX; ++piece)
+			{
+				batch.push_back(iovec{ (void*)pieces_[piece].data, pieces_[piece].size });
+			}
+			// writev may stop part way through, carry on from there
+			std::size_t first = 0;
+			while (first < batch.size())
+			{
+				ssize_t written = ::writev(fd, batch.data() + first, std::min<std::size_t>(batch.size() - first, IOV_MAX));
+				if (written < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+					return false;
+				}
+				while (first < batch.size() && (std::size_t)written >= batch[first].iov_len)
+				{
+					written -= batch[first].iov_len;
+					++first;
+				}
+				if (first < batch.size())
+				{
+					batch[first].iov_base = (char*)batch[first].iov_base + written;
+					batch[first].iov_len -= written;
+				}
+			}
+		}
+		return true;
+	}
+#endif
+
+	//Writes the rope to path, with writev where there is one
+	bool writeFile(const std::string &path, std::size_t firstPiece = 0) const
+	{
+#ifdef ROPE_WRITEV
+		int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+		{
+			return false;
+		}
+		bool ok = writeTo(fd, firstPiece);
+		return ::close(fd) == 0 && ok;
+#else
+		std::ofstream ofs(path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+		for (std::size_t piece = firstPiece; piece < pieces_.size(); ++piece)
+		{
+			ofs.write(pieces_[piece].data, pieces_[piece].size);
+		}
+		ofs.close();
+		return (bool)ofs;
+#endif
+	}
+
+private:
+	std::vector<RopeChunk> pieces_;
+	std::uint64_t size_ = 0;
+	std::uint64_t copied_ = 0;
+	std::shared_ptr<char> glue_;
+	std::size_t glueUsed_ = 0;
+	bool glueOpen_ = false; // last piece is glue that can still grow
+};
+
+// Renders shape into a rope. Leaves become chunks of their own output and
+// composites only add their translates, so no child output is copied.
+inline void renderRope(Shape &shape, Rope &out)
+{
+	if (Rotated *rotated = dynamic_cast<Rotated*>(&shape))
+	{
+		out += std::to_string(rotated->getAngle());
+		out += " rotate\n";
+		renderRope(*rotated->getShape(0), out);
+	}
+	else if (shape.getSize() > 0 && fragmentCount(shape) == shape.getSize())
+	{
+		for (unsigned int i = 0; i < shape.getSize(); ++i)
+		{
+			appendFragment(shape, i, out, [](Shape &child, Rope &childOut) {
+				renderRope(child, childOut);
+			});
+		}
+	}
+	else
+	{
+		out += shape.generatePostScript();
+	}
+}
+
+#endif // ROPE_HPP_INCLUDED
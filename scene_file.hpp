@@ -0,0 +1,613 @@
+#ifndef SCENE_FILE_HPP_INCLUDED
+#define SCENE_FILE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include "shape.hpp"
+#include "shape_value.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define SCENE_FILE_MMAP 1
+#endif
+
+// Binary scene files.
+//
+// Layout, all offsets in bytes from the start of the file:
+//   SceneHeader
+//   node table  nodeCount SceneNode records, in breadth first order so the
+//               children of a node are next to each other
+//   params      paramCount doubles. Every node starts with its width and
+//               height, followed by what its kind needs:
+//                 Polygon: number of sides, side length
+//                 Spacer:  x, y
+//                 Scaled:  fx, fy
+//                 Rotated: angle
+//                 Transformed: a, b, c, d, tx, ty
+//   text        postscript of Text nodes
+// Numbers are stored in the byte order of the machine that wrote the file,
+// byteOrder tells the reader whether that matches its own.
+
+const std::uint32_t sceneFileVersion = 1;
+const std::uint32_t sceneByteOrder = 0x01020304;
+
+struct SceneHeader {
+	char magic[4];          // "SHPS"
+	std::uint32_t version;
+	std::uint32_t byteOrder;
+	std::uint32_t reserved;
+	std::uint64_t nodeCount;
+	std::uint64_t paramCount;
+	std::uint64_t textSize;
+	std::uint64_t nodeOffset;
+	std::uint64_t paramOffset;
+	std::uint64_t textOffset;
+};
+
+// Kinds have the same order as the ShapeValue::Node alternatives
+enum SceneKind : std::uint8_t {
+	SceneCircle, ScenePolygon, SceneRectangle, SceneSpacer, SceneCustom,
+	SceneScaled, SceneRotated, SceneLayered, SceneMultiLayered, SceneHorizontal, SceneVertical, SceneText,
+	SceneTransformed, SceneKindCount
+};
+static_assert(std::variant_size<ShapeValue::Node>::value == SceneKindCount, "SceneKind must match ShapeValue::Node");
+
+struct SceneNode {
+	std::uint8_t kind;
+	std::uint8_t reserved[3];
+	std::uint32_t count;    // number of children, or text length for Text
+	std::uint64_t first;    // index of the first child, or text offset for Text
+	std::uint64_t param;    // index of the node's first param
+};
+static_assert(sizeof(SceneHeader) == 64, "SceneHeader must be 64 bytes");
+static_assert(sizeof(SceneNode) == 24, "SceneNode must be 24 bytes");
+
+//Number of params a node of the given kind uses
+inline unsigned int sceneParamCount(std::uint8_t kind)
+{
+	switch (kind)
+	{
+	case ScenePolygon:
+	case SceneSpacer:
+	case SceneScaled:
+		return 4;
+	case SceneRotated:
+		return 3;
+	case SceneTransformed:
+		return 8;
+	default:
+		return 2;
+	}
+}
+
+// Children of a ShapeValue node, empty for leaves
+inline const std::vector<ShapeValue> *sceneChildren(const ShapeValue &shape)
+{
+	switch (shape.node.index())
+	{
+	case SceneScaled: return &std::get<ScaledNode>(shape.node).child;
+	case SceneRotated: return &std::get<RotatedNode>(shape.node).child;
+	case SceneLayered: return &std::get<LayeredNode>(shape.node).children;
+	case SceneMultiLayered: return &std::get<MultiLayeredNode>(shape.node).children;
+	case SceneHorizontal: return &std::get<HorizontalNode>(shape.node).children;
+	case SceneVertical: return &std::get<VerticalNode>(shape.node).children;
+	case SceneTransformed: return &std::get<TransformedNode>(shape.node).child;
+	default: return nullptr;
+	}
+}
+
+// Calls f(shape) for every node in breadth first order
+template <class F>
+void forEachBreadthFirst(const ShapeValue &root, F &&f)
+{
+	std::deque<const ShapeValue*> queue;
+	queue.push_back(&root);
+	while (!queue.empty())
+	{
+		const ShapeValue &shape = *queue.front();
+		queue.pop_front();
+		f(shape);
+		if (const std::vector<ShapeValue> *children = sceneChildren(shape))
+		{
+			for (const ShapeValue &child : *children)
+			{
+				queue.push_back(&child);
+			}
+		}
+	}
+}
+
+// Writes a scene file. The tree is walked once per section so nothing but
+// a small buffer is held besides the shape itself. Returns false if the
+// file could not be written.
+inline bool writeScene(const ShapeValue &root, const std::string &path)
+{
+	SceneHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "SHPS", 4);
+	header.version = sceneFileVersion;
+	header.byteOrder = sceneByteOrder;
+	forEachBreadthFirst(root, [&](const ShapeValue &shape) {
+		header.nodeCount++;
+		header.paramCount += sceneParamCount(shape.node.index());
+		if (const TextNode *text = std::get_if<TextNode>(&shape.node))
+		{
+			header.textSize += text->text.size();
+		}
+	});
+	header.nodeOffset = sizeof(SceneHeader);
+	header.paramOffset = header.nodeOffset + header.nodeCount * sizeof(SceneNode);
+	header.textOffset = header.paramOffset + header.paramCount * sizeof(double);
+
+	std::ofstream ofs(path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+	if (!ofs)
+	{
+		return false;
+	}
+	ofs.write((const char*)&header, sizeof(header));
+
+	// Node table. Children of the node at queue position i get the next
+	// free indices, which is where breadth first order puts them.
+	std::uint64_t nextChild = 1;
+	std::uint64_t nextParam = 0;
+	std::uint64_t nextText = 0;
+	forEachBreadthFirst(root, [&](const ShapeValue &shape) {
+		SceneNode node;
+		std::memset(&node, 0, sizeof(node));
+		node.kind = (std::uint8_t)shape.node.index();
+		node.param = nextParam;
+		nextParam += sceneParamCount(node.kind);
+		if (const TextNode *text = std::get_if<TextNode>(&shape.node))
+		{
+			node.first = nextText;
+			node.count = (std::uint32_t)text->text.size();
+			nextText += text->text.size();
+		}
+		else if (const std::vector<ShapeValue> *children = sceneChildren(shape))
+		{
+			node.first = nextChild;
+			node.count = (std::uint32_t)children->size();
+			nextChild += children->size();
+		}
+		ofs.write((const char*)&node, sizeof(node));
+	});
+
+	forEachBreadthFirst(root, [&](const ShapeValue &shape) {
+		double params[8] = { shape.width, shape.height, 0, 0, 0, 0, 0, 0 };
+		if (const PolygonNode *n = std::get_if<PolygonNode>(&shape.node))
+		{
+			params[2] = n->numSides;
+			params[3] = n->sideLength;
+		}
+		else if (const SpacerNode *n = std::get_if<SpacerNode>(&shape.node))
+		{
+			params[2] = n->x;
+			params[3] = n->y;
+		}
+		else if (const ScaledNode *n = std::get_if<ScaledNode>(&shape.node))
+		{
+			params[2] = n->fx;
+			params[3] = n->fy;
+		}
+		else if (const RotatedNode *n = std::get_if<RotatedNode>(&shape.node))
+		{
+			params[2] = n->angle;
+		}
+		else if (const TransformedNode *n = std::get_if<TransformedNode>(&shape.node))
+		{
+			const double matrix[6] = { n->matrix.a, n->matrix.b, n->matrix.c, n->matrix.d, n->matrix.tx, n->matrix.ty };
+			std::memcpy(params + 2, matrix, sizeof(matrix));
+		}
+		ofs.write((const char*)params, sceneParamCount(shape.node.index()) * sizeof(double));
+	});
+
+	forEachBreadthFirst(root, [&](const ShapeValue &shape) {
+		if (const TextNode *text = std::get_if<TextNode>(&shape.node))
+		{
+			ofs.write(text->text.data(), text->text.size());
+		}
+	});
+	return (bool)ofs;
+}
+
+inline bool writeScene(Shape &root, const std::string &path)
+{
+	return writeScene(ShapeValue::fromShape(root), path);
+}
+
+// A scene file mapped into memory. Nodes are read and rendered straight
+// from the mapping; nothing is copied and untouched parts of the file are
+// never read from disk.
+class SceneFile {
+public:
+	SceneFile() = default;
+	SceneFile(const SceneFile &) = delete;
+	SceneFile &operator=(const SceneFile &) = delete;
+	~SceneFile()
+	{
+		close();
+	}
+
+	// Maps the file and checks its header and that the node table is a tree.
+	// Returns false and sets getError() on failure.
+	bool open(const std::string &path)
+	{
+		close();
+#ifdef SCENE_FILE_MMAP
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return fail("can not open " + path);
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SceneHeader))
+		{
+			::close(fd);
+			return fail(path + " is too small to be a scene file");
+		}
+		size_ = st.st_size;
+		void *mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (mapped == MAP_FAILED)
+		{
+			size_ = 0;
+			return fail("can not map " + path);
+		}
+		data_ = (const char*)mapped;
+#else
+		std::ifstream ifs(path, std::ifstream::in | std::ifstream::binary);
+		if (!ifs)
+		{
+			return fail("can not open " + path);
+		}
+		copy_.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+		data_ = copy_.data();
+		size_ = copy_.size();
+#endif
+		return checkHeader();
+	}
+
+	void close()
+	{
+#ifdef SCENE_FILE_MMAP
+		if (data_ != nullptr)
+		{
+			munmap((void*)data_, size_);
+		}
+#else
+		copy_.clear();
+#endif
+		data_ = nullptr;
+		size_ = 0;
+		header_ = nullptr;
+	}
+
+	const std::string &getError() const
+	{
+		return error_;
+	}
+
+	std::uint64_t getNodeCount() const
+	{
+		return header_ ? header_->nodeCount : 0;
+	}
+	const SceneNode &getNode(std::uint64_t n) const
+	{
+		return nodes_[n];
+	}
+	double getWidth(std::uint64_t n) const
+	{
+		return params_[nodes_[n].param];
+	}
+	double getHeight(std::uint64_t n) const
+	{
+		return params_[nodes_[n].param + 1];
+	}
+
+	// Writes the postscript of node n (0 is the root), which is depth levels
+	// below the root. Nodes whose children, params or text point outside the
+	// file, or that are nested deeper than maxSceneDepth, are skipped and set
+	// getError().
+	template <class Writer>
+	void render(std::uint64_t n, Writer &w, unsigned int depth = 0)
+	{
+		if (!checkNode(n) || !checkDepth(depth))
+		{
+			return;
+		}
+		const SceneNode &node = nodes_[n];
+		const double *p = params_ + node.param;
+		double width = p[0];
+		double height = p[1];
+		switch (node.kind)
+		{
+		case SceneCircle:
+			emitCircle(w, width, height);
+			break;
+		case ScenePolygon:
+			emitPolygon(w, (int)p[2], p[3], height);
+			break;
+		case SceneRectangle:
+			emitRectangle(w, width, height);
+			break;
+		case SceneSpacer:
+			emitSpacer(w, width, height, p[2], p[3]);
+			break;
+		case SceneCustom:
+			emitCustom(w, width, height);
+			break;
+		case SceneScaled:
+			w.number(p[2]);
+			w.number(p[3]);
+			w.op("scale");
+			w.endLine();
+			render(node.first, w, depth + 1);
+			w.number(1 / p[2]);
+			w.number(1 / p[3]);
+			w.op("scale");
+			w.endLine();
+			break;
+		case SceneRotated:
+			w.integer((long)p[2]);
+			w.op("rotate");
+			w.endLine();
+			render(node.first, w, depth + 1);
+			break;
+		case SceneLayered:
+			for (std::uint64_t c = node.first; c < node.first + node.count; ++c)
+			{
+				render(c, w, depth + 1);
+			}
+			break;
+		case SceneMultiLayered:
+			for (std::uint64_t c = node.first; c < node.first + node.count; ++c) {
+				emitTranslate(w, 0.0, 0.0);
+				render(c, w, depth + 1);
+				emitTranslate(w, 0.0, 0.0);
+				w.endLine();
+			}
+			break;
+		case SceneHorizontal:
+			for (std::uint64_t c = node.first; c < node.first + node.count; ++c) {
+				if (!checkNode(c))
+				{
+					continue;
+				}
+				double childWidth = getWidth(c);
+				emitTranslate(w, childWidth / 2, height);
+				render(c, w, depth + 1);
+				emitTranslate(w, (childWidth / 2) + 1, -height);
+				w.endLine();
+			}
+			break;
+		case SceneVertical:
+			for (std::uint64_t c = node.first; c < node.first + node.count; ++c) {
+				if (!checkNode(c))
+				{
+					continue;
+				}
+				double childHeight = getHeight(c);
+				emitTranslate(w, width, childHeight / 2);
+				render(c, w, depth + 1);
+				emitTranslate(w, -width, (childHeight / 2) + 1);
+				w.endLine();
+			}
+			break;
+		case SceneText:
+			w.raw(text_ + node.first, node.count);
+			break;
+		case SceneTransformed:
+			w.op("gsave");
+			w.endLine();
+			emitConcat(w, matrixAt(p + 2));
+			render(node.first, w, depth + 1);
+			w.op("grestore");
+			w.endLine();
+			break;
+		}
+	}
+
+	std::string generatePostScript()
+	{
+		std::string out = "";
+		if (getNodeCount() > 0)
+		{
+			PostScriptWriter writer(out);
+			render(0, writer);
+		}
+		return out;
+	}
+
+	//Copies node n, depth levels below the root, into a ShapeValue
+	ShapeValue toShapeValue(std::uint64_t n, unsigned int depth = 0)
+	{
+		if (!checkNode(n) || !checkDepth(depth))
+		{
+			return ShapeValue();
+		}
+		const SceneNode &node = nodes_[n];
+		const double *p = params_ + node.param;
+		std::vector<ShapeValue> children;
+		if (node.kind != SceneText)
+		{
+			children.reserve(node.count);
+			for (std::uint64_t c = node.first; c < node.first + node.count; ++c)
+			{
+				children.push_back(toShapeValue(c, depth + 1));
+			}
+		}
+
+		ShapeValue::Node value;
+		switch (node.kind)
+		{
+		case SceneCircle: value = CircleNode{}; break;
+		case ScenePolygon: value = PolygonNode{ (int)p[2], p[3] }; break;
+		case SceneRectangle: value = RectangleNode{}; break;
+		case SceneSpacer: value = SpacerNode{ p[2], p[3] }; break;
+		case SceneCustom: value = CustomNode{}; break;
+		case SceneScaled: value = ScaledNode{ p[2], p[3], std::move(children) }; break;
+		case SceneRotated: value = RotatedNode{ (int)p[2], std::move(children) }; break;
+		case SceneLayered: value = LayeredNode{ std::move(children) }; break;
+		case SceneMultiLayered: value = MultiLayeredNode{ std::move(children) }; break;
+		case SceneHorizontal: value = HorizontalNode{ std::move(children) }; break;
+		case SceneVertical: value = VerticalNode{ std::move(children) }; break;
+		case SceneTransformed: value = TransformedNode{ matrixAt(p + 2), std::move(children) }; break;
+		default: value = TextNode{ std::string(text_ + node.first, node.count) }; break;
+		}
+		return ShapeValue(std::move(value), p[0], p[1]);
+	}
+
+private:
+	static Affine matrixAt(const double *p)
+	{
+		Affine m;
+		m.a = p[0];
+		m.b = p[1];
+		m.c = p[2];
+		m.d = p[3];
+		m.tx = p[4];
+		m.ty = p[5];
+		return m;
+	}
+
+	bool fail(const std::string &message)
+	{
+		error_ = message;
+		close();
+		return false;
+	}
+
+	bool checkHeader()
+	{
+		header_ = (const SceneHeader*)data_;
+		if (std::memcmp(header_->magic, "SHPS", 4) != 0)
+		{
+			return fail("not a scene file");
+		}
+		if (header_->version != sceneFileVersion)
+		{
+			return fail("unsupported scene file version " + std::to_string(header_->version));
+		}
+		if (header_->byteOrder != sceneByteOrder)
+		{
+			return fail("scene file was written with a different byte order");
+		}
+		// Sections must be aligned and inside the file. The counts are
+		// checked against the size first so the products can not overflow.
+		if (header_->nodeOffset % 8 != 0 || header_->paramOffset % 8 != 0 ||
+			header_->nodeCount > size_ / sizeof(SceneNode) || header_->paramCount > size_ / sizeof(double) ||
+			header_->nodeOffset > size_ || header_->nodeCount * sizeof(SceneNode) > size_ - header_->nodeOffset ||
+			header_->paramOffset > size_ || header_->paramCount * sizeof(double) > size_ - header_->paramOffset ||
+			header_->textOffset > size_ || header_->textSize > size_ - header_->textOffset)
+		{
+			return fail("scene file sections do not fit in the file");
+		}
+		nodes_ = (const SceneNode*)(data_ + header_->nodeOffset);
+		params_ = (const double*)(data_ + header_->paramOffset);
+		text_ = data_ + header_->textOffset;
+
+		// Every node but the root must be the child of exactly one node
+		// before it, with the children handed out in breadth first order.
+		// Then the nodes form a tree and a render visits each of them once,
+		// where overlapping child ranges could make it visit some of them
+		// exponentially often.
+		std::uint64_t nextChild = 1;
+		for (std::uint64_t n = 0; n < header_->nodeCount; ++n)
+		{
+			const SceneNode &node = nodes_[n];
+			if (n > 0 && n >= nextChild)
+			{
+				return fail("scene node " + std::to_string(n) + " has no parent");
+			}
+			if (node.kind >= SceneScaled && node.kind != SceneText && node.kind < SceneKindCount)
+			{
+				if (node.first != nextChild || node.count > header_->nodeCount - nextChild)
+				{
+					return fail("children of scene node " + std::to_string(n) + " are not in breadth first order");
+				}
+				nextChild += node.count;
+			}
+		}
+		if (header_->nodeCount > 0 && nextChild != header_->nodeCount)
+		{
+			return fail("scene file has nodes that are no node's children");
+		}
+		error_.clear();
+		return true;
+	}
+
+	bool checkNode(std::uint64_t n)
+	{
+		bool ok = n < header_->nodeCount;
+		if (ok)
+		{
+			const SceneNode &node = nodes_[n];
+			ok = node.kind < SceneKindCount && node.param <= header_->paramCount &&
+				sceneParamCount(node.kind) <= header_->paramCount - node.param;
+			if (ok && node.kind == ScenePolygon)
+			{
+				// Also false for NaN, so the cast to int is safe
+				double sides = params_[node.param + 2];
+				ok = sides >= 3 && sides < maxScenePolygonSides && node.count == 0;
+			}
+			else if (ok && node.kind == SceneText)
+			{
+				ok = node.first <= header_->textSize && node.count <= header_->textSize - node.first;
+			}
+			else if (ok && node.kind >= SceneScaled)
+			{
+				// open() checked the children are in breadth first order,
+				// this keeps a node that is read on its own in the file
+				bool oneChild = node.kind == SceneScaled || node.kind == SceneRotated || node.kind == SceneTransformed;
+				ok = node.first > n && node.first <= header_->nodeCount && node.count <= header_->nodeCount - node.first &&
+					(!oneChild || node.count == 1);
+				if (ok && node.kind == SceneRotated)
+				{
+					// Angles are ints, and this is false for NaN too
+					double angle = params_[node.param + 2];
+					ok = angle >= INT_MIN && angle <= INT_MAX;
+				}
+			}
+			else if (ok)
+			{
+				ok = node.count == 0;
+			}
+		}
+		if (!ok)
+		{
+			error_ = "scene node " + std::to_string(n) + " is invalid";
+		}
+		return ok;
+	}
+
+	bool checkDepth(unsigned int depth)
+	{
+		if (depth > maxSceneDepth)
+		{
+			error_ = "scene is nested deeper than " + std::to_string(maxSceneDepth) + " levels";
+			return false;
+		}
+		return true;
+	}
+
+	const char *data_ = nullptr;
+	std::size_t size_ = 0;
+#ifndef SCENE_FILE_MMAP
+	std::vector<char> copy_;
+#endif
+	const SceneHeader *header_ = nullptr;
+	const SceneNode *nodes_ = nullptr;
+	const double *params_ = nullptr;
+	const char *text_ = nullptr;
+	std::string error_;
+};
+
+#endif // SCENE_FILE_HPP_INCLUDED
@@ -0,0 +1,477 @@
+#ifndef SCENE_PARSER_HPP_INCLUDED
+#define SCENE_PARSER_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <fstream>
+#include <charconv>
+#include <cstring>
+#include "shape_value.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define SCENE_PARSER_MMAP 1
+#endif
+
+// Text scene descriptions, one node per line:
+//
+//   # comment
+//   vertical
+//     horizontal
+//       circle 5
+//       rectangle 2 3
+//     end
+//     scaled 2 0.5
+//       square 3
+//     rotated 90
+//       custom 20
+//   end
+//
+// Leaves: circle radius, polygon sides length, triangle side, square side,
+//         rectangle width height, spacer width height, custom side
+// Groups: layered, multilayered, horizontal, vertical ... end
+// Wrappers: scaled fx fy, rotated angle, apply to the node that follows
+//
+// Indentation is ignored. More than one top level node is drawn as if
+// they were layered. Groups and wrappers nest at most maxSceneDepth levels
+// and polygons have fewer than maxScenePolygonSides sides.
+//
+// The input is parsed a line at a time as it is read, either from a mapped
+// file or through a fixed size buffer, so the text is never held in
+// memory as a whole and nothing is allocated per token.
+
+class SceneParser {
+public:
+	static constexpr std::size_t bufferSize = 1 << 16;
+
+	//Parses the whole file. Returns false and sets getError() on failure.
+	bool parseFile(const std::string &path)
+	{
+		reset();
+#ifdef SCENE_PARSER_MMAP
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return fail("can not open " + path);
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0)
+		{
+			::close(fd);
+			return fail("can not read " + path);
+		}
+		if (st.st_size == 0)
+		{
+			::close(fd);
+			return finish();
+		}
+		void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (mapped == MAP_FAILED)
+		{
+			return fail("can not map " + path);
+		}
+		madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+		feed((const char*)mapped, st.st_size);
+		munmap(mapped, st.st_size);
+		return finish();
+#else
+		std::ifstream ifs(path, std::ifstream::in | std::ifstream::binary);
+		if (!ifs)
+		{
+			return fail("can not open " + path);
+		}
+		return parseStream(ifs);
+#endif
+	}
+
+	//Parses everything left in the stream, e.g. std::cin
+	bool parseStream(std::istream &in)
+	{
+		reset();
+		std::vector<char> buffer(bufferSize);
+		while (in && error_.empty())
+		{
+			in.read(buffer.data(), buffer.size());
+			feed(buffer.data(), (std::size_t)in.gcount());
+		}
+		return finish();
+	}
+
+	bool parseString(const std::string &text)
+	{
+		reset();
+		feed(text.data(), text.size());
+		return finish();
+	}
+
+	// Incremental interface: reset(), feed() any number of chunks, finish().
+	// Lines may be split between chunks.
+	void reset()
+	{
+		frames_.clear();
+		roots_.clear();
+		partial_.clear();
+		scene_ = ShapeValue();
+		error_.clear();
+		line_ = 0;
+	}
+
+	void feed(const char *data, std::size_t size)
+	{
+		const char *end = data + size;
+		if (!error_.empty())
+		{
+			return;
+		}
+		if (!partial_.empty())
+		{
+			// Finish the line left over from the last chunk
+			const char *newline = (const char*)std::memchr(data, '\n', size);
+			if (newline == nullptr)
+			{
+				partial_.append(data, end);
+				return;
+			}
+			partial_.append(data, newline);
+			parseLine(partial_.data(), partial_.data() + partial_.size());
+			partial_.clear();
+			data = newline + 1;
+		}
+		while (data < end && error_.empty())
+		{
+			const char *newline = (const char*)std::memchr(data, '\n', end - data);
+			if (newline == nullptr)
+			{
+				partial_.assign(data, end);
+				return;
+			}
+			parseLine(data, newline);
+			data = newline + 1;
+		}
+	}
+
+	bool finish()
+	{
+		if (!partial_.empty() && error_.empty())
+		{
+			parseLine(partial_.data(), partial_.data() + partial_.size());
+			partial_.clear();
+		}
+		if (!error_.empty())
+		{
+			return false;
+		}
+		if (!frames_.empty())
+		{
+			const Frame &open = frames_.back();
+			return fail("line " + std::to_string(open.line) + ": " + frameName(open.kind) +
+				(open.kind == ScaledFrame || open.kind == RotatedFrame ? " has no shape" : " is missing end"));
+		}
+		if (roots_.empty())
+		{
+			return fail("no shapes in scene");
+		}
+		if (roots_.size() == 1)
+		{
+			scene_ = std::move(roots_[0]);
+		}
+		else
+		{
+			scene_ = ShapeValue::layered(std::move(roots_));
+		}
+		roots_.clear();
+		return true;
+	}
+
+	ShapeValue &getScene()
+	{
+		return scene_;
+	}
+
+	const std::string &getError() const
+	{
+		return error_;
+	}
+
+	//Lines read so far
+	unsigned long getLine() const
+	{
+		return line_;
+	}
+
+private:
+	enum FrameKind { LayeredFrame, MultiLayeredFrame, HorizontalFrame, VerticalFrame, ScaledFrame, RotatedFrame };
+
+	//A group or wrapper still waiting for its children
+	struct Frame {
+		FrameKind kind;
+		unsigned long line;
+		double a;
+		double b;
+		std::vector<ShapeValue> children;
+	};
+
+	static const char *frameName(FrameKind kind)
+	{
+		switch (kind)
+		{
+		case LayeredFrame: return "layered";
+		case MultiLayeredFrame: return "multilayered";
+		case HorizontalFrame: return "horizontal";
+		case VerticalFrame: return "vertical";
+		case ScaledFrame: return "scaled";
+		default: return "rotated";
+		}
+	}
+
+	bool fail(const std::string &message)
+	{
+		if (error_.empty())
+		{
+			error_ = message;
+		}
+		return false;
+	}
+
+	bool failLine(const std::string &message)
+	{
+		return fail("line " + std::to_string(line_) + ": " + message);
+	}
+
+	static bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	//Next whitespace separated token, empty at the end of the line
+	static void nextToken(const char *&p, const char *end, const char *&tokenStart, const char *&tokenEnd)
+	{
+		while (p < end && isSpace(*p))
+		{
+			++p;
+		}
+		tokenStart = p;
+		while (p < end && !isSpace(*p))
+		{
+			++p;
+		}
+		tokenEnd = p;
+	}
+
+	bool number(const char *&p, const char *end, double &value)
+	{
+		const char *start;
+		const char *stop;
+		nextToken(p, end, start, stop);
+		if (start == stop)
+		{
+			return failLine("expected a number");
+		}
+		// from_chars does not take a leading '+'
+		if (*start == '+')
+		{
+			++start;
+		}
+		auto result = std::from_chars(start, stop, value);
+		if (result.ec != std::errc() || result.ptr != stop)
+		{
+			return failLine("'" + std::string(start, stop) + "' is not a number");
+		}
+		return true;
+	}
+
+	bool integer(const char *&p, const char *end, int &value)
+	{
+		const char *start;
+		const char *stop;
+		nextToken(p, end, start, stop);
+		if (start == stop)
+		{
+			return failLine("expected a whole number");
+		}
+		auto result = std::from_chars(start, stop, value);
+		if (result.ec != std::errc() || result.ptr != stop)
+		{
+			return failLine("'" + std::string(start, stop) + "' is not a whole number");
+		}
+		return true;
+	}
+
+	static bool is(const char *start, const char *stop, const char *keyword)
+	{
+		std::size_t length = std::strlen(keyword);
+		return (std::size_t)(stop - start) == length && std::memcmp(start, keyword, length) == 0;
+	}
+
+	void parseLine(const char *p, const char *end)
+	{
+		++line_;
+		const char *start;
+		const char *stop;
+		nextToken(p, end, start, stop);
+		if (start == stop || *start == '#')
+		{
+			return;
+		}
+
+		double a = 0;
+		double b = 0;
+		int sides = 0;
+		if (is(start, stop, "circle"))
+		{
+			if (!number(p, end, a) || !endOfLine(p, end)) return;
+			add(ShapeValue::circle(a));
+		}
+		else if (is(start, stop, "rectangle"))
+		{
+			if (!number(p, end, a) || !number(p, end, b) || !endOfLine(p, end)) return;
+			add(ShapeValue::rectangle(a, b));
+		}
+		else if (is(start, stop, "spacer"))
+		{
+			if (!number(p, end, a) || !number(p, end, b) || !endOfLine(p, end)) return;
+			add(ShapeValue::spacer(a, b));
+		}
+		else if (is(start, stop, "square"))
+		{
+			if (!number(p, end, a) || !endOfLine(p, end)) return;
+			add(ShapeValue::square(a));
+		}
+		else if (is(start, stop, "triangle"))
+		{
+			if (!number(p, end, a) || !endOfLine(p, end)) return;
+			add(ShapeValue::triangle(a));
+		}
+		else if (is(start, stop, "polygon"))
+		{
+			if (!integer(p, end, sides) || !number(p, end, a)) return;
+			if (sides < 3)
+			{
+				failLine("a polygon needs at least 3 sides");
+				return;
+			}
+			if (sides >= maxScenePolygonSides)
+			{
+				failLine("a polygon can have at most " + std::to_string((int)maxScenePolygonSides - 1) + " sides");
+				return;
+			}
+			if (!endOfLine(p, end)) return;
+			add(ShapeValue::polygon(sides, a));
+		}
+		else if (is(start, stop, "custom"))
+		{
+			if (!number(p, end, a) || !endOfLine(p, end)) return;
+			add(ShapeValue::custom(a));
+		}
+		else if (is(start, stop, "end"))
+		{
+			if (frames_.empty() || frames_.back().kind == ScaledFrame || frames_.back().kind == RotatedFrame)
+			{
+				failLine("end without a group to close");
+				return;
+			}
+			if (!endOfLine(p, end)) return;
+			closeGroup();
+			return;
+		}
+		else
+		{
+			FrameKind kind;
+			if (is(start, stop, "layered")) kind = LayeredFrame;
+			else if (is(start, stop, "multilayered")) kind = MultiLayeredFrame;
+			else if (is(start, stop, "horizontal")) kind = HorizontalFrame;
+			else if (is(start, stop, "vertical")) kind = VerticalFrame;
+			else if (is(start, stop, "scaled")) kind = ScaledFrame;
+			else if (is(start, stop, "rotated")) kind = RotatedFrame;
+			else
+			{
+				failLine("unknown shape '" + std::string(start, stop) + "'");
+				return;
+			}
+			if (kind == ScaledFrame)
+			{
+				if (!number(p, end, a) || !number(p, end, b)) return;
+			}
+			else if (kind == RotatedFrame)
+			{
+				if (!integer(p, end, sides)) return;
+				a = sides;
+			}
+			if (!endOfLine(p, end)) return;
+			// Room is left for the layered node that joins several top level nodes
+			if (frames_.size() + 1 >= maxSceneDepth)
+			{
+				failLine("nested deeper than " + std::to_string(maxSceneDepth) + " levels");
+				return;
+			}
+			frames_.push_back(Frame{ kind, line_, a, b, {} });
+
+			return;
+		}
+	}
+
+	bool endOfLine(const char *&p, const char *end)
+	{
+		const char *start;
+		const char *stop;
+		nextToken(p, end, start, stop);
+		if (start != stop && *start != '#')
+		{
+			return failLine("unexpected '" + std::string(start, stop) + "'");
+		}
+		return true;
+	}
+
+	//Hands a finished node to the innermost open frame, closing wrappers it completes
+	void add(ShapeValue shape)
+	{
+		while (!frames_.empty())
+		{
+			Frame &top = frames_.back();
+			if (top.kind == ScaledFrame)
+			{
+				shape = ShapeValue::scaled(std::move(shape), top.a, top.b);
+			}
+			else if (top.kind == RotatedFrame)
+			{
+				shape = ShapeValue::rotated(std::move(shape), (int)top.a);
+			}
+			else
+			{
+				top.children.push_back(std::move(shape));
+				return;
+			}
+			frames_.pop_back();
+		}
+		roots_.push_back(std::move(shape));
+	}
+
+	void closeGroup()
+	{
+		Frame &top = frames_.back();
+		std::vector<ShapeValue> children = std::move(top.children);
+		FrameKind kind = top.kind;
+		frames_.pop_back();
+		switch (kind)
+		{
+		case LayeredFrame: add(ShapeValue::layered(std::move(children))); break;
+		case MultiLayeredFrame: add(ShapeValue::multiLayered(std::move(children))); break;
+		case HorizontalFrame: add(ShapeValue::horizontal(std::move(children))); break;
+		default: add(ShapeValue::vertical(std::move(children))); break;
+		}
+	}
+
+	std::vector<Frame> frames_;
+	std::vector<ShapeValue> roots_;
+	std::string partial_;
+	ShapeValue scene_;
+	std::string error_;
+	unsigned long line_ = 0;
+};
+
+#endif // SCENE_PARSER_HPP_INCLUDED
@@ -5,6 +5,7 @@
 #include <cmath>
 #include <vector>
 #include <memory>
+#include "postscript.hpp"
 using std::unique_ptr;
 using std::make_unique;
 
@@ -14,6 +15,16 @@ public:
 	virtual ~Shape() = default;
 	virtual std::string generatePostScript() = 0;
 
+	//Number of child shapes and access to them, leaves have none
+	virtual unsigned int getSize()
+	{
+		return 0;
+	}
+	virtual Shape* getShape(int)
+	{
+		return nullptr;
+	}
+
 	double height;
 	double width;
 	double x;
@@ -28,23 +39,9 @@ public:
 	}
 	std::string generatePostScript() override
 	{
-		std::string circleString = "newpath\n";
-		circleString += std::to_string(height / -2);
-		circleString += " ";
-		circleString += std::to_string(width / -2);
-		circleString += " translate\n";
-		circleString += std::to_string(height / 2);
-		circleString += " ";
-		circleString += std::to_string(width / 2);
-		circleString += " ";
-		circleString += std::to_string(width / 2);
-		circleString += " 0 360 arc closepath\n";
-		circleString += "stroke\n";
-
-		circleString += std::to_string(height / 2);
-		circleString += " ";
-		circleString += std::to_string(width / 2);
-		circleString += " translate\n";
+		std::string circleString = "";
+		PostScriptWriter writer(circleString);
+		emitCircle(writer, width, height);
 		return circleString;
 	}
 };
@@ -58,60 +55,25 @@ public:
 	{
 		sideLength_g = sideLength;
 		numSides_g = numSides;
-		const double pi = 3.141592653589793238;
-
-		if (numSides % 2 == 1)
-		{
-			height = sideLength*(1 + cos(pi / numSides)) / (2 * sin(pi / numSides));
-			width = (sideLength*sin(pi*(numSides - 1) / (2 * numSides)) / (sin(pi / numSides)));
-		}
-		else if (numSides % 4 != 0) // numSides%2==0
-		{
-			height = sideLength * (cos(pi / numSides)) / (sin(pi / numSides));
-			width = sideLength / (sin(pi / numSides));
-		}
-		else // numSides%2 == 0 && numSides%4 == 0
-		{
-			height = sideLength*(cos(pi / numSides)) / (sin(pi / numSides));
-			width = height;
-		}
+		polygonExtents(numSides, sideLength, width, height);
 	}
 	std::string generatePostScript() override
 	{
-
-		int totalAngle = (numSides_g - 2) * 180;
-		int anglePerSide = 180 - totalAngle / numSides_g;
-		std::string sideAngle = std::to_string(anglePerSide);
-
-		std::string myLength = std::to_string(sideLength_g);
-
 		std::string polyString = "";
-		polyString += std::to_string(sideLength_g / -2);
-		polyString += " ";
-		polyString += std::to_string(height / -2);
-		polyString += " translate\n";
-		polyString += "newpath\n";
-		
-		polyString += "0 0 moveto\n";
-
-		for (int i = 0; i < numSides_g; i++)
-		{
-			polyString += myLength + " 0" + " lineto\n";
-			polyString += myLength + " 0" + " translate\n";
-			polyString += sideAngle + " rotate\n";
-
-		}
-		polyString += "closepath\n";
-		polyString += "stroke\n";
-		polyString += std::to_string(sideLength_g / 2);
-		polyString += " ";
-		polyString += std::to_string(height / 2);
-		polyString += " translate\n";
-
-
+		PostScriptWriter writer(polyString);
+		emitPolygon(writer, numSides(), sideLength_g, height);
 		return polyString;
 	}
 
+	int numSides() const
+	{
+		return (int)numSides_g;
+	}
+	double sideLength() const
+	{
+		return sideLength_g;
+	}
+
 private:
 	double sideLength_g;
 	double numSides_g;
@@ -125,59 +87,11 @@ public:
 	}
 	std::string generatePostScript() override
 	{
-		halfHeight_ = height / 2.0;
-		halfWidth_ = width / 2.0;
-
-		std::string rectangleString = "newpath\n";
-		rectangleString += "0";
-		rectangleString += " ";
-		rectangleString += "0";
-		rectangleString += " moveto\n";
-
-		rectangleString += std::to_string(-1 * halfWidth_); //move to draw at origin
-		rectangleString += " ";
-		rectangleString += std::to_string(-1 * halfHeight_);
-		rectangleString += " moveto\n";
-		rectangleString += std::to_string(-1 * halfWidth_);
-		rectangleString += " ";
-		rectangleString += std::to_string(-1 * halfHeight_);
-		rectangleString += " translate\n";
-
-		rectangleString += std::to_string(width);
-		rectangleString += " ";
-		rectangleString += "0";     					// Bottom
-		rectangleString += " ";
-		rectangleString += "rlineto\n";
-
-		rectangleString += "0";
-		rectangleString += " ";
-		rectangleString += std::to_string(height);      // Right
-		rectangleString += " ";
-		rectangleString += "rlineto\n";
-
-		rectangleString += std::to_string(width*-1);
-		rectangleString += " ";
-		rectangleString += "0";      					// Top
-		rectangleString += " ";
-		rectangleString += "rlineto\n";
-
-		rectangleString += "closepath\n";               // Left
-		rectangleString += "stroke\n";
-
-		rectangleString += std::to_string(halfWidth_);//move back from origin
-		rectangleString += " ";
-		rectangleString += std::to_string(halfHeight_);
-		rectangleString += " moveto\n";
-		rectangleString += std::to_string(halfWidth_);
-		rectangleString += " ";
-		rectangleString += std::to_string(halfHeight_);
-		rectangleString += " translate\n";
-
+		std::string rectangleString = "";
+		PostScriptWriter writer(rectangleString);
+		emitRectangle(writer, width, height);
 		return rectangleString;
 	}
-private:
-	double halfHeight_;
-	double halfWidth_;
 };
 
 class Spacer : public Shape {
@@ -190,26 +104,9 @@ public:
 	}
 	std::string generatePostScript() override
 	{
-		std::string SpacerString = "newpath\n";
-		SpacerString += std::to_string(x);
-		SpacerString += " ";
-		SpacerString += std::to_string(y);
-		SpacerString += " moveto\n";
-
-		SpacerString += std::to_string(width);
-		SpacerString += " ";
-		SpacerString += std::to_string(x);
-		SpacerString += " rlineto\n";
-
-		SpacerString += std::to_string(y);
-		SpacerString += " ";
-		SpacerString += std::to_string(height);
-		SpacerString += " rlineto\n";
-
-		SpacerString += std::to_string(-width);
-		SpacerString += " ";
-		SpacerString += std::to_string(x);
-		SpacerString += " rlineto closepath\n";
+		std::string SpacerString = "";
+		PostScriptWriter writer(SpacerString);
+		emitSpacer(writer, width, height, x, y);
 		return SpacerString;
 	}
 };
@@ -234,124 +131,96 @@ public:
 	}
 	std::string generatePostScript()
 	{
-		// Head
 		std::string totalString = "";
-		Square s_0(width);
-		totalString += s_0.generatePostScript();
-
-		totalString += std::to_string(width / 4);
-		totalString += " ";
-		totalString += std::to_string(height / 4);
-		totalString += " translate\n";
-
-		// Eyes
-		Square s_1(width / 5);
-		totalString += s_1.generatePostScript();
-
-		totalString += std::to_string(-width / 4);
-		totalString += " ";
-		totalString += std::to_string(-height / 4);
-		totalString += " translate\n";
+		PostScriptWriter writer(totalString);
+		emitCustom(writer, width, height);
+		return totalString;
+	}
+};
+//Width and height of a composite, summed one child at a time
+struct CompositeExtents {
+	double width = 0;
+	double height = 0;
+};
 
-		totalString += std::to_string(-width / 4);
-		totalString += " ";
-		totalString += std::to_string(height / 4);
-		totalString += " translate\n";
+//Extents of a Composite of shapes, summed by the composite's addExtents
+template <class Composite>
+CompositeExtents sumExtents(const std::vector<unique_ptr<Shape>> &shapes)
+{
+	CompositeExtents extents;
+	for (const unique_ptr<Shape> &shape : shapes)
+	{
+		Composite::addExtents(extents, *shape);
+	}
+	return extents;
+}
 
-		totalString += s_1.generatePostScript();
+//Children on top of each other, as wide and tall as the largest
+inline void addLayeredExtents(CompositeExtents &extents, double width, double height)
+{
+	if (extents.width < width)
+	{
+		extents.width = width;
+	}
+	if (extents.height < height)
+	{
+		extents.height = height;
+	}
+}
+inline void addLayeredExtents(CompositeExtents &extents, const Shape &shape)
+{
+	addLayeredExtents(extents, shape.width, shape.height);
+}
 
-		totalString += std::to_string(width / 4);
-		totalString += " ";
-		totalString += std::to_string(-height / 4);
-		totalString += " translate\n";
+//Children side by side, one apart, as tall as the tallest
+inline void addHorizontalExtents(CompositeExtents &extents, double width, double height)
+{
+	extents.width += width + 1;
+	if (height > extents.height)
+	{
+		extents.height = height;
+	}
+}
+inline void addHorizontalExtents(CompositeExtents &extents, const Shape &shape)
+{
+	addHorizontalExtents(extents, shape.width, shape.height);
+}
 
-		// Mouth
-		Rectangle mouth((width / 2), (height / 4));
-		
-		totalString += std::to_string(0);
-		totalString += " ";
-		totalString += std::to_string(-height / 4);
-		totalString += " translate\n";
-		
-		totalString += mouth.generatePostScript();
-
-		totalString += std::to_string(0);
-		totalString += " ";
-		totalString += std::to_string(height / 4);
-		totalString += " translate\n";
-
-		// Teeth
-		Square teeth(width / 8);
-		double halfTeeth = (width / 8);
-		double quarterTeeth = halfTeeth/2;
-
-		// Top row of teeth
-		int scale = 0;
-		for (int ii = 1; ii <= 4; ++ii) {
-			totalString += std::to_string((-width / 4));
-			totalString += " ";
-			totalString += std::to_string((-height / 4));
-			totalString += " translate\n";
-			totalString += std::to_string((quarterTeeth*ii) + (quarterTeeth*scale));
-			totalString += " ";
-			totalString += std::to_string(quarterTeeth);
-			totalString += " translate\n";
-			totalString += teeth.generatePostScript();
-			totalString += std::to_string((-quarterTeeth*ii) - (quarterTeeth*scale));
-			totalString += " ";
-			totalString += std::to_string(-quarterTeeth);
-			totalString += " translate\n";
-			totalString += std::to_string((width / 4));
-			totalString += " ";
-			totalString += std::to_string((height / 4));
-			totalString += " translate\n";
-			scale++;
-		}
-		// Bottom row of teeth
-		scale = 0;
-		for (int ii = 1; ii <= 4; ++ii) {
-			totalString += std::to_string((-width / 4));
-			totalString += " ";
-			totalString += std::to_string((-height / 4));
-			totalString += " translate\n";
-			totalString += std::to_string((quarterTeeth*ii) + (quarterTeeth*scale));
-			totalString += " ";
-			totalString += std::to_string(-quarterTeeth);
-			totalString += " translate\n";
-			totalString += teeth.generatePostScript();
-			totalString += std::to_string((-quarterTeeth*ii) - (quarterTeeth*scale));
-			totalString += " ";
-			totalString += std::to_string(quarterTeeth);
-			totalString += " translate\n";
-			totalString += std::to_string((width / 4));
-			totalString += " ";
-			totalString += std::to_string((height / 4));
-			totalString += " translate\n";
-			scale++;
-		}
-		return totalString;
+//Children stacked, one apart, as wide as the widest
+inline void addVerticalExtents(CompositeExtents &extents, double width, double height)
+{
+	extents.height += height + 1;
+	if (width > extents.width)
+	{
+		extents.width = width;
 	}
-};
+}
+inline void addVerticalExtents(CompositeExtents &extents, const Shape &shape)
+{
+	addVerticalExtents(extents, shape.width, shape.height);
+}
+
 class Layered : public Shape
 {
 public:
 	Layered(std::vector<unique_ptr<Shape>> shapeListGiven)
+		: Layered(std::move(shapeListGiven), CompositeExtents())
+	{
+		CompositeExtents extents = sumExtents<Layered>(shapeList);
+		width = extents.width;
+		height = extents.height;
+	}
+	//Takes extents already summed with addExtents, e.g. by CompositeBuilder
+	Layered(std::vector<unique_ptr<Shape>> shapeListGiven, const CompositeExtents &extents)
 	{
 		shapeList = std::move(shapeListGiven);
-		width = 0;
-		height = 0;
+		width = extents.width;
+		height = extents.height;
+	}
 
-		for (unsigned int i = 0; i<shapeList.size(); ++i)
-		{
-			if (width < shapeList[i]->width)
-			{
-				width = shapeList[i]->width;
-			}
-			if (height < shapeList[i]->height)
-			{
-				height = shapeList[i]->height;
-			}
-		}
+	static void addExtents(CompositeExtents &extents, const Shape &shape)
+	{
+		addLayeredExtents(extents, shape);
 	}
 	std::string generatePostScript()
 	{
@@ -363,6 +232,15 @@ public:
 		return totalString;
 	}
 
+	unsigned int getSize() override
+	{
+		return shapeList.size();
+	}
+	Shape* getShape(int shapeNum) override
+	{
+		return shapeList[shapeNum].get();
+	}
+
 private:
 	std::vector<unique_ptr<Shape>> shapeList;
 };
@@ -392,7 +270,41 @@ class Rotated : public Shape {
 public:
 	Rotated(Shape &shape, int rotationAngle)
 		:refShape(shape), rotAngle(rotationAngle) {
+		setExtents(shape, rotationAngle);
+	}
+	//Takes ownership of the rotated shape instead of referring to it
+	Rotated(unique_ptr<Shape> shape, int rotationAngle)
+		:refShape(*shape), rotAngle(rotationAngle), ownedShape(std::move(shape)) {
+		setExtents(refShape, rotationAngle);
+	}
+	//A temporary would be gone before it is drawn, pass a unique_ptr instead
+	Rotated(Shape &&shape, int rotationAngle) = delete;
 
+	std::string generatePostScript() override
+	{
+		std::string RotateString = std::to_string(rotAngle);
+		RotateString += " rotate\n";
+		RotateString += refShape.generatePostScript();
+
+		return RotateString;
+	}
+
+	unsigned int getSize() override
+	{
+		return 1;
+	}
+	Shape* getShape(int) override
+	{
+		return &refShape;
+	}
+	int getAngle() const
+	{
+		return rotAngle;
+	}
+
+private:
+	void setExtents(Shape &shape, int rotationAngle)
+	{
 		if (rotationAngle == 90 || rotationAngle == 270)
 		{
 			height = shape.width;
@@ -405,18 +317,66 @@ public:
 		}
 	}
 
+	Shape &refShape;
+	int rotAngle;
+	unique_ptr<Shape> ownedShape;
+};
+
+// Draws a shape in a space given by any affine matrix, e.g. the product of
+// a chain of scales and rotations. The matrix is applied with concat inside
+// gsave / grestore, so nothing is left changed for the shapes that follow.
+// Width and height are those of the box around the transformed shape.
+class Transformed : public Shape {
+public:
+	Transformed(Shape &shape, const Affine &m)
+		:refShape(shape), matrix(m) {
+		setExtents(shape);
+	}
+	//Takes ownership of the shape instead of referring to it
+	Transformed(unique_ptr<Shape> shape, const Affine &m)
+		:refShape(*shape), matrix(m), ownedShape(std::move(shape)) {
+		setExtents(refShape);
+	}
+	//A temporary would be gone before it is drawn, pass a unique_ptr instead
+	Transformed(Shape &&shape, const Affine &m) = delete;
+
 	std::string generatePostScript() override
 	{
-		std::string RotateString = std::to_string(rotAngle);
-		RotateString += " rotate\n";
-		RotateString += refShape.generatePostScript();
+		std::string out;
+		PostScriptWriter w(out);
+		w.op("gsave");
+		w.endLine();
+		emitConcat(w, matrix);
+		w.raw(refShape.generatePostScript());
+		w.op("grestore");
+		w.endLine();
+		return out;
+	}
 
-		return RotateString;
+	unsigned int getSize() override
+	{
+		return 1;
+	}
+	Shape* getShape(int) override
+	{
+		return &refShape;
+	}
+	const Affine &getMatrix() const
+	{
+		return matrix;
 	}
 
 private:
+	void setExtents(Shape &shape)
+	{
+		Box box = matrix.apply(Box{ -shape.width / 2, -shape.height / 2, shape.width / 2, shape.height / 2 });
+		width = box.maxX - box.minX;
+		height = box.maxY - box.minY;
+	}
+
 	Shape &refShape;
-	int rotAngle;
+	Affine matrix;
+	unique_ptr<Shape> ownedShape;
 };
 //takes a vector and layers them based on the subclass.
 //Several classes inherit from this
@@ -482,58 +442,69 @@ public:
 		return 0;
 	}
 
+	unsigned int getSize() override
+	{
+		return vecSize;
+	}
+
 private:
 	int vecSize;
 };
-//MultiLayered class inherits from multi, does not move shapes
+//MultiLayered class inherits from multi, takes ownership of the shapes
 class MultiLayered : public Multi {
 public:
-	MultiLayered(std::vector<unique_ptr<Shape>> mVec) : Multi(mVec.size()) {
+	MultiLayered(std::vector<unique_ptr<Shape>> mVec) : MultiLayered(std::move(mVec), CompositeExtents()) {
+		CompositeExtents extents = sumExtents<MultiLayered>(mStack);
+		width = extents.width;
+		height = extents.height;
+	}
+	//Takes extents already summed with addExtents, e.g. by CompositeBuilder
+	MultiLayered(std::vector<unique_ptr<Shape>> mVec, const CompositeExtents &extents) : Multi(mVec.size()) {
 		mStack = std::move(mVec);
-		
-		height = 0;
-		width = 0;
-		for (unsigned int i = 0; i<mStack.size(); ++i)
-		{
-			if (width < mStack[i]->width)
-			{
-				width = mStack[i]->width;
-			}
-			if (height < mStack[i]->height)
-			{
-				height = mStack[i]->height;
-			}
-		}
+		width = extents.width;
+		height = extents.height;
+	}
 
+	static void addExtents(CompositeExtents &extents, const Shape &shape)
+	{
+		addLayeredExtents(extents, shape);
 	}
 
 	std::string getPost(int shapeNum) override
 	{
 		return mStack[shapeNum]->generatePostScript();
 	}
+	Shape* getShape(int shapeNum) override
+	{
+		return mStack[shapeNum].get();
+	}
 
 
 
 private:
 	std::vector<unique_ptr<Shape>> mStack;
 };
-//MultiHorizontal class inherits from multi, does not move shapes
+//MultiHorizontal class inherits from multi, takes ownership of the shapes
 class MultiHorizontal : public Multi {
 public:
-	MultiHorizontal(std::vector<unique_ptr<Shape>>& mVec) : Multi(mVec.size()) {
-		mStack = std::move(mVec);
-		height = 0;
-		width = 0;
+	MultiHorizontal(std::vector<unique_ptr<Shape>> &&mVec) : MultiHorizontal(std::move(mVec), CompositeExtents()) {
 		// Find max height and total width of horizontal shape.
-		for (unsigned int i = 0; i<mStack.size(); ++i) {
-			width += std::move((mStack[i]->width) + 1);
-			// Find max height
-			if (mStack[i]->height > height) {
-				height = mStack[i]->height;
-			}
-		}
+		CompositeExtents extents = sumExtents<MultiHorizontal>(mStack);
+		width = extents.width;
+		height = extents.height;
+	}
+	//Takes extents already summed with addExtents, e.g. by CompositeBuilder
+	MultiHorizontal(std::vector<unique_ptr<Shape>> mVec, const CompositeExtents &extents) : Multi(mVec.size()) {
+		mStack = std::move(mVec);
+		width = extents.width;
+		height = extents.height;
+	}
 
+	static void addExtents(CompositeExtents &extents, const Shape &shape)
+	{
+		addHorizontalExtents(extents, shape);
 	}
+
 	//Move horizontally
 	double moveVertStart(int shapeNum) override
 	{
@@ -555,26 +526,34 @@ public:
 	{
 		return mStack[shapeNum]->generatePostScript();
 	}
+	Shape* getShape(int shapeNum) override
+	{
+		return mStack[shapeNum].get();
+	}
 private:
 	std::vector<unique_ptr<Shape>> mStack;
 };
 //MultiVertical inherits from vertical
 class MultiVertical : public Multi {
 public:
-	MultiVertical(std::vector<unique_ptr<Shape>>& mVec) : Multi(mVec.size()) {
-		mStack = std::move(mVec);
-		height = 0;
-		width = 0;
+	MultiVertical(std::vector<unique_ptr<Shape>> &&mVec) : MultiVertical(std::move(mVec), CompositeExtents()) {
 		// Find the total height and max width of the vertical shape.
-		for (unsigned int i = 0; i<mStack.size(); ++i) {
-			height += std::move((mStack[i]->height) + 1);
-			// Find max width
-			if (mStack[i]->width > width) {
-				width = mStack[i]->width;
-			}
-		}
+		CompositeExtents extents = sumExtents<MultiVertical>(mStack);
+		width = extents.width;
+		height = extents.height;
+	}
+	//Takes extents already summed with addExtents, e.g. by CompositeBuilder
+	MultiVertical(std::vector<unique_ptr<Shape>> mVec, const CompositeExtents &extents) : Multi(mVec.size()) {
+		mStack = std::move(mVec);
+		width = extents.width;
+		height = extents.height;
+	}
 
+	static void addExtents(CompositeExtents &extents, const Shape &shape)
+	{
+		addVerticalExtents(extents, shape);
 	}
+
 	//Move vertically
 	double moveVertStart(int shapeNum) override
 	{
@@ -596,6 +575,10 @@ public:
 	{
 		return mStack[shapeNum]->generatePostScript();
 	}
+	Shape* getShape(int shapeNum) override
+	{
+		return mStack[shapeNum].get();
+	}
 private:
 	std::vector<unique_ptr<Shape>> mStack;
 };
@@ -779,19 +762,24 @@ class Vertical : public Shape {
 public:
 	// Ctor from vector of shapes.
 	// Ctor accepts a vector of any size containing pointers to created shapes.
-	Vertical(std::vector<unique_ptr<Shape>> vertVec)
+	Vertical(std::vector<unique_ptr<Shape>> vertVec) : Vertical(std::move(vertVec), CompositeExtents())
 	{
-		vertStack = std::move(vertVec);
-		height = 0;
-		width = 0;
 		// Find the total height and max width of the vertical shape.
-		for (unsigned int i = 0; i<vertStack.size(); ++i) {
-			height += std::move((vertStack[i]->height) + 1);
-			// Find max width
-			if (vertStack[i]->width > width) {
-				width = vertStack[i]->width;
-			}
-		}
+		CompositeExtents extents = sumExtents<Vertical>(vertStack);
+		width = extents.width;
+		height = extents.height;
+	}
+	//Takes extents already summed with addExtents, e.g. by CompositeBuilder
+	Vertical(std::vector<unique_ptr<Shape>> vertVec, const CompositeExtents &extents)
+	{
+		vertStack = std::move(vertVec);
+		width = extents.width;
+		height = extents.height;
+	}
+
+	static void addExtents(CompositeExtents &extents, const Shape &shape)
+	{
+		addVerticalExtents(extents, shape);
 	}
 
 	std::string generatePostScript() override {
@@ -813,6 +801,15 @@ public:
 		return vertString;
 	}
 
+	unsigned int getSize() override
+	{
+		return vertStack.size();
+	}
+	Shape* getShape(int shapeNum) override
+	{
+		return vertStack[shapeNum].get();
+	}
+
 private:
 	std::vector<unique_ptr<Shape>> vertStack;
 };
@@ -824,19 +821,24 @@ class Horizontal : public Shape {
 public:
 	// Ctor from vector of shapes.
 	// Ctor accepts a vector of any size containing pointers to created shapes.
-	Horizontal(std::vector<unique_ptr<Shape>> horizontalVec)
+	Horizontal(std::vector<unique_ptr<Shape>> horizontalVec) : Horizontal(std::move(horizontalVec), CompositeExtents())
 	{
-		horizontalStack = std::move(horizontalVec);
-		height = 0;
-		width = 0;
 		// Find max height and total width of horizontal shape.
-		for (unsigned int i = 0; i<horizontalStack.size(); ++i) {
-			width += std::move((horizontalStack[i]->width) + 1);
-			// Find max height
-			if (horizontalStack[i]->height > height) {
-				height = horizontalStack[i]->height;
-			}
-		}
+		CompositeExtents extents = sumExtents<Horizontal>(horizontalStack);
+		width = extents.width;
+		height = extents.height;
+	}
+	//Takes extents already summed with addExtents, e.g. by CompositeBuilder
+	Horizontal(std::vector<unique_ptr<Shape>> horizontalVec, const CompositeExtents &extents)
+	{
+		horizontalStack = std::move(horizontalVec);
+		width = extents.width;
+		height = extents.height;
+	}
+
+	static void addExtents(CompositeExtents &extents, const Shape &shape)
+	{
+		addHorizontalExtents(extents, shape);
 	}
 
 	std::string generatePostScript() override {
@@ -859,6 +861,15 @@ public:
 		return horizontalString;
 	}
 
+	unsigned int getSize() override
+	{
+		return horizontalStack.size();
+	}
+	Shape* getShape(int shapeNum) override
+	{
+		return horizontalStack[shapeNum].get();
+	}
+
 private:
 	std::vector<unique_ptr<Shape>> horizontalStack;
 
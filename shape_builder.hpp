@@ -0,0 +1,89 @@
+#ifndef SHAPE_BUILDER_HPP_INCLUDED
+#define SHAPE_BUILDER_HPP_INCLUDED
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include "shape.hpp"
+
+// Builds a composite shape in place, one child at a time:
+//
+//   unique_ptr<MultiHorizontal> row = CompositeBuilder<MultiHorizontal>(3)
+//       .emplace<Circle>(5)
+//       .emplace<Rectangle>(10, 20)
+//       .emplace<Rotated>(make_unique<Custom>(40), 90)
+//       .build();
+//
+// Each child is constructed once, in the unique_ptr the composite keeps,
+// and the composite's extents are summed with its own addExtents as the
+// children come in, so it does not walk them again. With the number of
+// children reserved up front a composite of n leaves takes n + 2
+// allocations: the leaves, the vector of children and the composite.
+
+template <class Composite>
+class CompositeBuilder {
+public:
+	//capacity is the number of children to reserve room for
+	explicit CompositeBuilder(std::size_t capacity = 0)
+	{
+		children_.reserve(capacity);
+	}
+
+	//Constructs a Child from args as the next child
+	template <class Child, class... Args>
+	CompositeBuilder &emplace(Args&&... args)
+	{
+		return add(make_unique<Child>(std::forward<Args>(args)...));
+	}
+
+	CompositeBuilder &add(unique_ptr<Shape> child)
+	{
+		Composite::addExtents(extents_, *child);
+		children_.push_back(std::move(child));
+		return *this;
+	}
+
+	//Builds child and adds it, child is left empty
+	template <class Child>
+	CompositeBuilder &add(CompositeBuilder<Child> &child)
+	{
+		return add(child.build());
+	}
+	template <class Child>
+	CompositeBuilder &add(CompositeBuilder<Child> &&child)
+	{
+		return add(child.build());
+	}
+
+	void reserve(std::size_t capacity)
+	{
+		children_.reserve(capacity);
+	}
+
+	//Children added so far
+	std::size_t getSize() const
+	{
+		return children_.size();
+	}
+
+	//Extents the composite will have
+	const CompositeExtents &getExtents() const
+	{
+		return extents_;
+	}
+
+	//Makes the composite out of the children added, the builder is left empty
+	unique_ptr<Composite> build()
+	{
+		unique_ptr<Composite> composite = make_unique<Composite>(std::move(children_), extents_);
+		children_ = std::vector<unique_ptr<Shape>>();
+		extents_ = CompositeExtents();
+		return composite;
+	}
+
+private:
+	std::vector<unique_ptr<Shape>> children_;
+	CompositeExtents extents_;
+};
+
+#endif // SHAPE_BUILDER_HPP_INCLUDED
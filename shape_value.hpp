@@ -0,0 +1,541 @@
+#ifndef SHAPE_VALUE_HPP_INCLUDED
+#define SHAPE_VALUE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <variant>
+#include <utility>
+#include "shape.hpp"
+
+// Value semantic version of the shapes in shape.hpp.
+// A ShapeValue holds one of the node types below. Composites keep their
+// children inline in a vector, so leaves need no allocation of their own
+// and rendering goes through std::visit instead of virtual calls.
+
+class ShapeValue;
+
+// Limits on scenes read from outside, scene files and scene text. Polygons
+// are drawn a side at a time and nodes are rendered, copied and destroyed
+// recursively, so a scene past these is refused rather than left to run or
+// overflow the stack.
+const double maxScenePolygonSides = 65536;
+const unsigned int maxSceneDepth = 1024;
+
+// Circle, Rectangle and Custom are described fully by the value's width and height
+struct CircleNode {};
+struct RectangleNode {};
+struct CustomNode {};
+
+struct PolygonNode {
+	int numSides;
+	double sideLength;
+};
+
+struct SpacerNode {
+	double x;
+	double y;
+};
+
+struct ScaledNode {
+	double fx;
+	double fy;
+	std::vector<ShapeValue> child; // always one shape
+};
+
+struct RotatedNode {
+	int angle;
+	std::vector<ShapeValue> child; // always one shape
+};
+
+// Layered draws its children on top of each other with no translates,
+// MultiLayered does the same but goes through the Multi translate loop
+struct LayeredNode {
+	std::vector<ShapeValue> children;
+};
+
+struct MultiLayeredNode {
+	std::vector<ShapeValue> children;
+};
+
+struct HorizontalNode {
+	std::vector<ShapeValue> children;
+};
+
+struct VerticalNode {
+	std::vector<ShapeValue> children;
+};
+
+struct TransformedNode {
+	Affine matrix;
+	std::vector<ShapeValue> child; // always one shape
+};
+
+// Postscript from a Shape that can not be looked into, e.g. Scaled only
+// keeps the output of its child.
+struct TextNode {
+	std::string text;
+};
+
+class ShapeValue {
+public:
+	using Node = std::variant<CircleNode, PolygonNode, RectangleNode, SpacerNode, CustomNode,
+		ScaledNode, RotatedNode, LayeredNode, MultiLayeredNode, HorizontalNode, VerticalNode, TextNode,
+		TransformedNode>;
+
+	ShapeValue() : node(LayeredNode{}) {}
+	ShapeValue(Node n, double w, double h) : node(std::move(n)), height(h), width(w) {}
+
+	static ShapeValue circle(double radius)
+	{
+		return ShapeValue(CircleNode{}, radius * 2, radius * 2);
+	}
+	static ShapeValue polygon(int numSides, double sideLength)
+	{
+		double w;
+		double h;
+		polygonExtents(numSides, sideLength, w, h);
+		return ShapeValue(PolygonNode{ numSides, sideLength }, w, h);
+	}
+	static ShapeValue square(double sideLength)
+	{
+		return polygon(4, sideLength);
+	}
+	static ShapeValue triangle(double sideLength)
+	{
+		return polygon(3, sideLength);
+	}
+	static ShapeValue rectangle(double w, double h)
+	{
+		return ShapeValue(RectangleNode{}, w, h);
+	}
+	static ShapeValue spacer(double w, double h)
+	{
+		return ShapeValue(SpacerNode{ 0, 0 }, w, h);
+	}
+	static ShapeValue custom(double sideLength)
+	{
+		return ShapeValue(CustomNode{}, sideLength, sideLength);
+	}
+	static ShapeValue scaled(ShapeValue shape, double fx, double fy)
+	{
+		double w = shape.width * fx;
+		double h = shape.height * fy;
+		ScaledNode n{ fx, fy, {} };
+		n.child.push_back(std::move(shape));
+		return ShapeValue(std::move(n), w, h);
+	}
+	static ShapeValue rotated(ShapeValue shape, int rotationAngle)
+	{
+		bool swap = rotationAngle == 90 || rotationAngle == 270;
+		double w = swap ? shape.height : shape.width;
+		double h = swap ? shape.width : shape.height;
+		RotatedNode n{ rotationAngle, {} };
+		n.child.push_back(std::move(shape));
+		return ShapeValue(std::move(n), w, h);
+	}
+	//Extents are the box around the transformed shape, for any matrix
+	static ShapeValue transformed(ShapeValue shape, const Affine &m)
+	{
+		Box box = m.apply(Box{ -shape.width / 2, -shape.height / 2, shape.width / 2, shape.height / 2 });
+		TransformedNode n{ m, {} };
+		n.child.push_back(std::move(shape));
+		return ShapeValue(std::move(n), box.maxX - box.minX, box.maxY - box.minY);
+	}
+	static ShapeValue layered(std::vector<ShapeValue> shapes)
+	{
+		double w;
+		double h;
+		maxExtents(shapes, w, h);
+		return ShapeValue(LayeredNode{ std::move(shapes) }, w, h);
+	}
+	static ShapeValue multiLayered(std::vector<ShapeValue> shapes)
+	{
+		double w;
+		double h;
+		maxExtents(shapes, w, h);
+		return ShapeValue(MultiLayeredNode{ std::move(shapes) }, w, h);
+	}
+	static ShapeValue horizontal(std::vector<ShapeValue> shapes)
+	{
+		double w = 0;
+		double h = 0;
+		for (const ShapeValue &s : shapes) {
+			w += s.width + 1;
+			if (s.height > h) {
+				h = s.height;
+			}
+		}
+		return ShapeValue(HorizontalNode{ std::move(shapes) }, w, h);
+	}
+	static ShapeValue vertical(std::vector<ShapeValue> shapes)
+	{
+		double w = 0;
+		double h = 0;
+		for (const ShapeValue &s : shapes) {
+			h += s.height + 1;
+			if (s.width > w) {
+				w = s.width;
+			}
+		}
+		return ShapeValue(VerticalNode{ std::move(shapes) }, w, h);
+	}
+
+	//Writes the postscript through any writer with the PostScriptWriter interface
+	template <class Writer>
+	void render(Writer &w) const;
+
+	void appendPostScript(std::string &out) const
+	{
+		PostScriptWriter writer(out);
+		render(writer);
+	}
+
+	std::string generatePostScript() const
+	{
+		std::string out = "";
+		appendPostScript(out);
+		return out;
+	}
+
+	//Conversion from and to the polymorphic shapes
+	static ShapeValue fromShape(Shape &shape);
+	unique_ptr<Shape> toShape() const;
+
+	Node node;
+	double height = 0;
+	double width = 0;
+
+private:
+	static void maxExtents(const std::vector<ShapeValue> &shapes, double &w, double &h)
+	{
+		w = 0;
+		h = 0;
+		for (const ShapeValue &s : shapes)
+		{
+			if (w < s.width)
+			{
+				w = s.width;
+			}
+			if (h < s.height)
+			{
+				h = s.height;
+			}
+		}
+	}
+};
+
+// Writes the postscript of one node. renderChild(const ShapeValue &) writes
+// a child, so a caller can change how children are drawn.
+template <class Writer, class RenderChild>
+struct ShapeValueRenderer {
+	Writer &w;
+	const ShapeValue &shape;
+	RenderChild &renderChild;
+
+	void operator()(const CircleNode &) const
+	{
+		emitCircle(w, shape.width, shape.height);
+	}
+	void operator()(const PolygonNode &n) const
+	{
+		emitPolygon(w, n.numSides, n.sideLength, shape.height);
+	}
+	void operator()(const RectangleNode &) const
+	{
+		emitRectangle(w, shape.width, shape.height);
+	}
+	void operator()(const SpacerNode &n) const
+	{
+		emitSpacer(w, shape.width, shape.height, n.x, n.y);
+	}
+	void operator()(const CustomNode &) const
+	{
+		emitCustom(w, shape.width, shape.height);
+	}
+	void operator()(const ScaledNode &n) const
+	{
+		w.number(n.fx);
+		w.number(n.fy);
+		w.op("scale");
+		w.endLine();
+		renderChild(n.child[0]);
+		w.number(1 / n.fx);
+		w.number(1 / n.fy);
+		w.op("scale");
+		w.endLine();
+	}
+	void operator()(const RotatedNode &n) const
+	{
+		w.integer(n.angle);
+		w.op("rotate");
+		w.endLine();
+		renderChild(n.child[0]);
+	}
+	void operator()(const LayeredNode &n) const
+	{
+		for (const ShapeValue &s : n.children)
+		{
+			renderChild(s);
+		}
+	}
+	void operator()(const MultiLayeredNode &n) const
+	{
+		for (const ShapeValue &s : n.children) {
+			emitTranslate(w, 0.0, 0.0);
+			renderChild(s);
+			emitTranslate(w, 0.0, 0.0);
+			w.endLine();
+		}
+	}
+	void operator()(const HorizontalNode &n) const
+	{
+		for (const ShapeValue &s : n.children) {
+			emitTranslate(w, s.width / 2, shape.height);
+			renderChild(s);
+			emitTranslate(w, (s.width / 2) + 1, -shape.height);
+			w.endLine();
+		}
+	}
+	void operator()(const VerticalNode &n) const
+	{
+		for (const ShapeValue &s : n.children) {
+			emitTranslate(w, shape.width, s.height / 2);
+			renderChild(s);
+			emitTranslate(w, -shape.width, (s.height / 2) + 1);
+			w.endLine();
+		}
+	}
+	void operator()(const TextNode &n) const
+	{
+		w.raw(n.text);
+	}
+	void operator()(const TransformedNode &n) const
+	{
+		w.op("gsave");
+		w.endLine();
+		emitConcat(w, n.matrix);
+		renderChild(n.child[0]);
+		w.op("grestore");
+		w.endLine();
+	}
+};
+
+template <class Writer>
+void ShapeValue::render(Writer &w) const
+{
+	auto renderChild = [&w](const ShapeValue &child) { child.render(w); };
+	std::visit(ShapeValueRenderer<Writer, decltype(renderChild)>{ w, *this, renderChild }, node);
+}
+
+//Shape returning postscript that was generated earlier, used for TextNode
+class PostScriptText : public Shape {
+public:
+	PostScriptText(std::string text, double w, double h) : text_(std::move(text))
+	{
+		width = w;
+		height = h;
+	}
+	std::string generatePostScript() override
+	{
+		return text_;
+	}
+
+private:
+	std::string text_;
+};
+
+inline ShapeValue ShapeValue::fromShape(Shape &shape)
+{
+	std::vector<ShapeValue> children;
+	for (unsigned int i = 0; i < shape.getSize(); ++i)
+	{
+		children.push_back(fromShape(*shape.getShape(i)));
+	}
+
+	Node n = TextNode{};
+	if (dynamic_cast<Circle*>(&shape))
+	{
+		n = CircleNode{};
+	}
+	else if (Polygon *p = dynamic_cast<Polygon*>(&shape))
+	{
+		n = PolygonNode{ p->numSides(), p->sideLength() };
+	}
+	else if (dynamic_cast<Rectangle*>(&shape))
+	{
+		n = RectangleNode{};
+	}
+	else if (dynamic_cast<Spacer*>(&shape))
+	{
+		n = SpacerNode{ shape.x, shape.y };
+	}
+	else if (dynamic_cast<Custom*>(&shape))
+	{
+		n = CustomNode{};
+	}
+	else if (Rotated *r = dynamic_cast<Rotated*>(&shape))
+	{
+		n = RotatedNode{ r->getAngle(), std::move(children) };
+	}
+	else if (Transformed *t = dynamic_cast<Transformed*>(&shape))
+	{
+		n = TransformedNode{ t->getMatrix(), std::move(children) };
+	}
+	else if (dynamic_cast<Layered*>(&shape))
+	{
+		n = LayeredNode{ std::move(children) };
+	}
+	else if (dynamic_cast<MultiLayered*>(&shape))
+	{
+		n = MultiLayeredNode{ std::move(children) };
+	}
+	else if (dynamic_cast<MultiHorizontal*>(&shape) || dynamic_cast<Horizontal*>(&shape))
+	{
+		n = HorizontalNode{ std::move(children) };
+	}
+	else if (dynamic_cast<MultiVertical*>(&shape) || dynamic_cast<Vertical*>(&shape))
+	{
+		n = VerticalNode{ std::move(children) };
+	}
+	else
+	{
+		// Scaled and shapes defined outside shape.hpp
+		n = TextNode{ shape.generatePostScript() };
+	}
+	// Keep the extents of the shape itself rather than recomputing them
+	return ShapeValue(std::move(n), shape.width, shape.height);
+}
+
+inline unique_ptr<Shape> ShapeValue::toShape() const
+{
+	auto convertAll = [](const std::vector<ShapeValue> &shapes) {
+		std::vector<unique_ptr<Shape>> result;
+		result.reserve(shapes.size());
+		for (const ShapeValue &s : shapes)
+		{
+			result.push_back(s.toShape());
+		}
+		return result;
+	};
+
+	if (std::holds_alternative<CircleNode>(node))
+	{
+		return make_unique<Circle>(width / 2);
+	}
+	if (const PolygonNode *n = std::get_if<PolygonNode>(&node))
+	{
+		return make_unique<Polygon>(n->numSides, n->sideLength);
+	}
+	if (std::holds_alternative<RectangleNode>(node))
+	{
+		return make_unique<Rectangle>(width, height);
+	}
+	if (const SpacerNode *n = std::get_if<SpacerNode>(&node))
+	{
+		unique_ptr<Shape> s = make_unique<Spacer>(width, height);
+		s->x = n->x;
+		s->y = n->y;
+		return s;
+	}
+	if (std::holds_alternative<CustomNode>(node))
+	{
+		return make_unique<Custom>(width);
+	}
+	if (const ScaledNode *n = std::get_if<ScaledNode>(&node))
+	{
+		// Scaled renders its child once in the ctor, the child is not needed after
+		unique_ptr<Shape> child = n->child[0].toShape();
+		return make_unique<Scaled>(*child, n->fx, n->fy);
+	}
+	if (const RotatedNode *n = std::get_if<RotatedNode>(&node))
+	{
+		return make_unique<Rotated>(n->child[0].toShape(), n->angle);
+	}
+	if (const TransformedNode *n = std::get_if<TransformedNode>(&node))
+	{
+		unique_ptr<Shape> shape = make_unique<Transformed>(n->child[0].toShape(), n->matrix);
+		// Keep the extents, fuseTransforms keeps those of the chain it replaced
+		shape->width = width;
+		shape->height = height;
+		return shape;
+	}
+	if (const LayeredNode *n = std::get_if<LayeredNode>(&node))
+	{
+		return make_unique<Layered>(convertAll(n->children));
+	}
+	if (const MultiLayeredNode *n = std::get_if<MultiLayeredNode>(&node))
+	{
+		return make_unique<MultiLayered>(convertAll(n->children));
+	}
+	if (const HorizontalNode *n = std::get_if<HorizontalNode>(&node))
+	{
+		std::vector<unique_ptr<Shape>> shapes = convertAll(n->children);
+		return make_unique<MultiHorizontal>(std::move(shapes));
+	}
+	if (const VerticalNode *n = std::get_if<VerticalNode>(&node))
+	{
+		std::vector<unique_ptr<Shape>> shapes = convertAll(n->children);
+		return make_unique<MultiVertical>(std::move(shapes));
+	}
+	const TextNode &n = std::get<TextNode>(node);
+	return make_unique<PostScriptText>(n.text, width, height);
+}
+
+// Replaces every chain of two or more Scaled, Rotated and Transformed nodes
+// with one Transformed node holding the product of their matrices, so the
+// interpreter does one concat instead of a scale or rotate per level.
+// The new node keeps the extents of the chain's outermost node, so the
+// layout around it does not move. Unlike Rotated, the fused node restores
+// the graphics state after drawing, so a rotation no longer carries over
+// to the shapes drawn after it.
+inline void fuseTransforms(ShapeValue &shape)
+{
+	Affine m;
+	int wrappers = 0;
+	ShapeValue *inner = &shape;
+	while (true)
+	{
+		if (ScaledNode *n = std::get_if<ScaledNode>(&inner->node))
+		{
+			m = m.scaled(n->fx, n->fy);
+			inner = &n->child[0];
+		}
+		else if (RotatedNode *n = std::get_if<RotatedNode>(&inner->node))
+		{
+			m = m.rotated(n->angle);
+			inner = &n->child[0];
+		}
+		else if (TransformedNode *n = std::get_if<TransformedNode>(&inner->node))
+		{
+			m = m * n->matrix;
+			inner = &n->child[0];
+		}
+		else
+		{
+			break;
+		}
+		++wrappers;
+	}
+
+	std::vector<ShapeValue> *children = nullptr;
+	if (LayeredNode *n = std::get_if<LayeredNode>(&inner->node)) children = &n->children;
+	else if (MultiLayeredNode *n = std::get_if<MultiLayeredNode>(&inner->node)) children = &n->children;
+	else if (HorizontalNode *n = std::get_if<HorizontalNode>(&inner->node)) children = &n->children;
+	else if (VerticalNode *n = std::get_if<VerticalNode>(&inner->node)) children = &n->children;
+	if (children != nullptr)
+	{
+		for (ShapeValue &child : *children)
+		{
+			fuseTransforms(child);
+		}
+	}
+
+	if (wrappers >= 2)
+	{
+		TransformedNode fused{ m, {} };
+		fused.child.push_back(std::move(*inner));
+		shape.node = std::move(fused);
+	}
+}
+
+#endif // SHAPE_VALUE_HPP_INCLUDED
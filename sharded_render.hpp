@@ -0,0 +1,310 @@
+#ifndef SHARDED_RENDER_HPP_INCLUDED
+#define SHARDED_RENDER_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include "shape.hpp"
+#include "atomic_file.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#define SHARDED_RENDER_AVAILABLE 1
+#endif
+
+// Rendering of one large shape by several processes.
+//
+// The output of a composite is the output of its children one after the
+// other, each wrapped in the composite's translates. Those pieces are the
+// fragments: they are cut into contiguous shards of about the same number
+// of leaves and each shard is rendered by a forked process into its own
+// shared memory region. The parent then writes the regions into the file
+// at offsets that are the running total of the shard sizes, so the file is
+// byte for byte what generatePostScript() would give.
+//
+// Shards that fail, e.g. because they do not fit in their region or the
+// process died, are rendered by the parent instead.
+
+// Number of pieces the output of shape can be cut into: one per child for
+// Multi, Vertical, Horizontal and Layered, otherwise just the whole shape.
+inline unsigned int fragmentCount(Shape &shape)
+{
+	if (dynamic_cast<Multi*>(&shape) || dynamic_cast<Vertical*>(&shape) ||
+		dynamic_cast<Horizontal*>(&shape) || dynamic_cast<Layered*>(&shape))
+	{
+		return shape.getSize();
+	}
+	return 1;
+}
+
+// Appends fragment i of shape's output, the same bytes generatePostScript()
+// writes for it. childOutput(Shape &child, Out &out) appends the output of
+// a child, so callers can take it from somewhere else. Out is a string or
+// anything else with += for strings.
+template <class Out, class ChildOutput>
+void appendFragment(Shape &shape, unsigned int i, Out &out, ChildOutput &&childOutput)
+{
+	auto translate = [&](double x, double y) {
+		out += std::to_string(x);
+		out += " ";
+		out += std::to_string(y);
+		out += " translate\n";
+	};
+	if (Multi *multi = dynamic_cast<Multi*>(&shape))
+	{
+		translate(multi->moveHorzStart(i), multi->moveVertStart(i));
+		childOutput(*multi->getShape(i), out);
+		translate(multi->moveHorzEnd(i), multi->moveVertEnd(i));
+		out += "\n";
+	}
+	else if (dynamic_cast<Vertical*>(&shape))
+	{
+		Shape &child = *shape.getShape(i);
+		translate(shape.width, child.height / 2);
+		childOutput(child, out);
+		translate(-shape.width, (child.height / 2) + 1);
+		out += "\n";
+	}
+	else if (dynamic_cast<Horizontal*>(&shape))
+	{
+		Shape &child = *shape.getShape(i);
+		translate(child.width / 2, shape.height);
+		childOutput(child, out);
+		translate((child.width / 2) + 1, -shape.height);
+		out += "\n";
+	}
+	else if (dynamic_cast<Layered*>(&shape))
+	{
+		childOutput(*shape.getShape(i), out);
+	}
+	else
+	{
+		out += shape.generatePostScript();
+	}
+}
+
+inline void appendFragment(Shape &shape, unsigned int i, std::string &out)
+{
+	appendFragment(shape, i, out, [](Shape &child, std::string &childOut) {
+		childOut += child.generatePostScript();
+	});
+}
+
+//Leaves under shape, used to balance the shards
+inline std::size_t leafCount(Shape &shape)
+{
+	unsigned int size = shape.getSize();
+	if (size == 0)
+	{
+		return 1;
+	}
+	std::size_t count = 0;
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		count += leafCount(*shape.getShape(i));
+	}
+	return count;
+}
+
+// Cuts the fragments of shape into at most shards contiguous ranges with
+// about the same number of leaves each. Returns the first fragment of every
+// shard followed by the fragment count.
+inline std::vector<unsigned int> shardBounds(Shape &shape, unsigned int shards)
+{
+	unsigned int fragments = fragmentCount(shape);
+	std::vector<std::size_t> weights(fragments, 1);
+	std::size_t total = 0;
+	if (fragments > 1)
+	{
+		for (unsigned int i = 0; i < fragments; ++i)
+		{
+			weights[i] = leafCount(*shape.getShape(i));
+			total += weights[i];
+		}
+	}
+	else
+	{
+		total = fragments;
+	}
+
+	std::vector<unsigned int> bounds = { 0 };
+	std::size_t done = 0;
+	unsigned int i = 0;
+	for (unsigned int s = 1; s < shards && i < fragments; ++s)
+	{
+		std::size_t target = total * s / shards;
+		while (i < fragments && done + weights[i] <= target)
+		{
+			done += weights[i++];
+		}
+		if (i > bounds.back())
+		{
+			bounds.push_back(i);
+		}
+	}
+	if (bounds.back() < fragments || fragments == 0)
+	{
+		bounds.push_back(fragments);
+	}
+	return bounds;
+}
+
+#ifdef SHARDED_RENDER_AVAILABLE
+
+// Renders shape with up to processes worker processes and writes the
+// output to path, through a temporary file that is renamed into place.
+// Each worker gets a shared region of regionSize bytes of address space;
+// memory is only used for what is written. Returns false and sets error
+// if the file can not be written.
+inline bool renderShardedToFile(Shape &shape, const std::string &path, unsigned int processes,
+	std::string &error, std::size_t regionSize = (std::size_t)1 << 32)
+{
+	std::vector<unsigned int> bounds = shardBounds(shape, std::max(1u, processes));
+	std::size_t shards = bounds.size() - 1;
+
+	// Per shard: bytes used, and 1 once the worker finished
+	struct ShardResult {
+		std::uint64_t size;
+		std::uint64_t done;
+	};
+	std::size_t resultsSize = shards * sizeof(ShardResult);
+	void *resultsMap = mmap(nullptr, resultsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (resultsMap == MAP_FAILED)
+	{
+		error = "can not map shared memory";
+		return false;
+	}
+	ShardResult *results = (ShardResult*)resultsMap;
+	std::vector<char*> regions(shards, nullptr);
+	std::vector<pid_t> workers(shards, -1);
+
+	for (std::size_t s = 0; s < shards; ++s)
+	{
+		results[s] = ShardResult{ 0, 0 };
+		void *region = mmap(nullptr, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (region == MAP_FAILED)
+		{
+			continue; // rendered below by the parent
+		}
+		regions[s] = (char*)region;
+		workers[s] = fork();
+		if (workers[s] == 0)
+		{
+			std::string fragment;
+			std::uint64_t used = 0;
+			for (unsigned int i = bounds[s]; i < bounds[s + 1]; ++i)
+			{
+				fragment.clear();
+				appendFragment(shape, i, fragment);
+				if (fragment.size() > regionSize - used)
+				{
+					_exit(1);
+				}
+				std::memcpy(regions[s] + used, fragment.data(), fragment.size());
+				used += fragment.size();
+			}
+			results[s].size = used;
+			results[s].done = 1;
+			_exit(0);
+		}
+	}
+
+	// Whatever no worker could do is rendered here
+	std::vector<std::string> fallback(shards);
+	std::vector<bool> failed(shards, false);
+	for (std::size_t s = 0; s < shards; ++s)
+	{
+		if (workers[s] > 0)
+		{
+			int status;
+			while (waitpid(workers[s], &status, 0) < 0 && errno == EINTR)
+			{
+			}
+		}
+		if (regions[s] == nullptr || workers[s] < 0 || !results[s].done)
+		{
+			failed[s] = true;
+			for (unsigned int i = bounds[s]; i < bounds[s + 1]; ++i)
+			{
+				appendFragment(shape, i, fallback[s]);
+			}
+		}
+	}
+
+	bool ok = true;
+	std::string temporary;
+	int fd = createTemporary(path, temporary);
+	if (fd < 0)
+	{
+		error = "can not create " + temporary;
+		ok = false;
+	}
+	std::uint64_t offset = 0;
+	for (std::size_t s = 0; s < shards && ok; ++s)
+	{
+		const char *data = failed[s] ? fallback[s].data() : regions[s];
+		std::uint64_t size = failed[s] ? fallback[s].size() : results[s].size;
+		while (size > 0 && ok)
+		{
+			ssize_t written = pwrite(fd, data, size, offset);
+			if (written < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (written <= 0)
+			{
+				error = "can not write " + temporary;
+				ok = false;
+				break;
+			}
+			data += written;
+			size -= written;
+			offset += written;
+		}
+	}
+	// On disk before the rename, so a crash can not leave a short file at path
+	if (ok && ::fsync(fd) != 0)
+	{
+		error = "can not write " + temporary;
+		ok = false;
+	}
+	if (fd >= 0 && ::close(fd) != 0 && ok)
+	{
+		error = "can not write " + temporary;
+		ok = false;
+	}
+	if (ok && std::rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		error = "can not rename " + temporary + " to " + path;
+		ok = false;
+	}
+	if (ok)
+	{
+		syncDirectory(path);
+	}
+	else if (fd >= 0)
+	{
+		std::remove(temporary.c_str());
+	}
+
+	for (std::size_t s = 0; s < shards; ++s)
+	{
+		if (regions[s] != nullptr)
+		{
+			munmap(regions[s], regionSize);
+		}
+	}
+	munmap(resultsMap, resultsSize);
+	return ok;
+}
+
+#endif // SHARDED_RENDER_AVAILABLE
+
+#endif // SHARDED_RENDER_HPP_INCLUDED
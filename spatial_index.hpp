@@ -0,0 +1,387 @@
+#ifndef SPATIAL_INDEX_HPP_INCLUDED
+#define SPATIAL_INDEX_HPP_INCLUDED
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <cstdint>
+#include "shape.hpp"
+#include "mutable_composite.hpp"
+#include "affine.hpp"
+
+// Where a leaf shape ends up once the composites above it are laid out.
+// Coordinates are relative to the point the root shape is drawn at.
+// transform is the current transformation when the leaf is drawn and
+// order its position in the output.
+struct LeafBox {
+	Shape *shape;
+	Box box;
+	Affine transform;
+	unsigned int order;
+};
+
+//Box of a leaf in its own coordinates. Leaves are drawn centered on the
+//current point, except Spacer which starts at it.
+inline Box localBox(Shape &shape)
+{
+	if (dynamic_cast<Spacer*>(&shape))
+	{
+		return Box{ shape.x, shape.y, shape.x + shape.width, shape.y + shape.height };
+	}
+	return Box{ -shape.width / 2, -shape.height / 2, shape.width / 2, shape.height / 2 };
+}
+
+// How drawing a polygon changes the current transformation. It turns by
+// its truncated side angle each side, so a polygon whose angles do not add
+// up to 360 is left slightly turned.
+inline Affine polygonTransformChange(int numSides, double sideLength, double height)
+{
+	double sides = numSides;
+	int totalAngle = (sides - 2) * 180;
+	int anglePerSide = 180 - totalAngle / sides;
+	Affine change;
+	change = change.translated(sideLength / -2, height / -2);
+	for (int i = 0; i < numSides; i++)
+	{
+		change = change.translated(sideLength, 0).rotated(anglePerSide);
+	}
+	return change.translated(sideLength / 2, height / 2);
+}
+
+// How drawing a leaf changes the current transformation. Most leaves
+// translate back to where they started, Polygon may not.
+// Scaled is assumed to restore its child's start.
+inline Affine leafTransformChange(Shape &shape)
+{
+	if (Polygon *p = dynamic_cast<Polygon*>(&shape))
+	{
+		return polygonTransformChange(p->numSides(), p->sideLength(), shape.height);
+	}
+	return Affine();
+}
+
+// Walks the tree the way generatePostScript moves the current point,
+// collects the box of every leaf and returns the transformation in effect
+// after the shape is drawn. The Multi classes are asked for their
+// translates, so the boxes follow the same layout as the output.
+// Composites do not translate back to where they started, and Rotated
+// does not undo its rotation, so later shapes are drawn relative to
+// wherever the previous one left off, just like in the output. Transformed
+// restores everything it changed.
+// Scaled keeps only its child's output, so it counts as a leaf.
+inline Affine layoutLeaves(Shape &shape, const Affine &m, std::vector<LeafBox> &out)
+{
+	if (Multi *multi = dynamic_cast<Multi*>(&shape))
+	{
+		Affine current = m;
+		for (unsigned int i = 0; i < multi->getSize(); ++i)
+		{
+			Affine start = current.translated(multi->moveHorzStart(i), multi->moveVertStart(i));
+			current = layoutLeaves(*multi->getShape(i), start, out);
+			current = current.translated(multi->moveHorzEnd(i), multi->moveVertEnd(i));
+		}
+		return current;
+	}
+	if (MutableComposite *mutableShape = dynamic_cast<MutableComposite*>(&shape))
+	{
+		MutableComposite::Layout layout = mutableShape->getLayout();
+		Affine current = m;
+		for (unsigned int i = 0; i < mutableShape->getSize(); ++i)
+		{
+			Shape &child = *mutableShape->getShape(i);
+			if (layout == MutableComposite::HorizontalLayout)
+			{
+				current = layoutLeaves(child, current.translated(child.width / 2, shape.height), out);
+				current = current.translated((child.width / 2) + 1, -shape.height);
+			}
+			else if (layout == MutableComposite::VerticalLayout)
+			{
+				current = layoutLeaves(child, current.translated(shape.width, child.height / 2), out);
+				current = current.translated(-shape.width, (child.height / 2) + 1);
+			}
+			else
+			{
+				current = layoutLeaves(child, current, out);
+			}
+		}
+		return current;
+	}
+	if (dynamic_cast<Vertical*>(&shape))
+	{
+		Affine current = m;
+		for (unsigned int i = 0; i < shape.getSize(); ++i)
+		{
+			Shape &child = *shape.getShape(i);
+			current = layoutLeaves(child, current.translated(shape.width, child.height / 2), out);
+			current = current.translated(-shape.width, (child.height / 2) + 1);
+		}
+		return current;
+	}
+	if (dynamic_cast<Horizontal*>(&shape))
+	{
+		Affine current = m;
+		for (unsigned int i = 0; i < shape.getSize(); ++i)
+		{
+			Shape &child = *shape.getShape(i);
+			current = layoutLeaves(child, current.translated(child.width / 2, shape.height), out);
+			current = current.translated((child.width / 2) + 1, -shape.height);
+		}
+		return current;
+	}
+	if (Rotated *rotated = dynamic_cast<Rotated*>(&shape))
+	{
+		return layoutLeaves(*rotated->getShape(0), m.rotated(rotated->getAngle()), out);
+	}
+	if (Transformed *transformed = dynamic_cast<Transformed*>(&shape))
+	{
+		// Drawn inside gsave / grestore, nothing carries over
+		layoutLeaves(*transformed->getShape(0), m * transformed->getMatrix(), out);
+		return m;
+	}
+	if (dynamic_cast<Layered*>(&shape))
+	{
+		Affine current = m;
+		for (unsigned int i = 0; i < shape.getSize(); ++i)
+		{
+			current = layoutLeaves(*shape.getShape(i), current, out);
+		}
+		return current;
+	}
+	unsigned int order = out.size();
+	out.push_back(LeafBox{ &shape, m.apply(localBox(shape)), m, order });
+	return m * leafTransformChange(shape);
+}
+
+// Packed R-tree over the laid out leaves of a shape.
+// Leaves are sorted along a Hilbert curve and packed into nodes of
+// nodeSize entries, level by level, so the whole tree is a few flat arrays.
+// Children of entry i on one level are entries [i*nodeSize, (i+1)*nodeSize)
+// on the level below it.
+class SpatialIndex {
+public:
+	static constexpr unsigned int nodeSize = 16;
+
+	SpatialIndex(Shape &root)
+	{
+		end_ = layoutLeaves(root, Affine(), leaves_);
+		build();
+	}
+	SpatialIndex(std::vector<LeafBox> leaves) : leaves_(std::move(leaves))
+	{
+		build();
+	}
+
+	//Box around every leaf
+	Box getBounds() const
+	{
+		if (levels_.empty())
+		{
+			return Box{ 0, 0, 0, 0 };
+		}
+		const std::vector<Box> &top = levels_.back();
+		Box bounds = top[0];
+		for (const Box &b : top)
+		{
+			bounds.expand(b);
+		}
+		return bounds;
+	}
+
+	//Transformation in effect after the root is drawn
+	const Affine &getEnd() const
+	{
+		return end_;
+	}
+
+	//Leaves in index order
+	const std::vector<LeafBox> &getLeaves() const
+	{
+		return leaves_;
+	}
+
+	//Calls f(const LeafBox &) for every leaf whose box intersects box
+	template <class F>
+	void forEachIntersecting(const Box &box, F &&f) const
+	{
+		if (leaves_.empty())
+		{
+			return;
+		}
+		std::vector<std::pair<unsigned int, unsigned int>> stack; // level, entry
+		unsigned int top = levels_.size() - 1;
+		for (unsigned int i = 0; i < levels_[top].size(); ++i)
+		{
+			stack.push_back({ top, i });
+		}
+		while (!stack.empty())
+		{
+			unsigned int level = stack.back().first;
+			unsigned int entry = stack.back().second;
+			stack.pop_back();
+			if (!levels_[level][entry].intersects(box))
+			{
+				continue;
+			}
+			if (level == 0)
+			{
+				f(leaves_[entry]);
+				continue;
+			}
+			unsigned int first = entry * nodeSize;
+			unsigned int last = std::min<unsigned int>(first + nodeSize, levels_[level - 1].size());
+			for (unsigned int i = last; i-- > first;)
+			{
+				stack.push_back({ level - 1, i });
+			}
+		}
+	}
+
+	//Leaves whose box contains the point
+	std::vector<Shape*> at(double x, double y) const
+	{
+		return intersecting(Box{ x, y, x, y });
+	}
+
+	std::vector<Shape*> intersecting(const Box &box) const
+	{
+		std::vector<Shape*> result;
+		forEachIntersecting(box, [&](const LeafBox &leaf) {
+			result.push_back(leaf.shape);
+		});
+		return result;
+	}
+
+	//The k leaves closest to the point, closest first. Distance is to the box.
+	std::vector<Shape*> nearest(double x, double y, unsigned int k) const
+	{
+		std::vector<Shape*> result;
+		if (leaves_.empty() || k == 0)
+		{
+			return result;
+		}
+		struct Entry {
+			double distance2;
+			unsigned int level;
+			unsigned int entry;
+			bool operator<(const Entry &other) const
+			{
+				return distance2 > other.distance2; // smallest on top
+			}
+		};
+		// Best first search, a leaf popped from the queue is closer than
+		// anything still in it
+		std::priority_queue<Entry> queue;
+		unsigned int top = levels_.size() - 1;
+		for (unsigned int i = 0; i < levels_[top].size(); ++i)
+		{
+			queue.push(Entry{ levels_[top][i].distance2(x, y), top, i });
+		}
+		while (!queue.empty() && result.size() < k)
+		{
+			Entry e = queue.top();
+			queue.pop();
+			if (e.level == 0)
+			{
+				result.push_back(leaves_[e.entry].shape);
+				continue;
+			}
+			unsigned int first = e.entry * nodeSize;
+			unsigned int last = std::min<unsigned int>(first + nodeSize, levels_[e.level - 1].size());
+			for (unsigned int i = first; i < last; ++i)
+			{
+				queue.push(Entry{ levels_[e.level - 1][i].distance2(x, y), e.level - 1, i });
+			}
+		}
+		return result;
+	}
+
+private:
+	//Position of a point on a Hilbert curve through a 65536 x 65536 grid
+	static std::uint64_t hilbert(std::uint32_t x, std::uint32_t y)
+	{
+		std::uint64_t d = 0;
+		for (std::uint32_t s = 1u << 15; s > 0; s >>= 1)
+		{
+			std::uint32_t rx = (x & s) > 0;
+			std::uint32_t ry = (y & s) > 0;
+			d += (std::uint64_t)s * s * ((3 * rx) ^ ry);
+			if (ry == 0)
+			{
+				if (rx == 1)
+				{
+					x = 65535 - x;
+					y = 65535 - y;
+				}
+				std::swap(x, y);
+			}
+		}
+		return d;
+	}
+
+	void build()
+	{
+		levels_.clear();
+		if (leaves_.empty())
+		{
+			return;
+		}
+
+		Box bounds = leaves_[0].box;
+		for (const LeafBox &leaf : leaves_)
+		{
+			bounds.expand(leaf.box);
+		}
+		double spanX = std::max(bounds.maxX - bounds.minX, 1e-9);
+		double spanY = std::max(bounds.maxY - bounds.minY, 1e-9);
+
+		std::vector<std::pair<std::uint64_t, unsigned int>> order(leaves_.size());
+		for (unsigned int i = 0; i < leaves_.size(); ++i)
+		{
+			const Box &b = leaves_[i].box;
+			double cx = ((b.minX + b.maxX) / 2 - bounds.minX) / spanX;
+			double cy = ((b.minY + b.maxY) / 2 - bounds.minY) / spanY;
+			order[i] = { hilbert((std::uint32_t)(cx * 65535), (std::uint32_t)(cy * 65535)), i };
+		}
+		std::sort(order.begin(), order.end());
+
+		std::vector<LeafBox> sorted;
+		sorted.reserve(leaves_.size());
+		for (const auto &o : order)
+		{
+			sorted.push_back(leaves_[o.second]);
+		}
+		leaves_ = std::move(sorted);
+
+		std::vector<Box> level;
+		level.reserve(leaves_.size());
+		for (const LeafBox &leaf : leaves_)
+		{
+			level.push_back(leaf.box);
+		}
+		levels_.push_back(std::move(level));
+
+		while (levels_.back().size() > nodeSize)
+		{
+			const std::vector<Box> &below = levels_.back();
+			std::vector<Box> above;
+			above.reserve((below.size() + nodeSize - 1) / nodeSize);
+			for (unsigned int i = 0; i < below.size(); i += nodeSize)
+			{
+				Box node = below[i];
+				unsigned int last = std::min<unsigned int>(i + nodeSize, below.size());
+				for (unsigned int j = i + 1; j < last; ++j)
+				{
+					node.expand(below[j]);
+				}
+				above.push_back(node);
+			}
+			levels_.push_back(std::move(above));
+		}
+	}
+
+	std::vector<LeafBox> leaves_;
+	Affine end_;
+	std::vector<std::vector<Box>> levels_; // levels_[0] holds the leaf boxes
+};
+
+#endif // SPATIAL_INDEX_HPP_INCLUDED
@@ -0,0 +1,223 @@
+#ifndef STREAMING_COMPOSITE_HPP_INCLUDED
+#define STREAMING_COMPOSITE_HPP_INCLUDED
+
+#include <string>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include "shape.hpp"
+#include "postscript.hpp"
+
+// Composites whose children are made while they are drawn and dropped right
+// after, so memory does not grow with the number of children.
+//
+// The layout of a child depends on the extents of the whole composite, e.g.
+// every child of a MultiHorizontal is moved up by the height of the tallest.
+// So the children come from a ChildSource that can be read twice: once for
+// the sizes only, when the composite is made, and once for the shapes, each
+// time it is drawn. The sizes have to be those the shapes come out with.
+//
+// Output is the same as the matching fixed composite. There are no children
+// to walk, getSize() is 0, so the shapes that look into composites, e.g.
+// the spatial index and the render cache, see a streaming composite as one
+// shape that draws its postscript.
+
+// Children of a streaming composite, in order
+class ChildSource {
+public:
+	virtual ~ChildSource() = default;
+
+	//Goes back to the first child
+	virtual void rewind() = 0;
+
+	//Width and height of the next child, false after the last
+	virtual bool nextSize(double &width, double &height) = 0;
+
+	//Makes the next child, nullptr after the last
+	virtual unique_ptr<Shape> nextShape() = 0;
+};
+
+// Child source that calls sizeOf(i, width, height) for the size of child i
+// and make(i), returning a unique_ptr<Shape>, for the child itself
+template <class SizeOf, class Make>
+class GeneratedChildren : public ChildSource {
+public:
+	GeneratedChildren(std::size_t count, SizeOf sizeOf, Make make)
+		: count_(count), sizeOf_(std::move(sizeOf)), make_(std::move(make)) {}
+
+	void rewind() override
+	{
+		next_ = 0;
+	}
+
+	bool nextSize(double &width, double &height) override
+	{
+		if (next_ >= count_)
+		{
+			return false;
+		}
+		sizeOf_(next_++, width, height);
+		return true;
+	}
+
+	unique_ptr<Shape> nextShape() override
+	{
+		if (next_ >= count_)
+		{
+			return nullptr;
+		}
+		return make_(next_++);
+	}
+
+private:
+	std::size_t count_;
+	SizeOf sizeOf_;
+	Make make_;
+	std::size_t next_ = 0;
+};
+
+template <class SizeOf, class Make>
+unique_ptr<ChildSource> generateChildren(std::size_t count, SizeOf sizeOf, Make make)
+{
+	return make_unique<GeneratedChildren<SizeOf, Make>>(count, std::move(sizeOf), std::move(make));
+}
+
+class StreamingComposite : public Shape {
+public:
+	enum Layout { LayeredLayout, MultiLayeredLayout, HorizontalLayout, VerticalLayout };
+
+	// Reads the sizes of the children from source to work out the extents
+	StreamingComposite(Layout layout, unique_ptr<ChildSource> source)
+		: layout_(layout), source_(std::move(source))
+	{
+		CompositeExtents extents;
+		double childWidth;
+		double childHeight;
+		source_->rewind();
+		while (source_->nextSize(childWidth, childHeight))
+		{
+			switch (layout_)
+			{
+			case LayeredLayout:
+			case MultiLayeredLayout:
+				addLayeredExtents(extents, childWidth, childHeight);
+				break;
+			case HorizontalLayout:
+				addHorizontalExtents(extents, childWidth, childHeight);
+				break;
+			case VerticalLayout:
+				addVerticalExtents(extents, childWidth, childHeight);
+				break;
+			}
+			++count_;
+		}
+		width = extents.width;
+		height = extents.height;
+	}
+
+	std::string generatePostScript() override
+	{
+		std::string mString = "";
+		PostScriptWriter writer(mString);
+		render(writer);
+		return mString;
+	}
+
+	//Makes, writes and drops each child in turn
+	template <class Writer>
+	void render(Writer &w)
+	{
+		source_->rewind();
+		while (unique_ptr<Shape> child = source_->nextShape())
+		{
+			renderChild(*child, w);
+		}
+	}
+
+	// Writes the postscript to out a child at a time, so the text of no
+	// more than one child is held. Returns false if the stream failed.
+	bool writePostScript(std::ostream &out)
+	{
+		std::string buffer;
+		source_->rewind();
+		while (unique_ptr<Shape> child = source_->nextShape())
+		{
+			buffer.clear();
+			PostScriptWriter writer(buffer);
+			renderChild(*child, writer);
+			out.write(buffer.data(), buffer.size());
+		}
+		return (bool)out;
+	}
+
+	//Children the source has
+	std::size_t getChildCount() const
+	{
+		return count_;
+	}
+
+	Layout getLayout() const
+	{
+		return layout_;
+	}
+
+private:
+	template <class Writer>
+	void renderChild(Shape &shape, Writer &w)
+	{
+		switch (layout_)
+		{
+		case LayeredLayout:
+			w.raw(shape.generatePostScript());
+			break;
+		case MultiLayeredLayout:
+			emitTranslate(w, 0.0, 0.0);
+			w.raw(shape.generatePostScript());
+			emitTranslate(w, 0.0, 0.0);
+			w.endLine();
+			break;
+		case HorizontalLayout:
+			emitTranslate(w, shape.width / 2, height);
+			w.raw(shape.generatePostScript());
+			emitTranslate(w, (shape.width / 2) + 1, -height);
+			w.endLine();
+			break;
+		case VerticalLayout:
+			emitTranslate(w, width, shape.height / 2);
+			w.raw(shape.generatePostScript());
+			emitTranslate(w, -width, (shape.height / 2) + 1);
+			w.endLine();
+			break;
+		}
+	}
+
+	Layout layout_;
+	unique_ptr<ChildSource> source_;
+	std::size_t count_ = 0;
+};
+
+//Streaming version of Layered
+class StreamingLayered : public StreamingComposite {
+public:
+	StreamingLayered(unique_ptr<ChildSource> source) : StreamingComposite(LayeredLayout, std::move(source)) {}
+};
+
+//Streaming version of MultiLayered
+class StreamingMultiLayered : public StreamingComposite {
+public:
+	StreamingMultiLayered(unique_ptr<ChildSource> source) : StreamingComposite(MultiLayeredLayout, std::move(source)) {}
+};
+
+//Streaming version of MultiHorizontal
+class StreamingHorizontal : public StreamingComposite {
+public:
+	StreamingHorizontal(unique_ptr<ChildSource> source) : StreamingComposite(HorizontalLayout, std::move(source)) {}
+};
+
+//Streaming version of MultiVertical
+class StreamingVertical : public StreamingComposite {
+public:
+	StreamingVertical(unique_ptr<ChildSource> source) : StreamingComposite(VerticalLayout, std::move(source)) {}
+};
+
+#endif // STREAMING_COMPOSITE_HPP_INCLUDED
@@ -0,0 +1,301 @@
+#ifndef STROKE_BATCH_HPP_INCLUDED
+#define STROKE_BATCH_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include "postscript.hpp"
+#include "shape.hpp"
+#include "shape_value.hpp"
+
+// Postscript with one stroke for a run of leaves instead of one each.
+//
+// Every leaf builds its own path between newpath and stroke. A path is kept
+// in device space, so it is not moved by the translate and rotate the
+// layouts and polygons write between leaves, and rotating does not change
+// how a round pen strokes. A stroke followed by the next leaf's newpath can
+// then be dropped, and the next leaf's subpaths added to the same path, as
+// long as nothing else that uses the graphics state comes between them.
+// scale, concat, setlinewidth, gsave, grestore and anything the writer does
+// not know end the run with the stroke that was held back, before they are
+// written, so each stroke still sees the state its leaves were drawn in.
+//
+// A leaf whose path starts with arc would be joined to the end of the one
+// before it by a line, so a moveto to the start of the arc is put in front.
+// A path that is never stroked, like Spacer's, ends the run at its newpath.
+
+// Writer with the PostScriptWriter interface that batches strokes before
+// passing everything on to another writer. What is held back is written by
+// finish(), or when the batching writer is destroyed.
+template <class Writer>
+class StrokeBatchingWriter {
+public:
+	StrokeBatchingWriter(Writer &w) : w_(w) {}
+
+	~StrokeBatchingWriter()
+	{
+		finish();
+	}
+
+	void number(double value)
+	{
+		if (pending_)
+		{
+			tokens_.push_back(Token{ NumberToken, value, 0, nullptr });
+			return;
+		}
+		w_.number(value);
+	}
+
+	void integer(long value)
+	{
+		if (pending_)
+		{
+			tokens_.push_back(Token{ IntegerToken, 0, value, nullptr });
+			return;
+		}
+		w_.integer(value);
+	}
+
+	void op(const char *name)
+	{
+		bool stroke = std::strcmp(name, "stroke") == 0;
+		if (!pending_)
+		{
+			if (stroke)
+			{
+				pending_ = true;
+				return;
+			}
+			w_.op(name);
+			return;
+		}
+
+		if (stroke)
+		{
+			if (newpath_ < 0)
+			{
+				// Nothing to join, the path was already stroked
+				release();
+				pending_ = true;
+				return;
+			}
+			join();
+			return;
+		}
+		if (std::strcmp(name, "newpath") == 0)
+		{
+			if (newpath_ >= 0)
+			{
+				// The path after the first newpath was never stroked
+				release();
+				w_.op(name);
+				return;
+			}
+			newpath_ = (long)tokens_.size();
+			tokens_.push_back(Token{ OpToken, 0, 0, "newpath" });
+			return;
+		}
+		const char *known = pathOperator(name);
+		if (known == nullptr)
+		{
+			release();
+			w_.op(name);
+			return;
+		}
+		tokens_.push_back(Token{ OpToken, 0, 0, known });
+	}
+
+	void endLine()
+	{
+		if (!pending_)
+		{
+			w_.endLine();
+			return;
+		}
+		if (tokens_.empty() && !strokeLineEnded_)
+		{
+			strokeLineEnded_ = true;
+			return;
+		}
+		tokens_.push_back(Token{ EndLineToken, 0, 0, nullptr });
+	}
+
+	//Already generated postscript, which ends the run
+	void raw(const char *text, std::size_t size)
+	{
+		release();
+		w_.raw(text, size);
+	}
+	void raw(const std::string &text)
+	{
+		raw(text.data(), text.size());
+	}
+
+	//Writes the stroke held back, if there is one
+	void finish()
+	{
+		release();
+	}
+
+	//Strokes passed on so far
+	std::size_t getStrokeCount() const
+	{
+		return strokes_;
+	}
+
+	//Strokes dropped by joining paths
+	std::size_t getJoinedCount() const
+	{
+		return joined_;
+	}
+
+private:
+	enum TokenKind { NumberToken, IntegerToken, OpToken, EndLineToken };
+
+	struct Token {
+		TokenKind kind;
+		double number;
+		long integer;
+		const char *name;
+	};
+
+	// The name of a path operator that may sit between leaves of one run,
+	// as a literal that can be kept, or nullptr
+	static const char *pathOperator(const char *name)
+	{
+		static const char *const names[] = { "translate", "rotate", "moveto", "rmoveto", "lineto", "rlineto",
+			"arc", "arcn", "closepath", "curveto", "rcurveto" };
+		for (const char *known : names)
+		{
+			if (std::strcmp(known, name) == 0)
+			{
+				return known;
+			}
+		}
+		return nullptr;
+	}
+
+	double value(const Token &token) const
+	{
+		return token.kind == NumberToken ? token.number : (double)token.integer;
+	}
+
+	void replay(std::size_t begin, std::size_t end)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			const Token &token = tokens_[i];
+			switch (token.kind)
+			{
+			case NumberToken: w_.number(token.number); break;
+			case IntegerToken: w_.integer(token.integer); break;
+			case OpToken: w_.op(token.name); break;
+			case EndLineToken: w_.endLine(); break;
+			}
+		}
+	}
+
+	//Writes the stroke held back and what came after it as it was
+	void release()
+	{
+		if (!pending_)
+		{
+			return;
+		}
+		w_.op("stroke");
+		++strokes_;
+		if (strokeLineEnded_)
+		{
+			w_.endLine();
+		}
+		replay(0, tokens_.size());
+		reset();
+		pending_ = false;
+	}
+
+	// The next leaf's path was stroked as well: writes its tokens without
+	// the stroke before it and its newpath, and holds back its stroke
+	void join()
+	{
+		std::size_t skip = newpath_;
+		std::size_t resume = skip + 1;
+		if (resume < tokens_.size() && tokens_[resume].kind == EndLineToken)
+		{
+			++resume;
+		}
+
+		// The first path operator after newpath decides if it needs a moveto
+		std::size_t first = resume;
+		for (; first < tokens_.size(); ++first)
+		{
+			const Token &token = tokens_[first];
+			if (token.kind == OpToken && std::strcmp(token.name, "translate") != 0 && std::strcmp(token.name, "rotate") != 0)
+			{
+				break;
+			}
+		}
+		bool arc = first < tokens_.size() && first >= resume + 5 &&
+			(std::strcmp(tokens_[first].name, "arc") == 0 || std::strcmp(tokens_[first].name, "arcn") == 0);
+		for (std::size_t i = first - 5; arc && i < first; ++i)
+		{
+			arc = tokens_[i].kind == NumberToken || tokens_[i].kind == IntegerToken;
+		}
+
+		replay(0, skip);
+		if (arc)
+		{
+			const double pi = 3.141592653589793238;
+			double x = value(tokens_[first - 5]);
+			double y = value(tokens_[first - 4]);
+			double r = value(tokens_[first - 3]);
+			double angle = value(tokens_[first - 2]) * pi / 180;
+			replay(resume, first - 5);
+			w_.number(x + r * std::cos(angle));
+			w_.number(y + r * std::sin(angle));
+			w_.op("moveto");
+			w_.endLine();
+			replay(first - 5, tokens_.size());
+		}
+		else
+		{
+			replay(resume, tokens_.size());
+		}
+		++joined_;
+		reset();
+	}
+
+	void reset()
+	{
+		tokens_.clear();
+		newpath_ = -1;
+		strokeLineEnded_ = false;
+	}
+
+	Writer &w_;
+	// A stroke is held back, and the tokens after it in tokens_. newpath_ is
+	// the index of the first newpath among them, or -1.
+	bool pending_ = false;
+	bool strokeLineEnded_ = false;
+	long newpath_ = -1;
+	std::vector<Token> tokens_;
+	std::size_t strokes_ = 0;
+	std::size_t joined_ = 0;
+};
+
+//Appends the postscript of shape to out, with its strokes batched
+inline void appendBatched(const ShapeValue &shape, std::string &out)
+{
+	PostScriptWriter writer(out);
+	StrokeBatchingWriter<PostScriptWriter> batching(writer);
+	shape.render(batching);
+	batching.finish();
+}
+
+inline void appendBatched(Shape &shape, std::string &out)
+{
+	appendBatched(ShapeValue::fromShape(shape), out);
+}
+
+#endif // STROKE_BATCH_HPP_INCLUDED
@@ -0,0 +1,127 @@
+#ifndef VIEWPORT_HPP_INCLUDED
+#define VIEWPORT_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include "shape.hpp"
+#include "spatial_index.hpp"
+
+// Rendering of only the part of a shape that falls inside a clip box.
+//
+// The leaves are looked up in a SpatialIndex, so subtrees whose boxes are
+// outside the clip are skipped as a whole and the work done depends on
+// the number of visible leaves rather than the size of the shape. Each
+// visible leaf is drawn in output order after a translate (or concat, if
+// rotations are involved) that moves from where the previous leaf left the
+// current point to where the full output would draw it.
+
+//Writes a change of the current transformation, as a translate when it is one
+template <class Writer>
+void emitTransform(Writer &w, const Affine &m)
+{
+	if (m.isTranslation())
+	{
+		if (m.tx != 0 || m.ty != 0)
+		{
+			emitTranslate(w, m.tx, m.ty);
+		}
+		return;
+	}
+	emitConcat(w, m);
+}
+
+// Draws the leaves of index that intersect clip. The postscript starts at
+// the same point as the root shape's own output and, if restoreEnd is set,
+// leaves the current point where the full output would.
+template <class Writer>
+void renderClipped(const SpatialIndex &index, const Box &clip, Writer &w, bool restoreEnd = true)
+{
+	std::vector<const LeafBox*> visible;
+	index.forEachIntersecting(clip, [&](const LeafBox &leaf) {
+		visible.push_back(&leaf);
+	});
+	std::sort(visible.begin(), visible.end(), [](const LeafBox *l, const LeafBox *r) {
+		return l->order < r->order;
+	});
+
+	Affine current;
+	for (const LeafBox *leaf : visible)
+	{
+		emitTransform(w, current.inverse() * leaf->transform);
+		w.raw(leaf->shape->generatePostScript());
+		current = leaf->transform * leafTransformChange(*leaf->shape);
+	}
+	if (restoreEnd)
+	{
+		emitTransform(w, current.inverse() * index.getEnd());
+	}
+}
+
+inline std::string renderClipped(const SpatialIndex &index, const Box &clip)
+{
+	std::string out = "";
+	PostScriptWriter writer(out);
+	renderClipped(index, clip, writer);
+	return out;
+}
+
+inline std::string renderClipped(Shape &shape, const Box &clip)
+{
+	SpatialIndex index(shape);
+	return renderClipped(index, clip);
+}
+
+// Splits the bounds of a shape into tiles of the given size and renders
+// each tile as its own page, with the tile's corner moved to the origin.
+// Tiles are rendered in parallel, each page ends with showpage.
+// Boxes are grown by half the default line width so strokes on a tile
+// edge are not lost.
+inline std::vector<std::string> renderTiles(const SpatialIndex &index, double tileWidth, double tileHeight,
+	unsigned int threads = std::thread::hardware_concurrency())
+{
+	std::vector<std::string> pages;
+	if (index.getLeaves().empty() || tileWidth <= 0 || tileHeight <= 0)
+	{
+		return pages;
+	}
+	const double margin = 0.5;
+	Box bounds = index.getBounds();
+	unsigned int columns = std::max(1.0, std::ceil((bounds.maxX - bounds.minX) / tileWidth));
+	unsigned int rows = std::max(1.0, std::ceil((bounds.maxY - bounds.minY) / tileHeight));
+	pages.resize((std::size_t)columns * rows);
+
+	std::atomic<std::size_t> nextTile(0);
+	auto work = [&]() {
+		for (std::size_t tile = nextTile++; tile < pages.size(); tile = nextTile++)
+		{
+			double minX = bounds.minX + (tile % columns) * tileWidth;
+			double minY = bounds.minY + (tile / columns) * tileHeight;
+			Box clip{ minX - margin, minY - margin, minX + tileWidth + margin, minY + tileHeight + margin };
+
+			std::string &page = pages[tile];
+			PostScriptWriter writer(page);
+			emitTranslate(writer, -minX, -minY);
+			renderClipped(index, clip, writer, false);
+			writer.op("showpage");
+			writer.endLine();
+		}
+	};
+
+	threads = std::max(1u, std::min<unsigned int>(threads, pages.size()));
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < threads; ++i)
+	{
+		workers.emplace_back(work);
+	}
+	work();
+	for (std::thread &t : workers)
+	{
+		t.join();
+	}
+	return pages;
+}
+
+#endif // VIEWPORT_HPP_INCLUDED
@@ -0,0 +1,87 @@
+#ifndef WORK_STEALING_HPP_INCLUDED
+#define WORK_STEALING_HPP_INCLUDED
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <algorithm>
+
+// Runs f(i) for every i in [0, count) on a pool of threads.
+//
+// Tasks are dealt round robin in index order, so callers put the biggest
+// tasks first. Each thread works through its own queue from the front and,
+// once it is empty, steals from the back of the others, where the
+// smallest tasks are. Threads only meet on a queue's lock when stealing.
+template <class F>
+void parallelFor(std::size_t count, F &&f, unsigned int threads = std::thread::hardware_concurrency())
+{
+	threads = std::max(1u, std::min<unsigned int>(threads, count));
+	if (count == 0)
+	{
+		return;
+	}
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<std::size_t> tasks;
+	};
+	std::vector<std::unique_ptr<Queue>> queues;
+	for (unsigned int t = 0; t < threads; ++t)
+	{
+		queues.emplace_back(new Queue());
+	}
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		queues[i % threads]->tasks.push_back(i);
+	}
+
+	auto work = [&](unsigned int self) {
+		while (true)
+		{
+			std::size_t task = 0;
+			bool found = false;
+			{
+				Queue &own = *queues[self];
+				std::lock_guard<std::mutex> lock(own.mutex);
+				if (!own.tasks.empty())
+				{
+					task = own.tasks.front();
+					own.tasks.pop_front();
+					found = true;
+				}
+			}
+			for (unsigned int k = 1; k < threads && !found; ++k)
+			{
+				Queue &victim = *queues[(self + k) % threads];
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if (!victim.tasks.empty())
+				{
+					task = victim.tasks.back();
+					victim.tasks.pop_back();
+					found = true;
+				}
+			}
+			// Nothing is added once started, so empty queues mean we are done
+			if (!found)
+			{
+				return;
+			}
+			f(task);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int t = 1; t < threads; ++t)
+	{
+		workers.emplace_back(work, t);
+	}
+	work(0);
+	for (std::thread &t : workers)
+	{
+		t.join();
+	}
+}
+
+#endif // WORK_STEALING_HPP_INCLUDED